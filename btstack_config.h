@@ -14,7 +14,8 @@
 #define MAX_NR_HCI_ACL_PACKETS 4
 
 #define MAX_NR_HCI_CONNECTIONS 4
-#define MAX_NR_L2CAP_CHANNELS  4
+// HID control + HID interrupt per controller
+#define MAX_NR_L2CAP_CHANNELS  8
 #define MAX_NR_L2CAP_SERVICES  4
 //
 #define HCI_ACL_PAYLOAD_SIZE 256
@@ -22,6 +23,10 @@
 #define HCI_OUTGOING_PRE_BUFFER_SIZE 4
 
 
+// DualSense controllers served at once, one ACL link each
+#define MAX_NR_GAMEPADS MAX_NR_HCI_CONNECTIONS
+
+
 #define MAX_NR_RFCOMM_MULTIPLEXERS 0
 #define MAX_NR_RFCOMM_SERVICES 0
 #define MAX_NR_RFCOMM_CHANNELS 0
@@ -0,0 +1,186 @@
+// Replays an L2CAP capture of a PICO_W_CAPTURE=1 build through the Gamepad-Core decode path on the PC.
+//
+// Reads the USB CDC capture from a file or stdin (e.g. `cat /dev/ttyACM0 > run.cap` while 'c' is on, then
+// `dualsense_capture_replay run.cap`); console text around the records is skipped. Every inbound 0x31 frame goes
+// through the firmware's CRC check, the copy into FDeviceContext::Buffer and UpdateInput on one Gamepad-Core device
+// per HID interrupt CID: first as fast as possible, for frames/s and the per-frame decode cost, then, unless --fast
+// is given, paced at the captured arrival times, for how closely the replay reproduces the original timing.
+#include <cstdio>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "pico/cyw43_arch.h"
+#include "pico_w_registry_policy.h"
+
+#include "pico_w_btstack.h"
+#include "GCore/Interfaces/IPlatformHardwareInfo.h"
+#include "GCore/Templates/TBasicDeviceRegistry.h"
+#include "pico_w_capture.h"
+#include "pico_w_platform.h"
+#include "GCore/Interfaces/ISonyGamepad.h"
+
+#include "sim/bench_stats.h"
+
+using pico_platform = GamepadCore::TGenericHardwareInfo<pico_w_platform_policy>;
+
+#define REPLAY_MIN_FRAMES 100000    // fast passes repeat the capture until at least this many frames are decoded
+#define REPLAY_SPIN_NS 2000000      // paced replay sleeps until this close to a frame's time, then spins
+
+struct replay_frame {
+    uint64_t at_us;                 // since the first record
+    uint8_t device;
+    float delta_time;               // seconds since the previous frame of the same device
+    const uint8_t* report;          // from the report id, INPUT_REPORT_SIZE bytes
+};
+
+static bool read_all(FILE* in, std::vector<uint8_t>& data) {
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) data.insert(data.end(), chunk, chunk + n);
+    return !ferror(in);
+}
+
+// The application loop's work for one frame; false when the CRC check rejects it.
+static bool decode_frame(const replay_frame& frame, ISonyGamepad* const* devices) {
+    ISonyGamepad* gamepad = devices[frame.device];
+    if (!ds_bt_input_crc_ok(frame.report, INPUT_REPORT_SIZE)) return false;
+    memcpy(gamepad->GetMutableDeviceContext()->Buffer, frame.report, INPUT_REPORT_SIZE);
+    gamepad->UpdateInput(frame.delta_time);
+    return true;
+}
+
+// One fast pass: returns the wall time in ns, adds each frame's decode cost to samples.
+static uint64_t decode_pass(const std::vector<replay_frame>& frames, ISonyGamepad* const* devices,
+                            bench_samples* samples, uint32_t& crc_failures) {
+    const uint64_t start = bench_now_ns();
+    for (const replay_frame& frame : frames) {
+        const uint64_t t0 = bench_now_ns();
+        if (!decode_frame(frame, devices)) crc_failures++;
+        if (samples) samples->add(bench_now_ns() - t0);
+    }
+    return bench_now_ns() - start;
+}
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    bool paced = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fast") == 0) paced = false;
+        else path = argv[i];
+    }
+    FILE* in = path ? fopen(path, "rb") : stdin;
+    std::vector<uint8_t> data;
+    if (!in || !read_all(in, data)) {
+        fprintf(stderr, "usage: dualsense_capture_replay [--fast] [capture file]\n");
+        return 1;
+    }
+    if (path) fclose(in);
+
+    IPlatformHardwareInfo::SetInstance(std::make_unique<pico_platform>());
+    auto& registry = policy_device::get_instance();
+    ISonyGamepad* devices[MAX_NR_GAMEPADS] = {};
+    uint16_t device_cids[MAX_NR_GAMEPADS] = {};
+    uint64_t device_last_us[MAX_NR_GAMEPADS] = {};
+    uint8_t device_count = 0;
+
+    std::vector<replay_frame> frames;
+    uint32_t counts[CAPTURE_TYPE_COUNT] = {};
+    uint32_t dropped = 0, torn = 0, other_in = 0, unmapped = 0;
+    uint64_t now_us = 0;
+    size_t offset = 0;
+    capture_record record;
+    while (capture_parse(data.data(), data.size(), offset, record, &torn)) {
+        counts[record.type]++;
+        now_us += record.delta_us;
+        if (record.type == CAPTURE_DROPPED && record.size >= 4) dropped += capture_get_u32(record.payload);
+        if (record.type != CAPTURE_IN) continue;
+        if (record.size < 1 + INPUT_REPORT_SIZE || record.payload[0] != DS_BT_HID_INPUT ||
+            record.payload[1] != 0x31) {
+            other_in++;
+            continue;
+        }
+        uint8_t device = 0;
+        while (device < device_count && device_cids[device] != record.cid) device++;
+        if (device == device_count) {
+            if (device_count == MAX_NR_GAMEPADS) {
+                unmapped++;
+                continue;
+            }
+            FDeviceContext context = {};
+            context.Path = "Replay";
+            context.DeviceType = EDSDeviceType::DualSense;
+            context.ConnectionType = EDSDeviceConnection::Bluetooth;
+            registry.CreateDevice(context);
+            devices[device] = registry.GetLibrary(device);
+            device_cids[device] = record.cid;
+            device_last_us[device] = now_us;
+            device_count++;
+        }
+        const float delta = static_cast<float>(now_us - device_last_us[device]) * 1e-6f;
+        device_last_us[device] = now_us;
+        frames.push_back({now_us, device, delta, &record.payload[1]});
+    }
+
+    printf("Capture: %zu bytes, %u records (%u in, %u out, %u starts), %u dropped on the device, %u torn\n",
+           data.size(), counts[CAPTURE_START] + counts[CAPTURE_IN] + counts[CAPTURE_OUT] + counts[CAPTURE_DROPPED],
+           counts[CAPTURE_IN], counts[CAPTURE_OUT], counts[CAPTURE_START], dropped, torn);
+    if (frames.empty()) {
+        printf("No 0x31 input frames to replay\n");
+        return 1;
+    }
+    const uint64_t span_us = frames.back().at_us - frames.front().at_us;
+    printf("  %zu input frames from %u controllers over %.3f s (%u other inbound packets, %u from extra CIDs)\n",
+           frames.size(), device_count, span_us * 1e-6, other_in, unmapped);
+
+    // fast: untimed warm-up pass, then enough passes for REPLAY_MIN_FRAMES
+    uint32_t crc_failures = 0;
+    decode_pass(frames, devices, nullptr, crc_failures);
+    const uint32_t passes = static_cast<uint32_t>((REPLAY_MIN_FRAMES + frames.size() - 1) / frames.size());
+    bench_samples decode{"decode (CRC + UpdateInput)"};
+    decode.reserve(static_cast<size_t>(passes) * frames.size());
+    crc_failures = 0;
+    uint64_t wall_ns = 0;
+    for (uint32_t pass = 0; pass < passes; pass++) wall_ns += decode_pass(frames, devices, &decode, crc_failures);
+    printf("Fast replay: %u passes, %.0f frames/s, %u CRC failures per pass\n", passes,
+           static_cast<double>(passes) * frames.size() * 1e9 / wall_ns, crc_failures / passes);
+    decode.print(stdout);
+
+    if (!paced) return 0;
+
+    // paced: each frame decoded at its captured offset; lateness against the schedule and interval error against
+    // the captured interval of the same controller
+    bench_samples lateness{"lateness vs capture"};
+    bench_samples interval_error{"interval error vs capture"};
+    lateness.reserve(frames.size());
+    interval_error.reserve(frames.size());
+    uint64_t replayed_last_ns[MAX_NR_GAMEPADS] = {};
+    uint64_t captured_last_us[MAX_NR_GAMEPADS] = {};
+    const uint64_t start_ns = bench_now_ns();
+    for (const replay_frame& frame : frames) {
+        const uint64_t due_ns = start_ns + (frame.at_us - frames.front().at_us) * 1000;
+        uint64_t now_ns = bench_now_ns();
+        if (due_ns > now_ns + REPLAY_SPIN_NS) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due_ns - now_ns - REPLAY_SPIN_NS));
+        }
+        while ((now_ns = bench_now_ns()) < due_ns) {
+        }
+        lateness.add(now_ns - due_ns);
+        decode_frame(frame, devices);
+        if (replayed_last_ns[frame.device]) {
+            const int64_t replayed = static_cast<int64_t>(now_ns - replayed_last_ns[frame.device]);
+            const int64_t captured = static_cast<int64_t>(frame.at_us - captured_last_us[frame.device]) * 1000;
+            interval_error.add(static_cast<uint64_t>(replayed > captured ? replayed - captured : captured - replayed));
+        }
+        replayed_last_ns[frame.device] = now_ns;
+        captured_last_us[frame.device] = frame.at_us;
+    }
+    const uint64_t paced_ns = bench_now_ns() - start_ns;
+    printf("Paced replay: %.3f s for %.3f s captured\n", paced_ns * 1e-9, span_us * 1e-6);
+    lateness.print(stdout);
+    interval_error.print(stdout);
+    return 0;
+}
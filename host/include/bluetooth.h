@@ -0,0 +1,104 @@
+// Host stand-in for BTstack's bluetooth.h / btstack_defines.h.
+// Only the subset used by the firmware is declared; values follow BTstack.
+#pragma once
+
+#include <cstdint>
+
+typedef uint8_t bd_addr_t[6];
+typedef uint8_t link_key_t[16];
+typedef uint16_t hci_con_handle_t;
+
+typedef void (*btstack_packet_handler_t)(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size);
+
+typedef struct {
+    void *item;
+    btstack_packet_handler_t callback;
+} btstack_packet_callback_registration_t;
+
+#define BD_ADDR_LEN  6
+#define LINK_KEY_LEN 16
+
+// packet types
+#define HCI_COMMAND_DATA_PACKET 0x01
+#define HCI_ACL_DATA_PACKET     0x02
+#define HCI_EVENT_PACKET        0x04
+#define L2CAP_DATA_PACKET       0x06
+
+// HCI events
+#define HCI_EVENT_INQUIRY_COMPLETE              0x01
+#define HCI_EVENT_INQUIRY_RESULT                0x02
+#define HCI_EVENT_CONNECTION_COMPLETE           0x03
+#define HCI_EVENT_CONNECTION_REQUEST            0x04
+#define HCI_EVENT_DISCONNECTION_COMPLETE        0x05
+#define HCI_EVENT_AUTHENTICATION_COMPLETE       0x06
+#define HCI_EVENT_ENCRYPTION_CHANGE             0x08
+#define HCI_EVENT_COMMAND_COMPLETE              0x0E
+#define HCI_EVENT_COMMAND_STATUS                0x0F
+#define HCI_EVENT_ROLE_CHANGE                   0x12
+#define HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS   0x13
+#define HCI_EVENT_MODE_CHANGE                   0x14
+#define HCI_EVENT_PIN_CODE_REQUEST              0x16
+#define HCI_EVENT_LINK_KEY_REQUEST              0x17
+#define HCI_EVENT_LINK_KEY_NOTIFICATION         0x18
+#define HCI_EVENT_INQUIRY_RESULT_WITH_RSSI      0x22
+#define HCI_EVENT_EXTENDED_INQUIRY_RESPONSE     0x2F
+#define HCI_EVENT_USER_CONFIRMATION_REQUEST     0x33
+#define HCI_EVENT_USER_PASSKEY_REQUEST          0x34
+
+// BTstack / L2CAP / GAP events
+#define BTSTACK_EVENT_STATE                     0x60
+#define L2CAP_EVENT_CHANNEL_OPENED              0x70
+#define L2CAP_EVENT_CHANNEL_CLOSED              0x71
+#define L2CAP_EVENT_INCOMING_CONNECTION         0x72
+#define L2CAP_EVENT_CAN_SEND_NOW                0x78
+#define GAP_EVENT_INQUIRY_COMPLETE              0xD4
+
+// states and commands
+#define HCI_STATE_OFF      0
+#define HCI_STATE_WORKING  2
+#define HCI_POWER_OFF      0
+#define HCI_POWER_ON       1
+#define HCI_ROLE_MASTER    0
+#define HCI_ROLE_SLAVE     1
+
+typedef uint8_t hci_role_t;
+
+// link policy settings
+#define LM_LINK_POLICY_DISABLE_ALL_LM_MODES  0x0000
+#define LM_LINK_POLICY_ENABLE_ROLE_SWITCH    0x0001
+#define LM_LINK_POLICY_ENABLE_HOLD_MODE      0x0002
+#define LM_LINK_POLICY_ENABLE_SNIFF_MODE     0x0004
+
+// status codes
+#define ERROR_CODE_SUCCESS                         0x00
+#define ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER   0x02
+#define ERROR_CODE_PAGE_TIMEOUT                    0x04
+#define ERROR_CODE_AUTHENTICATION_FAILURE          0x05
+#define ERROR_CODE_PIN_OR_KEY_MISSING              0x06
+#define ERROR_CODE_CONNECTION_TIMEOUT              0x08
+#define ERROR_CODE_ACL_CONNECTION_ALREADY_EXISTS   0x0B
+#define ERROR_CODE_REMOTE_USER_TERMINATED_CONNECTION 0x13
+#define ERROR_CODE_CONNECTION_TERMINATED_BY_LOCAL_HOST 0x16
+#define BTSTACK_ACL_BUFFERS_FULL                   0x57
+#define L2CAP_LOCAL_CID_DOES_NOT_EXIST             0x62
+#define L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU          0x69
+
+// L2CAP
+#define PSM_SDP            0x01
+#define PSM_HID_CONTROL    0x11
+#define PSM_HID_INTERRUPT  0x13
+
+typedef enum {
+    LEVEL_0 = 0,
+    LEVEL_1,
+    LEVEL_2,
+    LEVEL_3,
+    LEVEL_4,
+} gap_security_level_t;
+
+// SSP
+#define SSP_IO_CAPABILITY_DISPLAY_ONLY   0
+#define SSP_IO_CAPABILITY_DISPLAY_YES_NO 1
+#define SSP_IO_CAPABILITY_KEYBOARD_ONLY  2
+#define SSP_IO_CAPABILITY_NO_INPUT_NO_OUTPUT 3
+#define SSP_IO_AUTHREQ_MITM_PROTECTION_NOT_REQUIRED_GENERAL_BONDING 0x04
@@ -0,0 +1,140 @@
+// Host stand-in for BTstack's btstack_event.h. Field offsets follow the HCI/BTstack event layouts so
+// scripted events built by the simulator decode exactly as on device.
+#pragma once
+
+#include "bluetooth.h"
+#include "btstack_util.h"
+
+static inline uint8_t hci_event_packet_get_type(const uint8_t *event) { return event[0]; }
+
+static inline uint8_t btstack_event_state_get_state(const uint8_t *event) { return event[2]; }
+
+static inline uint32_t hci_event_inquiry_result_get_class_of_device(const uint8_t *event) {
+    return little_endian_read_24(event, 12);
+}
+static inline void hci_event_inquiry_result_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[3], addr);
+}
+static inline uint32_t hci_event_inquiry_result_with_rssi_get_class_of_device(const uint8_t *event) {
+    return little_endian_read_24(event, 11);
+}
+static inline void hci_event_inquiry_result_with_rssi_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[3], addr);
+}
+static inline uint32_t hci_event_extended_inquiry_response_get_class_of_device(const uint8_t *event) {
+    return little_endian_read_24(event, 11);
+}
+static inline void hci_event_extended_inquiry_response_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[3], addr);
+}
+
+static inline void hci_event_connection_request_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[2], addr);
+}
+static inline uint32_t hci_event_connection_request_get_class_of_device(const uint8_t *event) {
+    return little_endian_read_24(event, 8);
+}
+
+static inline uint8_t hci_event_connection_complete_get_status(const uint8_t *event) { return event[2]; }
+static inline hci_con_handle_t hci_event_connection_complete_get_connection_handle(const uint8_t *event) {
+    return little_endian_read_16(event, 3);
+}
+static inline void hci_event_connection_complete_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[5], addr);
+}
+
+static inline void hci_event_link_key_request_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[2], addr);
+}
+static inline void hci_event_user_confirmation_request_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[2], addr);
+}
+static inline void hci_event_user_passkey_request_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[2], addr);
+}
+static inline void hci_event_pin_code_request_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[2], addr);
+}
+
+static inline uint8_t hci_event_encryption_change_get_status(const uint8_t *event) { return event[2]; }
+static inline hci_con_handle_t hci_event_encryption_change_get_connection_handle(const uint8_t *event) {
+    return little_endian_read_16(event, 3);
+}
+static inline uint8_t hci_event_encryption_change_get_encryption_enabled(const uint8_t *event) { return event[5]; }
+
+static inline uint8_t hci_event_role_change_get_status(const uint8_t *event) { return event[2]; }
+static inline void hci_event_role_change_get_bd_addr(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[3], addr);
+}
+static inline uint8_t hci_event_role_change_get_role(const uint8_t *event) { return event[9]; }
+
+static inline uint8_t hci_event_mode_change_get_status(const uint8_t *event) { return event[2]; }
+static inline hci_con_handle_t hci_event_mode_change_get_handle(const uint8_t *event) {
+    return little_endian_read_16(event, 3);
+}
+static inline uint8_t hci_event_mode_change_get_mode(const uint8_t *event) { return event[5]; }
+static inline uint16_t hci_event_mode_change_get_interval(const uint8_t *event) {
+    return little_endian_read_16(event, 6);
+}
+
+static inline uint16_t hci_event_command_complete_get_command_opcode(const uint8_t *event) {
+    return little_endian_read_16(event, 3);
+}
+static inline const uint8_t *hci_event_command_complete_get_return_parameters(const uint8_t *event) {
+    return &event[5];
+}
+
+static inline uint8_t hci_event_command_status_get_status(const uint8_t *event) { return event[2]; }
+static inline uint16_t hci_event_command_status_get_command_opcode(const uint8_t *event) {
+    return little_endian_read_16(event, 4);
+}
+
+static inline uint8_t hci_event_authentication_complete_get_status(const uint8_t *event) { return event[2]; }
+static inline hci_con_handle_t hci_event_authentication_complete_get_connection_handle(const uint8_t *event) {
+    return little_endian_read_16(event, 3);
+}
+
+static inline hci_con_handle_t hci_event_disconnection_complete_get_connection_handle(const uint8_t *event) {
+    return little_endian_read_16(event, 3);
+}
+
+static inline uint8_t l2cap_event_channel_opened_get_status(const uint8_t *event) { return event[2]; }
+static inline void l2cap_event_channel_opened_get_address(const uint8_t *event, bd_addr_t addr) {
+    reverse_bd_addr(&event[3], addr);
+}
+static inline hci_con_handle_t l2cap_event_channel_opened_get_handle(const uint8_t *event) {
+    return little_endian_read_16(event, 9);
+}
+static inline uint16_t l2cap_event_channel_opened_get_psm(const uint8_t *event) {
+    return little_endian_read_16(event, 11);
+}
+static inline uint16_t l2cap_event_channel_opened_get_local_cid(const uint8_t *event) {
+    return little_endian_read_16(event, 13);
+}
+static inline uint16_t l2cap_event_channel_opened_get_remote_cid(const uint8_t *event) {
+    return little_endian_read_16(event, 15);
+}
+static inline uint16_t l2cap_event_channel_opened_get_local_mtu(const uint8_t *event) {
+    return little_endian_read_16(event, 17);
+}
+static inline uint16_t l2cap_event_channel_opened_get_remote_mtu(const uint8_t *event) {
+    return little_endian_read_16(event, 19);
+}
+
+static inline uint16_t l2cap_event_channel_closed_get_local_cid(const uint8_t *event) {
+    return little_endian_read_16(event, 2);
+}
+
+static inline hci_con_handle_t l2cap_event_incoming_connection_get_handle(const uint8_t *event) {
+    return little_endian_read_16(event, 8);
+}
+static inline uint16_t l2cap_event_incoming_connection_get_psm(const uint8_t *event) {
+    return little_endian_read_16(event, 10);
+}
+static inline uint16_t l2cap_event_incoming_connection_get_local_cid(const uint8_t *event) {
+    return little_endian_read_16(event, 12);
+}
+
+static inline uint16_t l2cap_event_can_send_now_get_local_cid(const uint8_t *event) {
+    return little_endian_read_16(event, 2);
+}
@@ -0,0 +1,17 @@
+// Host stand-in for BTstack's btstack_run_loop.h (timers only). Timers fire from sim_run() against the
+// simulated clock.
+#pragma once
+
+#include <cstdint>
+
+typedef struct btstack_timer_source {
+    uint64_t timeout;  // absolute deadline in us of the simulated clock, so a timer never fires early
+    void (*process)(struct btstack_timer_source *ts);
+    void *context;
+} btstack_timer_source_t;
+
+void btstack_run_loop_set_timer(btstack_timer_source_t *ts, uint32_t timeout_in_ms);
+void btstack_run_loop_set_timer_handler(btstack_timer_source_t *ts, void (*process)(btstack_timer_source_t *ts));
+void btstack_run_loop_add_timer(btstack_timer_source_t *timer);
+int btstack_run_loop_remove_timer(btstack_timer_source_t *timer);
+uint32_t btstack_run_loop_get_time_ms(void);
@@ -0,0 +1,19 @@
+// Host stand-in for BTstack's btstack_util.h.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "bluetooth.h"
+
+uint16_t little_endian_read_16(const uint8_t *buffer, int position);
+uint32_t little_endian_read_24(const uint8_t *buffer, int position);
+uint32_t little_endian_read_32(const uint8_t *buffer, int position);
+void little_endian_store_16(uint8_t *buffer, uint16_t position, uint16_t value);
+void little_endian_store_24(uint8_t *buffer, uint16_t position, uint32_t value);
+void little_endian_store_32(uint8_t *buffer, uint16_t position, uint32_t value);
+
+void reverse_bd_addr(const bd_addr_t src, bd_addr_t dest);
+void bd_addr_copy(bd_addr_t dest, const bd_addr_t src);
+int bd_addr_cmp(const bd_addr_t a, const bd_addr_t b);
+char *bd_addr_to_str(const bd_addr_t addr);
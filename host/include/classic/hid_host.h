@@ -0,0 +1,2 @@
+// Host stand-in; HID host helpers are not used by the firmware.
+#pragma once
@@ -0,0 +1,2 @@
+// Host stand-in; SDP server helpers are not used by the firmware.
+#pragma once
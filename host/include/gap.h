@@ -0,0 +1,38 @@
+// Host stand-in for BTstack's gap.h.
+#pragma once
+
+#include "bluetooth.h"
+
+typedef enum {
+    HCI_SERVICE_TYPE_NO_TRAFFIC = 0,
+    HCI_SERVICE_TYPE_BEST_EFFORT,
+    HCI_SERVICE_TYPE_GUARANTEED,
+} hci_service_type_t;
+
+typedef enum {
+    PAGE_SCAN_MODE_STANDARD = 0,
+    PAGE_SCAN_MODE_INTERLACED,
+} page_scan_type_t;
+
+void gap_set_local_name(const char *local_name);
+void gap_ssp_set_enable(int enable);
+void gap_secure_connections_enable(bool enable);
+void gap_ssp_set_io_capability(int io_capability);
+void gap_ssp_set_authentication_requirement(int authentication_requirement);
+void gap_connectable_control(uint8_t enable);
+void gap_discoverable_control(uint8_t enable);
+void gap_set_allow_role_switch(bool allow_role_switch);
+int gap_inquiry_start(uint8_t duration_in_1280ms_units);
+int gap_inquiry_stop(void);
+uint8_t gap_disconnect(hci_con_handle_t handle);
+void gap_request_security_level(hci_con_handle_t con_handle, gap_security_level_t level);
+void gap_set_page_timeout(uint16_t page_timeout);
+void gap_set_page_scan_activity(uint16_t page_scan_interval, uint16_t page_scan_window);
+void gap_set_page_scan_type(page_scan_type_t page_scan_type);
+hci_role_t gap_get_role(hci_con_handle_t connection_handle);
+uint8_t gap_request_role(const bd_addr_t addr, hci_role_t role);
+uint8_t gap_sniff_mode_enter(hci_con_handle_t con_handle, uint16_t sniff_min_interval, uint16_t sniff_max_interval,
+                             uint16_t sniff_attempt, uint16_t sniff_timeout);
+uint8_t gap_sniff_mode_exit(hci_con_handle_t con_handle);
+uint8_t gap_qos_set(hci_con_handle_t con_handle, hci_service_type_t service_type, uint32_t token_rate,
+                    uint32_t peak_bandwidth, uint32_t latency, uint32_t delay_variation);
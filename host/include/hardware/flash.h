@@ -0,0 +1,15 @@
+// Host stand-in for hardware/flash.h backed by a RAM image of the 2 MB flash.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define FLASH_PAGE_SIZE   (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+
+extern uint8_t sim_flash_image[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE (reinterpret_cast<uintptr_t>(sim_flash_image))
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
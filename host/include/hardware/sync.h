@@ -0,0 +1,7 @@
+// Host stand-in for hardware/sync.h. Interrupt masking is a no-op; the simulator counts it.
+#pragma once
+
+#include <cstdint>
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
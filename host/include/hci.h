@@ -0,0 +1,30 @@
+// Host stand-in for BTstack's hci.h / hci_cmd.h.
+#pragma once
+
+#include "bluetooth.h"
+#include "gap.h"
+
+typedef struct {
+    uint16_t opcode;
+    const char *format;
+} hci_cmd_t;
+
+extern const hci_cmd_t hci_create_connection;
+extern const hci_cmd_t hci_link_key_request_reply;
+extern const hci_cmd_t hci_link_key_request_negative_reply;
+extern const hci_cmd_t hci_user_confirmation_request_reply;
+extern const hci_cmd_t hci_user_passkey_request_reply;
+extern const hci_cmd_t hci_pin_code_request_reply;
+extern const hci_cmd_t hci_write_link_policy_settings;
+extern const hci_cmd_t hci_write_automatic_flush_timeout;
+extern const hci_cmd_t hci_read_link_quality;
+extern const hci_cmd_t hci_read_rssi;
+
+#define HCI_OPCODE_HCI_READ_LINK_QUALITY 0x1403
+#define HCI_OPCODE_HCI_READ_RSSI         0x1405
+
+uint8_t hci_send_cmd(const hci_cmd_t *cmd, ...);
+bool hci_can_send_command_packet_now(void);
+uint16_t hci_usable_acl_packet_types(void);
+int hci_power_control(int power_mode);
+void hci_add_event_handler(btstack_packet_callback_registration_t *callback_handler);
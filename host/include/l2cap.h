@@ -0,0 +1,19 @@
+// Host stand-in for BTstack's l2cap.h.
+#pragma once
+
+#include "bluetooth.h"
+#include "hci.h"
+
+void l2cap_init(void);
+void l2cap_add_event_handler(btstack_packet_callback_registration_t *callback_handler);
+uint8_t l2cap_register_service(btstack_packet_handler_t packet_handler, uint16_t psm, uint16_t mtu,
+                               gap_security_level_t security_level);
+uint8_t l2cap_create_channel(btstack_packet_handler_t packet_handler, bd_addr_t address, uint16_t psm,
+                             uint16_t mtu, uint16_t *out_local_cid);
+void l2cap_accept_connection(uint16_t local_cid);
+uint8_t l2cap_request_can_send_now_event(uint16_t local_cid);
+uint8_t l2cap_send(uint16_t local_cid, const uint8_t *data, uint16_t len);
+bool l2cap_reserve_packet_buffer(void);
+void l2cap_release_packet_buffer(void);
+uint8_t *l2cap_get_outgoing_buffer(void);
+uint8_t l2cap_send_prepared(uint16_t local_cid, uint16_t len);
@@ -0,0 +1,20 @@
+// Host stand-in for pico/async_context.h. The simulator is single threaded: the lock is a no-op and pending
+// workers run immediately.
+#pragma once
+
+#include "pico/platform.h"
+
+typedef struct async_context async_context_t;
+typedef struct async_when_pending_worker async_when_pending_worker_t;
+
+struct async_when_pending_worker {
+    async_when_pending_worker_t *next;
+    void (*do_work)(async_context_t *context, async_when_pending_worker_t *worker);
+    bool work_pending;
+    void *user_data;
+};
+
+void async_context_acquire_lock_blocking(async_context_t *context);
+void async_context_release_lock(async_context_t *context);
+bool async_context_add_when_pending_worker(async_context_t *context, async_when_pending_worker_t *worker);
+void async_context_set_work_pending(async_context_t *context, async_when_pending_worker_t *worker);
@@ -0,0 +1,11 @@
+// Host stand-in for pico/cyw43_arch.h. The LED pin is tracked by the simulator.
+#pragma once
+
+#include "pico/async_context.h"
+#include "pico/stdlib.h"
+
+#define CYW43_WL_GPIO_LED_PIN 0
+
+int cyw43_arch_init(void);
+void cyw43_arch_gpio_put(unsigned int wl_gpio, bool value);
+async_context_t *cyw43_arch_async_context(void);
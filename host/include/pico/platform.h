@@ -0,0 +1,23 @@
+// Host stand-in for pico/platform.h. The simulator runs the firmware handlers on one thread: core 0, thread mode.
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+static inline unsigned int get_core_num(void) { return 0; }
+static inline unsigned int __get_current_exception(void) { return 0; }
+static inline void tight_loop_contents(void) {}
+
+// Prints and aborts, like the SDK's panic() halting the core
+[[noreturn]] static inline void panic(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    abort();
+}
+
+// Section placement is meaningless on the host
+#define __not_in_flash_func(func_name) func_name
@@ -0,0 +1,17 @@
+// Host stand-in for pico/sem.h, thread-safe so producer and consumer may run on different host threads.
+#pragma once
+
+#include <cstdint>
+
+typedef struct {
+    int16_t permits;
+    int16_t max_permits;
+    void *impl;
+} semaphore_t;
+
+void sem_init(semaphore_t *sem, int16_t initial_permits, int16_t max_permits);
+int sem_available(semaphore_t *sem);
+bool sem_release(semaphore_t *sem);
+void sem_acquire_blocking(semaphore_t *sem);
+bool sem_acquire_timeout_ms(semaphore_t *sem, uint32_t timeout_ms);
+bool sem_try_acquire(semaphore_t *sem);
@@ -0,0 +1,14 @@
+// Host stand-in for the Pico SDK stdlib umbrella header.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "pico/time.h"
+
+bool stdio_init_all(void);
+int putchar_raw(int c);
+
+#define PICO_ERROR_TIMEOUT (-1)
+int getchar_timeout_us(uint32_t timeout_us);
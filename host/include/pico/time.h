@@ -0,0 +1,10 @@
+// Host stand-in for pico/time.h. The clock is the host's monotonic clock plus an offset that scripted
+// scenarios can advance with sim_clock_advance_us(), so timestamps stay meaningful without real waits.
+#pragma once
+
+#include <cstdint>
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
@@ -0,0 +1,46 @@
+// Formats the binary log stream of a PICO_W_LOG_BINARY=1 build on the PC.
+//
+// Reads the USB CDC capture from stdin (e.g. `cat /dev/ttyACM0 | dualsense_log_decode`). Bytes outside sync-marked
+// records are ordinary printf output and are passed through unchanged. The message table comes from the same
+// pico_w_log.h the firmware was built with.
+#include <cstdio>
+#include <cstring>
+
+#include "pico_w_log.h"
+
+int main() {
+    uint8_t buffer[2 + sizeof(log_record)];
+    size_t fill = 0;
+    uint32_t records = 0, unknown = 0;
+
+    int c;
+    while ((c = getchar()) != EOF) {
+        buffer[fill++] = static_cast<uint8_t>(c);
+        if (fill == 1 && buffer[0] != LOG_SYNC_0) {
+            putchar(buffer[0]);
+            fill = 0;
+            continue;
+        }
+        if (fill == 2 && buffer[1] != LOG_SYNC_1) {
+            // not a record: flush the first byte and retry the second as a sync start
+            putchar(buffer[0]);
+            buffer[0] = buffer[1];
+            fill = buffer[0] == LOG_SYNC_0 ? 1 : 0;
+            if (!fill) putchar(buffer[0]);
+            continue;
+        }
+        if (fill < sizeof(buffer)) continue;
+
+        log_record record;
+        memcpy(&record, &buffer[2], sizeof(record));
+        fill = 0;
+        if (record.id >= LOG_MESSAGE_COUNT || record.argc > LOG_MAX_ARGS) unknown++;
+
+        char line[160];
+        log_format(record, line, sizeof(line));
+        puts(line);
+        records++;
+    }
+    fprintf(stderr, "%u records decoded, %u with unknown ids\n", records, unknown);
+    return 0;
+}
@@ -0,0 +1,1842 @@
+// Host-side driver for the firmware handlers.
+//
+// Builds the same l2cap/hci packet handlers, platform policy and registry policy as the Pico target, runs a
+// scripted pairing + reconnect sequence through the simulated radio, connects further controllers and then
+// pushes 0x31 input reports through the real report path, timing each stage.
+// Usage: dualsense_host [reports] [--quiet] [--capture FILE]
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "pico/cyw43_arch.h"
+#include "pico_w_registry_policy.h"
+
+#include "pico_w_btstack.h"
+#include "GCore/Interfaces/IPlatformHardwareInfo.h"
+#include "GCore/Templates/TBasicDeviceRegistry.h"
+#include "pico_w_action_map.h"
+#include "pico_w_capture.h"
+#include "pico_w_crc32.h"
+#include "pico_w_fixed_input.h"
+#include "pico_w_haptic_audio.h"
+#include "pico_w_imu_bench.h"
+#include "pico_w_imu_fusion.h"
+#include "pico_w_input_bench.h"
+#include "pico_w_input_events.h"
+#include "pico_w_latency.h"
+#include "pico_w_log.h"
+#include "pico_w_memory.h"
+#include "pico_w_output_sequencer.h"
+#include "pico_w_platform.h"
+#include "pico_w_report_view.h"
+#include "pico_w_spsc_ring.h"
+#include "pico_w_trigger_effects.h"
+#include "pico_w_usb_bridge.h"
+#include "GCore/Interfaces/ISonyGamepad.h"
+
+#include "sim/bench_stats.h"
+#include "sim/btstack_sim.h"
+#include "sim/dualsense_report.h"
+
+using pico_platform = GamepadCore::TGenericHardwareInfo<pico_w_platform_policy>;
+
+static const bd_addr_t sim_dualsense_addr[sim_max_remotes] = {
+    {0xA0, 0x5A, 0x5D, 0x12, 0x34, 0x56},
+    {0xA0, 0x5A, 0x5D, 0x12, 0x34, 0x57},
+    {0xA0, 0x5A, 0x5D, 0x12, 0x34, 0x58},
+    {0xA0, 0x5A, 0x5D, 0x12, 0x34, 0x59},
+};
+
+static bool expect(bool condition, const char *what) {
+    fprintf(stderr, "  [%s] %s\n", condition ? " OK " : "FAIL", what);
+    return condition;
+}
+
+static bool run_connection_script() {
+    fprintf(stderr, "Connection script\n");
+    bool ok = true;
+
+    // First boot: empty flash, pad in pairing mode -> inquiry, SSP pairing, channel setup
+    const uint8_t pad = sim_add_remote(sim_dualsense_addr[0]);
+    sim_set_remote_pairing_mode(pad, true);
+    init_bluetooth();
+    sim_run();
+
+    ok &= expect(sim_local_cid(pad, PSM_HID_INTERRUPT) != 0, "paired and HID interrupt channel open");
+    link_key_t saved_key;
+    ok &= expect(flash_bond_find(sim_dualsense_addr[0], saved_key), "link key stored in flash");
+
+    // Controller power cycle: our pages time out while it is off, then the pad pages us and authenticates with the
+    // stored key
+    sim_set_remote_pairing_mode(pad, false);
+    sim_set_remote_page_scan(pad, false);
+    sim_remote_disconnect(pad);
+    sim_run();
+    ok &= expect(sim_local_cid(pad, PSM_HID_INTERRUPT) == 0, "channels closed after disconnect");
+    ok &= expect(connection_count() == 0, "controller slot released");
+    ok &= expect(reconnect_active(), "bonded controller paged on the retry schedule");
+
+    sim_set_remote_page_scan(pad, true);
+    sim_remote_connect(pad);
+    sim_run();
+    ok &= expect(sim_local_cid(pad, PSM_HID_INTERRUPT) != 0, "bonded reconnect reopened HID interrupt channel");
+    ok &= expect(!reconnect_active(), "controller's own connection ended the page schedule");
+    return ok;
+}
+
+// Rewrites the keys of a handful of devices many times, rebooting (re-scanning the journal) along the way.
+static bool run_bond_journal(uint32_t writes) {
+    fprintf(stderr, "Bond journal (%u key writes)\n", writes);
+    bool ok = true;
+
+    // Firmware from before the journal kept one device_config_t at the start of the region
+    device_config_t legacy = {};
+    memcpy(legacy.mac, sim_dualsense_addr[3], 6);
+    memset(legacy.link_key, 0x5A, LINK_KEY_LEN);
+    legacy.exists = CONFIG_VALID_MARKER;
+    uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, &legacy, sizeof(legacy));
+    flash_range_program(FLASH_TARGET_OFFSET, page, FLASH_PAGE_SIZE);
+
+    flash_bonds_init();
+    link_key_t key;
+    ok &= expect(flash_bond_find(sim_dualsense_addr[3], key) && key[0] == 0x5A, "single-device config imported");
+
+    constexpr uint8_t devices = 6;
+    uint8_t expected[devices] = {};
+    bd_addr_t macs[devices];
+    for (uint8_t d = 0; d < devices; d++) {
+        memcpy(macs[d], sim_dualsense_addr[0], 6);
+        macs[d][0] = static_cast<uint8_t>(0xC0 + d);
+    }
+
+    const uint32_t erases_before = sim_get_stats().flash_erases;
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < writes; i++) {
+        const uint8_t d = static_cast<uint8_t>(i % devices);
+        expected[d] = static_cast<uint8_t>(i + 1);
+        memset(key, expected[d], LINK_KEY_LEN);
+        flash_bond_save(macs[d], key);
+
+        if (i % 97 == 0) flash_bonds_init();
+        if (!flash_bond_find(macs[d], key) || key[0] != expected[d]) mismatches++;
+    }
+    const uint32_t erases = sim_get_stats().flash_erases - erases_before;
+    fprintf(stderr, "  %u sector erases for %u key writes (single-record store: %u)\n", erases, writes, writes);
+
+    flash_bond_remove(macs[1]);
+    flash_bonds_init();
+    for (uint8_t d = 0; d < devices; d++) {
+        const bool found = flash_bond_find(macs[d], key);
+        if (d == 1 ? found : (!found || key[0] != expected[d])) mismatches++;
+    }
+    ok &= expect(mismatches == 0, "newest key of every device survives compaction and reboot");
+    ok &= expect(flash_bond_find(sim_dualsense_addr[3], key) && key[0] == 0x5A, "imported bond kept live");
+    ok &= expect(erases <= writes / (BOND_RECORDS_PER_SECTOR - BOND_MAX_DEVICES) + 1,
+                 "sectors are only erased when the journal compacts");
+
+    // Journal of 32-byte records from before calibration was cached: rewritten, most recent bond kept last
+    flash_range_erase(FLASH_TARGET_OFFSET, BOND_SECTOR_COUNT * FLASH_SECTOR_SIZE);
+    memset(page, 0xFF, sizeof(page));
+    for (uint8_t d = 0; d < 2; d++) {
+        bond_record_v1 old = {BOND_RECORD_V1_MAGIC, BOND_RECORD_KEY, {}, static_cast<uint32_t>(7 - d * 2), {}, 0};
+        memcpy(old.mac, macs[d], 6);
+        memset(old.link_key, 0x30 + d, LINK_KEY_LEN);
+        old.crc = crc32_compute(reinterpret_cast<const uint8_t *>(&old), offsetof(bond_record_v1, crc));
+        memcpy(&page[d * BOND_RECORD_V1_SIZE], &old, sizeof(old));
+    }
+    flash_range_program(FLASH_TARGET_OFFSET, page, FLASH_PAGE_SIZE);
+    flash_bonds_init();
+    flash_bonds_init();
+    bd_addr_t latest;
+    ok &= expect(flash_bond_find(macs[0], key) && key[0] == 0x30 && flash_bond_find(macs[1], key) && key[0] == 0x31 &&
+                 flash_bond_latest(latest) && bd_addr_cmp(latest, macs[0]) == 0,
+                 "32-byte journal rewritten, newest bond still the latest");
+
+    flash_range_erase(FLASH_TARGET_OFFSET, BOND_SECTOR_COUNT * FLASH_SECTOR_SIZE);
+    flash_bonds_init();
+    return ok;
+}
+
+static uint8_t slot_of_remote(uint8_t remote) {
+    const gamepad_connection *conn = connection_for_cid(sim_local_cid(remote, PSM_HID_INTERRUPT));
+    return conn ? connection_slot(conn) : NO_SLOT;
+}
+
+// One 0x31 frame from remote, consumed like the application loop would so later tests start from an empty slot
+static bool first_input(uint8_t remote) {
+    uint8_t report[sim_report::size];
+    sim_build_input_report(report, sim_input_state{}, 0);
+    if (!sim_send_input_report(remote, report)) return false;
+    input_frame_info frame = {};
+    return input_pipeline_wait(0) && input_pipeline_acquire(slot_of_remote(remote), frame) != nullptr;
+}
+
+// Link loss with the pad in range, boot with a bond, controller wake, and a pad that never answers: the schedule
+// has to end in the pairing inquiry. Time to first input is recorded per origin.
+static bool run_reconnect() {
+    fprintf(stderr, "Reconnect\n");
+    bool ok = true;
+    const uint8_t pad = 0;
+    const reconnect_timing &link_loss = reconnect_timings[RECONNECT_ORIGIN_LINK_LOSS];
+    const reconnect_timing &boot = reconnect_timings[RECONNECT_ORIGIN_BOOT];
+    const reconnect_timing &wake = reconnect_timings[RECONNECT_ORIGIN_WAKE];
+    first_input(pad);
+    sim_run();
+
+    uint32_t pages = sim_get_stats().pages;
+    sim_remote_disconnect(pad, ERROR_CODE_CONNECTION_TIMEOUT);
+    sim_run();
+    ok &= expect(sim_local_cid(pad, PSM_HID_INTERRUPT) != 0 && sim_get_stats().pages == pages + 1,
+                 "link loss: one page brought the bonded pad back");
+    first_input(pad);
+    ok &= expect(link_loss.count == 1, "link loss: time to first input recorded");
+
+    // link loss while another HCI command holds the only credit: the page waits for it instead of being lost
+    const uint32_t busy = reconnect_busy_retries;
+    sim_hold_command_credit(5 * RECONNECT_BUSY_RETRY_MS * 1000);
+    pages = sim_get_stats().pages;
+    sim_remote_disconnect(pad, ERROR_CODE_CONNECTION_TIMEOUT);
+    sim_run();
+    ok &= expect(sim_get_stats().pages == pages && reconnect_active() && reconnect_busy_retries == busy + 1,
+                 "no command credit: page put off, schedule still armed");
+    for (uint32_t i = 0; i < 6 && sim_get_stats().pages == pages; i++) {
+        sim_clock_advance_us(RECONNECT_BUSY_RETRY_MS * 1000);
+        sim_run();
+    }
+    ok &= expect(sim_local_cid(pad, PSM_HID_INTERRUPT) != 0 && sim_get_stats().pages == pages + 1,
+                 "credit back: the put-off page reconnected the pad");
+    first_input(pad);
+
+    // host reboot while the pad sleeps, pad answers the second page
+    sim_set_remote_page_scan(pad, false);
+    sim_remote_disconnect(pad, ERROR_CODE_REMOTE_USER_TERMINATED_CONNECTION);
+    sim_run();
+    hci_power_control(HCI_POWER_ON);
+    sim_run();
+    pages = sim_get_stats().pages;
+    sim_set_remote_page_scan(pad, true);
+    sim_clock_advance_us(RECONNECT_BACKOFF_MS[1] * 1000);
+    sim_run();
+    first_input(pad);
+    ok &= expect(sim_local_cid(pad, PSM_HID_INTERRUPT) != 0 && sim_get_stats().pages == pages + 1 &&
+                 boot.count == 1 && boot.last_ms >= RECONNECT_BACKOFF_MS[1],
+                 "boot: bonded pad paged on the schedule, time from power-on recorded");
+
+    // pad switched off, later woken by the user: its own page counts as a wake
+    sim_set_remote_page_scan(pad, false);
+    sim_remote_disconnect(pad, ERROR_CODE_REMOTE_USER_TERMINATED_CONNECTION);
+    sim_run();
+    sim_clock_advance_us(200000);
+    sim_run();
+    const uint32_t wakes = wake.count;
+    sim_remote_connect(pad);
+    sim_run();
+    first_input(pad);
+    ok &= expect(wake.count == wakes + 1 && !reconnect_active(), "wake: controller page recorded, schedule stopped");
+
+    // pad gone for good: every page times out, then the inquiry finds it in pairing mode
+    sim_set_remote_page_scan(pad, false);
+    sim_remote_disconnect(pad, ERROR_CODE_CONNECTION_TIMEOUT);
+    sim_run();
+    pages = sim_get_stats().pages;
+    for (uint32_t i = 0; i < RECONNECT_ATTEMPTS; i++) {
+        sim_clock_advance_us(RECONNECT_BACKOFF_MS[RECONNECT_ATTEMPTS - 1] * 1000);
+        sim_run();
+    }
+    ok &= expect(!reconnect_active() && sim_get_stats().pages == pages + RECONNECT_ATTEMPTS - 1,
+                 "schedule gave up after its last page");
+    sim_set_remote_page_scan(pad, true);
+    sim_set_remote_pairing_mode(pad, true);
+    sim_run();
+    sim_set_remote_pairing_mode(pad, false);
+    ok &= expect(sim_local_cid(pad, PSM_HID_INTERRUPT) != 0, "inquiry fallback reconnected the pad");
+
+    fprintf(stderr, "  time to first input: link loss %u ms, boot %u ms, wake %u ms (simulated clock)\n",
+            (unsigned int)link_loss.last_ms, (unsigned int)boot.last_ms, (unsigned int)wake.last_ms);
+    return ok;
+}
+
+// Profile settings reach the link, the controller cannot take the central role back under competitive, and the
+// report interval follows the frame spacing.
+static bool run_link_profile() {
+    fprintf(stderr, "Link profile\n");
+    bool ok = true;
+    const uint8_t pad = 0;
+    const uint8_t slot = slot_of_remote(pad);
+    const sim_link &link = sim_remote_link(pad);
+
+    ok &= expect(link.local_role == HCI_ROLE_MASTER && link.link_policy == LM_LINK_POLICY_DISABLE_ALL_LM_MODES &&
+                 link.mode == sim_mode_active && link.qos_service == HCI_SERVICE_TYPE_GUARANTEED &&
+                 link.flush_timeout == LINK_PROFILES[LINK_PROFILE_COMPETITIVE].flush_timeout_slots,
+                 "competitive: central, no role switch or sniff, guaranteed QoS, flush timeout");
+    ok &= expect(!sim_remote_switch_role(pad), "competitive: controller role switch refused");
+
+    const link_slot &state = link_slots[slot];
+    const uint32_t frames = state.frames;
+    for (uint32_t i = 0; i < 40; i++) {
+        sim_clock_advance_us(i & 1 ? 3000 : 5000);
+        first_input(pad);
+    }
+    ok &= expect(state.frames == frames + 40 && state.interval_avg_us >= 3500 && state.interval_avg_us <= 4500 &&
+                 state.interval_max_us >= 5000 && state.interval_max_us < 5100,
+                 "report interval measured from frame arrivals");
+
+    link_profile_select(slot, LINK_PROFILE_BATTERY);
+    sim_run();
+    ok &= expect(link.mode == sim_mode_sniff &&
+                 link.sniff_interval == LINK_PROFILES[LINK_PROFILE_BATTERY].sniff_max_slots &&
+                 state.mode == LINK_MODE_SNIFF && link.qos_service == HCI_SERVICE_TYPE_BEST_EFFORT &&
+                 link.flush_timeout == 0, "battery: sniff entered, best effort, no flush");
+    ok &= expect(sim_remote_switch_role(pad), "battery: controller may take the central role");
+    sim_run();
+    ok &= expect(state.role == HCI_ROLE_SLAVE, "role change tracked");
+
+    link_profile_select(slot, LINK_PROFILE_COMPETITIVE);
+    sim_run();
+    ok &= expect(link.local_role == HCI_ROLE_MASTER && state.role == HCI_ROLE_MASTER && !state.awaiting_role &&
+                 link.mode == sim_mode_active && link.link_policy == LM_LINK_POLICY_DISABLE_ALL_LM_MODES,
+                 "competitive again: central role taken back, sniff left");
+    link_profile_dump();
+    return ok;
+}
+
+// Calibration read over the control channel on first connect, cached with the bond, applied from flash before the
+// controller answers on the next connect, and a controller that never answers times out.
+static bool run_calibration() {
+    fprintf(stderr, "Calibration\n");
+    bool ok = true;
+    const uint8_t pad = 0;
+    uint8_t expected[sim_calibration::size];
+    sim_build_calibration_report(expected, pad);
+    const int16_t pitch_bias = static_cast<int16_t>(expected[1] | (expected[2] << 8));
+
+    uint8_t cached[BOND_CALIBRATION_SIZE];
+    ok &= expect(flash_bond_calibration(sim_dualsense_addr[pad], cached) &&
+                 memcmp(cached, expected, sizeof(cached)) == 0,
+                 "first connection: feature report 0x05 read and stored with the bond");
+
+    FDeviceContext *context = connections[slot_of_remote(pad)].gamepad->GetMutableDeviceContext();
+    ok &= expect(context->Calibration.PitchBias == pitch_bias, "reply parsed into the device calibration");
+
+    // controller answers: cached copy applied, same reply, no flash write
+    const uint32_t programs = sim_get_stats().flash_programs;
+    const uint32_t hits = calibration_cache_hits;
+    context->Calibration = {};
+    sim_remote_disconnect(pad, ERROR_CODE_CONNECTION_TIMEOUT);
+    sim_run();
+    ok &= expect(calibration_cache_hits == hits + 1 && context->Calibration.PitchBias == pitch_bias &&
+                 sim_get_stats().flash_programs == programs,
+                 "reconnect: cached calibration, unchanged reply not rewritten");
+
+    // controller silent: cached calibration stays, the request gives up after its retries
+    const uint32_t failed = calibration_failed;
+    sim_set_remote_feature_reports(pad, false);
+    context->Calibration = {};
+    sim_remote_disconnect(pad, ERROR_CODE_CONNECTION_TIMEOUT);
+    sim_run();
+    ok &= expect(context->Calibration.PitchBias == pitch_bias, "reconnect: calibration applied before any reply");
+    for (uint8_t i = 0; i < FEATURE_REPORT_ATTEMPTS; i++) {
+        sim_clock_advance_us(CALIBRATION_TIMEOUT_MS * 1000);
+        sim_run();
+    }
+    ok &= expect(calibration_failed == failed + 1 && !feature_requests[slot_of_remote(pad)].handler,
+                 "unanswered request times out after its retries");
+    sim_set_remote_feature_reports(pad, true);
+    return ok;
+}
+
+// Fusion factors from the pad's 0x05 report, the fixed-point filter against the float one and the true motion of a
+// synthesised recording, and a connected pad's frames driving the per-slot estimate through the input pipeline.
+static bool run_imu_fusion(uint32_t updates) {
+    fprintf(stderr, "IMU fusion (%u updates)\n", updates);
+    bool ok = true;
+    const uint8_t pad = 0;
+    const uint8_t slot = slot_of_remote(pad);
+    const imu_calibration &calibration = imu_calibrations[slot];
+    ok &= expect(calibration.gyro_bias[0] == 4 + pad && calibration.gyro_scale[0] == 17870 &&
+                 calibration.accel_bias[0] == 20 && calibration.accel_scale[0] == 4096,
+                 "calibration report parsed into the fusion factors");
+    uint8_t degenerate[sim_calibration::size] = {0x05};
+    const imu_calibration fallback = imu_calibration_parse(degenerate);
+    ok &= expect(fallback.gyro_scale[1] == IMU_GYRO_DEFAULT_SCALE && fallback.accel_scale[2] == 4096,
+                 "empty calibration entries keep the nominal ranges");
+
+    const imu_bench_result bench = imu_bench_run(updates);
+    fprintf(stderr, "  per update: float %.1f cycles, Q30 %.1f cycles (host TSC; on the RP2040 build with "
+                    "-DDUALSENSE_INPUT_BENCH=ON)\n",
+            static_cast<double>(bench.float_cycles) / bench.updates,
+            static_cast<double>(bench.fixed_cycles) / bench.updates);
+    fprintf(stderr, "  fixed vs float tilt: max %.3f deg; tilt vs truth: fixed rms %.3f deg (max %.3f), "
+                    "float rms %.3f deg\n",
+            bench.max_divergence_deg, bench.fixed_tilt_rms_deg, bench.fixed_tilt_max_deg, bench.float_tilt_rms_deg);
+    ok &= expect(bench.max_divergence_deg < 0.5f, "fixed-point tilt tracks the float filter");
+    ok &= expect(bench.fixed_tilt_rms_deg < bench.float_tilt_rms_deg + 0.1f && bench.fixed_tilt_max_deg < 5.0f,
+                 "fixed-point tilt as accurate as the float filter");
+
+    // pad on its side, still: gravity along +x from the first frame, one update per frame
+    sim_input_state state;
+    state.gyro[0] = static_cast<int16_t>(4 + pad);
+    state.gyro[1] = -3;
+    state.gyro[2] = 2;
+    state.accel[0] = 8192 + 20;
+    state.accel[1] = -2;
+    state.accel[2] = 40;
+    uint32_t received = 0;
+    for (uint32_t i = 0; i < 50; i++) {
+        state.sensor_timestamp = i * 4000 * IMU_SENSOR_TICKS_PER_US;
+        uint8_t report[sim_report::size];
+        sim_build_input_report(report, state, static_cast<uint8_t>(i));
+        sim_send_input_report(pad, report);
+        input_frame_info frame = {};
+        const uint8_t *taken = input_pipeline_wait(0) ? input_pipeline_acquire(slot, frame) : nullptr;
+        if (!taken) continue;
+        imu_fusion_update(slot, {taken}, i == 0);
+        received++;
+    }
+    const imu_fusion_state &fused = imu_fusion[slot];
+    ok &= expect(received == 50 && fused.updates == 50, "one estimate per frame, the first seeded from gravity");
+    ok &= expect(fused.gravity[0] > 32600 && std::abs(fused.gravity[1]) < 200 && std::abs(fused.gravity[2]) < 200,
+                 "gravity follows the pad's accelerometer");
+    return ok;
+}
+
+// Remaining pads page the host one after another. Every pad must land in its own slot, its reports must reach
+// only its own gamepad and the output scheduler must serve all of them before serving anyone twice.
+static bool run_multi_controller() {
+    fprintf(stderr, "Multi-controller (%u pads)\n", sim_max_remotes);
+    bool ok = true;
+
+    for (uint8_t i = 1; i < sim_max_remotes; i++) {
+        const uint8_t pad = sim_add_remote(sim_dualsense_addr[i]);
+        sim_remote_connect(pad);
+        sim_run();
+    }
+    ok &= expect(connection_count() == sim_max_remotes, "every pad holds a controller slot");
+
+    uint8_t slot_mask = 0;
+    for (uint8_t pad = 0; pad < sim_max_remotes; pad++) {
+        const uint8_t slot = slot_of_remote(pad);
+        if (slot != NO_SLOT) slot_mask |= static_cast<uint8_t>(1u << slot);
+    }
+    ok &= expect(slot_mask == (1u << sim_max_remotes) - 1, "CID table routes each pad to a distinct slot");
+
+    uint8_t report[sim_report::size];
+    for (uint8_t pad = 0; pad < sim_max_remotes; pad++) {
+        sim_input_state in;
+        in.lx = static_cast<uint8_t>(0x10 + pad);
+        sim_build_input_report(report, in, pad);
+        sim_send_input_report(pad, report);
+    }
+    uint32_t misrouted = 0;
+    for (uint8_t pad = 0; pad < sim_max_remotes; pad++) {
+        const uint8_t slot = slot_of_remote(pad);
+        input_frame_info frame = {};
+        if (slot == NO_SLOT || !input_pipeline_take(slot, frame, report) ||
+            report[sim_report::offset] != 0x10 + pad) {
+            misrouted++;
+        }
+    }
+    ok &= expect(misrouted == 0, "input reports reach the slot of the sending pad");
+
+    // Slot 0 asks for three outputs before the radio gets a turn; the other pads ask once each
+    sim_clear_sent_packets();
+    for (int i = 0; i < 3; i++) connections[0].gamepad->UpdateOutput();
+    for (uint8_t slot = 1; slot < sim_max_remotes; slot++) connections[slot].gamepad->UpdateOutput();
+    sim_run();
+
+    const auto &sent = sim_sent_packets();
+    uint8_t first_round = 0;
+    for (size_t i = 0; i < sent.size() && i < sim_max_remotes; i++) {
+        if (const gamepad_connection *conn = connection_for_cid(sent[i].cid)) {
+            first_round |= static_cast<uint8_t>(1u << connection_slot(conn));
+        }
+    }
+    ok &= expect(first_round == (1u << sim_max_remotes) - 1, "first round of sends covers every pad");
+
+    // Two pads drop together, one of them switched off: each gets its own schedule, and the page that times out
+    // neither replaces the other target nor holds it back
+    const uint32_t pages = sim_get_stats().pages;
+    sim_set_remote_page_scan(1, false);
+    sim_remote_disconnect(1, ERROR_CODE_CONNECTION_TIMEOUT);
+    sim_remote_disconnect(2, ERROR_CODE_CONNECTION_TIMEOUT);
+    sim_run();
+    const uint8_t off = reconnect_find(sim_dualsense_addr[1]);
+    ok &= expect(slot_of_remote(2) != NO_SLOT && slot_of_remote(1) == NO_SLOT && sim_get_stats().pages == pages + 2,
+                 "two pads dropped: the one in range reconnected, the one switched off paged once");
+    ok &= expect(off != RECONNECT_NONE && reconnect_targets[off].attempt == 1 &&
+                     reconnect_find(sim_dualsense_addr[2]) == RECONNECT_NONE,
+                 "two pads dropped: the failed page charged to its own target only");
+    sim_set_remote_page_scan(1, true);
+    sim_clock_advance_us(RECONNECT_BACKOFF_MS[1] * 1000);
+    sim_run();
+    ok &= expect(slot_of_remote(1) != NO_SLOT && !reconnect_active() && sim_get_stats().pages == pages + 3,
+                 "two pads dropped: the other pad reconnected on its own schedule");
+    for (uint8_t pad = 1; pad <= 2; pad++) first_input(pad);
+
+    // Leave only the first pad connected for the report path benchmark; the others are switched off
+    for (uint8_t pad = 1; pad < sim_max_remotes; pad++) {
+        sim_set_remote_page_scan(pad, false);
+        sim_remote_disconnect(pad);
+    }
+    sim_run();
+    ok &= expect(connection_count() == 1, "disconnected pads release their slots");
+    reconnect_cancel();
+    return ok;
+}
+
+// Table-driven CRC against the bitwise reference, incremental patching, input rejection and output stamping,
+// then throughput of slice-by-4 and crc32_patch against the bytewise loop on report-sized buffers.
+static bool run_crc32(uint32_t frames) {
+    fprintf(stderr, "CRC32 (%u frames)\n", frames);
+    bool ok = true;
+
+    const uint8_t check[] = "123456789";
+    ok &= expect(crc32_compute(check, 9) == 0xCBF43926u && crc32_compute_bytewise(check, 9) == 0xCBF43926u,
+                 "CRC-32 check value");
+
+    uint8_t a[CRC32_MAX_SHIFT], b[CRC32_MAX_SHIFT];
+    uint32_t seed = 7;
+    uint32_t bad = 0;
+    for (uint32_t round = 0; round < 2000; round++) {
+        const size_t len = round % (CRC32_MAX_SHIFT + 1);
+        for (size_t i = 0; i < len; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            a[i] = b[i] = static_cast<uint8_t>(seed >> 24);
+        }
+        const uint32_t crc = crc32_compute(a, len);
+        if (crc != ~sim_crc32(0xFFFFFFFFu, a, len) || crc != crc32_compute_bytewise(a, len)) bad++;
+        for (uint32_t changes = round % 5; changes && len; changes--) {
+            seed = seed * 1664525u + 1013904223u;
+            b[(seed >> 8) % len] ^= static_cast<uint8_t>(1 + (seed >> 24) % 255);
+        }
+        if (crc32_patch(crc, a, b, len) != crc32_compute(b, len)) bad++;
+    }
+    ok &= expect(bad == 0, "slice-by-4, bytewise, bitwise and patched CRCs agree");
+
+    // Input validation: a flipped bit must not reach the pipeline
+    const uint8_t slot = slot_of_remote(0);
+    uint8_t report[sim_report::size];
+    sim_input_state in;
+    sim_build_input_report(report, in, 1);
+    input_frame_info frame = {};
+    uint8_t taken[INPUT_REPORT_SIZE];
+    while (input_pipeline_take(slot, frame, taken)) {}
+    const uint32_t rejected = input_pipeline_crc_rejected(slot);
+    report[10] ^= 0x04;
+    sim_send_input_report(0, report);
+    ok &= expect(input_pipeline_crc_rejected(slot) == rejected + 1 && !input_pipeline_take(slot, frame, taken),
+                 "corrupt 0x31 frame counted and dropped");
+    // neither a truncated 0x31 nor one whose report id took the bit flip is published
+    const uint32_t malformed = input_pipeline_malformed(slot);
+    report[10] ^= 0x04;
+    sim_send_input_report(0, report, 40);
+    report[0] ^= 0x10;
+    sim_send_input_report(0, report);
+    report[0] ^= 0x10;
+    ok &= expect(input_pipeline_malformed(slot) == malformed + 2 && !input_pipeline_take(slot, frame, taken),
+                 "short frame and frame with a flipped report id counted and dropped");
+    sim_send_input_report(0, report);
+    ok &= expect(input_pipeline_take(slot, frame, taken), "intact 0x31 frame published");
+
+    // Output stamping
+    sim_clock_advance_us(output_slots[slot].min_interval_us);
+    sim_clear_sent_packets();
+    connections[slot].gamepad->SetLightbar({0x21, 0x43, 0x65, 0});
+    connections[slot].gamepad->UpdateOutput();
+    sim_run();
+    const auto &sent = sim_sent_packets();
+    ok &= expect(sent.size() == 1 && sent[0].data.size() == 1 + OUTPUT_REPORT_SIZE &&
+                 ~sim_crc32(0xFFFFFFFFu, sent[0].data.data(), OUTPUT_REPORT_SIZE - 3) ==
+                 ds_bt_stored_crc(&sent[0].data[1], OUTPUT_REPORT_SIZE),
+                 "output report carries the 0xA2-seeded CRC");
+
+    // Throughput on report-sized buffers
+    std::vector<uint8_t> buffers(static_cast<size_t>(frames) * sim_report::size);
+    for (auto &byte: buffers) {
+        seed = seed * 1664525u + 1013904223u;
+        byte = static_cast<uint8_t>(seed >> 24);
+    }
+    constexpr size_t len = sim_report::size - DS_BT_CRC_SIZE;
+    uint32_t sink = 0;
+    uint64_t t0 = bench_now_ns();
+    for (uint32_t i = 0; i < frames; i++) sink ^= crc32_compute_bytewise(&buffers[i * sim_report::size], len);
+    uint64_t t1 = bench_now_ns();
+    for (uint32_t i = 0; i < frames; i++) sink ^= crc32_compute(&buffers[i * sim_report::size], len);
+    uint64_t t2 = bench_now_ns();
+    // typical output update: the same report with a 3-byte lightbar change
+    memcpy(a, buffers.data(), len);
+    memcpy(b, a, len);
+    uint32_t crc = crc32_compute(a, len);
+    for (uint32_t i = 0; i < frames; i++) {
+        b[44] = static_cast<uint8_t>(i);
+        b[45] = static_cast<uint8_t>(i >> 8);
+        b[46] = static_cast<uint8_t>(i >> 16);
+        sink ^= crc32_patch(crc, a, b, len);
+    }
+    uint64_t t3 = bench_now_ns();
+    bench_keep(sink);
+    const double mb = static_cast<double>(frames) * len / 1e6;
+    fprintf(stderr, "  bytewise     %7.1f MB/s  %6.1f ns/report\n", mb / ((t1 - t0) / 1e9),
+            static_cast<double>(t1 - t0) / frames);
+    fprintf(stderr, "  slice-by-4   %7.1f MB/s  %6.1f ns/report\n", mb / ((t2 - t1) / 1e9),
+            static_cast<double>(t2 - t1) / frames);
+    fprintf(stderr, "  patch 3 B    %7s       %6.1f ns/report\n", "", static_cast<double>(t3 - t2) / frames);
+    return ok;
+}
+
+static bool sent_lightbar_is(const sim_packet &packet, uint8_t r, uint8_t g, uint8_t b) {
+    return packet.data.size() > 47 && packet.data[45] == r && packet.data[46] == g && packet.data[47] == b;
+}
+
+// Setters made in one frame leave as one report, unchanged reports stay home, a send that hits full ACL buffers
+// goes out later with the newest state, and the per-controller rate cap spaces the sends.
+static bool run_output_scheduler() {
+    fprintf(stderr, "Output scheduler\n");
+
+    const uint8_t slot = slot_of_remote(0);
+    ISonyGamepad *gamepad = slot != NO_SLOT ? connections[slot].gamepad : nullptr;
+    if (!gamepad) return expect(false, "gamepad registered");
+    const output_slot &out = output_slots[slot];
+    bool ok = true;
+
+    output_set_max_rate(slot, 0);
+    sim_run();
+    sim_clear_sent_packets();
+    gamepad->SetLightbar({1, 2, 3, 0});
+    gamepad->UpdateOutput();
+    gamepad->SetVibration(0x40, 0x80);
+    gamepad->UpdateOutput();
+    gamepad->SetLightbar({4, 5, 6, 0});
+    gamepad->UpdateOutput();
+    sim_run();
+    ok &= expect(sim_sent_packets().size() == 1, "three UpdateOutput calls in one frame produced one send");
+    ok &= expect(sim_sent_packets().size() == 1 && sent_lightbar_is(sim_sent_packets()[0], 4, 5, 6) &&
+                 sim_sent_packets()[0].data[5] == 0x40 && sim_sent_packets()[0].data[6] == 0x80,
+                 "coalesced report carries the latest lightbar and vibration");
+
+    const uint32_t skipped = out.skipped;
+    sim_clear_sent_packets();
+    gamepad->UpdateOutput();
+    sim_run();
+    ok &= expect(sim_sent_packets().empty() && out.skipped == skipped + 1, "unchanged report was not sent");
+
+    const uint32_t retries = out.retries;
+    sim_set_acl_buffers(1, false);
+    sim_inject_acl_full(1);
+    gamepad->SetLightbar({7, 8, 9, 0});
+    gamepad->UpdateOutput();
+    sim_run();
+    ok &= expect(sim_sent_packets().empty() && out.retries == retries + 1, "ACL full send left pending");
+    gamepad->SetLightbar({10, 11, 12, 0});
+    gamepad->UpdateOutput();
+    sim_acl_complete_packets(1);
+    sim_run();
+    ok &= expect(sim_sent_packets().size() == 1 && sent_lightbar_is(sim_sent_packets()[0], 10, 11, 12),
+                 "retry after ACL full sent the newest state");
+    ok &= expect(!sim_packet_buffer_reserved(), "outgoing buffer released after the failed send");
+    sim_set_acl_buffers(4, true);
+
+    constexpr uint32_t rate_hz = 100;
+    output_set_max_rate(slot, rate_hz);
+    sim_clock_advance_us(1000000 / rate_hz);
+    sim_clear_sent_packets();
+    gamepad->SetLightbar({13, 0, 0, 0});
+    gamepad->UpdateOutput();
+    sim_run();
+    gamepad->SetLightbar({14, 0, 0, 0});
+    gamepad->UpdateOutput();
+    sim_run();
+    const auto &sent = sim_sent_packets();
+    sim_clock_advance_us(1000000 / rate_hz - 1);
+    sim_run();
+    const bool held = sent.size() == 1;
+    sim_clock_advance_us(1);
+    sim_run();
+    ok &= expect(held && sent.size() == 2 && sent_lightbar_is(sent[1], 14, 0, 0) &&
+                 sent[1].time_us - sent[0].time_us == 1000000 / rate_hz,
+                 "rate cap delayed the second report to the next interval, to the us");
+
+    // the link drops between the grant and CAN_SEND_NOW: the grant is freed, nothing counted as skipped or sent
+    sim_clock_advance_us(1000000 / rate_hz);
+    const uint32_t skipped_before = out.skipped;
+    const uint32_t sends_before = out.sends;
+    gamepad->SetLightbar({15, 0, 0, 0});
+    gamepad->UpdateOutput();
+    const bool granted = output_in_flight == slot;
+    sim_remote_disconnect(0, ERROR_CODE_CONNECTION_TIMEOUT);
+    sim_run();
+    ok &= expect(granted && output_in_flight != slot && out.skipped == skipped_before && out.sends == sends_before,
+                 "grant of a dropped link released without touching the counters");
+    first_input(0);
+
+    output_set_max_rate(slot, OUTPUT_DEFAULT_MAX_RATE_HZ);
+    return ok;
+}
+
+static bool run_report_path(uint32_t reports) {
+    fprintf(stderr, "Report path (%u reports)\n", reports);
+
+    const uint8_t slot = slot_of_remote(0);
+    ISonyGamepad *gamepad = slot != NO_SLOT ? connections[slot].gamepad : nullptr;
+    if (!gamepad) return expect(false, "gamepad registered");
+
+    bench_samples receive{"l2cap_packet_handler (0x31)"};
+    bench_samples decode{"UpdateInput"};
+    bench_samples output{"UpdateOutput -> l2cap_send"};
+    receive.reserve(reports);
+    decode.reserve(reports);
+    output.reserve(reports / 8 + 1);
+
+    sim_input_state in;
+    uint8_t report[sim_report::size];
+    sim_clear_sent_packets();
+    uint32_t missed_wakeups = 0;
+    uint32_t misread = 0;
+    uint32_t bad_delta = 0;
+    uint64_t start = bench_now_ns();
+
+    for (uint32_t i = 0; i < reports; i++) {
+        in.lx = static_cast<uint8_t>(i);
+        in.ry = static_cast<uint8_t>(255 - i);
+        in.buttons[0] = static_cast<uint8_t>(0x08 | ((i & 0x40) ? sim_report::cross : 0));
+        in.sensor_timestamp += 1333;
+        sim_build_input_report(report, in, static_cast<uint8_t>(i));
+
+        uint64_t t0 = bench_now_ns();
+        sim_send_input_report(0, report);
+        uint64_t t1 = bench_now_ns();
+        input_frame_info frame = {};
+        const uint8_t *view = input_pipeline_wait(0) ? input_pipeline_acquire(slot, frame) : nullptr;
+        if (!view) {
+            missed_wakeups++;
+        } else {
+            if (ds_input_view{view}.left_x() != in.lx) misread++;
+            memcpy(gamepad->GetMutableDeviceContext()->Buffer, view, INPUT_REPORT_SIZE);
+        }
+        gamepad->UpdateInput(frame.delta_time);
+        latency_input_decoded(slot, frame.timestamp_us);
+        uint64_t t2 = bench_now_ns();
+        receive.add(t1 - t0);
+        decode.add(t2 - t1);
+        if (i > 0 && frame.delta_time < 0.0039f) bad_delta++;
+        sim_clock_advance_us(4000);
+
+        if ((i & 7) == 0) {
+            gamepad->SetLightbar({static_cast<uint8_t>(i), 0, 0, 0});
+            uint64_t t3 = bench_now_ns();
+            gamepad->UpdateOutput();
+            sim_run();
+            output.add(bench_now_ns() - t3);
+            log_drain(LOG_DRAIN_ALL);
+        }
+    }
+
+    uint64_t elapsed = bench_now_ns() - start;
+    receive.print(stderr);
+    decode.print(stderr);
+    output.print(stderr);
+    fprintf(stderr, "  throughput: %.0f reports/s (wall clock, including script overhead)\n",
+            reports / (static_cast<double>(elapsed) / 1e9));
+
+    bool ok = expect(missed_wakeups == 0 && input_pipeline_overwritten(slot) == 0,
+                     "every published frame woke the consumer, none overwritten");
+    ok &= expect(bad_delta == 0, "delta time follows the 4 ms report spacing");
+    ok &= expect(misread == 0, "acquired frames read in place match what the pad sent");
+    ok &= expect(sim_sent_packets().size() == output.ns.size(), "every UpdateOutput produced one l2cap_send");
+    uint32_t output_sends = 0;
+    for (const output_slot &out: output_slots) output_sends += out.sends;
+    ok &= expect(sim_get_stats().prepared_sends == output_sends && !sim_packet_buffer_reserved(),
+                 "output reports built in the L2CAP outgoing buffer, none left reserved");
+    ok &= expect(!sim_sent_packets().empty() && sim_sent_packets().back().data[0] == 0xA2,
+                 "output reports carry the HID DATA|OUTPUT header");
+    return ok;
+}
+
+// Q15 tables against the float reference for every raw value and curve, then the per-report cost of both paths.
+static bool run_fixed_input(uint32_t reports) {
+    fprintf(stderr, "Fixed-point input (%u reports)\n", reports);
+    bool ok = true;
+
+    constexpr float stick_deadzone = FIXED_STICK_DEADZONE_Q15 / 32767.0f;
+    float worst = 0.0f;
+    for (fixed_curve curve: {FIXED_CURVE_LINEAR, FIXED_CURVE_QUADRATIC, FIXED_CURVE_CUBIC}) {
+        fixed_input_configure(FIXED_STICK_DEADZONE_Q15, curve, FIXED_TRIGGER_DEADZONE_Q15);
+        for (int raw = 0; raw < 256; raw++) {
+            const float expected = float_stick(static_cast<uint8_t>(raw), stick_deadzone, curve);
+            worst = std::max(worst, std::fabs(q15_to_float(fixed_stick_lut[raw]) - expected));
+        }
+    }
+    fixed_input_configure(FIXED_STICK_DEADZONE_Q15, static_cast<fixed_curve>(FIXED_STICK_CURVE),
+                          FIXED_TRIGGER_DEADZONE_Q15);
+    fprintf(stderr, "  worst stick table error: %.6f\n", worst);
+    ok &= expect(worst < 0.001f, "stick tables match the float deadzone and curves");
+
+    uint8_t report[78];
+    uint32_t seed = 1;
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < 10000; i++) {
+        input_bench_make_report(report, &seed);
+        float_input_state f;
+        fixed_input_state q;
+        float_input_decode(report, f, stick_deadzone, static_cast<fixed_curve>(FIXED_STICK_CURVE),
+                           FIXED_TRIGGER_DEADZONE_Q15 / 32767.0f);
+        fixed_input_decode({report}, q);
+        if (f.buttons != q.buttons || f.touch_count != q.touch_count || std::fabs(q15_to_float(q.l2) - f.l2) > 0.001f ||
+            std::fabs(q15_to_float(q.touch_x) - f.touch_x) > 0.001f ||
+            std::fabs(q15_to_float(q.touch_y) - f.touch_y) > 0.001f) {
+            bad++;
+        }
+    }
+    ok &= expect(bad == 0, "buttons, triggers and touch agree with the float decode");
+
+    const input_bench_result bench = input_bench_run(reports);
+    fprintf(stderr, "  per report: float %.1f cycles, Q15 %.1f cycles (host TSC; on the RP2040 build with "
+                    "-DDUALSENSE_INPUT_BENCH=ON)\n",
+            static_cast<double>(bench.float_cycles) / bench.reports,
+            static_cast<double>(bench.fixed_cycles) / bench.reports);
+    ok &= expect(bench.mismatches == 0, "both paths agree on stick activity");
+    return ok;
+}
+
+// Dirty bits and events of the change detector, then the cost of an unchanged frame.
+static bool run_input_events(uint32_t reports) {
+    fprintf(stderr, "Input events (%u reports)\n", reports);
+    bool ok = true;
+    const uint8_t slot = 0;
+    input_event event;
+    while (input_events_pop(event)) {}
+    input_events_subscribe(INPUT_DIRTY_ALL & ~INPUT_DIRTY_IMU);
+
+    sim_input_state in;
+    uint8_t report[sim_report::size];
+    sim_build_input_report(report, in, 0);
+    ok &= expect(input_events_update(slot, {report}, 100) == (INPUT_DIRTY_ALL & ~INPUT_DIRTY_IMU),
+                 "first frame marks every subscribed field dirty");
+    while (input_events_pop(event)) {}
+
+    in.gyro[0] = 123;
+    in.sensor_timestamp += 1333;
+    sim_build_input_report(report, in, 1);
+    ok &= expect(input_events_update(slot, {report}, 200) == 0 && !input_events_pop(event),
+                 "unchanged frame (IMU not subscribed) is clean and silent");
+
+    in.buttons[0] = static_cast<uint8_t>(0x08 | sim_report::cross);
+    sim_build_input_report(report, in, 2);
+    ok &= expect(input_events_update(slot, {report}, 300) == INPUT_DIRTY_BUTTONS, "cross press marks buttons dirty");
+    ok &= expect(input_events_pop(event) && event.type == INPUT_EVENT_PRESS && event.code == 5 &&
+                 event.timestamp_us == 300 && !input_events_pop(event), "one press event for cross, timestamped");
+    in.buttons[0] = 0x08;
+    sim_build_input_report(report, in, 3);
+    input_events_update(slot, {report}, 400);
+    ok &= expect(input_events_pop(event) && event.type == INPUT_EVENT_RELEASE && event.code == 5, "release event");
+
+    in.lx = 0x82;
+    sim_build_input_report(report, in, 4);
+    ok &= expect(input_events_update(slot, {report}, 500) == INPUT_DIRTY_LEFT_STICK && !input_events_pop(event),
+                 "stick jitter marks the stick dirty without an axis event");
+    in.lx = 0xC0;
+    sim_build_input_report(report, in, 5);
+    input_events_update(slot, {report}, 600);
+    ok &= expect(input_events_pop(event) && event.type == INPUT_EVENT_AXIS && event.code == INPUT_AXIS_LEFT_X &&
+                 event.value == 0xC0 && !input_events_pop(event), "large stick move emits one axis event");
+
+    input_events_subscribe(INPUT_DIRTY_IMU);
+    input_events_update(slot, {report}, 700);
+    in.gyro[0] = 321;
+    sim_build_input_report(report, in, 6);
+    ok &= expect(input_events_update(slot, {report}, 800) == INPUT_DIRTY_IMU && !input_events_pop(event),
+                 "IMU change is a dirty bit only when subscribed");
+
+    input_events_subscribe(INPUT_DIRTY_BUTTONS);
+    const uint32_t dropped = input_events_dropped;
+    for (uint32_t i = 0; i < INPUT_EVENT_QUEUE_CAPACITY + 8; i++) {
+        in.buttons[1] = static_cast<uint8_t>(i & 1 ? sim_report::l1 : 0);
+        sim_build_input_report(report, in, static_cast<uint8_t>(i));
+        input_events_update(slot, {report}, 900 + i);
+    }
+    ok &= expect(input_events_dropped > dropped, "events past the queue capacity are counted as dropped");
+    while (input_events_pop(event)) {}
+
+    input_events_subscribe(INPUT_DIRTY_ALL & ~INPUT_DIRTY_IMU);
+    input_events_update(slot, {report}, 0);
+    uint32_t dirty_frames = 0;
+    const uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < reports; i++) dirty_frames += input_events_update(slot, {report}, i) != 0;
+    const uint64_t elapsed = bench_now_ns() - start;
+    fprintf(stderr, "  unchanged frame: %.1f ns\n", static_cast<double>(elapsed) / reports);
+    ok &= expect(dirty_frames == 0, "repeated frame never reports a change");
+    input_events_subscribe(INPUT_DIRTY_ALL);
+    return ok;
+}
+
+// Zero-heap arena: allocations are aligned and charged to the current subsystem, nothing is handed out past the end
+// or after the seal, and the sizing covers what Gamepad-Core allocates for MAX_NR_GAMEPADS devices.
+static bool run_heap_arena() {
+    fprintf(stderr, "Heap arena\n");
+    bool ok = true;
+    alignas(HEAP_ARENA_ALIGN) uint8_t storage[64];
+    heap_arena arena = {storage, sizeof(storage), 0, {}, HEAP_REGISTRY, false, 0};
+    void *device = heap_arena_alloc(arena, 10);
+    arena.current = HEAP_EFFECTS;
+    void *effect = heap_arena_alloc(arena, 1);
+    ok &= expect(device == storage && effect == storage + 16 && arena.charged[HEAP_REGISTRY] == 16 &&
+                 arena.charged[HEAP_EFFECTS] == 8, "blocks rounded to 8 bytes and charged to their subsystem");
+    ok &= expect(heap_arena_alloc(arena, 48) == nullptr && arena.refused == 1 && heap_arena_alloc(arena, 40),
+                 "a request past the end is refused, the rest still fits");
+    arena.used = 0;
+    arena.sealed = true;
+    ok &= expect(heap_arena_alloc(arena, 1) == nullptr && arena.refused == 2, "nothing allocated after the seal");
+
+    const size_t needed = MAX_NR_GAMEPADS * sizeof(ISonyGamepad) + sizeof(pico_platform) + TRIGGER_EFFECT_SIZE;
+    fprintf(stderr, "  arena %zu bytes for %zu bytes of objects\n", heap_arena_size, needed);
+    ok &= expect(heap_arena_size >= needed + HEAP_ARENA_SLACK, "arena sized for every device, platform and effect");
+    return ok;
+}
+
+// Timelines played one millisecond at a time: holds, fades, steps, and the sleep hint given back to the loop.
+static bool run_output_sequencer() {
+    fprintf(stderr, "Output sequencer\n");
+
+    const uint8_t slot = slot_of_remote(0);
+    ISonyGamepad *gamepad = slot != NO_SLOT ? connections[slot].gamepad : nullptr;
+    if (!gamepad) return expect(false, "gamepad registered");
+    bool ok = true;
+
+    static constexpr output_keyframe envelope[] = {
+        {.at_ms = 0, .fields = OUTPUT_FIELD_LIGHTBAR | OUTPUT_FIELD_RUMBLE, .lightbar = {0xff, 0, 0}, .rumble = {100, 0}},
+        {.at_ms = 250, .fields = OUTPUT_FIELD_RUMBLE, .rumble = {100, 0}},
+        {.at_ms = 400, .fields = OUTPUT_FIELD_RUMBLE, .rumble = {0, 0}},
+    };
+    static constexpr output_keyframe step[] = {
+        {.at_ms = 0, .fields = OUTPUT_FIELD_LIGHTBAR, .lightbar = {0, 0, 0}},
+        {.at_ms = 400, .fields = OUTPUT_FIELD_LIGHTBAR | OUTPUT_FIELD_STEP, .lightbar = {255, 255, 255}},
+    };
+
+    sim_clock_advance_us(1000000);
+    sim_run();
+    sim_clear_sent_packets();
+    const uint32_t start_ms = 1000;
+    output_sequencer_start(slot, envelope, start_ms);
+    uint32_t polls = 0;
+    uint32_t longest_wait_while_fading = 0;
+    uint32_t end_ms = 0;
+    for (uint32_t t = 0; t <= 500 && !end_ms; t++) {
+        const uint32_t wait = output_sequencer_poll(slot, gamepad, start_ms + t);
+        if (wait == OUTPUT_SEQUENCER_IDLE) end_ms = t;
+        if (t > 250 && t < 400) longest_wait_while_fading = std::max(longest_wait_while_fading, wait);
+        polls++;
+        sim_run();
+        sim_clock_advance_us(1000);
+    }
+    const auto &sent = sim_sent_packets();
+    bool decreasing = true;
+    uint32_t during_hold = 0;
+    for (size_t i = 1; i < sent.size(); i++) {
+        if (sent[i].data[5] >= sent[i - 1].data[5]) decreasing = false;
+        if (sent[i].time_us - sent[0].time_us < 250000) during_hold++;
+    }
+    fprintf(stderr, "  envelope: %zu reports, finished after %u ms\n", sent.size(), end_ms);
+    ok &= expect(!sent.empty() && sent_lightbar_is(sent[0], 0xff, 0, 0) && sent[0].data[5] == 100,
+                 "first frame sets lightbar and rumble");
+    ok &= expect(during_hold == 0, "hold keyframe sends nothing new");
+    ok &= expect(decreasing && !sent.empty() && sent.back().data[5] == 0, "rumble fades down to zero");
+    ok &= expect(sent.size() >= 1 + 150 / (1000 / OUTPUT_SEQUENCER_DEFAULT_RATE_HZ) &&
+                 longest_wait_while_fading <= 1000 / OUTPUT_SEQUENCER_DEFAULT_RATE_HZ,
+                 "fade emitted at the sequencer rate");
+    ok &= expect(end_ms == 400 && !output_sequencer_active(slot), "timeline ends at its last keyframe");
+
+    sim_clock_advance_us(1000000);
+    sim_run();
+    sim_clear_sent_packets();
+    output_sequencer_start(slot, step, 2000);
+    ok &= expect(output_sequencer_poll(slot, gamepad, 2000) == 400, "step timeline sleeps until its next keyframe");
+    sim_run();
+    for (uint32_t t = 1; t <= 400; t++) output_sequencer_poll(slot, gamepad, 2000 + t);
+    sim_clock_advance_us(400000);
+    sim_run();
+    ok &= expect(sim_sent_packets().size() == 2 && sent_lightbar_is(sim_sent_packets()[0], 0, 0, 0) &&
+                 sent_lightbar_is(sim_sent_packets()[1], 255, 255, 255),
+                 "step keyframe jumps without a fade");
+    ok &= expect(output_sequencer_poll(slot, gamepad, 2401) == OUTPUT_SEQUENCER_IDLE, "sequencer idle afterwards");
+    return ok;
+}
+
+// Trigger effect builders against the bytes the demo used to fill by hand.
+static bool run_trigger_effects() {
+    fprintf(stderr, "Trigger effects\n");
+    bool ok = true;
+    ok &= expect(trigger_effect_v<trigger_feedback{1, 8}> ==
+                         trigger_effect{0x21, 0xfe, 0x03, 0xf8, 0xff, 0xff, 0x3f, 0x00, 0x00, 0x00},
+                 "feedback (0x21)");
+    ok &= expect(trigger_effect_v<trigger_bow{1, 8, 8, 8}> == trigger_effect{0x22, 0x02, 0x01, 0x3f},
+                 "bow (0x22)");
+    ok &= expect(trigger_effect_v<trigger_gallop{1, 7, 6, 7, 2}> == trigger_effect{0x23, 0x82, 0x00, 0x37, 0x02},
+                 "gallop (0x23)");
+    ok &= expect(trigger_effect_v<trigger_weapon{3, 8, 8}> == trigger_effect{0x25, 0x08, 0x01, 0x07}, "weapon (0x25)");
+    ok &= expect(trigger_effect_v<trigger_vibration{0, 8, 30}> ==
+                         trigger_effect{0x26, 0xff, 0x03, 0xff, 0xff, 0xff, 0x3f, 0x00, 0x00, 30},
+                 "vibration (0x26)");
+    ok &= expect(trigger_effect_v<trigger_machine{7, 9, 3, 8, 10, 4}> ==
+                         trigger_effect{0x27, 0x80, 0x02, 0x3a, 0x0a, 0x04},
+                 "machine (0x27)");
+
+    volatile uint8_t strength = 9;
+    ok &= expect(trigger_weapon{3, 8, strength}.pack() == TRIGGER_EFFECT_OFF,
+                 "out-of-range parameters at run time give the off effect");
+    return ok;
+}
+
+// Bucket bounds of the latency histograms, then the probes filled by the report path.
+static bool run_latency_probes() {
+    fprintf(stderr, "Latency probes\n");
+    bool ok = true;
+
+    uint32_t bad_bucket = 0;
+    for (uint64_t us = 0; us < (1ull << 32); us += 1 + us / 7) {
+        const uint32_t bucket = latency_bucket(static_cast<uint32_t>(us));
+        if (latency_bucket_limit(bucket) < us || (bucket > 0 && latency_bucket_limit(bucket - 1) >= us)) bad_bucket++;
+    }
+    ok &= expect(bad_bucket == 0, "every sample lands in the bucket whose range holds it");
+
+    const latency_histogram &decoded = latency_histograms[LATENCY_DECODED];
+    const latency_histogram &end_to_end = latency_histograms[LATENCY_END_TO_END];
+    ok &= expect(decoded.count > 0 && end_to_end.count > 0, "decode and end-to-end stages recorded");
+    uint32_t output_sends = 0;
+    for (const output_slot &out: output_slots) output_sends += out.sends;
+    ok &= expect(end_to_end.count <= latency_histograms[LATENCY_QUEUED].count &&
+                 latency_histograms[LATENCY_QUEUED].count == output_sends,
+                 "every output report accepted by l2cap_send recorded once");
+    ok &= expect(latency_percentile(end_to_end, 50) <= latency_percentile(end_to_end, 99) &&
+                 latency_percentile(end_to_end, 99) <= end_to_end.max_us, "p50 <= p99 <= max");
+    fprintf(stderr, "  arrival->send p50 %u us, p99 %u us, max %u us (4 ms simulated frame spacing)\n",
+            latency_percentile(end_to_end, 50), latency_percentile(end_to_end, 99), end_to_end.max_us);
+    latency_dump();
+    return ok;
+}
+
+// Deferred records against formatting in place, plus formatting, ordering and overflow accounting.
+static bool run_deferred_log(uint32_t iterations) {
+    fprintf(stderr, "Deferred log (%u records)\n", iterations);
+    log_drain(LOG_DRAIN_ALL);
+
+    bench_samples deferred{"LOG_DEBUG (deferred record)"};
+    bench_samples formatted{"printf (same message)"};
+    deferred.reserve(iterations);
+    formatted.reserve(iterations);
+    for (uint32_t i = 0; i < iterations; i++) {
+        const uint16_t cid = static_cast<uint16_t>(0x40 + (i & 0xF));
+        uint64_t t0 = bench_now_ns();
+        LOG_DEBUG(LOG_L2CAP_SEND_FAILED, cid, 0x57);
+        uint64_t t1 = bench_now_ns();
+        printf("[L2CAP] l2cap_send on CID 0x%04x failed: 0x%02x\n", cid, 0x57);
+        uint64_t t2 = bench_now_ns();
+        deferred.add(t1 - t0);
+        formatted.add(t2 - t1);
+        if (log_rings[LOG_CONTEXT_APP].records.size() == LOG_RING_CAPACITY) log_drain(LOG_DRAIN_ALL);
+    }
+    deferred.print(stderr);
+    formatted.print(stderr);
+    log_drain(LOG_DRAIN_ALL);
+
+    LOG_WARN(LOG_L2CAP_ACL_FULL, 0x0041);
+    const log_record *record = log_rings[LOG_CONTEXT_APP].records.front();
+    char line[128] = {};
+    if (record) log_format(*record, line, sizeof(line));
+    bool ok = expect(strstr(line, " W [L2CAP] CID 0x0041: BTSTACK_ACL_BUFFERS_FULL") != nullptr,
+                     "record formats with level tag and arguments");
+    log_drain(LOG_DRAIN_ALL);
+
+    const uint32_t dropped_before = log_rings[LOG_CONTEXT_APP].dropped.load();
+    for (uint32_t i = 0; i < LOG_RING_CAPACITY + 5; i++) LOG_DEBUG(LOG_OUTPUT_SCHEDULED, i);
+    ok &= expect(log_rings[LOG_CONTEXT_APP].dropped.load() - dropped_before == 5, "overflow counted, not blocked");
+    ok &= expect(log_drain(LOG_DRAIN_ALL) == LOG_RING_CAPACITY, "drain writes every queued record");
+    return ok;
+}
+
+// Producer thread publishes frames filled with their own sequence byte while the consumer decodes; a torn
+// frame would mix two sequence bytes.
+static bool run_handoff_stress(uint32_t frames) {
+    fprintf(stderr, "Input handoff stress (%u frames, producer thread)\n", frames);
+    input_pipeline_init();
+
+    std::thread producer([frames] {
+        uint8_t report[INPUT_REPORT_SIZE];
+        for (uint32_t i = 1; i <= frames; i++) {
+            memset(report, static_cast<uint8_t>(i), sizeof(report));
+            input_pipeline_publish(0, report, time_us_64());
+        }
+    });
+
+    uint32_t torn = 0, consumed = 0, last_sequence = 0;
+    uint8_t snapshot[INPUT_REPORT_SIZE];
+    while (last_sequence < frames) {
+        input_frame_info frame = {};
+        if (!input_pipeline_wait(100) || !input_pipeline_take(0, frame, snapshot)) continue;
+        consumed++;
+        last_sequence = frame.sequence;
+        for (uint8_t byte: snapshot) {
+            if (byte != static_cast<uint8_t>(frame.sequence)) {
+                torn++;
+                break;
+            }
+        }
+    }
+    producer.join();
+
+    fprintf(stderr, "  consumed %u, overwritten %u\n", consumed, input_pipeline_overwritten(0));
+    bool ok = expect(torn == 0, "no torn frames");
+    ok &= expect(consumed + input_pipeline_overwritten(0) == frames, "consumed + overwritten == published");
+    input_pipeline_init();
+    return ok;
+}
+
+// Same check for the core0 -> core1 output ring used in dual-core mode: every item arrives, in order, intact.
+static bool run_ring_stress(uint32_t items) {
+    fprintf(stderr, "Output ring stress (%u items, producer thread)\n", items);
+    struct command {
+        uint32_t sequence;
+        uint8_t report[78];
+    };
+    static spsc_ring<command, 8> ring;
+
+    std::thread producer([items] {
+        command item;
+        for (uint32_t i = 1; i <= items; i++) {
+            item.sequence = i;
+            memset(item.report, static_cast<uint8_t>(i), sizeof(item.report));
+            while (!ring.push(item)) std::this_thread::yield();
+        }
+    });
+
+    uint32_t expected = 1, bad = 0;
+    while (expected <= items) {
+        const command *item = ring.front();
+        if (!item) continue;
+        if (item->sequence != expected || item->report[77] != static_cast<uint8_t>(expected)) bad++;
+        ring.pop();
+        expected++;
+    }
+    producer.join();
+    return expect(bad == 0, "ring delivered every item in order without tearing");
+}
+
+// Inbound 0x31 frames and an output report recorded by the handlers, read back with the parser the replay tool uses
+// from a stream with console text around the records; then a full ring drops records and says how many.
+static bool run_capture(const char *path) {
+    fprintf(stderr, "L2CAP capture\n");
+    const uint8_t slot = slot_of_remote(0);
+    ISonyGamepad *gamepad = slot != NO_SLOT ? connections[slot].gamepad : nullptr;
+    if (!gamepad) return expect(false, "gamepad registered");
+    bool ok = true;
+    const uint16_t cid = sim_local_cid(0, PSM_HID_INTERRUPT);
+
+    std::vector<uint8_t> stream;
+    const auto drain = [&stream] {
+        uint8_t chunk[256];
+        size_t n;
+        while ((n = capture_read(chunk, sizeof(chunk))) != 0) stream.insert(stream.end(), chunk, chunk + n);
+    };
+    const auto text = [&stream](const char *line) { stream.insert(stream.end(), line, line + strlen(line)); };
+
+    sim_run();
+    sim_clear_sent_packets();
+    constexpr uint8_t frames = 8;
+    uint8_t reports[frames][sim_report::size];
+    sim_input_state in;
+    text("[BT] console output before the capture\n");
+    const uint32_t start_us = time_us_32();
+    capture_start();
+    for (uint8_t i = 0; i < frames; i++) {
+        in.lx = static_cast<uint8_t>(i * 30);
+        in.sensor_timestamp = i * 12000;
+        sim_build_input_report(reports[i], in, i);
+        sim_send_input_report(0, reports[i]);
+        if (i == frames / 2) {
+            drain();
+            text("[CAP] text between records\n");
+            // console text printed from the BTstack context in the middle of a record: the reader skips it
+            sim_send_input_report(0, reports[i]);
+            const size_t record_at = stream.size();
+            drain();
+            const char *line = "[LINK] text inside a record\n";
+            stream.insert(stream.begin() + static_cast<ptrdiff_t>(record_at + (stream.size() - record_at) / 2), line,
+                          line + strlen(line));
+            // sync bytes inside a payload, followed by a varint longer than any: not the end of the capture
+            const uint8_t false_sync[] = {CAPTURE_SYNC_0, CAPTURE_SYNC_1, CAPTURE_IN, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                          0xFF};
+            stream.insert(stream.end(), false_sync, false_sync + sizeof(false_sync));
+        }
+        sim_clock_advance_us(4000);
+    }
+    sim_clock_advance_us(output_slots[slot].min_interval_us);
+    gamepad->SetLightbar({0x12, 0x34, 0x56, 0});
+    gamepad->UpdateOutput();
+    sim_run();
+    const uint32_t elapsed_us = time_us_32() - start_us;
+    drain();
+    const uint8_t torn[] = {CAPTURE_SYNC_0, CAPTURE_SYNC_1, CAPTURE_IN, 0x10};
+    stream.insert(stream.end(), torn, torn + sizeof(torn));
+
+    uint32_t counts[CAPTURE_TYPE_COUNT] = {};
+    bool inputs_match = true, output_matches = false, start_valid = false;
+    uint64_t recorded_us = 0;
+    uint32_t torn_records = 0;
+    size_t offset = 0;
+    capture_record record;
+    while (capture_parse(stream.data(), stream.size(), offset, record, &torn_records)) {
+        recorded_us += record.delta_us;
+        if (record.type == CAPTURE_START) {
+            start_valid = record.size == 5 && record.payload[0] == CAPTURE_VERSION &&
+                          capture_get_u32(&record.payload[1]) - start_us < 1000 && record.delta_us == 0;
+        } else if (record.type == CAPTURE_IN) {
+            const uint32_t i = counts[CAPTURE_IN];
+            inputs_match &= i < frames && record.cid == cid && record.size == 1 + sim_report::size &&
+                            record.payload[0] == DS_BT_HID_INPUT &&
+                            memcmp(&record.payload[1], reports[i], sim_report::size) == 0 &&
+                            (i == 0 || record.delta_us >= 4000);
+        } else if (record.type == CAPTURE_OUT) {
+            const auto &sent = sim_sent_packets();
+            output_matches = sent.size() == 1 && record.cid == sent[0].cid && record.size == sent[0].data.size() &&
+                             memcmp(record.payload, sent[0].data.data(), record.size) == 0;
+        }
+        counts[record.type]++;
+    }
+    ok &= expect(start_valid && counts[CAPTURE_START] == 1, "START record carries the version and start time");
+    ok &= expect(counts[CAPTURE_IN] == frames && inputs_match, "every inbound frame recorded byte for byte, in order");
+    ok &= expect(torn_records == 1, "record with console text inside failed its CRC and was skipped");
+    ok &= expect(counts[CAPTURE_OUT] == 1 && output_matches, "the output report recorded as it was sent");
+    ok &= expect(recorded_us >= frames * 4000 && recorded_us <= elapsed_us, "record deltas add up to the run time");
+    ok &= expect(offset == stream.size() - sizeof(torn) && counts[CAPTURE_DROPPED] == 0,
+                 "console text skipped, torn record at the end left unparsed");
+    const size_t recorded_bytes = stream.size();
+
+    // No drain while the pad keeps sending: the ring fills, later frames are counted instead
+    const uint32_t records = capture_records;
+    constexpr uint32_t flood = CAPTURE_RING_SIZE / sim_report::size + 16;
+    for (uint32_t i = 0; i < flood; i++) sim_send_input_report(0, reports[i % frames]);
+    const uint32_t kept = capture_records - records;
+    const uint32_t lost = capture_dropped_total;
+    ok &= expect(lost > 0 && kept + lost >= flood, "records that do not fit the ring are dropped and counted");
+    drain();
+    sim_send_input_report(0, reports[0]);
+    capture_stop();
+    const uint32_t stopped_at = capture_records;
+    sim_send_input_report(0, reports[1]);
+    drain();
+    counts[CAPTURE_DROPPED] = 0;
+    uint32_t dropped = 0, after_drop = 0;
+    while (capture_parse(stream.data(), stream.size(), offset, record)) {
+        if (record.type == CAPTURE_DROPPED) {
+            counts[CAPTURE_DROPPED]++;
+            dropped = capture_get_u32(record.payload);
+        } else if (counts[CAPTURE_DROPPED] && record.type == CAPTURE_IN) {
+            after_drop++;
+        }
+    }
+    ok &= expect(counts[CAPTURE_DROPPED] == 1 && dropped == lost && after_drop == 1 && capture_records == stopped_at,
+                 "DROPPED record with the count ahead of the next frame; nothing after stop");
+    fprintf(stderr, "  %zu bytes for %u frames + 1 output; ring of %u held %u records\n", recorded_bytes, frames,
+            CAPTURE_RING_SIZE, kept);
+
+    if (path) {
+        FILE *out = fopen(path, "wb");
+        ok &= expect(out && fwrite(stream.data(), 1, stream.size(), out) == stream.size() && fclose(out) == 0,
+                     "capture written for dualsense_capture_replay");
+    }
+    return ok;
+}
+
+// Counters of one link fed by the real handlers, signal reads answered by the simulated radio, and the output
+// interval backing off while the link is degraded and coming back once it is clean again.
+static bool run_link_health() {
+    fprintf(stderr, "Link health\n");
+    const uint8_t pad = 0;
+    const uint8_t slot = slot_of_remote(pad);
+    ISonyGamepad *gamepad = slot != NO_SLOT ? connections[slot].gamepad : nullptr;
+    if (!gamepad) return expect(false, "gamepad registered");
+    bool ok = true;
+    const output_slot &out = output_slots[slot];
+    const auto close_window = [] {
+        sim_clock_advance_us(LINK_HEALTH_WINDOW_MS * 1000);
+        sim_run();
+    };
+
+    // frames every 4 ms by the sensor clock; counters 10..29 with 13 and 14 missing, one frame held up 3 ms
+    uint8_t report[sim_report::size];
+    sim_input_state in;
+    const auto send = [&](uint8_t counter, uint32_t extra_delay_us) {
+        in.sensor_timestamp = counter * 4000 * ds_input_view::sensor_ticks_per_us;
+        sim_build_input_report(report, in, counter);
+        sim_clock_advance_us(4000 + extra_delay_us);
+        sim_send_input_report(pad, report);
+    };
+    // a window starts here; earlier tests sent frames without sensor timestamps, 64 steady ones settle the
+    // jitter estimate, and may have left the link backed off, which clean windows undo
+    close_window();
+    for (uint32_t windows = 0; out.backoff && windows < 20; windows++) close_window();
+    const uint32_t window_start_us = time_us_32();
+    for (uint8_t i = 0; i < 64; i++) send(static_cast<uint8_t>(i + 10 - 64), 0);
+    link_health_stats before;
+    bool snapshots_live_only = link_health_snapshot(slot, before);
+    for (uint8_t other = 0; other < MAX_NR_GAMEPADS; other++) {
+        link_health_stats unused;
+        snapshots_live_only &= link_health_snapshot(other, unused) == connections[other].in_use;
+    }
+    ok &= expect(snapshots_live_only, "snapshot of live links only");
+    for (uint8_t counter = 10; counter < 30; counter++) {
+        if (counter == 13 || counter == 14) {
+            in.sensor_timestamp += 8000 * ds_input_view::sensor_ticks_per_us;
+            sim_clock_advance_us(4000);
+            continue;
+        }
+        send(counter, counter == 20 ? 3000 : 0);
+    }
+    report[20] ^= 0x01;
+    sim_send_input_report(pad, report);
+    link_health_stats after;
+    link_health_snapshot(slot, after);
+    ok &= expect(after.frames == before.frames + 18 && after.sequence_gaps == before.sequence_gaps + 2,
+                 "frames counted, two missing by the report counter");
+    ok &= expect(after.crc_failures == before.crc_failures + 1, "corrupt frame counted as a CRC failure");
+    ok &= expect(after.jitter_us > before.jitter_us + 50 && after.jitter_us < 500,
+                 "a frame held up 3 ms raises the jitter estimate");
+
+    // 2 of 20 frames lost: the window is degraded and the interval doubles; the weak signal read at the same time
+    // keeps it degrading
+    sim_set_remote_signal(pad, -20, 150);
+    const uint32_t reads = sim_get_stats().signal_reads;
+    sim_clock_advance_us(LINK_HEALTH_WINDOW_MS * 1000 + 1000 - (time_us_32() - window_start_us));
+    sim_run();
+    link_health_snapshot(slot, after);
+    ok &= expect(after.frames_per_sec >= 80 && after.frames_per_sec <= 82, "frame rate over the window");
+    ok &= expect(sim_get_stats().signal_reads == reads + 2 && after.rssi == -20 && after.link_quality == 150,
+                 "RSSI and link quality read for the link");
+    ok &= expect(after.backoff == 1 && output_interval_us(out) == 2 * out.min_interval_us,
+                 "lossy window: output interval doubled");
+    close_window();
+    close_window();
+    close_window();
+    link_health_snapshot(slot, after);
+    ok &= expect(after.backoff == LINK_HEALTH_MAX_BACKOFF, "weak signal: backoff up to its limit");
+
+    // the scheduler holds a changed report back for the longer interval
+    gamepad->SetLightbar({0x10, 0x20, 0x30, 0});
+    gamepad->UpdateOutput();
+    sim_run();
+    sim_clear_sent_packets();
+    sim_clock_advance_us(out.min_interval_us);
+    gamepad->SetLightbar({0x11, 0x21, 0x31, 0});
+    gamepad->UpdateOutput();
+    sim_run();
+    const bool held = sim_sent_packets().empty();
+    sim_clock_advance_us(output_interval_us(out) - out.min_interval_us);
+    sim_run();
+    ok &= expect(held && sim_sent_packets().size() == 1, "output sent at the backed-off rate");
+
+    sim_set_remote_signal(pad, 0, 255);
+    close_window();
+    uint32_t windows = 0;
+    while (out.backoff && windows < 20) {
+        close_window();
+        windows++;
+    }
+    ok &= expect(out.backoff == 0 && windows == LINK_HEALTH_MAX_BACKOFF * LINK_HEALTH_RECOVER_WINDOWS,
+                 "clean windows step the interval back");
+
+    // an ACL-full retry degrades the next window
+    link_health_snapshot(slot, before);
+    sim_clock_advance_us(out.min_interval_us);
+    sim_inject_acl_full(1);
+    gamepad->SetLightbar({0x12, 0x22, 0x32, 0});
+    gamepad->UpdateOutput();
+    sim_run();
+    link_health_snapshot(slot, after);
+    ok &= expect(after.output_acl_full == before.output_acl_full + 1 && after.output_sends == before.output_sends + 1,
+                 "ACL-full retry and the send after it counted");
+    close_window();
+    ok &= expect(out.backoff == 1, "ACL-full window backs off");
+    for (uint32_t i = 0; i < LINK_HEALTH_RECOVER_WINDOWS; i++) close_window();
+    ok &= expect(out.backoff == 0, "and recovers");
+    link_health_print(slot, after);
+    return ok;
+}
+
+// Both report mappings of the USB HID bridge, then what it adds to each frame on the way to the USB endpoint.
+static bool run_usb_bridge(uint32_t reports) {
+    fprintf(stderr, "USB HID bridge (%u reports)\n", reports);
+    const uint8_t pad = 0;
+    const uint8_t slot = slot_of_remote(pad);
+    ISonyGamepad *gamepad = slot != NO_SLOT ? connections[slot].gamepad : nullptr;
+    if (!gamepad) return expect(false, "gamepad registered");
+    const usb_bridge_slot &bridge = usb_bridge_slots[slot];
+    const output_slot &out = output_slots[slot];
+    bool ok = true;
+
+    // d-pad down-right, cross, triangle, R1, options, PS, mute
+    sim_input_state in;
+    in.lx = 0x11;
+    in.ly = 0x22;
+    in.rx = 0x33;
+    in.ry = 0x44;
+    in.l2 = 0x55;
+    in.r2 = 0x66;
+    in.buttons[0] = 0x03 | sim_report::cross | sim_report::triangle;
+    in.buttons[1] = sim_report::r1 | sim_report::options;
+    in.buttons[2] = 0x01 | 0x04;
+    uint8_t report[sim_report::size];
+    sim_build_input_report(report, in, 0x5A);
+    uint8_t usb[USB_BRIDGE_INPUT_SIZE];
+    usb_bridge_translate_input({report}, usb);
+    const uint8_t expected[USB_BRIDGE_INPUT_SIZE] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x03, 0x2A, 0x52, 0x5A};
+    ok &= expect(memcmp(usb, expected, sizeof(usb)) == 0, "0x31 frame translated to the HID input report");
+
+    // through the pipeline: a frame the endpoint had no room for is replaced by the next one
+    const uint32_t delivered = latency_histograms[LATENCY_USB_DELIVERED].count;
+    input_frame_info frame = {};
+    for (uint8_t counter = 0x5B; counter < 0x5D; counter++) {
+        sim_build_input_report(report, in, counter);
+        sim_send_input_report(pad, report);
+        const uint8_t *view = input_pipeline_wait(0) ? input_pipeline_acquire(slot, frame) : nullptr;
+        if (view) usb_bridge_stage_input(slot, {view}, static_cast<uint32_t>(frame.timestamp_us));
+    }
+    const uint8_t *taken = usb_bridge_take_input(slot);
+    ok &= expect(taken && taken[9] == 0x5C && bridge.replaced == 1 && !usb_bridge_take_input(slot),
+                 "endpoint gets the newest frame, the one it missed counted as replaced");
+    sim_clock_advance_us(1000);
+    usb_bridge_input_delivered(slot);
+    ok &= expect(bridge.forwarded == 1 && latency_histograms[LATENCY_USB_DELIVERED].count == delivered + 1 &&
+                 latency_histograms[LATENCY_USB_DELIVERED].max_us >= 1000,
+                 "host poll records arrival -> USB latency");
+    usb_bridge_release(slot);
+    taken = usb_bridge_take_input(slot);
+    usb_bridge_neutral_input(usb);
+    ok &= expect(taken && memcmp(taken, usb, sizeof(usb)) == 0 && taken[6] == 8 && taken[0] == 0x80,
+                 "released slot sends one neutral report");
+    usb_bridge_release(slot);
+    ok &= expect(!usb_bridge_take_input(slot), "and only one");
+
+    // output: lightbar, rumble, a gallop on the left trigger and an unknown mode on the right
+    uint8_t output[USB_BRIDGE_OUTPUT_SIZE] = {USB_BRIDGE_OUT_LIGHTBAR | USB_BRIDGE_OUT_RUMBLE |
+                                              USB_BRIDGE_OUT_LEFT_TRIGGER | USB_BRIDGE_OUT_RIGHT_TRIGGER,
+                                              0x21, 0x42, 0x63, 0x30, 0x90};
+    constexpr trigger_effect gallop = trigger_effect_v<trigger_gallop{1, 7, 6, 7, 2}>;
+    memcpy(&output[6], gallop.data(), TRIGGER_EFFECT_SIZE);
+    output[16] = 0x99;
+    ok &= expect(!usb_bridge_stage_output(slot, output, USB_BRIDGE_OUTPUT_SIZE - 1) && bridge.rejected == 1,
+                 "short output report rejected");
+    sim_clock_advance_us(output_interval_us(out));
+    sim_run();
+    sim_clear_sent_packets();
+    usb_bridge_stage_output(slot, output, USB_BRIDGE_OUTPUT_SIZE);
+    usb_bridge_apply_pending(slot, gamepad);
+    sim_run();
+    const auto &sent = sim_sent_packets();
+    ok &= expect(sent.size() == 1 && sent_lightbar_is(sent[0], 0x21, 0x42, 0x63) && sent[0].data[5] == 0x30 &&
+                 sent[0].data[6] == 0x90, "lightbar and rumble from the host reached the controller");
+    ok &= expect(sent.size() == 1 && memcmp(&sent[0].data[23], gallop.data(), TRIGGER_EFFECT_SIZE) == 0 &&
+                 sent[0].data[12] == TRIGGER_MODE_OFF, "left trigger effect applied, unknown right mode turned off");
+    sim_clear_sent_packets();
+    output[0] = 0;
+    usb_bridge_stage_output(slot, output, USB_BRIDGE_OUTPUT_SIZE);
+    usb_bridge_apply_pending(slot, gamepad);
+    usb_bridge_stage_output(slot, output, USB_BRIDGE_OUTPUT_SIZE);
+    usb_bridge_apply_pending(slot, nullptr);
+    sim_run();
+    ok &= expect(sim_sent_packets().empty() && bridge.outputs == 1 && bridge.rejected == 2,
+                 "report without flags sends nothing, one for a slot without controller is dropped");
+
+    // arrival -> report ready for the endpoint, and the bridge's share of it
+    bench_samples path{"arrival -> USB endpoint"};
+    bench_samples translate{"stage + take (bridge only)"};
+    path.reserve(reports);
+    translate.reserve(reports);
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < reports; i++) {
+        in.lx = static_cast<uint8_t>(i);
+        in.buttons[0] = static_cast<uint8_t>((i & 7) | ((i & 0x10) ? sim_report::square : 0));
+        sim_build_input_report(report, in, static_cast<uint8_t>(i));
+        const uint64_t t0 = bench_now_ns();
+        sim_send_input_report(pad, report);
+        const uint8_t *view = input_pipeline_wait(0) ? input_pipeline_acquire(slot, frame) : nullptr;
+        const uint64_t t1 = bench_now_ns();
+        if (view) usb_bridge_stage_input(slot, {view}, static_cast<uint32_t>(frame.timestamp_us));
+        taken = usb_bridge_take_input(slot);
+        const uint64_t t2 = bench_now_ns();
+        path.add(t2 - t0);
+        translate.add(t2 - t1);
+        if (!taken || taken[0] != in.lx || taken[6] != (i & 7) || (taken[7] & 0x01) != ((i & 0x10) != 0)) {
+            mismatches++;
+        }
+        sim_clock_advance_us(4000);
+        usb_bridge_input_delivered(slot);
+    }
+    path.print(stderr);
+    translate.print(stderr);
+    ok &= expect(mismatches == 0, "every frame reached the endpoint with its own sticks, hat and buttons");
+    ok &= expect(latency_histograms[LATENCY_USB_DELIVERED].count == delivered + 1 + reports,
+                 "every delivered report recorded its latency");
+    return ok;
+}
+
+// Action mapping: the table holds each binding under its buttons and sources, press and release fire once per
+// edge, a same-frame chord suppresses its parts, and an unchanged frame costs next to nothing.
+static uint32_t action_test_counts[8];
+
+template<uint8_t Index>
+static void action_test_count(const action_context &context) {
+    (void)context;
+    action_test_counts[Index]++;
+}
+
+static constexpr action_binding action_test_bindings[] = {
+    on_chord(FIXED_BUTTON_CROSS, action_call(action_test_count<0>), "cross"),
+    on_chord(FIXED_BUTTON_L1, action_call(action_test_count<1>), "L1"),
+    on_chord(FIXED_BUTTON_R1, action_call(action_test_count<2>), "R1"),
+    on_chord(FIXED_BUTTON_L1 | FIXED_BUTTON_R1, action_call(action_test_count<3>), "L1+R1"),
+    on_chord(FIXED_BUTTON_CROSS, action_call(action_test_count<4>), "cross up", ACTION_ON_RELEASE),
+    on_chord(FIXED_BUTTON_CROSS, action_event(7), "cross event"),
+    on_source(ACTION_SOURCE_LEFT_STICK, 13, action_call(action_test_count<5>), "left stick", ACTION_WHILE_HELD),
+    on_source(ACTION_SOURCE_TOUCH, 1, action_call(action_test_count<6>), "touch"),
+    on_source(ACTION_SOURCE_R2, 100, action_call(action_test_count<7>), "R2"),
+};
+
+static_assert(action_bindings_valid(action_test_bindings), "action binding: chord must be non-empty button bits");
+static constexpr auto action_test_table = action_table_build(action_test_bindings);
+static_assert(action_test_table.by_button[5] == ((1u << 0) | (1u << 4) | (1u << 5)), "cross bindings under cross");
+static_assert(action_test_table.by_button[8] == ((1u << 1) | (1u << 3)), "L1 and the chord under L1");
+static_assert(action_test_table.covered[3] == ((1u << 1) | (1u << 2)), "the chord covers L1 and R1");
+static_assert(action_test_table.by_dirty[1] == (1u << 6) && action_test_table.by_dirty[4] == (1u << 7) &&
+              action_test_table.by_dirty[3] == (1u << 8), "stick, touch and trigger bindings under their sources");
+
+static bool run_action_map(uint32_t reports) {
+    fprintf(stderr, "Action map (%u reports)\n", reports);
+    bool ok = true;
+    const uint8_t slot = 0;
+    input_event event;
+    while (input_events_pop(event)) {}
+    input_events_subscribe(INPUT_DIRTY_ALL & ~INPUT_DIRTY_IMU);
+    input_events_reset(slot);
+    action_map_reset(slot);
+    memset(action_test_counts, 0, sizeof(action_test_counts));
+
+    sim_input_state in;
+    uint8_t report[sim_report::size];
+    uint8_t counter = 0;
+    uint32_t fired = 0;
+    bool touching = false;
+    auto frame = [&]() {
+        sim_build_input_report(report, in, counter++);
+        if (touching) report[sim_report::offset + 32] = 0x05;
+        const uint16_t dirty = input_events_update(slot, {report}, counter);
+        fired = action_dispatch(action_test_table, dirty, {slot, nullptr, counter, 0,
+                                                          &input_change_slots[slot].last});
+    };
+    auto counts_are = [&](uint32_t cross, uint32_t l1, uint32_t r1, uint32_t chord, uint32_t cross_up) {
+        return action_test_counts[0] == cross && action_test_counts[1] == l1 && action_test_counts[2] == r1 &&
+               action_test_counts[3] == chord && action_test_counts[4] == cross_up;
+    };
+
+    frame();
+    ok &= expect(fired == 0 && counts_are(0, 0, 0, 0, 0), "first frame with nothing held fires nothing");
+    in.buttons[0] = static_cast<uint8_t>(0x08 | sim_report::cross);
+    frame();
+    ok &= expect(fired == ((1u << 0) | (1u << 5)) && counts_are(1, 0, 0, 0, 0),
+                 "cross press runs both of its bindings");
+    bool action_event_seen = false;
+    while (input_events_pop(event)) action_event_seen |= event.type == INPUT_EVENT_ACTION && event.code == 7;
+    ok &= expect(action_event_seen, "action_event() binding queued its event");
+    in.r2 = 50;
+    frame();
+    frame();
+    ok &= expect(counts_are(1, 0, 0, 0, 0) && action_test_counts[7] == 0, "held cross does not fire again");
+    in.buttons[0] = 0x08;
+    frame();
+    ok &= expect(fired == (1u << 4) && counts_are(1, 0, 0, 0, 1), "cross release fires the release binding");
+
+    in.buttons[1] = sim_report::l1 | sim_report::r1;
+    frame();
+    ok &= expect(fired == (1u << 3) && counts_are(1, 0, 0, 1, 1), "same-frame L1+R1 runs the chord, not its parts");
+    in.buttons[1] = 0;
+    frame();
+    in.buttons[1] = sim_report::l1;
+    frame();
+    in.buttons[1] = sim_report::l1 | sim_report::r1;
+    frame();
+    ok &= expect(counts_are(1, 1, 0, 2, 1), "L1 then R1: L1 on its own, then the chord instead of R1");
+    in.buttons[1] = sim_report::l1;
+    frame();
+    in.buttons[1] = sim_report::l1 | sim_report::r1;
+    frame();
+    ok &= expect(counts_are(1, 1, 0, 3, 1), "R1 again while L1 is held completes the chord again");
+    in.buttons[1] = 0;
+    frame();
+
+    in.lx = 0xA0;
+    frame();
+    in.lx = 0xB0;
+    frame();
+    ok &= expect(action_test_counts[5] == 2, "deflected stick fires on every frame it moves");
+    frame();
+    ok &= expect(action_test_counts[5] == 2 && fired == 0, "but not on a frame where it did not");
+    in.lx = 0x88;
+    frame();
+    ok &= expect(action_test_counts[5] == 2, "nor inside the threshold");
+
+    touching = true;
+    frame();
+    in.r2 = 101;
+    frame();
+    touching = false;
+    frame();
+    ok &= expect(action_test_counts[6] == 1 && action_test_counts[7] == 1, "touch and R2 press once each");
+
+    // constant time per frame: unchanged frames, and frames toggling cross
+    bench_samples unchanged{"frame, nothing changed"};
+    bench_samples changed{"frame, cross toggling"};
+    unchanged.reserve(reports);
+    changed.reserve(reports);
+    const action_context context = {slot, nullptr, 0, 0, &input_change_slots[slot].last};
+    sim_build_input_report(report, in, counter);
+    for (uint32_t i = 0; i < reports; i++) {
+        const uint64_t t0 = bench_now_ns();
+        const uint16_t dirty = input_events_update(slot, {report}, i);
+        fired |= action_dispatch(action_test_table, dirty, context);
+        unchanged.add(bench_now_ns() - t0);
+    }
+    ok &= expect(fired == 0, "unchanged frames fire nothing");
+    const uint32_t presses = action_test_counts[0];
+    for (uint32_t i = 0; i < reports; i++) {
+        in.buttons[0] = static_cast<uint8_t>(0x08 | ((i & 1) ? 0 : sim_report::cross));
+        sim_build_input_report(report, in, static_cast<uint8_t>(i));
+        const uint64_t t0 = bench_now_ns();
+        const uint16_t dirty = input_events_update(slot, {report}, i);
+        action_dispatch(action_test_table, dirty, context);
+        changed.add(bench_now_ns() - t0);
+        if (!(i & 63)) while (input_events_pop(event)) {}
+    }
+    while (input_events_pop(event)) {}
+    unchanged.print(stderr);
+    changed.print(stderr);
+    ok &= expect(action_test_counts[0] - presses == (reports + 1) / 2, "one press action per cross press");
+    input_events_subscribe(INPUT_DIRTY_ALL);
+    return ok;
+}
+
+// Haptic audio: a stream starts after the prefill, keeps the 3 kHz packet cadence without drifting while 0x31
+// output reports go out in between, sends silence on underrun and then stops; the cost of a packet is timed.
+static bool run_haptic_audio(uint32_t reports) {
+    fprintf(stderr, "Haptic audio (%u reports)\n", reports);
+    const uint8_t pad = 0;
+    const uint8_t slot = slot_of_remote(pad);
+    ISonyGamepad *gamepad = slot != NO_SLOT ? connections[slot].gamepad : nullptr;
+    if (!gamepad) return expect(false, "gamepad registered");
+    const haptic_audio_stats &stats = haptic_audio_slots[slot].stats;
+    bool ok = true;
+    const auto is_haptic = [](const sim_packet &p) {
+        return p.data.size() == 1 + HAPTIC_AUDIO_REPORT_SIZE && p.data[0] == DS_BT_HID_OUTPUT &&
+               p.data[1] == HAPTIC_AUDIO_REPORT_ID;
+    };
+    const auto run_ms = [](uint32_t ms) {
+        for (uint32_t i = 0; i < ms; i++) {
+            sim_clock_advance_us(1000);
+            sim_run();
+        }
+    };
+    int8_t packet[HAPTIC_AUDIO_PACKET_BYTES];
+
+    sim_run();
+    sim_clear_sent_packets();
+    ok &= expect(haptic_audio_write(slot, packet, 1) == 0, "nothing is taken before the device is initialized");
+    // the BTstack side looks for open streams every HAPTIC_AUDIO_IDLE_POLL_MS while none is
+    pico_w_platform_policy::InitializeAudioDevice(gamepad->GetMutableDeviceContext());
+    run_ms(HAPTIC_AUDIO_IDLE_POLL_MS);
+    for (uint8_t i = 0; i < HAPTIC_AUDIO_PACKET_BYTES; i++) packet[i] = static_cast<int8_t>(i - 32);
+    haptic_audio_write(slot, packet, HAPTIC_AUDIO_PACKET_FRAMES);
+    run_ms(30);
+    ok &= expect(sim_sent_packets().empty(), "one packet is below the prefill: nothing sent");
+    haptic_audio_write(slot, packet, HAPTIC_AUDIO_PACKET_FRAMES / 2);
+    pico_w_platform_policy::ProcessAudioHaptic(gamepad->GetMutableDeviceContext());
+    run_ms(HAPTIC_AUDIO_PERIOD_US / 1000 + 1);
+    const auto &sent = sim_sent_packets();
+    ok &= expect(sent.size() == 1 && is_haptic(sent[0]) &&
+                 memcmp(&sent[0].data[1 + HAPTIC_AUDIO_SAMPLES_OFFSET], packet, sizeof(packet)) == 0,
+                 "prefilled stream sends its first packet as report 0x32");
+    ok &= expect(sent.size() == 1 && ds_bt_crc(DS_BT_HID_OUTPUT, &sent[0].data[1], HAPTIC_AUDIO_REPORT_SIZE) ==
+                 ds_bt_stored_crc(&sent[0].data[1], HAPTIC_AUDIO_REPORT_SIZE), "haptic report carries its CRC");
+    run_ms(HAPTIC_AUDIO_PERIOD_US / 1000 + 1);
+    ok &= expect(sent.size() == 2 && is_haptic(sent[1]) && sent[1].data[2] == 0x10 &&
+                 sent[1].data[1 + HAPTIC_AUDIO_SAMPLES_OFFSET + HAPTIC_AUDIO_PACKET_FRAMES] == 0 &&
+                 sent[1].data[1 + HAPTIC_AUDIO_SAMPLES_OFFSET] == static_cast<uint8_t>(-32),
+                 "flushed half packet follows, sequence tag 1, padded with silence");
+    const uint32_t silent = stats.silent;
+    const uint32_t stalls = stats.stalls;
+    run_ms(10 * HAPTIC_AUDIO_PERIOD_US / 1000);
+    ok &= expect(sent.size() == 2 + HAPTIC_AUDIO_UNDERRUN_PACKETS &&
+                 stats.silent == silent + HAPTIC_AUDIO_UNDERRUN_PACKETS && stats.stalls == stalls + 1,
+                 "underrun: silence for a few packets, then the stream stops");
+
+    // producer ahead of the schedule: the ring fills and the write comes back short
+    uint32_t taken = 0;
+    for (uint32_t i = 0; i <= HAPTIC_AUDIO_RING_PACKETS; i++) {
+        taken += haptic_audio_write(slot, packet, HAPTIC_AUDIO_PACKET_FRAMES);
+    }
+    ok &= expect(taken == HAPTIC_AUDIO_RING_PACKETS * HAPTIC_AUDIO_PACKET_FRAMES && haptic_audio_space(slot) == 0,
+                 "a full ring refuses further frames");
+
+    // one second of stream next to 0x31 reports at the default rate; the producer tops the ring up every 5 ms
+    sim_clear_sent_packets();
+    const uint32_t resyncs = stats.resyncs;
+    int16_t pcm[2 * HAPTIC_AUDIO_PACKET_FRAMES];
+    for (uint32_t i = 0; i < 2 * HAPTIC_AUDIO_PACKET_FRAMES; i++) pcm[i] = static_cast<int16_t>(i * 512 - 16384);
+    for (uint32_t ms = 0; ms < 1000; ms++) {
+        if (ms % 5 == 0) {
+            while (haptic_audio_space(slot) >= HAPTIC_AUDIO_PACKET_FRAMES) {
+                haptic_audio_write_pcm16(slot, pcm, HAPTIC_AUDIO_PACKET_FRAMES);
+            }
+        }
+        if (ms % 4 == 0) {
+            gamepad->SetLightbar({static_cast<uint8_t>(ms), 0, 0, 0});
+            gamepad->UpdateOutput();
+        }
+        run_ms(1);
+    }
+    std::vector<uint64_t> haptic_us;
+    uint32_t output_reports = 0;
+    const sim_packet *last = nullptr;
+    for (const sim_packet &p : sent) {
+        if (!is_haptic(p)) {
+            output_reports += p.data[1] == 0x31;
+            continue;
+        }
+        haptic_us.push_back(p.time_us);
+        last = &p;
+    }
+    // the ring still held the int8 packets written above; the last packets are the PCM ones
+    const bool pcm_reduced = last && static_cast<int8_t>(last->data[1 + HAPTIC_AUDIO_SAMPLES_OFFSET]) == -64 &&
+                             static_cast<int8_t>(last->data[1 + HAPTIC_AUDIO_SAMPLES_OFFSET + 63]) == 62;
+    // packet n leaves at start + n periods, give or take the 1 ms of timer resolution and of the simulation step
+    uint64_t worst_offset_us = 0;
+    for (size_t n = 0; n < haptic_us.size(); n++) {
+        const int64_t offset = static_cast<int64_t>(haptic_us[n] - haptic_us[0]) -
+                               static_cast<int64_t>(haptic_audio_packet_offset_us(static_cast<uint32_t>(n)));
+        worst_offset_us = std::max<uint64_t>(worst_offset_us, static_cast<uint64_t>(offset < 0 ? -offset : offset));
+    }
+    fprintf(stderr, "  1 s of stream: %zu haptic packets, %u output reports, worst offset from schedule %llu us\n",
+            haptic_us.size(), output_reports, static_cast<unsigned long long>(worst_offset_us));
+    ok &= expect(haptic_us.size() >= 93 && haptic_us.size() <= 95 && worst_offset_us <= 2000 &&
+                 stats.resyncs == resyncs, "3000 Hz / 32 frames: ~94 packets per second on schedule");
+    // earlier tests may have left the link backed off; the output rate limit is whatever it enforces now
+    const uint32_t interval_us = std::max<uint32_t>(output_interval_us(output_slots[slot]), 4000);
+    ok &= expect(output_reports >= 900000 / interval_us, "output reports kept flowing between the haptic packets");
+    ok &= expect(pcm_reduced, "16-bit PCM reduced to its high byte");
+
+    // a full ACL buffer holds the packet back for the next CAN_SEND_NOW instead of losing it; the last 0x31
+    // report goes out first so the failure falls on a haptic packet
+    run_ms(interval_us / 1000 + 1);
+    const uint32_t acl_full = stats.acl_full;
+    const uint32_t packets = stats.packets;
+    sim_set_acl_buffers(1, false);
+    sim_inject_acl_full(1);
+    run_ms(HAPTIC_AUDIO_PERIOD_US / 1000 + 1);
+    ok &= expect(stats.acl_full == acl_full + 1 && stats.packets == packets, "ACL full send left due");
+    sim_acl_complete_packets(1);
+    sim_run();
+    ok &= expect(stats.packets == packets + 1 && !sim_packet_buffer_reserved(), "retry sent the packet");
+    sim_set_acl_buffers(4, true);
+
+    // CPU per packet: the producer's write of 32 frames, and building the report with its CRC
+    bench_samples write{"write 32 frames (pcm16)"};
+    bench_samples build{"build report + CRC"};
+    write.reserve(reports);
+    build.reserve(reports);
+    haptic_audio_close(slot);
+    run_ms(20 * HAPTIC_AUDIO_PERIOD_US / 1000);
+    pico_w_platform_policy::InitializeAudioDevice(gamepad->GetMutableDeviceContext());
+    uint8_t report[HAPTIC_AUDIO_REPORT_SIZE];
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < reports; i++) {
+        pcm[0] = static_cast<int16_t>(i << 8);
+        const uint64_t t0 = bench_now_ns();
+        haptic_audio_write_pcm16(slot, pcm, HAPTIC_AUDIO_PACKET_FRAMES);
+        const uint64_t t1 = bench_now_ns();
+        haptic_audio_build(slot, report);
+        const uint64_t t2 = bench_now_ns();
+        write.add(t1 - t0);
+        build.add(t2 - t1);
+        mismatches += report[HAPTIC_AUDIO_SAMPLES_OFFSET] != static_cast<uint8_t>(i);
+        haptic_audio_slots[slot].ring.pop();
+    }
+    write.print(stderr);
+    build.print(stderr);
+    ok &= expect(mismatches == 0, "every packet built from its own samples");
+    haptic_audio_close(slot);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint32_t reports = 100000;
+    bool quiet = false;
+    const char *capture_path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quiet") == 0) quiet = true;
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) capture_path = argv[++i];
+        else reports = static_cast<uint32_t>(strtoul(argv[i], nullptr, 10));
+    }
+    // Firmware logging goes to stdout; results go to stderr so they survive --quiet
+    if (quiet && !freopen("/dev/null", "w", stdout)) return 1;
+
+    stdio_init_all();
+    cyw43_arch_init();
+    sim_reset();
+    flash_bonds_init();
+    input_pipeline_init();
+
+    IPlatformHardwareInfo::SetInstance(std::make_unique<pico_platform>());
+
+    auto &registry = policy_device::get_instance();
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        FDeviceContext Context = {};
+        Context.Path = "Bluetooth";
+        Context.IsConnected = false;
+        Context.DeviceType = EDSDeviceType::DualSense;
+        Context.ConnectionType = EDSDeviceConnection::Bluetooth;
+        registry.CreateDevice(Context);
+        connection_bind_gamepad(slot, registry.GetLibrary(slot));
+    }
+    trigger_effects_init();
+
+    bool ok = run_handoff_stress(reports);
+    ok &= run_ring_stress(reports);
+    ok &= run_bond_journal(2000);
+    ok &= run_deferred_log(reports);
+    ok &= run_fixed_input(reports);
+    ok &= run_connection_script();
+    ok &= run_reconnect();
+    ok &= run_link_profile();
+    ok &= run_calibration();
+    ok &= run_imu_fusion(reports);
+    ok &= run_multi_controller();
+    ok &= run_output_scheduler();
+    ok &= run_crc32(reports);
+    ok &= run_report_path(reports);
+    ok &= run_latency_probes();
+    ok &= run_input_events(reports);
+    ok &= run_trigger_effects();
+    ok &= run_output_sequencer();
+    ok &= run_heap_arena();
+    ok &= run_capture(capture_path);
+    ok &= run_link_health();
+    ok &= run_usb_bridge(reports);
+    ok &= run_action_map(reports);
+    ok &= run_haptic_audio(reports);
+
+    const sim_stats &stats = sim_get_stats();
+    fprintf(stderr, "Simulator: %u HCI events, %u L2CAP events, %u data packets, %u sends, %u ACL full, "
+                    "%u flash erases\n",
+            stats.hci_events, stats.l2cap_events, stats.data_packets, stats.sends, stats.acl_buffers_full,
+            stats.flash_erases);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+// Small timing helpers shared by the host scenario and benchmarks.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct bench_samples {
+    const char *name;
+    std::vector<uint32_t> ns;
+
+    void reserve(size_t count) { ns.reserve(count); }
+
+    void add(uint64_t sample_ns) { ns.push_back(static_cast<uint32_t>(std::min<uint64_t>(sample_ns, UINT32_MAX))); }
+
+    void print(FILE *out = stdout) {
+        if (ns.empty()) {
+            fprintf(out, "  %-28s (no samples)\n", name);
+            return;
+        }
+        std::vector<uint32_t> sorted = ns;
+        std::sort(sorted.begin(), sorted.end());
+        uint64_t total = 0;
+        for (uint32_t v: sorted) total += v;
+        fprintf(out, "  %-28s n=%-8zu avg=%7.1f ns  p50=%6u ns  p99=%6u ns  max=%7u ns\n", name, sorted.size(),
+               static_cast<double>(total) / sorted.size(), sorted[sorted.size() / 2], sorted[sorted.size() * 99 / 100],
+               sorted.back());
+    }
+};
+
+inline uint64_t bench_now_ns() {
+    using namespace std::chrono;
+    return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+// Keeps the optimiser from discarding benchmark results.
+template<typename T>
+inline void bench_keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
@@ -0,0 +1,759 @@
+#include "btstack_sim.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <deque>
+
+#include "btstack_event.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+#include "l2cap.h"
+#include "pico/cyw43_arch.h"
+#include "pico/time.h"
+
+#include "dualsense_report.h"
+
+const hci_cmd_t hci_create_connection = {0x0405, "B21121"};
+const hci_cmd_t hci_link_key_request_reply = {0x040B, "BP"};
+const hci_cmd_t hci_link_key_request_negative_reply = {0x040C, "B"};
+const hci_cmd_t hci_pin_code_request_reply = {0x040D, "B1P"};
+const hci_cmd_t hci_user_confirmation_request_reply = {0x042C, "B"};
+const hci_cmd_t hci_user_passkey_request_reply = {0x042E, "B4"};
+const hci_cmd_t hci_write_link_policy_settings = {0x080D, "H2"};
+const hci_cmd_t hci_write_automatic_flush_timeout = {0x0C28, "H2"};
+const hci_cmd_t hci_read_link_quality = {HCI_OPCODE_HCI_READ_LINK_QUALITY, "H"};
+const hci_cmd_t hci_read_rssi = {HCI_OPCODE_HCI_READ_RSSI, "H"};
+
+namespace {
+    constexpr hci_con_handle_t sim_first_con_handle = 0x000B;
+    constexpr uint16_t sim_remote_mtu = 672;
+    constexpr uint8_t sim_max_channels = 2 * sim_max_remotes;
+    constexpr uint8_t no_remote = 0xFF;
+
+    struct sim_remote {
+        bool present;
+        bd_addr_t addr;
+        uint32_t cod;
+        bool pairing;
+        bool page_scan;     // answers our pages (powered on)
+        bool connected;
+        link_key_t link_key;
+        bool has_key;
+        bool feature_reports;   // answers GET_REPORT on the HID control channel
+        int8_t rssi;            // Read RSSI / Read Link Quality results
+        uint8_t link_quality;
+        sim_link link;
+    };
+
+    struct sim_channel {
+        uint16_t local_cid;
+        uint16_t psm;
+        uint8_t remote;
+        btstack_packet_handler_t handler;
+    };
+
+    struct sim_event {
+        btstack_packet_handler_t handler; // nullptr: broadcast to HCI event handlers
+        uint8_t packet_type;
+        uint16_t channel;
+        std::vector<uint8_t> packet;
+    };
+
+    struct sim_state {
+        sim_remote remotes[sim_max_remotes];
+        bool powered = false;
+        bool inquiry_active = false;
+        bool allow_role_switch = false;     // become central when accepting a connection
+        uint16_t next_cid = 0x0040;
+        uint8_t acl_buffers = 4;
+        uint8_t acl_free = 4;
+        bool acl_auto_complete = true;
+        sim_channel channels[sim_max_channels];
+        std::vector<btstack_packet_callback_registration_t *> hci_handlers;
+        std::vector<btstack_packet_callback_registration_t *> l2cap_handlers;
+        std::deque<sim_event> events;
+        std::deque<sim_event> parked_can_send;  // CAN_SEND_NOW waiting for a free ACL buffer
+        std::vector<btstack_timer_source_t *> timers;
+        uint32_t injected_acl_full = 0;
+        uint64_t command_credit_us = 0;     // no HCI command credit before this time
+        bool packet_buffer_reserved = false;
+        std::vector<sim_packet> sent;
+        sim_stats stats;
+        bool led;
+    };
+
+    sim_state state;
+
+    hci_con_handle_t handle_of(uint8_t remote) { return static_cast<hci_con_handle_t>(sim_first_con_handle + remote); }
+
+    uint8_t remote_by_addr(const uint8_t *addr) {
+        for (uint8_t i = 0; i < sim_max_remotes; i++) {
+            if (state.remotes[i].present && bd_addr_cmp(state.remotes[i].addr, addr) == 0) return i;
+        }
+        return no_remote;
+    }
+
+    uint8_t remote_by_handle(hci_con_handle_t handle) {
+        const uint8_t i = static_cast<uint8_t>(handle - sim_first_con_handle);
+        return i < sim_max_remotes && state.remotes[i].present ? i : no_remote;
+    }
+
+    void queue_hci(std::vector<uint8_t> packet) {
+        packet[1] = static_cast<uint8_t>(packet.size() - 2);
+        state.events.push_back({nullptr, HCI_EVENT_PACKET, 0, std::move(packet)});
+    }
+
+    void queue_channel(const sim_channel &ch, std::vector<uint8_t> packet) {
+        packet[1] = static_cast<uint8_t>(packet.size() - 2);
+        state.events.push_back({ch.handler, HCI_EVENT_PACKET, ch.local_cid, std::move(packet)});
+    }
+
+    void store_addr(std::vector<uint8_t> &packet, int pos, const bd_addr_t addr) {
+        reverse_bd_addr(addr, &packet[pos]);
+    }
+
+    sim_channel *find_channel(uint16_t local_cid) {
+        for (auto &ch: state.channels) {
+            if (ch.local_cid != 0 && ch.local_cid == local_cid) return &ch;
+        }
+        return nullptr;
+    }
+
+    void queue_connection_complete(uint8_t remote, uint8_t status, const uint8_t *addr) {
+        std::vector<uint8_t> ev(13, 0);
+        ev[0] = HCI_EVENT_CONNECTION_COMPLETE;
+        ev[2] = status;
+        little_endian_store_16(ev.data(), 3, remote == no_remote ? 0 : handle_of(remote));
+        store_addr(ev, 5, addr);
+        ev[11] = 0x01; // ACL
+        if (remote != no_remote) state.remotes[remote].connected = status == ERROR_CODE_SUCCESS;
+        queue_hci(std::move(ev));
+    }
+
+    // BTstack's default link policy allows role switch and sniff; QoS starts as the spec default best effort
+    void reset_link(uint8_t remote, uint8_t local_role) {
+        state.remotes[remote].link = {local_role, sim_mode_active, 0,
+                                      LM_LINK_POLICY_ENABLE_ROLE_SWITCH | LM_LINK_POLICY_ENABLE_SNIFF_MODE, 0,
+                                      HCI_SERVICE_TYPE_BEST_EFFORT, 25000};
+    }
+
+    void queue_role_change(uint8_t remote) {
+        std::vector<uint8_t> ev(10, 0);
+        ev[0] = HCI_EVENT_ROLE_CHANGE;
+        store_addr(ev, 3, state.remotes[remote].addr);
+        ev[9] = state.remotes[remote].link.local_role;
+        queue_hci(std::move(ev));
+    }
+
+    void queue_mode_change(uint8_t remote) {
+        const sim_link &link = state.remotes[remote].link;
+        std::vector<uint8_t> ev(8, 0);
+        ev[0] = HCI_EVENT_MODE_CHANGE;
+        little_endian_store_16(ev.data(), 3, handle_of(remote));
+        ev[5] = link.mode;
+        little_endian_store_16(ev.data(), 6, link.sniff_interval);
+        queue_hci(std::move(ev));
+    }
+
+    void queue_auth_complete(uint8_t remote, uint8_t status) {
+        std::vector<uint8_t> auth(5, 0);
+        auth[0] = HCI_EVENT_AUTHENTICATION_COMPLETE;
+        auth[2] = status;
+        little_endian_store_16(auth.data(), 3, handle_of(remote));
+        queue_hci(std::move(auth));
+    }
+
+    void queue_encryption_complete(uint8_t remote) {
+        queue_auth_complete(remote, ERROR_CODE_SUCCESS);
+
+        std::vector<uint8_t> enc(6, 0);
+        enc[0] = HCI_EVENT_ENCRYPTION_CHANGE;
+        little_endian_store_16(enc.data(), 3, handle_of(remote));
+        enc[5] = 1;
+        queue_hci(std::move(enc));
+    }
+
+    void queue_inquiry_results() {
+        for (auto &remote: state.remotes) {
+            if (!remote.present || !remote.pairing || remote.connected) continue;
+            std::vector<uint8_t> ev(17, 0);
+            ev[0] = HCI_EVENT_EXTENDED_INQUIRY_RESPONSE;
+            ev[2] = 1;
+            store_addr(ev, 3, remote.addr);
+            little_endian_store_24(ev.data(), 11, remote.cod);
+            queue_hci(std::move(ev));
+        }
+    }
+
+    // GET_REPORT (feature) on a HID control channel: report 0x05 comes back as DATA, any other id as an
+    // ERR_INVALID_REPORT_ID handshake
+    void answer_control(const sim_channel &ch, const uint8_t *data, uint16_t len) {
+        if (ch.psm != PSM_HID_CONTROL || len < 2 || data[0] != 0x43) return;
+        if (!state.remotes[ch.remote].feature_reports) return;
+        std::vector<uint8_t> reply;
+        if (data[1] == 0x05) {
+            reply.resize(1 + sim_calibration::size);
+            reply[0] = 0xA3;  // DATA | FEATURE
+            sim_build_calibration_report(&reply[1], ch.remote);
+        } else {
+            reply.push_back(0x02);  // HANDSHAKE | ERR_INVALID_REPORT_ID
+        }
+        state.stats.feature_requests++;
+        state.events.push_back({ch.handler, L2CAP_DATA_PACKET, ch.local_cid, std::move(reply)});
+    }
+
+    void disconnect_remote(uint8_t remote, uint8_t reason) {
+        for (auto &ch: state.channels) {
+            if (ch.local_cid == 0 || ch.remote != remote) continue;
+            // BTstack emits no CAN_SEND_NOW for a channel that closed after the request
+            for (auto *queue: {&state.events, &state.parked_can_send}) {
+                queue->erase(std::remove_if(queue->begin(), queue->end(), [&ch](const sim_event &ev) {
+                    return ev.handler && ev.channel == ch.local_cid && ev.packet[0] == L2CAP_EVENT_CAN_SEND_NOW;
+                }), queue->end());
+            }
+            std::vector<uint8_t> ev(4, 0);
+            ev[0] = L2CAP_EVENT_CHANNEL_CLOSED;
+            little_endian_store_16(ev.data(), 2, ch.local_cid);
+            queue_channel(ch, std::move(ev));
+            ch.local_cid = 0;
+        }
+
+        std::vector<uint8_t> ev(6, 0);
+        ev[0] = HCI_EVENT_DISCONNECTION_COMPLETE;
+        little_endian_store_16(ev.data(), 3, handle_of(remote));
+        ev[5] = reason;
+        state.remotes[remote].connected = false;
+        queue_hci(std::move(ev));
+    }
+}
+
+// --- stdio / time / gpio ---------------------------------------------------------------------------------
+
+bool stdio_init_all(void) { return true; }
+
+int putchar_raw(int c) { return putchar(c); }
+
+int getchar_timeout_us(uint32_t) { return PICO_ERROR_TIMEOUT; }
+
+int cyw43_arch_init(void) { return 0; }
+
+void cyw43_arch_gpio_put(unsigned int, bool value) { state.led = value; }
+
+// --- async context: single threaded, so the lock is free and pending work runs immediately -------------------
+
+struct async_context {
+    int lock_depth;
+};
+
+static async_context sim_async_context;
+
+async_context_t *cyw43_arch_async_context(void) { return &sim_async_context; }
+
+void async_context_acquire_lock_blocking(async_context_t *context) { context->lock_depth++; }
+
+void async_context_release_lock(async_context_t *context) { context->lock_depth--; }
+
+bool async_context_add_when_pending_worker(async_context_t *, async_when_pending_worker_t *) { return true; }
+
+void async_context_set_work_pending(async_context_t *context, async_when_pending_worker_t *worker) {
+    if (worker->do_work) worker->do_work(context, worker);
+}
+
+// --- run loop timers --------------------------------------------------------------------------------------
+
+uint32_t btstack_run_loop_get_time_ms(void) { return static_cast<uint32_t>(time_us_64() / 1000); }
+
+void btstack_run_loop_set_timer(btstack_timer_source_t *ts, uint32_t timeout_in_ms) {
+    ts->timeout = time_us_64() + static_cast<uint64_t>(timeout_in_ms) * 1000;
+}
+
+void btstack_run_loop_set_timer_handler(btstack_timer_source_t *ts, void (*process)(btstack_timer_source_t *)) {
+    ts->process = process;
+}
+
+void btstack_run_loop_add_timer(btstack_timer_source_t *timer) {
+    btstack_run_loop_remove_timer(timer);
+    state.timers.push_back(timer);
+}
+
+int btstack_run_loop_remove_timer(btstack_timer_source_t *timer) {
+    for (auto it = state.timers.begin(); it != state.timers.end(); ++it) {
+        if (*it != timer) continue;
+        state.timers.erase(it);
+        return 1;
+    }
+    return 0;
+}
+
+// --- GAP / HCI -------------------------------------------------------------------------------------------
+
+void gap_set_local_name(const char *) {}
+void gap_ssp_set_enable(int) {}
+void gap_secure_connections_enable(bool) {}
+void gap_ssp_set_io_capability(int) {}
+void gap_ssp_set_authentication_requirement(int) {}
+void gap_connectable_control(uint8_t) {}
+void gap_discoverable_control(uint8_t) {}
+void gap_set_allow_role_switch(bool allow_role_switch) { state.allow_role_switch = allow_role_switch; }
+void gap_set_page_timeout(uint16_t) {}
+void gap_set_page_scan_activity(uint16_t, uint16_t) {}
+void gap_set_page_scan_type(page_scan_type_t) {}
+
+int gap_inquiry_start(uint8_t) {
+    state.inquiry_active = true;
+    queue_inquiry_results();
+    return 0;
+}
+
+int gap_inquiry_stop(void) {
+    if (!state.inquiry_active) return 0;
+    state.inquiry_active = false;
+    std::vector<uint8_t> ev(3, 0);
+    ev[0] = GAP_EVENT_INQUIRY_COMPLETE;
+    queue_hci(std::move(ev));
+    return 0;
+}
+
+void gap_request_security_level(hci_con_handle_t con_handle, gap_security_level_t) {
+    const uint8_t remote = remote_by_handle(con_handle);
+    if (remote == no_remote) return;
+    std::vector<uint8_t> ev(8, 0);
+    ev[0] = HCI_EVENT_LINK_KEY_REQUEST;
+    store_addr(ev, 2, state.remotes[remote].addr);
+    queue_hci(std::move(ev));
+}
+
+uint8_t gap_disconnect(hci_con_handle_t handle) {
+    const uint8_t remote = remote_by_handle(handle);
+    if (remote != no_remote && state.remotes[remote].connected) {
+        disconnect_remote(remote, ERROR_CODE_CONNECTION_TERMINATED_BY_LOCAL_HOST);
+    }
+    return ERROR_CODE_SUCCESS;
+}
+
+uint16_t hci_usable_acl_packet_types(void) { return 0xCC18; }
+
+int hci_power_control(int power_mode) {
+    state.powered = power_mode == HCI_POWER_ON;
+    std::vector<uint8_t> ev(3, 0);
+    ev[0] = BTSTACK_EVENT_STATE;
+    ev[2] = state.powered ? HCI_STATE_WORKING : HCI_STATE_OFF;
+    queue_hci(std::move(ev));
+    return 0;
+}
+
+void hci_add_event_handler(btstack_packet_callback_registration_t *callback_handler) {
+    state.hci_handlers.push_back(callback_handler);
+}
+
+hci_role_t gap_get_role(hci_con_handle_t connection_handle) {
+    const uint8_t remote = remote_by_handle(connection_handle);
+    return remote == no_remote ? HCI_ROLE_MASTER : state.remotes[remote].link.local_role;
+}
+
+uint8_t gap_request_role(const bd_addr_t addr, hci_role_t role) {
+    const uint8_t remote = remote_by_addr(addr);
+    if (remote == no_remote || !state.remotes[remote].connected) return ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER;
+    if (state.remotes[remote].link.local_role == role) return ERROR_CODE_SUCCESS;
+    state.remotes[remote].link.local_role = role;
+    queue_role_change(remote);
+    return ERROR_CODE_SUCCESS;
+}
+
+uint8_t gap_sniff_mode_enter(hci_con_handle_t con_handle, uint16_t, uint16_t sniff_max_interval, uint16_t,
+                             uint16_t) {
+    const uint8_t remote = remote_by_handle(con_handle);
+    if (remote == no_remote) return ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER;
+    sim_link &link = state.remotes[remote].link;
+    if (!(link.link_policy & LM_LINK_POLICY_ENABLE_SNIFF_MODE)) return ERROR_CODE_SUCCESS;  // controller refuses
+    link.mode = sim_mode_sniff;
+    link.sniff_interval = sniff_max_interval;
+    queue_mode_change(remote);
+    return ERROR_CODE_SUCCESS;
+}
+
+uint8_t gap_sniff_mode_exit(hci_con_handle_t con_handle) {
+    const uint8_t remote = remote_by_handle(con_handle);
+    if (remote == no_remote) return ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER;
+    sim_link &link = state.remotes[remote].link;
+    if (link.mode == sim_mode_active) return ERROR_CODE_SUCCESS;
+    link.mode = sim_mode_active;
+    link.sniff_interval = 0;
+    queue_mode_change(remote);
+    return ERROR_CODE_SUCCESS;
+}
+
+uint8_t gap_qos_set(hci_con_handle_t con_handle, hci_service_type_t service_type, uint32_t, uint32_t,
+                    uint32_t latency, uint32_t) {
+    const uint8_t remote = remote_by_handle(con_handle);
+    if (remote == no_remote) return ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER;
+    state.remotes[remote].link.qos_service = static_cast<uint8_t>(service_type);
+    state.remotes[remote].link.qos_latency = latency;
+    return ERROR_CODE_SUCCESS;
+}
+
+bool hci_can_send_command_packet_now(void) { return time_us_64() >= state.command_credit_us; }
+
+uint8_t hci_send_cmd(const hci_cmd_t *cmd, ...) {
+    // as BTstack's hci_send_cmd without a command credit
+    if (!hci_can_send_command_packet_now()) return BTSTACK_ACL_BUFFERS_FULL;
+    va_list args;
+    va_start(args, cmd);
+
+    // signal reads: the result comes back in HCI_EVENT_COMMAND_COMPLETE
+    if (cmd == &hci_read_rssi || cmd == &hci_read_link_quality) {
+        const hci_con_handle_t handle = static_cast<hci_con_handle_t>(va_arg(args, int));
+        va_end(args);
+        const uint8_t remote = remote_by_handle(handle);
+        std::vector<uint8_t> ev(9, 0);
+        ev[0] = HCI_EVENT_COMMAND_COMPLETE;
+        ev[2] = 1; // command packets
+        little_endian_store_16(ev.data(), 3, cmd->opcode);
+        ev[5] = remote == no_remote || !state.remotes[remote].connected ? ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER
+                                                                        : ERROR_CODE_SUCCESS;
+        little_endian_store_16(ev.data(), 6, handle);
+        if (remote != no_remote) {
+            ev[8] = cmd == &hci_read_rssi ? static_cast<uint8_t>(state.remotes[remote].rssi)
+                                          : state.remotes[remote].link_quality;
+        }
+        state.stats.signal_reads++;
+        queue_hci(std::move(ev));
+        return ERROR_CODE_SUCCESS;
+    }
+
+    // link policy commands address the ACL handle
+    if (cmd == &hci_write_link_policy_settings || cmd == &hci_write_automatic_flush_timeout) {
+        const uint8_t remote = remote_by_handle(static_cast<hci_con_handle_t>(va_arg(args, int)));
+        const uint16_t value = static_cast<uint16_t>(va_arg(args, int));
+        va_end(args);
+        if (remote == no_remote) return ERROR_CODE_SUCCESS;
+        if (cmd == &hci_write_link_policy_settings) {
+            state.remotes[remote].link.link_policy = value;
+        } else {
+            state.remotes[remote].link.flush_timeout = value;
+        }
+        return ERROR_CODE_SUCCESS;
+    }
+
+    const uint8_t *addr = va_arg(args, const uint8_t *);
+    const uint8_t remote = remote_by_addr(addr);
+
+    if (cmd == &hci_create_connection) {
+        state.stats.pages++;
+        uint8_t status = ERROR_CODE_SUCCESS;
+        if (remote == no_remote || !state.remotes[remote].page_scan) {
+            status = ERROR_CODE_PAGE_TIMEOUT;
+        } else if (state.remotes[remote].connected) {
+            status = ERROR_CODE_ACL_CONNECTION_ALREADY_EXISTS;
+        }
+        if (status == ERROR_CODE_SUCCESS) reset_link(remote, HCI_ROLE_MASTER);
+        queue_connection_complete(status == ERROR_CODE_ACL_CONNECTION_ALREADY_EXISTS ? no_remote : remote, status, addr);
+    } else if (remote == no_remote) {
+        // command for a device the simulator does not know
+    } else if (cmd == &hci_link_key_request_reply) {
+        sim_remote &r = state.remotes[remote];
+        const uint8_t *key = va_arg(args, const uint8_t *);
+        if (r.has_key && memcmp(key, r.link_key, LINK_KEY_LEN) == 0) {
+            queue_encryption_complete(remote);
+        } else {
+            queue_auth_complete(remote, ERROR_CODE_AUTHENTICATION_FAILURE);
+        }
+    } else if (cmd == &hci_link_key_request_negative_reply) {
+        std::vector<uint8_t> ev(12, 0);
+        ev[0] = HCI_EVENT_USER_CONFIRMATION_REQUEST;
+        store_addr(ev, 2, addr);
+        queue_hci(std::move(ev));
+    } else if (cmd == &hci_user_confirmation_request_reply) {
+        sim_remote &r = state.remotes[remote];
+        for (int i = 0; i < LINK_KEY_LEN; i++) r.link_key[i] = static_cast<uint8_t>(0xA0 + 0x10 * remote + i);
+        r.has_key = true;
+
+        std::vector<uint8_t> ev(25, 0);
+        ev[0] = HCI_EVENT_LINK_KEY_NOTIFICATION;
+        store_addr(ev, 2, addr);
+        memcpy(&ev[8], r.link_key, LINK_KEY_LEN);
+        ev[24] = 0x05; // authenticated combination key
+        queue_hci(std::move(ev));
+        queue_encryption_complete(remote);
+    }
+
+    va_end(args);
+    return ERROR_CODE_SUCCESS;
+}
+
+// --- L2CAP -----------------------------------------------------------------------------------------------
+
+void l2cap_init(void) {}
+
+void l2cap_add_event_handler(btstack_packet_callback_registration_t *callback_handler) {
+    state.l2cap_handlers.push_back(callback_handler);
+}
+
+uint8_t l2cap_register_service(btstack_packet_handler_t, uint16_t, uint16_t, gap_security_level_t) {
+    return ERROR_CODE_SUCCESS;
+}
+
+uint8_t l2cap_create_channel(btstack_packet_handler_t packet_handler, bd_addr_t address, uint16_t psm, uint16_t,
+                             uint16_t *out_local_cid) {
+    sim_channel *slot = nullptr;
+    for (auto &ch: state.channels) {
+        if (ch.local_cid == 0) {
+            slot = &ch;
+            break;
+        }
+    }
+    if (!slot) return BTSTACK_ACL_BUFFERS_FULL;
+
+    const uint8_t remote = remote_by_addr(address);
+    slot->local_cid = state.next_cid++;
+    slot->psm = psm;
+    slot->remote = remote;
+    slot->handler = packet_handler;
+    if (out_local_cid) *out_local_cid = slot->local_cid;
+
+    const bool connected = remote != no_remote && state.remotes[remote].connected;
+    std::vector<uint8_t> ev(25, 0);
+    ev[0] = L2CAP_EVENT_CHANNEL_OPENED;
+    ev[2] = connected ? ERROR_CODE_SUCCESS : ERROR_CODE_CONNECTION_TIMEOUT;
+    store_addr(ev, 3, address);
+    little_endian_store_16(ev.data(), 9, connected ? handle_of(remote) : 0);
+    little_endian_store_16(ev.data(), 11, psm);
+    little_endian_store_16(ev.data(), 13, slot->local_cid);
+    little_endian_store_16(ev.data(), 15, slot->local_cid);
+    little_endian_store_16(ev.data(), 17, sim_remote_mtu);
+    little_endian_store_16(ev.data(), 19, sim_remote_mtu);
+    little_endian_store_16(ev.data(), 21, 0xffff);
+    queue_channel(*slot, std::move(ev));
+    if (!connected) slot->local_cid = 0;
+    return ERROR_CODE_SUCCESS;
+}
+
+void l2cap_accept_connection(uint16_t) {}
+
+uint8_t l2cap_request_can_send_now_event(uint16_t local_cid) {
+    sim_channel *ch = find_channel(local_cid);
+    if (!ch) return L2CAP_LOCAL_CID_DOES_NOT_EXIST;
+    state.stats.can_send_now_requests++;
+
+    std::vector<uint8_t> ev(4, 0);
+    ev[0] = L2CAP_EVENT_CAN_SEND_NOW;
+    little_endian_store_16(ev.data(), 2, local_cid);
+    queue_channel(*ch, std::move(ev));
+    return ERROR_CODE_SUCCESS;
+}
+
+uint8_t l2cap_send(uint16_t local_cid, const uint8_t *data, uint16_t len) {
+    if (!find_channel(local_cid)) return L2CAP_LOCAL_CID_DOES_NOT_EXIST;
+    if (len > sim_remote_mtu) return L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU;
+    if (state.injected_acl_full) {
+        state.injected_acl_full--;
+        state.acl_free = 0;
+        state.stats.acl_buffers_full++;
+        return BTSTACK_ACL_BUFFERS_FULL;
+    }
+    if (state.acl_free == 0) {
+        state.stats.acl_buffers_full++;
+        return BTSTACK_ACL_BUFFERS_FULL;
+    }
+    state.acl_free--;
+    state.stats.sends++;
+    state.sent.push_back({time_us_64(), local_cid, std::vector<uint8_t>(data, data + len)});
+    answer_control(*find_channel(local_cid), data, len);
+    return ERROR_CODE_SUCCESS;
+}
+
+// Single outgoing buffer, like HCI's: reserved by the caller, released by a successful send
+namespace {
+    uint8_t outgoing_buffer[sim_remote_mtu];
+}
+
+bool l2cap_reserve_packet_buffer(void) {
+    if (state.packet_buffer_reserved) return false;
+    state.packet_buffer_reserved = true;
+    return true;
+}
+
+void l2cap_release_packet_buffer(void) { state.packet_buffer_reserved = false; }
+
+uint8_t *l2cap_get_outgoing_buffer(void) { return outgoing_buffer; }
+
+uint8_t l2cap_send_prepared(uint16_t local_cid, uint16_t len) {
+    if (!state.packet_buffer_reserved) return BTSTACK_ACL_BUFFERS_FULL;
+    const uint8_t status = l2cap_send(local_cid, outgoing_buffer, len);
+    if (status == ERROR_CODE_SUCCESS) {
+        state.stats.prepared_sends++;
+        state.packet_buffer_reserved = false;
+    }
+    return status;
+}
+
+// --- Simulator control -----------------------------------------------------------------------------------
+
+void sim_reset() {
+    state = sim_state{};
+}
+
+uint8_t sim_add_remote(const bd_addr_t addr, uint32_t class_of_device) {
+    for (uint8_t i = 0; i < sim_max_remotes; i++) {
+        sim_remote &r = state.remotes[i];
+        if (r.present) continue;
+        r = {};
+        r.present = true;
+        r.page_scan = true;
+        r.feature_reports = true;
+        r.rssi = 0;
+        r.link_quality = 255;
+        bd_addr_copy(r.addr, addr);
+        r.cod = class_of_device;
+        return i;
+    }
+    return no_remote;
+}
+
+void sim_set_remote_pairing_mode(uint8_t remote, bool pairing) {
+    state.remotes[remote].pairing = pairing;
+    if (pairing && state.inquiry_active) queue_inquiry_results();
+}
+
+void sim_set_remote_page_scan(uint8_t remote, bool page_scan) {
+    state.remotes[remote].page_scan = page_scan;
+}
+
+void sim_remote_connect(uint8_t remote) {
+    const sim_remote &r = state.remotes[remote];
+    std::vector<uint8_t> ev(12, 0);
+    ev[0] = HCI_EVENT_CONNECTION_REQUEST;
+    store_addr(ev, 2, r.addr);
+    little_endian_store_24(ev.data(), 8, r.cod);
+    ev[11] = 0x01;
+    queue_hci(std::move(ev));
+    // BTstack accepts with a role switch request when allowed to
+    reset_link(remote, state.allow_role_switch ? HCI_ROLE_MASTER : HCI_ROLE_SLAVE);
+    if (state.allow_role_switch) queue_role_change(remote);
+    queue_connection_complete(remote, ERROR_CODE_SUCCESS, r.addr);
+}
+
+void sim_remote_disconnect(uint8_t remote, uint8_t reason) {
+    disconnect_remote(remote, reason);
+}
+
+void sim_set_remote_feature_reports(uint8_t remote, bool answer) {
+    state.remotes[remote].feature_reports = answer;
+}
+
+void sim_set_remote_signal(uint8_t remote, int8_t rssi, uint8_t link_quality) {
+    state.remotes[remote].rssi = rssi;
+    state.remotes[remote].link_quality = link_quality;
+}
+
+bool sim_remote_switch_role(uint8_t remote) {
+    sim_link &link = state.remotes[remote].link;
+    if (!(link.link_policy & LM_LINK_POLICY_ENABLE_ROLE_SWITCH)) return false;
+    link.local_role = HCI_ROLE_SLAVE;
+    queue_role_change(remote);
+    return true;
+}
+
+const sim_link &sim_remote_link(uint8_t remote) {
+    return state.remotes[remote].link;
+}
+
+namespace {
+    // The earliest due timer, as the real run loop keeps them sorted by deadline
+    bool fire_due_timers() {
+        const uint64_t now_us = time_us_64();
+        btstack_timer_source_t *due = nullptr;
+        for (auto *timer: state.timers) {
+            if (timer->timeout <= now_us && (!due || timer->timeout < due->timeout)) due = timer;
+        }
+        if (!due) return false;
+        btstack_run_loop_remove_timer(due);
+        due->process(due);
+        return true;
+    }
+
+    void unpark_can_send() {
+        while (state.acl_free > 0 && !state.parked_can_send.empty()) {
+            state.events.push_back(std::move(state.parked_can_send.front()));
+            state.parked_can_send.pop_front();
+        }
+    }
+}
+
+void sim_run() {
+    for (;;) {
+        while (fire_due_timers()) {}
+        if (state.events.empty()) {
+            if (state.acl_auto_complete) state.acl_free = state.acl_buffers;
+            unpark_can_send();
+            if (state.events.empty()) break;
+        }
+
+        sim_event ev = std::move(state.events.front());
+        state.events.pop_front();
+
+        if (ev.handler) {
+            // like BTstack, CAN_SEND_NOW is only emitted while the controller has a free ACL buffer
+            if (ev.packet[0] == L2CAP_EVENT_CAN_SEND_NOW && state.acl_free == 0) {
+                state.parked_can_send.push_back(std::move(ev));
+                continue;
+            }
+            state.stats.l2cap_events++;
+            ev.handler(ev.packet_type, ev.channel, ev.packet.data(), static_cast<uint16_t>(ev.packet.size()));
+        } else {
+            state.stats.hci_events++;
+            for (auto *registration: state.hci_handlers) {
+                registration->callback(ev.packet_type, 0, ev.packet.data(), static_cast<uint16_t>(ev.packet.size()));
+            }
+        }
+    }
+}
+
+uint16_t sim_local_cid(uint8_t remote, uint16_t psm) {
+    for (auto &ch: state.channels) {
+        if (ch.local_cid != 0 && ch.remote == remote && ch.psm == psm) return ch.local_cid;
+    }
+    return 0;
+}
+
+bool sim_send_input_report(uint8_t remote, const uint8_t *report, uint16_t len) {
+    sim_channel *ch = find_channel(sim_local_cid(remote, PSM_HID_INTERRUPT));
+    if (!ch) return false;
+
+    uint8_t packet[1 + 96];
+    if (len > sizeof(packet) - 1) return false;
+    packet[0] = 0xA1; // HID DATA | INPUT
+    memcpy(&packet[1], report, len);
+    state.stats.data_packets++;
+    ch->handler(L2CAP_DATA_PACKET, ch->local_cid, packet, static_cast<uint16_t>(len + 1));
+    return true;
+}
+
+void sim_set_acl_buffers(uint8_t count, bool auto_complete) {
+    state.acl_buffers = count;
+    state.acl_free = count;
+    state.acl_auto_complete = auto_complete;
+}
+
+void sim_acl_complete_packets(uint8_t count) {
+    state.acl_free = static_cast<uint8_t>(state.acl_free + count > state.acl_buffers ? state.acl_buffers
+                                                                                    : state.acl_free + count);
+    unpark_can_send();
+}
+
+void sim_inject_acl_full(uint32_t sends) { state.injected_acl_full = sends; }
+
+void sim_hold_command_credit(uint32_t us) { state.command_credit_us = time_us_64() + us; }
+
+const std::vector<sim_packet> &sim_sent_packets() { return state.sent; }
+
+void sim_clear_sent_packets() { state.sent.clear(); }
+
+const sim_stats &sim_get_stats() { return state.stats; }
+
+bool sim_packet_buffer_reserved() { return state.packet_buffer_reserved; }
+
+bool sim_led_state() { return state.led; }
+
+sim_stats &sim_mutable_stats() { return state.stats; }
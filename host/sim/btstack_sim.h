@@ -0,0 +1,93 @@
+// Scripted stand-in for the CYW43 radio and the remote DualSense.
+//
+// The firmware handlers talk to the stubs in host/include exactly as they talk to BTstack on device. The
+// simulator answers HCI commands and L2CAP requests the way a DualSense does, queues the resulting events
+// and delivers them from sim_run(), so connection sequences and 0x31 traffic go through the real code.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bluetooth.h"
+
+struct sim_packet {
+    uint64_t time_us;
+    uint16_t cid;
+    std::vector<uint8_t> data;
+};
+
+struct sim_stats {
+    uint32_t hci_events;
+    uint32_t l2cap_events;
+    uint32_t data_packets;
+    uint32_t sends;
+    uint32_t prepared_sends;    // sends built in the outgoing buffer (l2cap_send_prepared)
+    uint32_t acl_buffers_full;
+    uint32_t can_send_now_requests;
+    uint32_t interrupts_disabled;
+    uint32_t flash_erases;
+    uint32_t flash_programs;
+    uint32_t pages;             // hci_create_connection commands
+    uint32_t feature_requests;  // GET_REPORT (feature) answered on a HID control channel
+    uint32_t signal_reads;      // Read RSSI / Read Link Quality commands
+};
+
+// Current mode in HCI_EVENT_MODE_CHANGE
+constexpr uint8_t sim_mode_active = 0;
+constexpr uint8_t sim_mode_sniff = 2;
+
+// Link settings of one remote's ACL link, as the firmware left them
+struct sim_link {
+    uint8_t local_role;         // HCI_ROLE_MASTER: the Pico is central
+    uint8_t mode;               // sim_mode_active / sim_mode_sniff
+    uint16_t sniff_interval;    // slots, in sniff mode
+    uint16_t link_policy;       // LM_LINK_POLICY_* bits
+    uint16_t flush_timeout;     // slots, 0 = never flush
+    uint8_t qos_service;        // hci_service_type_t
+    uint32_t qos_latency;       // us
+};
+
+// Remote devices. Up to sim_max_remotes DualSense controllers; remote i uses ACL handle 0x000B + i.
+constexpr uint8_t sim_max_remotes = 4;
+
+void sim_reset();
+uint8_t sim_add_remote(const bd_addr_t addr, uint32_t class_of_device = 0x002508);
+void sim_set_remote_pairing_mode(uint8_t remote, bool pairing);
+// A remote with page scan off (powered down, out of range) times out our pages; on by default.
+void sim_set_remote_page_scan(uint8_t remote, bool page_scan);
+void sim_remote_connect(uint8_t remote);
+void sim_remote_disconnect(uint8_t remote, uint8_t reason = ERROR_CODE_REMOTE_USER_TERMINATED_CONNECTION);
+// A remote that ignores GET_REPORT lets the firmware's feature requests time out; answered by default.
+void sim_set_remote_feature_reports(uint8_t remote, bool answer);
+// What Read RSSI and Read Link Quality return for the remote's link; 0 dB and 255 by default.
+void sim_set_remote_signal(uint8_t remote, int8_t rssi, uint8_t link_quality);
+// The controller takes the central role; refused (false) when our link policy forbids role switches.
+bool sim_remote_switch_role(uint8_t remote);
+const sim_link &sim_remote_link(uint8_t remote);
+
+// Event loop. sim_run() also fires the BTstack run-loop timers that are due on the simulated clock.
+void sim_run();
+void sim_clock_advance_us(uint64_t us);
+
+// HID traffic of one remote
+uint16_t sim_local_cid(uint8_t remote, uint16_t psm);
+bool sim_send_input_report(uint8_t remote, const uint8_t *report, uint16_t len = 78);
+
+// ACL flow control. With auto-complete enabled every sim_run() returns the buffers used by l2cap_send.
+void sim_set_acl_buffers(uint8_t count, bool auto_complete = true);
+void sim_acl_complete_packets(uint8_t count);
+// The next `sends` l2cap_send calls fail with BTSTACK_ACL_BUFFERS_FULL, as when another channel takes the free
+// buffers between CAN_SEND_NOW and the send; the buffers stay taken until they complete.
+void sim_inject_acl_full(uint32_t sends);
+// The controller has no HCI command credit for the next `us` of simulated time: hci_send_cmd refuses commands.
+void sim_hold_command_credit(uint32_t us);
+
+// Observation
+const std::vector<sim_packet> &sim_sent_packets();
+void sim_clear_sent_packets();
+const sim_stats &sim_get_stats();
+bool sim_packet_buffer_reserved();
+bool sim_led_state();
+
+// Shared with the pico/flash stand-ins
+sim_stats &sim_mutable_stats();
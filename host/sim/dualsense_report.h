@@ -0,0 +1,96 @@
+// Builds DualSense Bluetooth 0x31 input reports for the simulator.
+//
+// Layout (78 bytes, as copied into FDeviceContext::Buffer): [0] report id 0x31, [1] sequence tag, then the
+// common input block: sticks LX LY RX RY, triggers L2 R2, counter, 4 button bytes, gyro/accel, touch, status,
+// and [74..77] the CRC32 over the 0xA1 HID header and bytes 0..73, little-endian.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+struct sim_input_state {
+    uint8_t lx = 0x80, ly = 0x80, rx = 0x80, ry = 0x80;
+    uint8_t l2 = 0, r2 = 0;
+    uint8_t buttons[3] = {0x08, 0x00, 0x00}; // dpad hat 8 = released
+    int16_t gyro[3] = {};
+    int16_t accel[3] = {0, 8192, 0};
+    uint32_t sensor_timestamp = 0;
+    uint8_t battery = 0x08;
+};
+
+namespace sim_report {
+    constexpr uint16_t size = 78;
+    constexpr uint8_t offset = 2;
+
+    constexpr uint8_t square = 0x10, cross = 0x20, circle = 0x40, triangle = 0x80;
+    constexpr uint8_t l1 = 0x01, r1 = 0x02, create = 0x10, options = 0x20, l3 = 0x40, r3 = 0x80;
+}
+
+// Bitwise CRC-32, independent of the firmware's table-driven one
+inline uint32_t sim_crc32(uint32_t crc, const uint8_t *data, size_t len) {
+    while (len--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return crc;
+}
+
+inline void sim_stamp_input_crc(uint8_t *report) {
+    const uint8_t header = 0xA1;
+    const uint32_t crc = ~sim_crc32(sim_crc32(0xFFFFFFFFu, &header, 1), report, sim_report::size - 4);
+    for (int i = 0; i < 4; i++) report[sim_report::size - 4 + i] = static_cast<uint8_t>(crc >> (8 * i));
+}
+
+inline void sim_build_input_report(uint8_t *out, const sim_input_state &in, uint8_t seq) {
+    memset(out, 0, sim_report::size);
+    out[0] = 0x31;
+    out[1] = static_cast<uint8_t>(seq << 4);
+
+    uint8_t *b = &out[sim_report::offset];
+    b[0] = in.lx;
+    b[1] = in.ly;
+    b[2] = in.rx;
+    b[3] = in.ry;
+    b[4] = in.l2;
+    b[5] = in.r2;
+    b[6] = seq;
+    b[7] = in.buttons[0];
+    b[8] = in.buttons[1];
+    b[9] = in.buttons[2];
+    for (int i = 0; i < 3; i++) {
+        b[15 + i * 2] = static_cast<uint8_t>(in.gyro[i]);
+        b[16 + i * 2] = static_cast<uint8_t>(in.gyro[i] >> 8);
+        b[21 + i * 2] = static_cast<uint8_t>(in.accel[i]);
+        b[22 + i * 2] = static_cast<uint8_t>(in.accel[i] >> 8);
+    }
+    memcpy(&b[27], &in.sensor_timestamp, 4);
+    b[32] = 0x80; // touch point 0 inactive
+    b[36] = 0x80; // touch point 1 inactive
+    b[52] = in.battery;
+    sim_stamp_input_crc(out);
+}
+
+// Feature report 0x05 (IMU calibration, 41 bytes) as a DualSense answers GET_REPORT: [0] report id, 17 little-endian
+// int16 calibration values from [1], the CRC32 over the 0xA3 HID header and bytes 0..36 in [37..40].
+namespace sim_calibration {
+    constexpr uint16_t size = 41;
+}
+
+inline void sim_build_calibration_report(uint8_t *out, uint8_t remote) {
+    memset(out, 0, sim_calibration::size);
+    out[0] = 0x05;
+    // gyro bias, plus/minus per axis, speed plus/minus (deg/s), accelerometer plus/minus per axis
+    const int16_t values[17] = {
+        static_cast<int16_t>(4 + remote), -3, 2,
+        static_cast<int16_t>(8850 + remote), -8846, 8851, -8853, 8849, -8851,
+        540, 540,
+        8212, -8172, 8190, -8194, 8230, -8150,
+    };
+    for (int i = 0; i < 17; i++) {
+        out[1 + i * 2] = static_cast<uint8_t>(values[i]);
+        out[2 + i * 2] = static_cast<uint8_t>(values[i] >> 8);
+    }
+    const uint8_t header = 0xA3;
+    const uint32_t crc = ~sim_crc32(sim_crc32(0xFFFFFFFFu, &header, 1), out, sim_calibration::size - 4);
+    for (int i = 0; i < 4; i++) out[sim_calibration::size - 4 + i] = static_cast<uint8_t>(crc >> (8 * i));
+}
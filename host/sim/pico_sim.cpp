@@ -0,0 +1,162 @@
+// Pico SDK stand-ins: clock, flash, interrupt masking and the BTstack utility helpers.
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "btstack_sim.h"
+#include "btstack_util.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "pico/sem.h"
+#include "pico/time.h"
+
+uint8_t sim_flash_image[PICO_FLASH_SIZE_BYTES];
+
+namespace {
+    // Simulated; moves only through sleep_ms, sleep_us and sim_clock_advance_us. It starts one second in: on the Pico
+    // no report arrives at time 0, and the input pipeline reads a zero timestamp as "no previous frame".
+    uint64_t clock_us = 1000000;
+
+    struct flash_init {
+        flash_init() { memset(sim_flash_image, 0xFF, sizeof(sim_flash_image)); }
+    } flash_init_instance;
+}
+
+uint64_t time_us_64(void) { return clock_us; }
+
+uint32_t time_us_32(void) { return static_cast<uint32_t>(time_us_64()); }
+
+void sleep_ms(uint32_t ms) { clock_us += static_cast<uint64_t>(ms) * 1000; }
+
+void sleep_us(uint64_t us) { clock_us += us; }
+
+void sim_clock_advance_us(uint64_t us) { clock_us += us; }
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    sim_mutable_stats().flash_erases++;
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        printf("[SIM] flash_range_erase: misaligned 0x%08x +%zu\n", (unsigned int) flash_offs, count);
+        return;
+    }
+    memset(&sim_flash_image[flash_offs], 0xFF, count);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    sim_mutable_stats().flash_programs++;
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        printf("[SIM] flash_range_program: misaligned 0x%08x +%zu\n", (unsigned int) flash_offs, count);
+        return;
+    }
+    // NOR flash can only clear bits
+    for (size_t i = 0; i < count; i++) sim_flash_image[flash_offs + i] &= data[i];
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    sim_mutable_stats().interrupts_disabled++;
+    return 0;
+}
+
+void restore_interrupts(uint32_t) {}
+
+// --- btstack_util ----------------------------------------------------------------------------------------
+
+uint16_t little_endian_read_16(const uint8_t *buffer, int position) {
+    return static_cast<uint16_t>(buffer[position] | (buffer[position + 1] << 8));
+}
+
+uint32_t little_endian_read_24(const uint8_t *buffer, int position) {
+    return buffer[position] | (buffer[position + 1] << 8) | (static_cast<uint32_t>(buffer[position + 2]) << 16);
+}
+
+uint32_t little_endian_read_32(const uint8_t *buffer, int position) {
+    return little_endian_read_24(buffer, position) | (static_cast<uint32_t>(buffer[position + 3]) << 24);
+}
+
+void little_endian_store_16(uint8_t *buffer, uint16_t position, uint16_t value) {
+    buffer[position] = static_cast<uint8_t>(value);
+    buffer[position + 1] = static_cast<uint8_t>(value >> 8);
+}
+
+void little_endian_store_24(uint8_t *buffer, uint16_t position, uint32_t value) {
+    little_endian_store_16(buffer, position, static_cast<uint16_t>(value));
+    buffer[position + 2] = static_cast<uint8_t>(value >> 16);
+}
+
+void little_endian_store_32(uint8_t *buffer, uint16_t position, uint32_t value) {
+    little_endian_store_16(buffer, position, static_cast<uint16_t>(value));
+    little_endian_store_16(buffer, position + 2, static_cast<uint16_t>(value >> 16));
+}
+
+void reverse_bd_addr(const bd_addr_t src, bd_addr_t dest) {
+    for (int i = 0; i < BD_ADDR_LEN; i++) dest[i] = src[BD_ADDR_LEN - 1 - i];
+}
+
+void bd_addr_copy(bd_addr_t dest, const bd_addr_t src) { memcpy(dest, src, BD_ADDR_LEN); }
+
+int bd_addr_cmp(const bd_addr_t a, const bd_addr_t b) { return memcmp(a, b, BD_ADDR_LEN); }
+
+char *bd_addr_to_str(const bd_addr_t addr) {
+    static char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X", addr[0], addr[1], addr[2], addr[3], addr[4],
+             addr[5]);
+    return buffer;
+}
+
+// --- pico/sem --------------------------------------------------------------------------------------------
+
+namespace {
+    struct sem_impl {
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    sem_impl &sem_get(semaphore_t *sem) {
+        if (!sem->impl) sem->impl = new sem_impl();
+        return *static_cast<sem_impl *>(sem->impl);
+    }
+}
+
+void sem_init(semaphore_t *sem, int16_t initial_permits, int16_t max_permits) {
+    sem->permits = initial_permits;
+    sem->max_permits = max_permits;
+    sem_get(sem);
+}
+
+int sem_available(semaphore_t *sem) {
+    std::lock_guard<std::mutex> lock(sem_get(sem).mutex);
+    return sem->permits;
+}
+
+bool sem_release(semaphore_t *sem) {
+    sem_impl &impl = sem_get(sem);
+    {
+        std::lock_guard<std::mutex> lock(impl.mutex);
+        if (sem->permits >= sem->max_permits) return false;
+        sem->permits++;
+    }
+    impl.cv.notify_one();
+    return true;
+}
+
+void sem_acquire_blocking(semaphore_t *sem) {
+    sem_impl &impl = sem_get(sem);
+    std::unique_lock<std::mutex> lock(impl.mutex);
+    impl.cv.wait(lock, [sem] { return sem->permits > 0; });
+    sem->permits--;
+}
+
+bool sem_acquire_timeout_ms(semaphore_t *sem, uint32_t timeout_ms) {
+    sem_impl &impl = sem_get(sem);
+    std::unique_lock<std::mutex> lock(impl.mutex);
+    if (!impl.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [sem] { return sem->permits > 0; })) {
+        return false;
+    }
+    sem->permits--;
+    return true;
+}
+
+bool sem_try_acquire(semaphore_t *sem) {
+    return sem_acquire_timeout_ms(sem, 0);
+}
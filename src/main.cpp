@@ -1,6 +1,10 @@
 #include "pico/cyw43_arch.h"
+#if PICO_W_DUAL_CORE
+#include "pico/multicore.h"
+#endif
 
 // Forward declarations for btstack
+#include <algorithm>
 #include <memory>
 #include "pico_w_registry_policy.h"
 
@@ -9,21 +13,70 @@
 #include "GCore/Interfaces/IPlatformHardwareInfo.h"
 #include "GCore/Templates/TBasicDeviceRegistry.h"
 #include "pico_w_platform.h"
+#include "pico_w_trigger_effects.h"
+#include "pico_w_input_events.h"
+#include "pico_w_output_sequencer.h"
+#include "pico_w_action_map.h"
+#include "pico_w_latency.h"
+#include "pico_w_log.h"
+#include "pico_w_memory.h"
+#if PICO_W_FIXED_INPUT
+#include "pico_w_fixed_input.h"
+#endif
+#if PICO_W_IMU_FUSION
+#include "pico_w_imu_fusion.h"
+#endif
+#if PICO_W_USB_BRIDGE
+#include "pico_w_usb_bridge.h"
+#endif
+#if PICO_W_INPUT_BENCH
+#include "pico_w_input_bench.h"
+#include "pico_w_imu_bench.h"
+#endif
 #include "GCore/Interfaces/ISonyGamepad.h"
 using pico_platform = GamepadCore::TGenericHardwareInfo<pico_w_platform_policy>;
 
-inline void initialize_device() {
-    printf("Initializing device...\n");
-    FDeviceContext Context = {};
-    Context.Path = "Bluetooth";
-    Context.IsConnected = false;
-    Context.DeviceType = EDSDeviceType::DualSense;
-    Context.ConnectionType = EDSDeviceConnection::Bluetooth;
+// LED blinks on/off every 400 ms; a binding that fires holds it on until the next off edge
+#define BLINK_HALF_PERIOD_MS 400
 
+// One registry device per controller slot; slot i is engine id i and is bound to connections[i]
+inline void initialize_device() {
+    printf("Initializing %d devices...\n", MAX_NR_GAMEPADS);
     auto& registry = policy_device::get_instance();
-    registry.CreateDevice(Context);
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        FDeviceContext Context = {};
+        Context.Path = "Bluetooth";
+        Context.IsConnected = false;
+        Context.DeviceType = EDSDeviceType::DualSense;
+        Context.ConnectionType = EDSDeviceConnection::Bluetooth;
+
+        registry.CreateDevice(Context);
+        connection_bind_gamepad(slot, registry.GetLibrary(slot));
+    }
 }
 
+// Start/Share: feature reset with the lightbar off, then lightbar white and player LED after 400 ms
+static constexpr output_keyframe reset_features_timeline[] = {
+    {.at_ms = 0, .fields = OUTPUT_FIELD_FEATURE | OUTPUT_FIELD_LIGHTBAR, .lightbar = {0, 0, 0},
+     .feature = {0xFF, 0xFF, 0x00, 0x00}},
+    {.at_ms = 400, .fields = OUTPUT_FIELD_FEATURE | OUTPUT_FIELD_LIGHTBAR | OUTPUT_FIELD_PLAYER_LED | OUTPUT_FIELD_STEP,
+     .lightbar = {255, 255, 255}, .player = EDSPlayer::One, .player_brightness = 0xff,
+     .feature = {0x57, 0xFF, 0x00, 0x00}},
+};
+
+// Cross: red lightbar, heavy rumble held for 250 ms and faded out by 400 ms
+static constexpr output_keyframe cross_timeline[] = {
+    {.at_ms = 0, .fields = OUTPUT_FIELD_LIGHTBAR | OUTPUT_FIELD_RUMBLE, .lightbar = {0xff, 0, 0}, .rumble = {100, 0}},
+    {.at_ms = 250, .fields = OUTPUT_FIELD_RUMBLE, .rumble = {100, 0}},
+    {.at_ms = 400, .fields = OUTPUT_FIELD_RUMBLE, .rumble = {0, 0}},
+};
+
+// Circle: yellow lightbar, soft rumble fading out over 400 ms
+static constexpr output_keyframe circle_timeline[] = {
+    {.at_ms = 0, .fields = OUTPUT_FIELD_LIGHTBAR | OUTPUT_FIELD_RUMBLE, .lightbar = {0xff, 0xff, 0}, .rumble = {0, 50}},
+    {.at_ms = 400, .fields = OUTPUT_FIELD_RUMBLE, .rumble = {0, 0}},
+};
+
 inline void print_controls_helper()
 {
     printf("=======================================================\n");
@@ -42,251 +95,388 @@ inline void print_controls_helper()
     printf("   [DOWN]  : Trigger Effect: Bow (Tension)\n");
     printf("   [LEFT]  : Trigger Effect: Weapon (Semi)\n");
     printf("   [RIGHT] : Trigger Effect: Automatic Gun (Buzz)\n");
+    printf("   [L1+R1] : Trigger Effects Off\n");
     printf("=======================================================\n");
     printf(" Waiting for input...\n");
 }
 
+// Triangle: green lightbar, both trigger effects off
+static constexpr output_keyframe stop_timeline[] = {
+    {.at_ms = 0, .fields = OUTPUT_FIELD_LIGHTBAR | OUTPUT_FIELD_TRIGGER_LEFT | OUTPUT_FIELD_TRIGGER_RIGHT |
+     OUTPUT_FIELD_STEP, .lightbar = {0, 255, 0}, .trigger = &TRIGGER_EFFECT_OFF},
+};
+
+// L1+R1: both trigger effects off
+static constexpr output_keyframe triggers_off_timeline[] = {
+    {.at_ms = 0, .fields = OUTPUT_FIELD_TRIGGER_LEFT | OUTPUT_FIELD_TRIGGER_RIGHT, .trigger = &TRIGGER_EFFECT_OFF},
+};
+
+// Raw stick deflection from centre that counts as "moved" for the analog printout (0.1 of full scale)
+#define STICK_ACTIVE_RAW 13
+
+// action_event() codes: buttons bound to nothing but the event trace
+enum main_action_event : uint8_t {
+    MAIN_ACTION_L3 = 0,
+    MAIN_ACTION_R3,
+};
+
+static bool reset_features_sent[MAX_NR_GAMEPADS] = {};
+#if PICO_W_FIXED_INPUT
+static fixed_input_state pad_fixed[MAX_NR_GAMEPADS] = {};
+#endif
+
+// Start/Share: the feature reset once per slot, the controls every time
+static void action_configure(const action_context& context) {
+    if (!reset_features_sent[context.slot]) {
+        reset_features_sent[context.slot] = true;
+        printf("Resetting bluetooth features...\n");
+        output_sequencer_start(context.slot, reset_features_timeline, context.now_ms);
+    }
+    printf("Complete configuration features...\n");
+    printf("Slot %u input frames overwritten before decode: %u\n", context.slot,
+           (unsigned int)input_pipeline_overwritten(context.slot));
+    print_controls_helper();
+}
+
+static void action_gamecube(const action_context& context) {
+    context.gamepad->GetIGamepadTrigger()->SetGameCube(EDSGamepadHand::Right);
+    context.gamepad->UpdateOutput();
+}
+
+static void action_machine_gun(const action_context& context) {
+    context.gamepad->GetIGamepadTrigger()->SetMachineGun26(0xed, 0x03, 0x02, 0x09, EDSGamepadHand::Right);
+    context.gamepad->UpdateOutput();
+}
+
+#if PICO_W_FIXED_INPUT
+static void action_print_left_stick(const action_context& context) {
+    const fixed_input_state& fixed = pad_fixed[context.slot];
+    printf("Left Analog: X %d, Y %d (x1000)\n", q15_to_milli(fixed.left.x), q15_to_milli(fixed.left.y));
+}
+
+static void action_print_right_stick(const action_context& context) {
+    const fixed_input_state& fixed = pad_fixed[context.slot];
+    printf("Right Analog: X %d, Y %d (x1000)\n", q15_to_milli(fixed.right.x), q15_to_milli(fixed.right.y));
+}
+
+static void action_print_touch(const action_context& context) {
+    const fixed_input_state& fixed = pad_fixed[context.slot];
+    printf("Fringer count: %d \n", (int)fixed.touch_count);
+    printf("Touchpad: X %d, Y %d (x1000)\n", q15_to_milli(fixed.touch_x), q15_to_milli(fixed.touch_y));
+}
+#else
+static void action_print_left_stick(const action_context& context) {
+    const FInputContext* input = context.gamepad->GetMutableDeviceContext()->GetInputState();
+    printf("Left Analog: X %f, Y %f \n", input->LeftAnalog.X, input->LeftAnalog.Y);
+}
+
+static void action_print_right_stick(const action_context& context) {
+    const FInputContext* input = context.gamepad->GetMutableDeviceContext()->GetInputState();
+    printf("Right Analog: X %f, Y %f \n", input->RightAnalog.X, input->RightAnalog.Y);
+}
+
+static void action_print_touch(const action_context& context) {
+    const FInputContext* input = context.gamepad->GetMutableDeviceContext()->GetInputState();
+    printf("Fringer count: %d \n", (int)input->TouchFingerCount);
+    printf("Touchpad: X %f, Y %f \n", input->TouchPosition.X, input->TouchPosition.Y);
+}
+#endif
+
+static constexpr action_binding main_bindings[] = {
+    on_chord(FIXED_BUTTON_OPTIONS, action_call(action_configure), "Options"),
+    on_chord(FIXED_BUTTON_CREATE, action_call(action_configure), "Create"),
+    on_chord(FIXED_BUTTON_CROSS, action_timeline(cross_timeline), "Cross"),
+    on_chord(FIXED_BUTTON_CIRCLE, action_timeline(circle_timeline), "Circle"),
+    on_chord(FIXED_BUTTON_SQUARE, action_call(action_gamecube), "Square: trigger R GameCube (0x02)"),
+    on_chord(FIXED_BUTTON_TRIANGLE, action_timeline(stop_timeline), "Triangle: stop all"),
+    on_chord(FIXED_BUTTON_L1, action_trigger(EDSGamepadHand::Left, trigger_effect_v<trigger_gallop{1, 7, 6, 7, 2}>),
+             "L1: trigger L Gallop (0x23)"),
+    on_chord(FIXED_BUTTON_R1,
+             action_trigger(EDSGamepadHand::Right, trigger_effect_v<trigger_machine{7, 9, 3, 8, 10, 4}>),
+             "R1: trigger R Machine (0x27)"),
+    on_chord(FIXED_BUTTON_L1 | FIXED_BUTTON_R1, action_timeline(triggers_off_timeline), "L1+R1: triggers off"),
+    on_chord(FIXED_BUTTON_DPAD_LEFT, action_trigger(EDSGamepadHand::Right, trigger_effect_v<trigger_weapon{3, 8, 8}>),
+             "Left: trigger R Weapon (0x25)"),
+    on_chord(FIXED_BUTTON_DPAD_RIGHT, action_call(action_machine_gun), "Right: trigger R AutomaticGun (0x26)"),
+    on_chord(FIXED_BUTTON_DPAD_DOWN, action_trigger(EDSGamepadHand::Right, trigger_effect_v<trigger_bow{1, 8, 8, 8}>),
+             "Down: trigger R Bow (0x22)"),
+    on_chord(FIXED_BUTTON_DPAD_UP, action_trigger(EDSGamepadHand::Left, trigger_effect_v<trigger_feedback{1, 8}>),
+             "Up: trigger L feedback (0x21)"),
+    on_chord(FIXED_BUTTON_L3, action_event(MAIN_ACTION_L3), "L3"),
+    on_chord(FIXED_BUTTON_R3, action_event(MAIN_ACTION_R3), "R3"),
+    on_source(ACTION_SOURCE_LEFT_STICK, STICK_ACTIVE_RAW, action_call(action_print_left_stick), nullptr,
+              ACTION_WHILE_HELD),
+    on_source(ACTION_SOURCE_RIGHT_STICK, STICK_ACTIVE_RAW, action_call(action_print_right_stick), nullptr,
+              ACTION_WHILE_HELD),
+    on_source(ACTION_SOURCE_TOUCH, 1, action_call(action_print_touch), nullptr, ACTION_WHILE_HELD),
+};
+
+static_assert(action_bindings_valid(main_bindings), "action binding: chord must be non-empty FIXED_BUTTON_* bits");
+static constexpr auto main_actions = action_table_build(main_bindings);
+
+// Fields the bindings above depend on; IMU and battery changes do not wake them
+#define MAIN_INPUT_EVENTS (INPUT_DIRTY_BUTTONS | INPUT_DIRTY_LEFT_STICK | INPUT_DIRTY_RIGHT_STICK | \
+                           INPUT_DIRTY_TRIGGERS | INPUT_DIRTY_TOUCH)
+// Fields a change of which runs UpdateInput: the bindings' plus the battery, so Gamepad-Core's battery state does
+// not go stale on an idle controller. Motion goes to the fixed-point fusion instead.
+#define MAIN_INPUT_DECODE (MAIN_INPUT_EVENTS | INPUT_DIRTY_BATTERY)
+
+static bool input_event_trace = false;
+
+// USB CDC console: 'l' dumps the latency histograms, reconnect timings and link state, 'r' clears the histograms,
+// 'e' toggles the input event trace, 'p' switches every controller to the next link profile, 'm' prints each
+// controller's orientation, 'c' starts or stops the L2CAP capture, 'h' prints each link's health counters, 'u' the
+// USB HID bridge counters, 'a' the haptic audio counters
+inline void poll_console() {
+    const int c = getchar_timeout_us(0);
+    if (c == 'l') {
+        latency_dump();
+        reconnect_dump();
+        link_profile_dump();
+    } else if (c == 'p') {
+        async_context_t* bt_context = cyw43_arch_async_context();
+        async_context_acquire_lock_blocking(bt_context);
+        link_profile_select_all(static_cast<link_profile>((link_profile_default + 1) % LINK_PROFILE_COUNT));
+        async_context_release_lock(bt_context);
+    } else if (c == 'h') {
+        link_health_stats stats[MAX_NR_GAMEPADS];
+        bool live[MAX_NR_GAMEPADS];
+        async_context_t* bt_context = cyw43_arch_async_context();
+        async_context_acquire_lock_blocking(bt_context);
+        for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) live[slot] = link_health_snapshot(slot, stats[slot]);
+        async_context_release_lock(bt_context);
+        for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+            if (live[slot]) link_health_print(slot, stats[slot]);
+        }
+    } else if (c == 'r') {
+        latency_reset();
+        printf("[LAT] Histograms cleared\n");
+#if PICO_W_IMU_FUSION
+    } else if (c == 'm') {
+        imu_fusion_dump();
+#endif
+#if PICO_W_CAPTURE
+    } else if (c == 'c') {
+        async_context_t* bt_context = cyw43_arch_async_context();
+        async_context_acquire_lock_blocking(bt_context);
+        if (capture_active) {
+            capture_stop();
+        } else {
+            capture_start();    // stays off if the ring has no room for the START record yet
+        }
+        async_context_release_lock(bt_context);
+        printf("[CAP] Capture %s (%u records, %u dropped)\n", capture_active ? "on" : "off",
+               (unsigned int)capture_records, (unsigned int)capture_dropped_total);
+#endif
+#if PICO_W_HAPTIC_AUDIO
+    } else if (c == 'a') {
+        async_context_t* bt_context = cyw43_arch_async_context();
+        async_context_acquire_lock_blocking(bt_context);
+        haptic_audio_print();
+        async_context_release_lock(bt_context);
+#endif
+#if PICO_W_USB_BRIDGE
+    } else if (c == 'u') {
+        usb_bridge_print();
+#endif
+    } else if (c == 'e') {
+        input_event_trace = !input_event_trace;
+        printf("[IN] Event trace %s (%u dropped)\n", input_event_trace ? "on" : "off",
+               (unsigned int)input_events_dropped);
+    }
+}
+
+inline void drain_input_events() {
+    static const char* const types[] = {"press", "release", "axis", "touch", "battery", "action"};
+    input_event event;
+    while (input_events_pop(event)) {
+        if (input_event_trace) {
+            printf("[IN] %10u us device %u %-7s %2u = %3u\n", (unsigned int)event.timestamp_us, event.slot,
+                   types[event.type], event.code, event.value);
+        }
+    }
+}
+
+#if PICO_W_DUAL_CORE
+#define CORE1_READY 0xB7C0DE01u
+
+// core1: owns CYW43 + BTstack; every BTstack callback runs from this core's async context interrupts
+static void core1_bluetooth_main() {
+    if (cyw43_arch_init()) {
+        printf("ERROR: Failed to initialize CYW43 on core1\n");
+        multicore_fifo_push_blocking(0);
+        return;
+    }
+    init_bluetooth();
+    multicore_fifo_push_blocking(CORE1_READY);
+
+    while (true) {
+        __wfi();
+    }
+}
+#endif
+
 int main() {
+#if PICO_W_USB_BRIDGE
+    usb_device_init();
+#endif
     stdio_init_all();
+#if !PICO_W_DUAL_CORE
     if (cyw43_arch_init()) {
         printf("ERROR: Failed to initialize CYW43\n");
         return -1;
     }
+#endif
 
+#if PICO_W_USB_BRIDGE
+    usb_device_wait_ms(2000);
+#else
     sleep_ms(2000);
+#endif
 
     printf("\n");
     printf("========================================\n");
     printf("   PICO W - BLUETOOTH DISCOVERY\n");
     printf("========================================\n");
 
+#if PICO_W_INPUT_BENCH
+    const input_bench_result bench = input_bench_run(1000);
+    printf("[BENCH] Input decode per report: float %u cycles, Q15 %u cycles (%u disagreements)\n",
+           (unsigned int)(bench.float_cycles / bench.reports), (unsigned int)(bench.fixed_cycles / bench.reports),
+           (unsigned int)bench.mismatches);
+    const imu_bench_result imu_bench = imu_bench_run(1000);
+    printf("[BENCH] IMU fusion per update: float %u cycles, Q30 %u cycles, %u mdeg from float, tilt rms %u mdeg\n",
+           (unsigned int)(imu_bench.float_cycles / imu_bench.updates),
+           (unsigned int)(imu_bench.fixed_cycles / imu_bench.updates),
+           (unsigned int)(imu_bench.max_divergence_deg * 1000.0f),
+           (unsigned int)(imu_bench.fixed_tilt_rms_deg * 1000.0f));
+#endif
+
+    heap_charge(HEAP_PLATFORM);
     auto HardwareInfo = std::make_unique<pico_platform>();
     IPlatformHardwareInfo::SetInstance(std::move(HardwareInfo));
     printf("Hardware initialized OK\n");
 
-    using namespace policy_device;
+    heap_charge(HEAP_REGISTRY);
     initialize_device();
-    auto& registry = get_instance();
     printf("Device initialized OK\n");
 
+    heap_charge(HEAP_EFFECTS);
+    trigger_effects_init();
+
+    flash_bonds_init();
+    input_pipeline_init();
+#if PICO_W_DUAL_CORE
+    multicore_launch_core1(core1_bluetooth_main);
+    if (multicore_fifo_pop_blocking() != CORE1_READY) {
+        return -1;
+    }
+    // core1 writes bonds to flash; from here on it can park core0 through the FIFO IRQ
+    multicore_lockout_victim_init();
+    printf("Bluetooth initialized OK (core1)\n");
+#else
     init_bluetooth();
     printf("Bluetooth initialized OK\n");
+#endif
 
-    std::vector<uint8_t> BufferTrigger;
-    BufferTrigger.resize(10);
+    input_events_subscribe(MAIN_INPUT_DECODE);
 
-    int blink_cnt = 0;
-    int unique_send = 0;
-    int reset_bt_send = 0;
-    while(true) {
+    // everything the loop needs is allocated; with DUALSENSE_ZERO_HEAP any later new or delete panics
+    heap_seal();
+    memory_budget_dump();
 
-        if (auto* gamepad = registry.GetLibrary(0)) {
-            if (gamepad->IsConnected()) {
-                // enable touchpad and sensors, gyro and accelerometer, can be used to control mouse cursor or for motion controls in games
+    uint32_t blink_phase = 0;
+    uint32_t sequencer_wait_ms = OUTPUT_SEQUENCER_IDLE;
+    while(true) {
+        // Sleep until any controller delivers a 0x31 frame, the next output timeline frame is due, or the next LED
+        // blink edge when all are idle
+        const uint32_t wait_ms = static_cast<uint32_t>(time_us_64() / 1000);
+        const uint32_t next_edge_ms = (wait_ms / BLINK_HALF_PERIOD_MS + 1) * BLINK_HALF_PERIOD_MS;
+#if PICO_W_USB_BRIDGE
+        // the host polls every 1 ms and only tud_task() answers it
+        const bool woke = input_pipeline_wait(std::min({next_edge_ms - wait_ms, sequencer_wait_ms,
+                                                        (uint32_t)USB_BRIDGE_POLL_MS}));
+        usb_bridge_task();
+#else
+        const bool woke = input_pipeline_wait(std::min(next_edge_ms - wait_ms, sequencer_wait_ms));
+#endif
+
+        const uint32_t now_ms = static_cast<uint32_t>(time_us_64() / 1000);
+        const uint32_t phase = now_ms / BLINK_HALF_PERIOD_MS;
+        const bool blink_edge = phase != blink_phase;
+        blink_phase = phase;
+        sequencer_wait_ms = OUTPUT_SEQUENCER_IDLE;
+
+        for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+            ISonyGamepad* gamepad = connections[slot].gamepad;
+            if (!gamepad) continue;
+            input_frame_info frame = {};
+            const uint8_t* input_report = input_pipeline_acquire(slot, frame);
+            if (input_report && gamepad->IsConnected()) {
+#if PICO_W_USB_BRIDGE
+                // to the USB host first: the bridge reads the raw frame and does not wait for Gamepad-Core
+                usb_bridge_stage_input(slot, {input_report}, static_cast<uint32_t>(frame.timestamp_us));
+                usb_bridge_send(slot);
+#endif
+                // enable touchpad; gyro and accelerometer are left to the fixed-point fusion below instead of the
+                // float decode
                 gamepad->EnableTouch(true);
                 gamepad->EnableMotionSensor(false);
 
-                gamepad->UpdateInput(0.016f); // Update input state, should be called every frame with the time delta since last call
-
-                FInputContext* input = gamepad->GetMutableDeviceContext()->GetInputState();
-                if (input->bStart || input->bShare) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    if (reset_bt_send == 0) { // l2cap_send to set lightbar to white and vibrate
-                        unique_send = 1;
-                        reset_bt_send = 1;
-
-                        printf("Resetting bluetooth features...\n");
-                        gamepad->GetMutableDeviceContext()->Output.Feature = {0xFF, 0xFF, 0x00, 0x00};
-                        gamepad->SetLightbar({0, 0, 0, 0});
-                        gamepad->UpdateOutput();
-                        sleep_ms(400);
-                        gamepad->GetMutableDeviceContext()->Output.Feature = {0x57, 0xFF, 0x00, 0x00};
-                        gamepad->SetLightbar({255, 255, 255, 0});
-                        gamepad->SetPlayerLed(EDSPlayer::One, 0xff);
-                        gamepad->UpdateOutput();
-                        sleep_ms(400);
-                    }
-
-                    printf("Complete configuration features...\n");
-                    print_controls_helper();
-                } else if (input->bCross) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("Cross button pressed\n");
-                    if (unique_send == 0) {
-                        unique_send = 1;
-                        gamepad->SetLightbar({0xff, 0, 0, 0});
-                        gamepad->SetVibration(100, 0);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bCircle) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("Circle button pressed\n");
-
-                    if (unique_send == 0) {
-                        unique_send = 1;
-                        gamepad->SetLightbar({0xff, 0xff, 0, 0});
-                        gamepad->SetVibration(0, 50);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bSquare) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("Square button pressed\n");
-                    printf("Trigger R: GameCube (0x02)\n");
-                    if (unique_send == 0) {
-                        unique_send = 1;
-                        gamepad->GetIGamepadTrigger()->SetGameCube(EDSGamepadHand::Right);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bTriangle) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("Triangle button pressed\n");
-
-                    if (unique_send == 0) { // l2cap_send to set lightbar to white and vibrate
-                        unique_send = 1;
-                        gamepad->SetLightbar({0, 255, 0});
-                        gamepad->GetIGamepadTrigger()->StopTrigger(EDSGamepadHand::AnyHand);
-                        gamepad->UpdateOutput();
-                    }
-                }  else if (input->bLeftShoulder) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("L1 button pressed:\n");
-
-                    if (unique_send == 0) { // l2cap_send to set lightbar to white and vibrate
-                        unique_send = 1;
-                        BufferTrigger[0] = 0x23;
-                        BufferTrigger[1] = 0x82;
-                        BufferTrigger[2] = 0x00;
-                        BufferTrigger[3] = 0xf7;
-                        BufferTrigger[4] = 0x02;
-                        BufferTrigger[5] = 0x00;
-                        BufferTrigger[6] = 0x00;
-                        BufferTrigger[7] = 0x00;
-                        BufferTrigger[8] = 0x00;
-                        BufferTrigger[9] = 0x00;
-
-                        printf("Trigger L: Gallop (0x23)\n");
-                        gamepad->GetIGamepadTrigger()->SetCustomTrigger(EDSGamepadHand::Left, BufferTrigger);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bDpadLeft) {
-
-                    if (unique_send == 0) {
-                        unique_send = 1;
-                        BufferTrigger[0] = 0x25;
-                        BufferTrigger[1] = 0x08;
-                        BufferTrigger[2] = 0x01;
-                        BufferTrigger[3] = 0x07;
-                        BufferTrigger[4] = 0x00;
-                        BufferTrigger[5] = 0x00;
-                        BufferTrigger[6] = 0x00;
-                        BufferTrigger[7] = 0x00;
-                        BufferTrigger[8] = 0x00;
-                        BufferTrigger[9] = 0x00;
-                        printf("Trigger R: Weapon (0x25)\n");
-
-                        gamepad->GetIGamepadTrigger()->SetCustomTrigger(EDSGamepadHand::Right, BufferTrigger);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bDpadRight) {
-                    if (unique_send == 0) {
-                        unique_send = 1;
-                        printf("Trigger R: AutomaticGun (0x26)\n");
-                        gamepad->GetIGamepadTrigger()->SetMachineGun26(0xed, 0x03, 0x02, 0x09, EDSGamepadHand::Right);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bDpadDown) {
-                    if (unique_send == 0) { // l2cap_send to set lightbar to white and vibrate
-                        unique_send = 1;
-                        BufferTrigger[0] = 0x22;
-                        BufferTrigger[1] = 0x02;
-                        BufferTrigger[2] = 0x01;
-                        BufferTrigger[3] = 0x3f;
-                        BufferTrigger[4] = 0x00;
-                        BufferTrigger[5] = 0x00;
-                        BufferTrigger[6] = 0x00;
-                        BufferTrigger[7] = 0x00;
-                        BufferTrigger[8] = 0x00;
-                        BufferTrigger[9] = 0x00;
-                        printf("Trigger R: Bow (0x22)\n");
-
-                        gamepad->GetIGamepadTrigger()->SetCustomTrigger(EDSGamepadHand::Right, BufferTrigger);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bDpadUp) {
-                    if (unique_send == 0) { // l2cap_send to set lightbar to white and vibrate
-                        unique_send = 1;
-                        BufferTrigger[0] = 0x21;
-                        BufferTrigger[1] = 0xfe;
-                        BufferTrigger[2] = 0x03;
-                        BufferTrigger[3] = 0xf8;
-                        BufferTrigger[4] = 0xff;
-                        BufferTrigger[5] = 0xff;
-                        BufferTrigger[6] = 0x3f;
-                        BufferTrigger[7] = 0x00;
-                        BufferTrigger[8] = 0x00;
-                        BufferTrigger[9] = 0x00;
-
-                        printf("Trigger L: feedback (0x21)\n");
-
-                        gamepad->GetIGamepadTrigger()->SetCustomTrigger(EDSGamepadHand::Left, BufferTrigger);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bRightShoulder) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("R1 button pressed\n");
-
-                    if (unique_send == 0) { // l2cap_send to set lightbar to white and vibrate
-                        unique_send = 1;
-                        BufferTrigger[0] = 0x27;
-                        BufferTrigger[1] = 0x80;
-                        BufferTrigger[2] = 0x02;
-                        BufferTrigger[3] = 0x3a;
-                        BufferTrigger[4] = 0x0a;
-                        BufferTrigger[5] = 0x04;
-                        BufferTrigger[6] = 0x00;
-                        BufferTrigger[7] = 0x00;
-                        BufferTrigger[8] = 0x00;
-                        BufferTrigger[9] = 0x00;
-
-                        printf("Trigger R: Machine (0x27)\n");
-                        gamepad->GetIGamepadTrigger()->SetCustomTrigger(EDSGamepadHand::Right, BufferTrigger);
-                        gamepad->UpdateOutput();
-                    }
-                } else if (input->bLeftStick) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("L3 button pressed\n");
-                } else if (input->bRightStick) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("R3 button pressed\n");
-                } else if (abs(input->LeftAnalog.X) > 0.1f || abs(input->LeftAnalog.Y) > 0.1f) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("Left Analog: X %f, Y %f \n", input->LeftAnalog.X, input->LeftAnalog.Y);
-                } else if (abs(input->RightAnalog.X) > 0.1f || abs(input->RightAnalog.Y) > 0.1f) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("Right Analog: X %f, Y %f \n", input->RightAnalog.X, input->RightAnalog.Y);
-                } else if (input->bIsTouching) {
-                    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-                    printf("Fringer count: %d \n", (int)input->TouchFingerCount);
-                    printf("Touchpad: X %f, Y %f \n", input->TouchPosition.X, input->TouchPosition.Y);
+                if (frame.first_after_connect) {
+                    input_events_reset(slot);
+                    action_map_reset(slot);
+                }
+                const uint16_t changed = input_events_update(slot, {input_report},
+                                                             static_cast<uint32_t>(frame.timestamp_us));
+                if (changed) {
+                    // decode the frame claimed by input_pipeline_acquire(), never the buffer BTstack writes
+                    memcpy(gamepad->GetMutableDeviceContext()->Buffer, input_report, INPUT_REPORT_SIZE);
+                    gamepad->UpdateInput(frame.delta_time); // time measured between the frames' arrival timestamps
+                    latency_input_decoded(slot, frame.timestamp_us);
+                }
+                const uint16_t dirty = changed & MAIN_INPUT_EVENTS;
+
+#if PICO_W_FIXED_INPUT
+                // sticks and touch for the print bindings, without soft-float
+                if (dirty) fixed_input_decode({input_report}, pad_fixed[slot]);
+#endif
+#if PICO_W_IMU_FUSION
+                // every frame: motion changes even when nothing the bindings read does
+                imu_fusion_update(slot, {input_report}, frame.first_after_connect);
+#endif
+                const action_context context = {slot, gamepad, static_cast<uint32_t>(frame.timestamp_us), now_ms,
+                                                &input_change_slots[slot].last};
+                const uint32_t fired = action_dispatch(main_actions, dirty, context);
+                if (fired) cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
+                for (uint32_t bits = fired; bits; bits &= bits - 1) {
+                    const char* name = main_actions.bindings[__builtin_ctz(bits)].name;
+                    if (name) printf("%s\n", name);
                 }
             }
 
-            if (blink_cnt % 50 == 25) {
-                unique_send = 0;
-                gamepad->SetVibration(0, 0);
+#if PICO_W_USB_BRIDGE
+            usb_bridge_apply_pending(slot, gamepad);    // dropped while no controller is connected
+            if (!gamepad->IsConnected()) usb_bridge_release(slot);
+#endif
+            if (gamepad->IsConnected()) {
+                sequencer_wait_ms = std::min(sequencer_wait_ms, output_sequencer_poll(slot, gamepad, now_ms));
+            } else {
+                output_sequencer_stop(slot);
             }
         }
 
-
-        if (blink_cnt++ % 50 == 0) {
-            cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-        }
-
-        if (blink_cnt % 50 == 25) {
-            cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
+        if (blink_edge) {
+            cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, (phase & 1) == 0);
         }
 
-        sleep_ms(16);
+        // deferred BTstack logs: everything when idle, a few records per pass while frames keep arriving
+        log_drain(woke ? LOG_DRAIN_BUSY : LOG_DRAIN_ALL);
+#if PICO_W_CAPTURE
+        capture_drain();
+#endif
+        drain_input_events();
+        poll_console();
     }
     return 0;
 }
@@ -0,0 +1,270 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "btstack_config.h"
+#include "GCore/Interfaces/ISonyGamepad.h"
+#include "pico_w_fixed_input.h"
+#include "pico_w_input_events.h"
+#include "pico_w_output_sequencer.h"
+#include "pico_w_trigger_effects.h"
+
+// Action mapping.
+// A binding pairs a predicate on one input source with an action. The predicate is a button chord (every
+// FIXED_BUTTON_* bit in it held), a stick pushed further than a deflection from centre, a trigger pulled past a
+// raw value, or at least some number of fingers on the touchpad. The action starts an output timeline, applies a
+// trigger effect, queues an INPUT_EVENT_ACTION event, or calls a function. ACTION_ON_PRESS fires when the
+// predicate becomes true, ACTION_ON_RELEASE when it becomes false, ACTION_WHILE_HELD on every frame its source
+// changes while it is true. action_table_build() turns a constexpr array of bindings into a dispatch table:
+// for each button bit, the bindings whose chord holds it, and for each input_dirty bit, the stick, trigger and
+// touch bindings that read it. action_dispatch() takes the dirty bits input_events_update() returned for the
+// frame. It looks only at bindings under a changed button or a dirty source, so an unchanged frame costs one
+// compare and a busy one at most ACTION_MAX_BINDINGS predicates. Every binding that fires runs, in table order,
+// except a press chord that fires on the same frame as a larger press chord containing it: pressing L1 and then
+// R1 with L1+R1 bound runs L1's action and then the chord's, not R1's. Application loop only.
+
+#define ACTION_MAX_BINDINGS 32          // one bit per binding in the dispatch masks
+#define ACTION_BUTTON_BITS 19           // FIXED_BUTTON_DPAD_UP .. FIXED_BUTTON_MUTE
+#define ACTION_DIRTY_BITS 7             // INPUT_DIRTY_BUTTONS .. INPUT_DIRTY_BATTERY
+
+enum action_source : uint8_t {
+    ACTION_SOURCE_BUTTONS = 0,          // chord
+    ACTION_SOURCE_LEFT_STICK,           // threshold: deflection of either axis from 0x80
+    ACTION_SOURCE_RIGHT_STICK,
+    ACTION_SOURCE_L2,                   // threshold: raw trigger value
+    ACTION_SOURCE_R2,
+    ACTION_SOURCE_TOUCH,                // threshold: finger count
+};
+
+enum action_when : uint8_t {
+    ACTION_ON_PRESS = 0,
+    ACTION_ON_RELEASE,
+    ACTION_WHILE_HELD,
+};
+
+enum action_kind : uint8_t {
+    ACTION_TIMELINE = 0,
+    ACTION_TRIGGER,
+    ACTION_EVENT,
+    ACTION_CALLBACK,
+};
+
+struct action_context {
+    uint8_t slot;
+    ISonyGamepad* gamepad;
+    uint32_t timestamp_us;              // arrival of the frame
+    uint32_t now_ms;
+    const input_digest* input;          // the frame, as packed by input_events_update()
+};
+
+typedef void (*action_callback_t)(const action_context& context);
+
+struct action {
+    action_kind kind;
+    uint8_t code;                       // ACTION_EVENT: event code; ACTION_TIMELINE: keyframe count
+    EDSGamepadHand hand;                // ACTION_TRIGGER
+    trigger_effect effect;              // ACTION_TRIGGER
+    const output_keyframe* timeline;    // ACTION_TIMELINE
+    action_callback_t callback;         // ACTION_CALLBACK
+};
+
+struct action_binding {
+    action_source source;
+    action_when when;
+    uint32_t chord;                     // ACTION_SOURCE_BUTTONS
+    uint8_t threshold;
+    action run;
+    const char* name;                   // for traces
+};
+
+template<uint8_t Count>
+constexpr action action_timeline(const output_keyframe (&keys)[Count]) {
+    return {ACTION_TIMELINE, Count, EDSGamepadHand::AnyHand, TRIGGER_EFFECT_OFF, keys, nullptr};
+}
+
+constexpr action action_trigger(EDSGamepadHand hand, const trigger_effect& effect) {
+    return {ACTION_TRIGGER, 0, hand, effect, nullptr, nullptr};
+}
+
+constexpr action action_event(uint8_t code) {
+    return {ACTION_EVENT, code, EDSGamepadHand::AnyHand, TRIGGER_EFFECT_OFF, nullptr, nullptr};
+}
+
+constexpr action action_call(action_callback_t callback) {
+    return {ACTION_CALLBACK, 0, EDSGamepadHand::AnyHand, TRIGGER_EFFECT_OFF, nullptr, callback};
+}
+
+constexpr action_binding on_chord(uint32_t chord, action run, const char* name, action_when when = ACTION_ON_PRESS) {
+    return {ACTION_SOURCE_BUTTONS, when, chord, 0, run, name};
+}
+
+constexpr action_binding on_source(action_source source, uint8_t threshold, action run, const char* name,
+                                   action_when when = ACTION_ON_PRESS) {
+    return {source, when, 0, threshold, run, name};
+}
+
+template<size_t Count>
+struct action_table {
+    action_binding bindings[Count];
+    uint32_t by_button[ACTION_BUTTON_BITS];     // bindings whose chord holds the button
+    uint32_t by_dirty[ACTION_DIRTY_BITS];       // non-button bindings reading the input_dirty bit
+    uint32_t covered[Count];                    // press chords strictly inside this binding's chord
+};
+
+constexpr uint16_t action_source_dirty(action_source source) {
+    switch (source) {
+        case ACTION_SOURCE_BUTTONS: return INPUT_DIRTY_BUTTONS;
+        case ACTION_SOURCE_LEFT_STICK: return INPUT_DIRTY_LEFT_STICK;
+        case ACTION_SOURCE_RIGHT_STICK: return INPUT_DIRTY_RIGHT_STICK;
+        case ACTION_SOURCE_L2:
+        case ACTION_SOURCE_R2: return INPUT_DIRTY_TRIGGERS;
+        case ACTION_SOURCE_TOUCH: return INPUT_DIRTY_TOUCH;
+    }
+    return 0;
+}
+
+// An empty chord or one outside the button bits would never fire. Firmware builds have no exceptions, so each
+// table is checked with static_assert(action_bindings_valid(bindings)) next to its action_table_build().
+constexpr bool action_binding_valid(const action_binding& binding) {
+    if (binding.source != ACTION_SOURCE_BUTTONS) return binding.chord == 0;
+    return binding.chord != 0 && (binding.chord >> ACTION_BUTTON_BITS) == 0;
+}
+
+template<size_t Count>
+constexpr bool action_bindings_valid(const action_binding (&bindings)[Count]) {
+    for (size_t i = 0; i < Count; i++) {
+        if (!action_binding_valid(bindings[i])) return false;
+    }
+    return true;
+}
+
+template<size_t Count>
+constexpr action_table<Count> action_table_build(const action_binding (&bindings)[Count]) {
+    static_assert(Count <= ACTION_MAX_BINDINGS, "more bindings than bits in the dispatch masks");
+    action_table<Count> table = {};
+    for (size_t i = 0; i < Count; i++) {
+        const action_binding& binding = bindings[i];
+        table.bindings[i] = binding;
+        const uint32_t bit = 1u << i;
+        if (binding.source == ACTION_SOURCE_BUTTONS) {
+            for (uint8_t b = 0; b < ACTION_BUTTON_BITS; b++) {
+                if (binding.chord & (1u << b)) table.by_button[b] |= bit;
+            }
+        } else {
+            for (uint8_t d = 0; d < ACTION_DIRTY_BITS; d++) {
+                if (action_source_dirty(binding.source) & (1u << d)) table.by_dirty[d] |= bit;
+            }
+        }
+        for (size_t j = 0; j < Count; j++) {
+            const action_binding& inner = bindings[j];
+            if (j == i || inner.source != ACTION_SOURCE_BUTTONS || binding.source != ACTION_SOURCE_BUTTONS ||
+                inner.when != ACTION_ON_PRESS || binding.when != ACTION_ON_PRESS) {
+                continue;
+            }
+            if ((inner.chord & binding.chord) == inner.chord && inner.chord != binding.chord) {
+                table.covered[i] |= 1u << j;
+            }
+        }
+    }
+    return table;
+}
+
+struct action_slot {
+    uint32_t buttons;       // as of the last dispatched frame
+    uint32_t held;          // bindings whose predicate was true
+    uint32_t fired;         // bindings run by the last dispatch, for tests and traces
+};
+
+static action_slot action_slots[MAX_NR_GAMEPADS];
+
+// With input_events_reset(): the next frame's predicates are judged from nothing held.
+inline void action_map_reset(uint8_t slot) {
+    action_slots[slot] = {};
+}
+
+inline bool action_predicate(const action_binding& binding, const input_digest& input) {
+    switch (binding.source) {
+        case ACTION_SOURCE_BUTTONS:
+            return (input.buttons & binding.chord) == binding.chord;
+        case ACTION_SOURCE_LEFT_STICK:
+        case ACTION_SOURCE_RIGHT_STICK: {
+            const uint32_t sticks = binding.source == ACTION_SOURCE_LEFT_STICK ? input.sticks : input.sticks >> 16;
+            const int x = static_cast<int>(sticks & 0xFF) - 0x80;
+            const int y = static_cast<int>((sticks >> 8) & 0xFF) - 0x80;
+            return x > binding.threshold || -x > binding.threshold || y > binding.threshold ||
+                   -y > binding.threshold;
+        }
+        case ACTION_SOURCE_L2:
+            return (input.triggers & 0xFF) > binding.threshold;
+        case ACTION_SOURCE_R2:
+            return ((input.triggers >> 8) & 0xFF) > binding.threshold;
+        case ACTION_SOURCE_TOUCH:
+            return !(input.touch[0] & 0x80) + !(input.touch[1] & 0x80) >= binding.threshold;
+    }
+    return false;
+}
+
+inline void action_run(const action_binding& binding, const action_context& context) {
+    const action& run = binding.run;
+    switch (run.kind) {
+        case ACTION_TIMELINE:
+            output_sequencer_start(context.slot, run.timeline, run.code, context.now_ms);
+            break;
+        case ACTION_TRIGGER:
+            trigger_apply(context.gamepad, run.hand, run.effect);
+            context.gamepad->UpdateOutput();
+            break;
+        case ACTION_EVENT:
+            input_events_emit(context.timestamp_us, context.slot, INPUT_EVENT_ACTION, run.code, 0);
+            break;
+        case ACTION_CALLBACK:
+            run.callback(context);
+            break;
+    }
+}
+
+// After input_events_update() of the frame: evaluates the bindings its changes can affect and runs those that
+// fire. Returns the mask of fired bindings.
+template<size_t Count>
+inline uint32_t action_dispatch(const action_table<Count>& table, uint16_t dirty, const action_context& context) {
+    action_slot& state = action_slots[context.slot];
+    const input_digest& input = *context.input;
+    if (!dirty) {
+        state.fired = 0;
+        return 0;
+    }
+
+    uint32_t candidates = 0;
+    uint32_t changed = (dirty & INPUT_DIRTY_BUTTONS) ? input.buttons ^ state.buttons : 0;
+    state.buttons = input.buttons;
+    while (changed) {
+        candidates |= table.by_button[__builtin_ctz(changed)];
+        changed &= changed - 1;
+    }
+    uint32_t sources = dirty & ~INPUT_DIRTY_BUTTONS & ((1u << ACTION_DIRTY_BITS) - 1);
+    while (sources) {
+        candidates |= table.by_dirty[__builtin_ctz(sources)];
+        sources &= sources - 1;
+    }
+
+    uint32_t fired = 0;
+    uint32_t covered = 0;
+    while (candidates) {
+        const uint8_t i = static_cast<uint8_t>(__builtin_ctz(candidates));
+        candidates &= candidates - 1;
+        const action_binding& binding = table.bindings[i];
+        const uint32_t bit = 1u << i;
+        const bool now = action_predicate(binding, input);
+        const bool before = state.held & bit;
+        state.held = now ? state.held | bit : state.held & ~bit;
+        const bool fire = binding.when == ACTION_ON_PRESS ? now && !before :
+                          binding.when == ACTION_ON_RELEASE ? !now && before : now;
+        if (!fire) continue;
+        fired |= bit;
+        covered |= table.covered[i];
+    }
+    fired &= ~covered;
+    state.fired = fired;
+
+    for (uint32_t run = fired; run; run &= run - 1) action_run(table.bindings[__builtin_ctz(run)], context);
+    return fired;
+}
@@ -11,24 +11,40 @@
 #include "btstack_event.h"
 #include "l2cap.h"
 #include "pico_w_flash_ptr.h"
+#include "pico_w_connections.h"
+#include "pico_w_calibration.h"
+#include "pico_w_capture.h"
+#include "pico_w_crc32.h"
+#include "pico_w_input_pipeline.h"
+#include "pico_w_dual_core.h"
+#include "pico_w_haptic_audio.h"
+#include "pico_w_reconnect.h"
+#include "pico_w_link_health.h"
+#include "pico_w_link_profile.h"
+#include "pico_w_log.h"
 #include "GImplementations/Utils/GamepadSensors.h"
 #include "classic/hid_host.h"
 #include "classic/sdp_server.h"
 
-// Connection state
-static uint16_t response_report = 0;
-static uint16_t l2cap_cid_control = 0;
-static uint16_t l2cap_cid_interrupt = 0;
-static uint16_t l2cap_cid_out_interrupt = 0;
-static bd_addr_t current_device_addr;
+// Connection state (per-controller state lives in pico_w_connections.h)
+static bd_addr_t pending_device_addr;    // found by inquiry / loaded from flash, before an ACL link exists
 static bool device_found = false;
 static bool is_pairing = false;
 static bool we_initiated_connection = false;
-static bool link_key_used = false;       // Flag: tried to use a saved link key
 static uint8_t auth_failure_count = 0;   // Consecutive failures counter
 static btstack_packet_callback_registration_t hci_event_callback;
 static btstack_packet_callback_registration_t l2cap_event_callback;
 
+#if PICO_W_DUAL_CORE
+// core1 async context: forward what core0 queued through pico_w_platform_policy::Write
+static void output_worker_do_work(async_context_t* context, async_when_pending_worker_t* worker) {
+    const uint8_t drained = dual_core_drain_outputs();
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        if (drained & (1u << slot)) output_schedule(slot);
+    }
+}
+#endif
+
 // Helper: check if link key is valid (non-zero)
 inline bool is_link_key_valid(const uint8_t *key) {
     for (int i = 0; i < 16; i++) {
@@ -38,14 +54,9 @@ inline bool is_link_key_valid(const uint8_t *key) {
 }
 
 inline void reset_connection_state() {
-    response_report = 0;
-    l2cap_cid_control = 0;
-    l2cap_cid_interrupt = 0;
-    l2cap_cid_out_interrupt = 0;
     is_pairing = false;
     we_initiated_connection = false;
-    link_key_used = false;
-    memset(current_device_addr, 0, sizeof(current_device_addr));
+    memset(pending_device_addr, 0, sizeof(pending_device_addr));
 }
 
 inline void start_pairing_inquiry() {
@@ -62,24 +73,41 @@ inline void start_pairing_inquiry() {
 
 inline void l2cap_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size) {
     if (packet_type == L2CAP_DATA_PACKET) {
-        using namespace policy_device;
-        if (size > 11 && response_report == 0) {
-            response_report = 1;
-
-            auto& registry = get_instance();
-            if (ISonyGamepad* gamepad = registry.GetLibrary(0)) {
-                FDeviceContext* context = gamepad->GetMutableDeviceContext();
-                memcpy(context->Buffer, &packet[1], 78);
-                context->IsConnected = true;
-            }
-
-        } else if (size > 11 && response_report == 1) {
-            auto& registry = get_instance();
-            if (ISonyGamepad* gamepad = registry.GetLibrary(0)) {
-                FDeviceContext* context = gamepad->GetMutableDeviceContext();
-                memcpy(context->Buffer, &packet[1], 78);
-            }
+        const uint64_t arrival_us = time_us_64();
+        CAPTURE_FRAME(CAPTURE_IN, channel, packet, size);
+        gamepad_connection* conn = connection_for_cid(channel);
+        if (!conn) return;
+        if (channel == conn->cid_control) {
+            feature_report_control_packet(connection_slot(conn), packet, size);
+            return;
+        }
+        if (!conn->gamepad) return;
+
+        const uint8_t slot = connection_slot(conn);
+        // The pipeline copies INPUT_REPORT_SIZE bytes and decodes them as 0x31, so anything but a full-length 0x31
+        // frame is dropped here: short frames, basic-mode 0x01 reports, a report id that was itself corrupted
+        if (size < 1 + INPUT_REPORT_SIZE || packet[1] != 0x31) {
+            input_pipeline_reject_malformed(slot);
+            link_health_malformed(slot);
+            LOG_DEBUG(LOG_INPUT_MALFORMED, slot, size > 1 ? packet[1] : 0, size);
+            return;
+        }
+        // 0x31 frames end in a CRC32 over 0xA1 + report; a corrupt frame must not reach UpdateInput
+        if (!ds_bt_input_crc_ok(&packet[1], INPUT_REPORT_SIZE)) {
+            input_pipeline_reject(slot);
+            link_health_crc_failure(slot);
+            LOG_WARN(LOG_INPUT_CRC_REJECTED, slot, input_pipeline_crc_rejected(slot));
+            return;
         }
+        link_profile_frame(slot, arrival_us);
+        link_health_frame(slot, arrival_us, {&packet[1]});
+        if (!conn->response_report) {
+            conn->response_report = true;
+            conn->gamepad->GetMutableDeviceContext()->IsConnected = true;
+            input_pipeline_reset_timing(slot);
+            reconnect_first_input(conn->addr, slot);
+        }
+        input_pipeline_publish(slot, &packet[1], arrival_us);
         return;
     }
 
@@ -102,58 +130,79 @@ inline void l2cap_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
             printf("[L2CAP] Open channel! CID: 0x%04x, PSM: 0x%04x, Addr: %s\n",
                    cid, psm, bd_addr_to_str(addr));
 
+            gamepad_connection* conn = connection_for_handle(l2cap_event_channel_opened_get_handle(packet));
+            if (!conn) {
+                printf("[L2CAP] No connection record for %s\n", bd_addr_to_str(addr));
+                return;
+            }
+            cid_table_insert(cid, connection_slot(conn));
+
             if (psm == PSM_HID_CONTROL) {
-                if (l2cap_cid_interrupt == 0) {
+                conn->cid_control = cid;
+                if (conn->cid_interrupt == 0) {
                     printf("[L2CAP] HID Control connected. Opening HID Interrupt...\n");
-                    l2cap_create_channel(&l2cap_packet_handler, addr, PSM_HID_INTERRUPT, 0xffff, &l2cap_cid_interrupt);
+                    l2cap_create_channel(&l2cap_packet_handler, addr, PSM_HID_INTERRUPT, 0xffff, &conn->cid_interrupt);
                 }
             } else if (psm == PSM_HID_INTERRUPT) {
+                conn->cid_interrupt = cid;
+                printf("[L2CAP] Controller slot %u\n", connection_slot(conn));
                 printf("[L2CAP] HID Interrupt connected.\n");
                 printf("========================================\n");
                 printf("   DualSense READY TO USE!\n");
                 printf("========================================\n");
                 printf("Press start and select to see command options.\n");
 
-                uint8_t get_feature[41] = {
-                    0x43,
-                    0x05
-                };
-                l2cap_send(l2cap_cid_control, get_feature, 41);
-
-                using namespace policy_device;
-                auto& registry = get_instance();
-                if (ISonyGamepad* gamepad = registry.GetLibrary(0)) {
-                    FDeviceContext* context = gamepad->GetMutableDeviceContext();
-                    using namespace FGamepadSensors;
-                    FGamepadCalibration OutCalibration;
-                    DualSenseCalibrationSensors(get_feature, OutCalibration);
-
-                    context->Calibration = OutCalibration;
-                }
+                calibration_start(connection_slot(conn));
             }
             break;
         }
         case L2CAP_EVENT_CAN_SEND_NOW: {
-            using namespace policy_device;
-            auto& registry = get_instance();
-            uint8_t buff[79] = { 0xA2 };
-            if (auto gamepad = registry.GetLibrary(0)) {
-                if (gamepad->IsConnected()) {
-                    uint8_t* out = gamepad->GetMutableDeviceContext()->GetRawOutputBuffer();
-                    memcpy(&buff[1], out, 78);
-                }
+            const uint16_t cid = l2cap_event_can_send_now_get_local_cid(packet);
+            gamepad_connection* conn = connection_for_cid(cid);
+            if (!conn) break;
+            const uint8_t slot = connection_slot(conn);
+#if PICO_W_HAPTIC_AUDIO
+            if (haptic_audio_due(slot)) {
+                haptic_audio_send(slot, cid);
+                break;
+            }
+#endif
+
+            const uint8_t* report = output_staged_report(slot);
+            if (!report || !conn->gamepad || !conn->gamepad->IsConnected() || output_unchanged(slot)) {
+                output_sent(slot, ERROR_CODE_SUCCESS, true);
+                break;
             }
 
-            auto cod = l2cap_send(l2cap_cid_interrupt, buff, 79);
+            // build the report straight in BTstack's outgoing buffer: one copy of the staged report, no stack array
+            if (!l2cap_reserve_packet_buffer()) {
+                link_health_output(slot, BTSTACK_ACL_BUFFERS_FULL);
+                output_sent(slot, BTSTACK_ACL_BUFFERS_FULL);
+                break;
+            }
+            uint8_t* buff = l2cap_get_outgoing_buffer();
+            buff[0] = DS_BT_HID_OUTPUT;
+            memcpy(&buff[1], report, OUTPUT_REPORT_SIZE);
+            ds_bt_store_crc(&buff[1], OUTPUT_REPORT_SIZE, output_report_crc(slot));
+            auto cod = l2cap_send_prepared(cid, 1 + OUTPUT_REPORT_SIZE);
+            if (cod != ERROR_CODE_SUCCESS) l2cap_release_packet_buffer();
             switch (cod) {
+                case ERROR_CODE_SUCCESS:
+                    LOG_DEBUG(LOG_L2CAP_SENT, cid);
+                    // the outgoing buffer is left as sent until the next l2cap_reserve_packet_buffer()
+                    CAPTURE_FRAME(CAPTURE_OUT, cid, buff, 1 + OUTPUT_REPORT_SIZE);
+                    break;
                 case L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU:
-                    printf("L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU!\n");
+                    LOG_WARN(LOG_L2CAP_MTU_EXCEEDED, cid);
                     break;
                 case BTSTACK_ACL_BUFFERS_FULL:
-                    printf("BTSTACK_ACL_BUFFERS_FULL!\n");
+                    LOG_WARN(LOG_L2CAP_ACL_FULL, cid);
                     break;
-                default: printf("error_or_success l2cap_send %02X \n", cod);
+                default:
+                    LOG_ERROR(LOG_L2CAP_SEND_FAILED, cid, cod);
             };
+            link_health_output(slot, cod);
+            output_sent(slot, cod);
             break;
         }
 
@@ -161,16 +210,10 @@ inline void l2cap_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t
             uint16_t cid = l2cap_event_channel_closed_get_local_cid(packet);
             printf("[L2CAP] Close Channel 0x%04x\n", cid);
 
-            using namespace policy_device;
-            auto& registry = get_instance();
-            if (ISonyGamepad* gamepad = registry.GetLibrary(0)) {
-                FDeviceContext* context = gamepad->GetMutableDeviceContext();
-                context->IsConnected = false;
-            }
-
-            if (cid == l2cap_cid_control) l2cap_cid_control = 0;
-            if (cid == l2cap_cid_interrupt) l2cap_cid_interrupt = 0;
-            if (cid == l2cap_cid_out_interrupt) l2cap_cid_out_interrupt = 0;
+            gamepad_connection* conn = connection_for_cid(cid);
+            if (!conn) break;
+            if (conn->gamepad) conn->gamepad->GetMutableDeviceContext()->IsConnected = false;
+            connection_channel_closed(conn, cid);
             break;
         }
 
@@ -188,14 +231,15 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
                 printf("[BT] Bluetooth Stack active!\n");
 
                 bd_addr_t saved_mac;
-                link_key_t saved_key;
-                if (flash_load_config(saved_mac, saved_key) && is_link_key_valid(saved_key)) {
+                if (flash_bond_latest(saved_mac)) {
                     printf("[BT] Paired device found: %s\n", bd_addr_to_str(saved_mac));
-                    printf("[BT] Waiting for controller connection...\n");
-                    bd_addr_copy(current_device_addr, saved_mac);
+                    printf("[BT] Paging it, still accepting its connection...\n");
+                    bd_addr_copy(pending_device_addr, saved_mac);
                     we_initiated_connection = false;
                     gap_connectable_control(1);
                     gap_discoverable_control(1);
+                    reconnect_measure(RECONNECT_ORIGIN_BOOT, saved_mac);
+                    reconnect_start(saved_mac);
                 } else {
                     start_pairing_inquiry();
                 }
@@ -222,9 +266,9 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
             }
 
             // CoD 0x002508 = Gamepad (Major: Peripheral, Minor: Gamepad)
-            if ((cod & 0x000F00) == 0x000500) {
+            if ((cod & 0x000F00) == 0x000500 && !connection_for_addr(addr)) {
                 printf("[HCI] Gamepad found: %s (CoD: 0x%06x)\n", bd_addr_to_str(addr), (unsigned int)cod);
-                bd_addr_copy(current_device_addr, addr);
+                bd_addr_copy(pending_device_addr, addr);
                 device_found = true;
                 gap_inquiry_stop();
             }
@@ -236,8 +280,8 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
             if (device_found) {
                 device_found = false;
                 we_initiated_connection = true;  // WE will initiate the connection
-                printf("[HCI] Connecting to %s...\n", bd_addr_to_str(current_device_addr));
-                hci_send_cmd(&hci_create_connection, current_device_addr,
+                printf("[HCI] Connecting to %s...\n", bd_addr_to_str(pending_device_addr));
+                hci_send_cmd(&hci_create_connection, pending_device_addr,
                              hci_usable_acl_packet_types(), 0, 0, 0, 1);
             }
             break;
@@ -253,9 +297,17 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
 
                 printf("[HCI] Connection request from %s (CoD: 0x%06x)\n", bd_addr_to_str(addr), (unsigned int)cod);
 
-                bd_addr_copy(current_device_addr, addr);
+                bd_addr_copy(pending_device_addr, addr);
                 we_initiated_connection = false;  // CONTROLLER initiated connection
                 gap_inquiry_stop();  // Stop any search in progress
+
+                // a bonded controller waking up; right after boot the measurement keeps counting from power-on
+                uint8_t key[16];
+                if (flash_bond_find(addr, key) &&
+                    !(reconnect_measuring && reconnect_measure_origin == RECONNECT_ORIGIN_BOOT &&
+                      bd_addr_cmp(addr, reconnect_measure_addr) == 0)) {
+                    reconnect_measure(RECONNECT_ORIGIN_WAKE, addr);
+                }
             }
             break;
         }
@@ -265,15 +317,26 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
             bd_addr_t addr;
             hci_event_connection_complete_get_bd_addr(packet, addr);
 
+            const bool paged = reconnect_connection_complete(addr, status);
             if (status == ERROR_CODE_SUCCESS) {
+                if (paged) we_initiated_connection = true;
                 hci_con_handle_t handle = hci_event_connection_complete_get_connection_handle(packet);
                 printf("[HCI] ACL Connection established with %s (handle: 0x%04x)\n", bd_addr_to_str(addr), handle);
                 printf("[HCI] Initiator: %s\n", we_initiated_connection ? "WE" : "CONTROLLER");
-                bd_addr_copy(current_device_addr, addr);
+
+                gamepad_connection* conn = connection_alloc(handle, addr, we_initiated_connection);
+                if (!conn) {
+                    printf("[HCI] All %d controller slots in use, dropping %s\n", MAX_NR_GAMEPADS, bd_addr_to_str(addr));
+                    gap_disconnect(handle);
+                    break;
+                }
+                printf("[HCI] Controller slot %u (%u connected)\n", connection_slot(conn), connection_count());
+                link_health_connected(connection_slot(conn));
+                link_profile_connected(connection_slot(conn));
 
                 printf("[HCI] Requesting authentication...\n");
                 gap_request_security_level(handle, LEVEL_2);
-            } else {
+            } else if (!paged) {
                 printf("[HCI] Connection failed: 0x%02x\n", status);
                 printf("[BT] Starting search for new devices...\n");
                 printf("[BT] No saved MAC. Starting search...\n");
@@ -290,19 +353,16 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
             hci_event_link_key_request_get_bd_addr(packet, addr);
             printf("[HCI] Link Key requested for %s\n", bd_addr_to_str(addr));
 
-            bd_addr_t saved_mac;
             uint8_t saved_key[16];
 
-            if (flash_load_config(saved_mac, saved_key) &&
-                bd_addr_cmp(saved_mac, addr) == 0 &&
-                is_link_key_valid(saved_key)) {
+            if (flash_bond_find(addr, saved_key) && is_link_key_valid(saved_key)) {
                 printf("[HCI] Valid Link Key found! Sending...\n");
-                link_key_used = true;  // Mark that we tried to use the key
+                if (gamepad_connection* conn = connection_for_addr(addr)) conn->link_key_used = true;
                 hci_send_cmd(&hci_link_key_request_reply, addr, saved_key);
             } else {
                 printf("[HCI] No valid Link Key. Requesting pairing...\n");
-                link_key_used = false;
-                hci_send_cmd(&hci_link_key_request_reply, addr);
+                if (gamepad_connection* conn = connection_for_addr(addr)) conn->link_key_used = false;
+                hci_send_cmd(&hci_link_key_request_negative_reply, addr);
             }
             break;
         }
@@ -321,8 +381,7 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
                 for (int i = 0; i < 16; i++) printf("%02X", new_key[i]);
                 printf("\n");
 
-                flash_save_config(addr, new_key);
-                bd_addr_copy(current_device_addr, addr);
+                flash_bond_save(addr, new_key);
             } else {
                 printf("[HCI] WARNING: zero Link Key received, ignoring.\n");
             }
@@ -362,10 +421,11 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
                 printf("[HCI] Encryption ACTIVATED!\n");
 
                 // ALWAYS open L2CAP after encryption - DualSense expects it
-                if (l2cap_cid_control == 0) {
+                gamepad_connection* conn = connection_for_handle(hci_event_encryption_change_get_connection_handle(packet));
+                if (conn && conn->cid_control == 0) {
                     printf("[L2CAP] Opening HID Control channel...\n");
-                    l2cap_create_channel(&l2cap_packet_handler, current_device_addr,
-                                        PSM_HID_CONTROL, 0xffff, &l2cap_cid_control);
+                    l2cap_create_channel(&l2cap_packet_handler, conn->addr,
+                                        PSM_HID_CONTROL, 0xffff, &conn->cid_control);
                 }
             } else if (status != ERROR_CODE_SUCCESS) {
                 printf("[HCI] Encryption error: 0x%02x\n", status);
@@ -384,14 +444,27 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
 
         // === DISCONNECTION ===
         case HCI_EVENT_DISCONNECTION_COMPLETE: {
-            using namespace policy_device;
-            auto& registry = get_instance();
-            if (ISonyGamepad* gamepad = registry.GetLibrary(0)) {
-                FDeviceContext* context = gamepad->GetMutableDeviceContext();
-                context->IsConnected = false;
+            const hci_con_handle_t handle = hci_event_disconnection_complete_get_connection_handle(packet);
+            bd_addr_t addr;
+            bool bonded = false;
+            if (gamepad_connection* conn = connection_for_handle(handle)) {
+                printf("[HCI] Controller slot %u released\n", connection_slot(conn));
+                feature_report_cancel(connection_slot(conn));
+                bd_addr_copy(addr, conn->addr);
+                uint8_t key[16];
+                bonded = flash_bond_find(addr, key);
+                connection_free(conn);
             }
             uint8_t reason = packet[5];
             printf("[HCI] Disconnected. Reason: 0x%02x\n", reason);
+            // we dropped it ourselves (no free slot): paging it back would only repeat that
+            if (bonded && reason != ERROR_CODE_CONNECTION_TERMINATED_BY_LOCAL_HOST) {
+                printf("[BT] Paging bonded controller %s\n", bd_addr_to_str(addr));
+                reset_connection_state();
+                reconnect_measure(RECONNECT_ORIGIN_LINK_LOSS, addr);
+                reconnect_start(addr);
+                break;
+            }
             printf("[BT] Starting search for new devices...\n");
             printf("[BT] No saved MAC. Starting search...\n");
             printf("Put DualSense in pairing mode:\n");
@@ -404,6 +477,10 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
             break;
         }
 
+        case HCI_EVENT_COMMAND_COMPLETE:
+            link_health_command_complete(packet);
+            break;
+
         case HCI_EVENT_COMMAND_STATUS: {
             uint8_t status = hci_event_command_status_get_status(packet);
             if (status != 0) {
@@ -413,6 +490,19 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
             break;
         }
 
+        case HCI_EVENT_ROLE_CHANGE: {
+            bd_addr_t addr;
+            hci_event_role_change_get_bd_addr(packet, addr);
+            link_profile_role_change(addr, hci_event_role_change_get_status(packet),
+                                     static_cast<hci_role_t>(hci_event_role_change_get_role(packet)));
+            break;
+        }
+
+        case HCI_EVENT_MODE_CHANGE:
+            link_profile_mode_change(hci_event_mode_change_get_handle(packet), hci_event_mode_change_get_status(packet),
+                                     hci_event_mode_change_get_mode(packet), hci_event_mode_change_get_interval(packet));
+            break;
+
         case HCI_EVENT_AUTHENTICATION_COMPLETE: {
             uint8_t status = hci_event_authentication_complete_get_status(packet);
 
@@ -420,9 +510,10 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
                 printf("[HCI] Authentication failed: 0x%02x\n", status);
 
                 // If we used a link key and it failed, delete it
-                if (link_key_used) {
+                gamepad_connection* conn = connection_for_handle(hci_event_authentication_complete_get_connection_handle(packet));
+                if (conn && conn->link_key_used) {
                     printf("[HCI] Link Key rejected by device. Deleting...\n");
-                    flash_clear_config();
+                    flash_bond_remove(conn->addr);
                     auth_failure_count++;
                 }
             } else {
@@ -435,6 +526,9 @@ inline void hci_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
         default:
             break;
     }
+    // a command completed or another event passed: the next link profile step or signal read may go out
+    link_profile_pump();
+    link_health_pump();
 }
 
 
@@ -445,11 +539,10 @@ inline void enable_discovery() {
 
     // Check if device is already paired
     bd_addr_t saved_mac;
-    link_key_t saved_key;
-    if (flash_load_config(saved_mac, saved_key) && is_link_key_valid(saved_key)) {
+    if (flash_bond_latest(saved_mac)) {
         // Already paired - just wait for controller connection
         printf("[BT] Waiting reconnection from %s...\n", bd_addr_to_str(saved_mac));
-        bd_addr_copy(current_device_addr, saved_mac);
+        bd_addr_copy(pending_device_addr, saved_mac);
 
         gap_connectable_control(1);
         gap_set_local_name("Gamepad-Core Host"); // Opcional, mas ajuda
@@ -481,6 +574,8 @@ static void init_bluetooth() {
     gap_secure_connections_enable(true);
     gap_ssp_set_io_capability(SSP_IO_CAPABILITY_DISPLAY_YES_NO);
     gap_ssp_set_authentication_requirement(SSP_IO_AUTHREQ_MITM_PROTECTION_NOT_REQUIRED_GENERAL_BONDING);
+    // Short page timeout for the reconnect schedule, interlaced page scan for controllers paging us
+    reconnect_configure_radio();
     // Allow connections
     gap_connectable_control(1);
     gap_discoverable_control(1);
@@ -492,7 +587,19 @@ static void init_bluetooth() {
     l2cap_event_callback.callback = &l2cap_packet_handler;
     l2cap_add_event_handler(&l2cap_event_callback);
 
+    output_init();
+    link_health_init();
+#if PICO_W_HAPTIC_AUDIO
+    haptic_audio_init();
+#endif
+
+#if PICO_W_DUAL_CORE
+    output_worker.do_work = output_worker_do_work;
+    async_context_add_when_pending_worker(cyw43_arch_async_context(), &output_worker);
+#endif
+
     printf("[BT] Turning on radio...\n");
-    // gap_set_allow_role_switch(HCI_ROLE_MASTER);
+    // accept incoming connections as central unless the default profile lets the controller keep that role
+    gap_set_allow_role_switch(link_profile_default == LINK_PROFILE_COMPETITIVE);
     hci_power_control(HCI_POWER_ON);
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "btstack_config.h"
+#include "pico_w_connections.h"
+#include "pico_w_crc32.h"
+#include "pico_w_feature_report.h"
+#include "pico_w_flash_ptr.h"
+#include "pico_w_imu_fusion.h"
+#include "GImplementations/Utils/GamepadSensors.h"
+
+// IMU calibration.
+// The DualSense keeps its gyro/accelerometer calibration in feature report 0x05. When the HID interrupt channel
+// opens, calibration_start() applies the copy cached with the bond (if any) at once and asks the controller for the
+// report. Reading it is also what switches a DualSense on Bluetooth to full 0x31 reports, so the request goes out on
+// every connection. A reply with a valid CRC is parsed into the device's FGamepadCalibration and the IMU fusion
+// factors, and stored with the bond when it differs from the cached one. BTstack context, like the rest of the
+// connection setup.
+
+#define DS_FEATURE_CALIBRATION 0x05
+#define DS_CALIBRATION_REPORT_SIZE 41
+#define DS_BT_HID_FEATURE 0xA3
+#define CALIBRATION_TIMEOUT_MS 250
+
+static_assert(DS_CALIBRATION_REPORT_SIZE == BOND_CALIBRATION_SIZE, "bond records cache the whole report");
+
+static uint32_t calibration_cache_hits = 0;
+static uint32_t calibration_fetched = 0;
+static uint32_t calibration_failed = 0;
+
+inline bool calibration_report_ok(const uint8_t* report, uint16_t size) {
+    return size >= DS_CALIBRATION_REPORT_SIZE && report[0] == DS_FEATURE_CALIBRATION &&
+           ds_bt_crc(DS_BT_HID_FEATURE, report, DS_CALIBRATION_REPORT_SIZE) ==
+           ds_bt_stored_crc(report, DS_CALIBRATION_REPORT_SIZE);
+}
+
+inline void calibration_apply(uint8_t slot, const uint8_t* report) {
+    imu_fusion_calibrate(slot, report);
+    ISonyGamepad* gamepad = connections[slot].gamepad;
+    if (!gamepad) return;
+    FGamepadCalibration calibration;
+    FGamepadSensors::DualSenseCalibrationSensors(report, calibration);
+    gamepad->GetMutableDeviceContext()->Calibration = calibration;
+}
+
+inline void calibration_received(uint8_t slot, feature_report_status status, const uint8_t* report, uint16_t size) {
+    if (status != FEATURE_REPORT_OK || !calibration_report_ok(report, size)) {
+        calibration_failed++;
+        static const char* const reasons[] = {"bad CRC", "rejected", "timeout"};
+        printf("[CAL] Device %u: no calibration (%s)\n", slot, reasons[status]);
+        return;
+    }
+    calibration_fetched++;
+    calibration_apply(slot, report);
+    flash_bond_save_calibration(connections[slot].addr, report);
+    printf("[CAL] Device %u: calibration read\n", slot);
+}
+
+// HID interrupt channel open on slot.
+inline void calibration_start(uint8_t slot) {
+    uint8_t cached[DS_CALIBRATION_REPORT_SIZE];
+    imu_fusion_calibrate(slot, nullptr);
+    if (flash_bond_calibration(connections[slot].addr, cached) && calibration_report_ok(cached, sizeof(cached))) {
+        calibration_cache_hits++;
+        calibration_apply(slot, cached);
+        printf("[CAL] Device %u: cached calibration applied\n", slot);
+    }
+    feature_report_get(slot, DS_FEATURE_CALIBRATION, &calibration_received, CALIBRATION_TIMEOUT_MS);
+}
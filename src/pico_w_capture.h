@@ -0,0 +1,227 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "pico/stdlib.h"
+#include "pico_w_crc32.h"
+
+// L2CAP capture (build with -DDUALSENSE_CAPTURE=ON, start and stop with 'c' on the console).
+// l2cap_packet_handler records every inbound data packet and the CAN_SEND_NOW path every output report it sent,
+// as compact binary records in a RAM byte ring. The application loop drains the ring over USB CDC among the
+// console text; host/capture_replay.cpp picks the records out and replays them. The drain is not atomic against
+// printf from the BTstack context (its IRQ, or core1 in the dual-core build), so text can land inside a record:
+// each record ends in a CRC32 and the reader skips one that fails it. A record that does not fit the ring is
+// dropped and counted, and a DROPPED record carrying the count goes out ahead of the next one that fits.
+//
+// Record: sync 0xCA 0x57, type, delta_us (LEB128, since the previous record), CID (u16 LE), length (LEB128),
+// payload, CRC32 (u32 LE) from type to the end of the payload. START carries the format version and the absolute
+// time in us, DROPPED the number of lost records, both as u32 LE; IN and OUT carry the L2CAP payload as it crossed
+// the link, HID header byte included. The delta of a skipped record is lost with it.
+
+#ifndef PICO_W_CAPTURE
+#define PICO_W_CAPTURE 0
+#endif
+
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE 8192
+#endif
+
+#define CAPTURE_SYNC_0 0xCA
+#define CAPTURE_SYNC_1 0x57
+#define CAPTURE_VERSION 2
+#define CAPTURE_MAX_PAYLOAD 1024
+#define CAPTURE_MAX_HEADER (2 + 1 + 5 + 2 + 3)
+#define CAPTURE_CRC_SIZE 4
+
+static_assert((CAPTURE_RING_SIZE & (CAPTURE_RING_SIZE - 1)) == 0, "capture ring size must be a power of two");
+
+enum capture_type : uint8_t {
+    CAPTURE_START = 0,
+    CAPTURE_IN,
+    CAPTURE_OUT,
+    CAPTURE_DROPPED,
+    CAPTURE_TYPE_COUNT
+};
+
+// Bytes of whole records: the producer publishes tail only after a complete record, the consumer moves head.
+struct capture_ring {
+    uint8_t bytes[CAPTURE_RING_SIZE];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+};
+
+static capture_ring capture_buffer;
+static bool capture_active = false;         // BTstack context, or the application under the BTstack lock
+static uint32_t capture_last_us = 0;
+static uint32_t capture_dropped = 0;        // since the last DROPPED record
+static uint32_t capture_dropped_total = 0;
+static uint32_t capture_records = 0;
+
+inline size_t capture_put_varint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+inline void capture_u32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+// Producer: false when the record does not fit.
+inline bool capture_push(capture_type type, uint16_t cid, const uint8_t* payload, uint16_t size, uint32_t now_us) {
+    uint8_t header[CAPTURE_MAX_HEADER];
+    size_t n = 0;
+    header[n++] = CAPTURE_SYNC_0;
+    header[n++] = CAPTURE_SYNC_1;
+    header[n++] = type;
+    n += capture_put_varint(&header[n], now_us - capture_last_us);
+    header[n++] = static_cast<uint8_t>(cid);
+    header[n++] = static_cast<uint8_t>(cid >> 8);
+    n += capture_put_varint(&header[n], size);
+
+    const uint32_t t = capture_buffer.tail.load(std::memory_order_relaxed);
+    if (CAPTURE_RING_SIZE - (t - capture_buffer.head.load(std::memory_order_acquire)) < n + size + CAPTURE_CRC_SIZE) {
+        return false;
+    }
+    uint8_t crc[CAPTURE_CRC_SIZE];
+    capture_u32(crc, ~crc32_update(crc32_update(0xFFFFFFFFu, &header[2], n - 2), payload, size));
+    for (size_t i = 0; i < n; i++) capture_buffer.bytes[(t + i) & (CAPTURE_RING_SIZE - 1)] = header[i];
+    const uint32_t at = (t + n) & (CAPTURE_RING_SIZE - 1);
+    const size_t first = size < CAPTURE_RING_SIZE - at ? size : CAPTURE_RING_SIZE - at;
+    memcpy(&capture_buffer.bytes[at], payload, first);
+    memcpy(capture_buffer.bytes, payload + first, size - first);
+    for (size_t i = 0; i < CAPTURE_CRC_SIZE; i++) {
+        capture_buffer.bytes[(t + n + size + i) & (CAPTURE_RING_SIZE - 1)] = crc[i];
+    }
+    capture_buffer.tail.store(t + static_cast<uint32_t>(n + size + CAPTURE_CRC_SIZE), std::memory_order_release);
+    capture_last_us = now_us;
+    capture_records++;
+    return true;
+}
+
+// BTstack context: one L2CAP packet that crossed the link on cid.
+inline void capture_frame(capture_type type, uint16_t cid, const uint8_t* payload, uint16_t size) {
+    if (!capture_active) return;
+    const uint32_t now_us = time_us_32();
+    if (size > CAPTURE_MAX_PAYLOAD) size = CAPTURE_MAX_PAYLOAD;
+    if (capture_dropped) {
+        // only together with the record itself, so a gap is reported once however long it was
+        const uint32_t used = capture_buffer.tail.load(std::memory_order_relaxed) -
+                              capture_buffer.head.load(std::memory_order_acquire);
+        if (CAPTURE_RING_SIZE - used >= 2u * (CAPTURE_MAX_HEADER + CAPTURE_CRC_SIZE) + 4u + size) {
+            uint8_t count[4];
+            capture_u32(count, capture_dropped);
+            capture_push(CAPTURE_DROPPED, 0, count, sizeof(count), now_us);
+            capture_dropped = 0;
+        }
+    }
+    if (capture_dropped || !capture_push(type, cid, payload, size, now_us)) {
+        capture_dropped++;
+        capture_dropped_total++;
+    }
+}
+
+// BTstack context or under the BTstack lock: later frames are recorded after a START record.
+inline void capture_start() {
+    const uint32_t now_us = time_us_32();
+    uint8_t start[5] = {CAPTURE_VERSION};
+    capture_u32(&start[1], now_us);
+    capture_last_us = now_us;
+    capture_dropped = 0;
+    capture_active = capture_push(CAPTURE_START, 0, start, sizeof(start), now_us);
+}
+
+inline void capture_stop() {
+    capture_active = false;
+}
+
+// Consumer: copies up to max pending bytes; returns 0 only at a record boundary with the ring empty.
+inline size_t capture_read(uint8_t* out, size_t max) {
+    const uint32_t h = capture_buffer.head.load(std::memory_order_relaxed);
+    const uint32_t pending = capture_buffer.tail.load(std::memory_order_acquire) - h;
+    const size_t n = pending < max ? pending : max;
+    for (size_t i = 0; i < n; i++) out[i] = capture_buffer.bytes[(h + i) & (CAPTURE_RING_SIZE - 1)];
+    capture_buffer.head.store(h + static_cast<uint32_t>(n), std::memory_order_release);
+    return n;
+}
+
+// Application loop: writes everything recorded so far to USB CDC, ending on a record boundary.
+inline void capture_drain() {
+    uint8_t chunk[64];
+    size_t n;
+    while ((n = capture_read(chunk, sizeof(chunk))) != 0) {
+        for (size_t i = 0; i < n; i++) putchar_raw(chunk[i]);
+    }
+}
+
+#if PICO_W_CAPTURE
+#define CAPTURE_FRAME(type, cid, payload, size) capture_frame(type, cid, payload, size)
+#else
+#define CAPTURE_FRAME(type, cid, payload, size) ((void)0)
+#endif
+
+// --- reader side, shared with host/capture_replay.cpp ---
+
+struct capture_record {
+    capture_type type;
+    uint32_t delta_us;
+    uint16_t cid;
+    uint16_t size;
+    const uint8_t* payload;
+};
+
+inline bool capture_get_varint(const uint8_t* data, size_t size, size_t& at, uint32_t& value) {
+    value = 0;
+    for (uint32_t shift = 0; shift < 35 && at < size; shift += 7) {
+        const uint8_t byte = data[at++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint32_t capture_get_u32(const uint8_t* at) {
+    return at[0] | (at[1] << 8) | (at[2] << 16) | (static_cast<uint32_t>(at[3]) << 24);
+}
+
+// Next record in data from offset, skipping bytes that are not part of one (console text, a torn record; those
+// whose CRC fails are counted in *torn). Returns false when no complete record is left; offset then points at the
+// unparsed rest, from the first record that runs past the end of data.
+inline bool capture_parse(const uint8_t* data, size_t size, size_t& offset, capture_record& record,
+                          uint32_t* torn = nullptr) {
+    size_t incomplete = size;
+    for (; offset + 2 <= size; offset++) {
+        if (data[offset] != CAPTURE_SYNC_0 || data[offset + 1] != CAPTURE_SYNC_1) continue;
+        size_t at = offset + 2;
+        uint32_t delta = 0, length = 0;
+        uint16_t cid = 0;
+        bool header = at < size;
+        const uint8_t type = header ? data[at++] : 0;
+        header = header && capture_get_varint(data, size, at, delta) && at + 2 <= size;
+        if (header) {
+            cid = static_cast<uint16_t>(data[at] | (data[at + 1] << 8));
+            at += 2;
+            header = capture_get_varint(data, size, at, length);
+        }
+        if (header && (type >= CAPTURE_TYPE_COUNT || length > CAPTURE_MAX_PAYLOAD)) continue;
+        if (!header || at + length + CAPTURE_CRC_SIZE > size) {
+            // a record still arriving at the end of data; with data left, a false sync whose varint overran
+            if ((header || at >= size) && incomplete == size) incomplete = offset;
+            continue;
+        }
+        if (crc32_compute(&data[offset + 2], at + length - offset - 2) != capture_get_u32(&data[at + length])) {
+            if (torn) (*torn)++;
+            continue;
+        }
+        record = {static_cast<capture_type>(type), delta, cid, static_cast<uint16_t>(length), &data[at]};
+        offset = at + length + CAPTURE_CRC_SIZE;
+        return true;
+    }
+    if (incomplete < offset) offset = incomplete;
+    return false;
+}
@@ -0,0 +1,380 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "btstack_config.h"
+#include "bluetooth.h"
+#include "btstack_util.h"
+#include "l2cap.h"
+#include "btstack_run_loop.h"
+#include "pico/time.h"
+#include "pico_w_crc32.h"
+#include "pico_w_latency.h"
+#include "pico_w_log.h"
+#include "GCore/Interfaces/ISonyGamepad.h"
+
+// Per-controller connection records.
+// Slot i owns registry device i (engine id i) for the whole run, and caches its ISonyGamepad pointer, so the
+// data path never goes through the registry's hash map. Inbound L2CAP packets are routed by local CID through
+// a small open-addressed table (at most MAX_NR_L2CAP_CHANNELS live CIDs in CID_TABLE_SIZE buckets).
+
+#define CID_TABLE_SIZE 16
+#define NO_SLOT 0xFF
+
+struct gamepad_connection {
+    bool in_use;
+    hci_con_handle_t handle;
+    bd_addr_t addr;
+    uint16_t cid_control;
+    uint16_t cid_interrupt;
+    bool response_report;   // first 0x31 frame seen on this link
+    bool we_initiated;
+    bool link_key_used;     // tried to authenticate with a saved link key
+    ISonyGamepad* gamepad;  // registry device for this slot, bound at boot
+};
+
+struct cid_table_entry {
+    uint16_t cid;  // 0 = empty bucket
+    uint8_t slot;
+};
+
+static_assert(CID_TABLE_SIZE >= 2 * MAX_NR_L2CAP_CHANNELS, "CID table needs free buckets to stay O(1)");
+static_assert(MAX_NR_GAMEPADS <= 8, "output scheduler uses an 8-bit pending mask");
+
+static gamepad_connection connections[MAX_NR_GAMEPADS];
+static cid_table_entry cid_table[CID_TABLE_SIZE];
+
+// Output scheduler state: one CAN_SEND_NOW request outstanding at a time, granted round-robin
+static uint8_t output_pending_mask = 0;
+static uint8_t output_haptic_mask = 0;
+static uint8_t output_in_flight = NO_SLOT;
+static uint8_t output_next_slot = 0;
+
+inline void connection_bind_gamepad(uint8_t slot, ISonyGamepad* gamepad) {
+    connections[slot].gamepad = gamepad;
+}
+
+inline uint8_t connection_slot(const gamepad_connection* conn) {
+    return static_cast<uint8_t>(conn - connections);
+}
+
+inline gamepad_connection* connection_for_handle(hci_con_handle_t handle) {
+    for (auto& conn : connections) {
+        if (conn.in_use && conn.handle == handle) return &conn;
+    }
+    return nullptr;
+}
+
+inline gamepad_connection* connection_for_addr(const bd_addr_t addr) {
+    for (auto& conn : connections) {
+        if (conn.in_use && bd_addr_cmp(conn.addr, addr) == 0) return &conn;
+    }
+    return nullptr;
+}
+
+inline uint8_t connection_slot_for_context(const FDeviceContext* context) {
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        if (connections[slot].gamepad && connections[slot].gamepad->GetMutableDeviceContext() == context) return slot;
+    }
+    return NO_SLOT;
+}
+
+inline uint8_t connection_count() {
+    uint8_t count = 0;
+    for (auto& conn : connections) count += conn.in_use ? 1 : 0;
+    return count;
+}
+
+// --- CID routing table -------------------------------------------------------------------------------------
+
+inline uint8_t cid_bucket(uint16_t cid) {
+    return static_cast<uint8_t>(cid & (CID_TABLE_SIZE - 1));
+}
+
+inline void cid_table_insert(uint16_t cid, uint8_t slot) {
+    uint8_t i = cid_bucket(cid);
+    while (cid_table[i].cid != 0 && cid_table[i].cid != cid) i = (i + 1) & (CID_TABLE_SIZE - 1);
+    cid_table[i] = {cid, slot};
+}
+
+inline void cid_table_remove(uint16_t cid) {
+    uint8_t i = cid_bucket(cid);
+    while (cid_table[i].cid != cid) {
+        if (cid_table[i].cid == 0) return;
+        i = (i + 1) & (CID_TABLE_SIZE - 1);
+    }
+    // backward-shift deletion keeps every probe chain contiguous
+    cid_table[i] = {};
+    uint8_t j = i;
+    while (true) {
+        j = (j + 1) & (CID_TABLE_SIZE - 1);
+        if (cid_table[j].cid == 0) return;
+        const uint8_t home = cid_bucket(cid_table[j].cid);
+        const bool movable = (j > i) ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            cid_table[i] = cid_table[j];
+            cid_table[j] = {};
+            i = j;
+        }
+    }
+}
+
+inline gamepad_connection* connection_for_cid(uint16_t cid) {
+    uint8_t i = cid_bucket(cid);
+    while (cid_table[i].cid != 0) {
+        if (cid_table[i].cid == cid) return &connections[cid_table[i].slot];
+        i = (i + 1) & (CID_TABLE_SIZE - 1);
+    }
+    return nullptr;
+}
+
+// --- Output scheduling -------------------------------------------------------------------------------------
+// pico_w_platform_policy::Write stages the freshly packed report of a slot (output_stage) and marks the slot
+// pending; every further Write before the slot's turn just replaces the staged report, so SetLightbar,
+// SetVibration and trigger calls made in one frame leave as a single report with the latest state.
+// BTstack grants CAN_SEND_NOW to channels in list order, so a pad that updates every frame could keep the ACL
+// buffers to itself. Only one request is kept outstanding and the next one goes to the following pending slot.
+// A slot is not granted again before its minimum output interval has passed; a run-loop timer picks it up later.
+// pico_w_link_health.h doubles that interval per backoff step while the link is degraded.
+// At send time a report equal to the last one sent (ignoring the sequence tag and CRC) is skipped, and a send
+// that fails with BTSTACK_ACL_BUFFERS_FULL leaves the slot pending so the retry sends whatever is newest then.
+// A slot in output_haptic_mask has a haptic audio report due (pico_w_haptic_audio.h). It takes its turn like a
+// pending report but is not held back by the output interval, and the output report stays pending behind it.
+
+#define OUTPUT_REPORT_SIZE 78
+// bytes compared for dedup: after report id + sequence tag, before the trailing CRC32
+#define OUTPUT_DEDUP_BEGIN 2
+#define OUTPUT_DEDUP_END (OUTPUT_REPORT_SIZE - 4)
+
+// 1: derive each output CRC from the previous one over the changed bytes (crc32_patch) instead of recomputing it
+#ifndef PICO_W_CRC_INCREMENTAL
+#define PICO_W_CRC_INCREMENTAL 0
+#endif
+
+#ifndef OUTPUT_DEFAULT_MAX_RATE_HZ
+#define OUTPUT_DEFAULT_MAX_RATE_HZ 250
+#endif
+
+struct output_slot {
+    uint8_t staged[OUTPUT_REPORT_SIZE];
+    uint8_t sent[OUTPUT_REPORT_SIZE];
+    uint32_t staged_crc;        // computed at send time
+    uint32_t sent_crc;
+    latency_stamp stamp;        // of the staged report
+    bool staged_valid;
+    bool sent_valid;
+    uint32_t sent_us;           // time of the last successful send
+    uint32_t min_interval_us;   // 0 = unlimited; survives reconnects
+    uint8_t backoff;            // link health: min_interval_us doubled this many times
+    uint32_t requests;          // Write calls
+    uint32_t sends;             // reports handed to l2cap_send
+    uint32_t skipped;           // unchanged reports not sent
+    uint32_t retries;           // sends repeated after BTSTACK_ACL_BUFFERS_FULL
+};
+
+static output_slot output_slots[MAX_NR_GAMEPADS];
+static btstack_timer_source_t output_rate_timer;
+static bool output_rate_timer_armed = false;
+static uint32_t output_rate_deadline_us = 0;
+
+inline void output_kick();
+
+// Interval actually enforced: a link without a limit backs off from the default rate.
+inline uint32_t output_interval_us(const output_slot& out) {
+    if (!out.backoff) return out.min_interval_us;
+    const uint32_t base = out.min_interval_us ? out.min_interval_us : 1000000u / OUTPUT_DEFAULT_MAX_RATE_HZ;
+    return base << out.backoff;
+}
+
+inline void output_arm_rate_timer(uint32_t wait_us);
+
+// The run loop counts whole ms from a truncated base, so the timer can fire before the deadline; it then waits
+// out the remaining us instead of kicking early.
+inline void output_rate_timer_handler(btstack_timer_source_t*) {
+    output_rate_timer_armed = false;
+    const int32_t remaining_us = static_cast<int32_t>(output_rate_deadline_us - time_us_32());
+    if (remaining_us > 0) {
+        output_arm_rate_timer(static_cast<uint32_t>(remaining_us));
+        return;
+    }
+    output_kick();
+}
+
+inline void output_arm_rate_timer(uint32_t wait_us) {
+    if (output_rate_timer_armed) btstack_run_loop_remove_timer(&output_rate_timer);
+    output_rate_deadline_us = time_us_32() + wait_us;
+    btstack_run_loop_set_timer_handler(&output_rate_timer, &output_rate_timer_handler);
+    btstack_run_loop_set_timer(&output_rate_timer, (wait_us + 999) / 1000);
+    btstack_run_loop_add_timer(&output_rate_timer);
+    output_rate_timer_armed = true;
+}
+
+inline void output_kick() {
+    if (output_in_flight != NO_SLOT) return;
+    const uint32_t now_us = time_us_32();
+    uint32_t wait_us = UINT32_MAX;
+    for (uint8_t i = 0; i < MAX_NR_GAMEPADS; i++) {
+        const uint8_t slot = (output_next_slot + i) % MAX_NR_GAMEPADS;
+        const uint8_t bit = static_cast<uint8_t>(1u << slot);
+        if (!((output_pending_mask | output_haptic_mask) & bit)) continue;
+
+        const gamepad_connection& conn = connections[slot];
+        if (!conn.in_use || conn.cid_interrupt == 0) {
+            output_pending_mask &= static_cast<uint8_t>(~bit);
+            output_haptic_mask &= static_cast<uint8_t>(~bit);
+            continue;
+        }
+
+        if (!(output_haptic_mask & bit)) {
+            const output_slot& out = output_slots[slot];
+            const uint32_t elapsed_us = now_us - out.sent_us;
+            const uint32_t interval_us = output_interval_us(out);
+            if (out.sent_valid && elapsed_us < interval_us) {
+                if (interval_us - elapsed_us < wait_us) wait_us = interval_us - elapsed_us;
+                continue;
+            }
+            output_pending_mask &= static_cast<uint8_t>(~bit);
+        }
+        output_in_flight = slot;
+        output_next_slot = static_cast<uint8_t>((slot + 1) % MAX_NR_GAMEPADS);
+        l2cap_request_can_send_now_event(conn.cid_interrupt);
+        return;
+    }
+    if (wait_us != UINT32_MAX) output_arm_rate_timer(wait_us);
+}
+
+// BTstack context: newest packed output report of slot (OUTPUT_REPORT_SIZE bytes), replacing any staged one.
+// A replacement not triggered by input keeps the input origin of the report it replaces.
+inline void output_stage(uint8_t slot, const uint8_t* report, const latency_stamp& stamp) {
+    output_slot& out = output_slots[slot];
+    memcpy(out.staged, report, OUTPUT_REPORT_SIZE);
+    out.stamp = {stamp.origin_us ? stamp.origin_us : out.stamp.origin_us, stamp.write_us};
+    out.staged_valid = true;
+    out.requests++;
+}
+
+// BTstack context: report to send for slot, or nullptr if nothing was staged since it connected.
+inline const uint8_t* output_staged_report(uint8_t slot) {
+    return output_slots[slot].staged_valid ? output_slots[slot].staged : nullptr;
+}
+
+// BTstack context: the staged report matches what the controller already has.
+inline bool output_unchanged(uint8_t slot) {
+    const output_slot& out = output_slots[slot];
+    return out.sent_valid && memcmp(&out.staged[OUTPUT_DEDUP_BEGIN], &out.sent[OUTPUT_DEDUP_BEGIN],
+                                    OUTPUT_DEDUP_END - OUTPUT_DEDUP_BEGIN) == 0;
+}
+
+// BTstack context: slot has a new output report to send.
+inline void output_schedule(uint8_t slot) {
+    if (slot >= MAX_NR_GAMEPADS) return;
+    output_pending_mask |= static_cast<uint8_t>(1u << slot);
+    output_kick();
+}
+
+// BTstack context: CRC32 (0xA2 seeded) to stamp into the staged report of slot just before it is sent.
+inline uint32_t output_report_crc(uint8_t slot) {
+    output_slot& out = output_slots[slot];
+#if PICO_W_CRC_INCREMENTAL
+    if (out.sent_valid) {
+        out.staged_crc = crc32_patch(out.sent_crc, out.sent, out.staged, OUTPUT_REPORT_SIZE - DS_BT_CRC_SIZE);
+        return out.staged_crc;
+    }
+#endif
+    out.staged_crc = ds_bt_crc(DS_BT_HID_OUTPUT, out.staged, OUTPUT_REPORT_SIZE);
+    return out.staged_crc;
+}
+
+// BTstack context: the CAN_SEND_NOW granted to slot was used; the next pending slot may request one.
+inline void output_release(uint8_t slot) {
+    if (output_in_flight == slot) output_in_flight = NO_SLOT;
+    output_kick();
+}
+
+// BTstack context: CAN_SEND_NOW for slot was consumed, with the l2cap_send status or ERROR_CODE_SUCCESS for a
+// skipped report.
+inline void output_sent(uint8_t slot, uint8_t status, bool skipped = false) {
+    output_slot& out = output_slots[slot];
+    if (skipped) {
+        LOG_DEBUG(LOG_OUTPUT_UNCHANGED, slot);
+        out.skipped++;
+        out.stamp.origin_us = 0;
+    } else if (status == ERROR_CODE_SUCCESS) {
+        latency_output_sent(out.stamp);
+        out.stamp.origin_us = 0;
+        memcpy(out.sent, out.staged, OUTPUT_REPORT_SIZE);
+        out.sent_crc = out.staged_crc;
+        out.sent_valid = true;
+        out.sent_us = time_us_32();
+        out.sends++;
+    } else if (status == BTSTACK_ACL_BUFFERS_FULL) {
+        // BTstack reports CAN_SEND_NOW again once a buffer is free; the retry sends the newest staged report
+        LOG_DEBUG(LOG_OUTPUT_RETRY, slot);
+        out.retries++;
+        output_pending_mask |= static_cast<uint8_t>(1u << slot);
+    }
+    output_release(slot);
+}
+
+// Application: caps how often slot may send; 0 removes the limit. Kept across reconnects.
+inline void output_set_max_rate(uint8_t slot, uint32_t max_rate_hz) {
+    output_slots[slot].min_interval_us = max_rate_hz ? 1000000u / max_rate_hz : 0;
+}
+
+inline void output_init() {
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        output_slots[slot] = {};
+        output_set_max_rate(slot, OUTPUT_DEFAULT_MAX_RATE_HZ);
+    }
+}
+
+// A new link starts without a staged or sent report: the first Write always goes out, at the undegraded rate.
+inline void output_reset(uint8_t slot) {
+    output_slot& out = output_slots[slot];
+    out.staged_valid = false;
+    out.sent_valid = false;
+    out.backoff = 0;
+    out.stamp = {};
+}
+
+// --- Lifetime ----------------------------------------------------------------------------------------------
+
+inline gamepad_connection* connection_alloc(hci_con_handle_t handle, const bd_addr_t addr, bool we_initiated) {
+    if (gamepad_connection* existing = connection_for_handle(handle)) return existing;
+    for (auto& conn : connections) {
+        if (conn.in_use) continue;
+        ISonyGamepad* gamepad = conn.gamepad;
+        conn = {};
+        conn.gamepad = gamepad;
+        conn.in_use = true;
+        conn.handle = handle;
+        bd_addr_copy(conn.addr, addr);
+        conn.we_initiated = we_initiated;
+        output_reset(connection_slot(&conn));
+        return &conn;
+    }
+    return nullptr;
+}
+
+inline void connection_channel_closed(gamepad_connection* conn, uint16_t cid) {
+    cid_table_remove(cid);
+    if (conn->cid_control == cid) conn->cid_control = 0;
+    if (conn->cid_interrupt == cid) {
+        conn->cid_interrupt = 0;
+        conn->response_report = false;
+    }
+}
+
+inline void connection_free(gamepad_connection* conn) {
+    const uint8_t slot = connection_slot(conn);
+    if (conn->cid_control) cid_table_remove(conn->cid_control);
+    if (conn->cid_interrupt) cid_table_remove(conn->cid_interrupt);
+    if (conn->gamepad) conn->gamepad->GetMutableDeviceContext()->IsConnected = false;
+
+    ISonyGamepad* gamepad = conn->gamepad;
+    *conn = {};
+    conn->gamepad = gamepad;
+
+    output_pending_mask &= static_cast<uint8_t>(~(1u << slot));
+    output_haptic_mask &= static_cast<uint8_t>(~(1u << slot));
+    if (output_in_flight == slot) output_release(slot);
+}
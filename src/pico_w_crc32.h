@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "pico/platform.h"
+
+// CRC-32 (IEEE 802.3, reflected, as used by the DualSense Bluetooth reports and the bond journal).
+// Slice-by-4: four 256-entry tables consume one byte from each table per step, so the M0+ does four table loads
+// and xors per 4 input bytes instead of a shift/xor per byte. The tables are generated at compile time and are
+// deliberately not const, so they are copied to SRAM at boot instead of being read through the XIP cache, and
+// the loops run from SRAM (__not_in_flash_func).
+// crc32_patch() updates a CRC after some bytes of the message changed, using CRC linearity: only the changed runs
+// are processed and shifted to their position with a GF(2) multiply by x^(8n) mod P.
+// DualSense: the CRC covers the HID header byte (0xA1 input, 0xA2 output) and the report up to its last 4 bytes,
+// which hold the CRC little-endian.
+
+#define CRC32_POLY 0xEDB88320u
+#define CRC32_MAX_SHIFT 128     // longest message crc32_patch() handles
+
+#define DS_BT_HID_INPUT 0xA1
+#define DS_BT_HID_OUTPUT 0xA2
+#define DS_BT_CRC_SIZE 4
+
+using crc32_tables_t = std::array<std::array<uint32_t, 256>, 4>;
+
+constexpr crc32_tables_t crc32_make_tables() {
+    crc32_tables_t tables{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (CRC32_POLY & (0u - (crc & 1)));
+        tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int slice = 1; slice < 4; slice++) {
+            const uint32_t prev = tables[slice - 1][i];
+            tables[slice][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+        }
+    }
+    return tables;
+}
+
+// a * b mod P, both reflected (bit 31 = x^0)
+constexpr uint32_t crc32_multiply(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m; m >>= 1) {
+        if (a & m) product ^= b;
+        b = (b >> 1) ^ (CRC32_POLY & (0u - (b & 1)));
+    }
+    return product;
+}
+
+// x^(8n) mod P for n = 0..CRC32_MAX_SHIFT: shifting a raw CRC state over n zero bytes
+constexpr std::array<uint32_t, CRC32_MAX_SHIFT + 1> crc32_make_shifts() {
+    std::array<uint32_t, CRC32_MAX_SHIFT + 1> shifts{};
+    shifts[0] = 1u << 31;
+    for (size_t n = 1; n <= CRC32_MAX_SHIFT; n++) shifts[n] = crc32_multiply(shifts[n - 1], 1u << 23);
+    return shifts;
+}
+
+static crc32_tables_t crc32_tables = crc32_make_tables();
+static std::array<uint32_t, CRC32_MAX_SHIFT + 1> crc32_shifts = crc32_make_shifts();
+
+// Raw CRC state update (no pre/post inversion)
+inline uint32_t __not_in_flash_func(crc32_update)(uint32_t crc, const uint8_t* data, size_t len) {
+    const auto& t = crc32_tables;
+    while (len >= 4) {
+        crc ^= data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+        crc = t[3][crc & 0xFF] ^ t[2][(crc >> 8) & 0xFF] ^ t[1][(crc >> 16) & 0xFF] ^ t[0][crc >> 24];
+        data += 4;
+        len -= 4;
+    }
+    while (len--) crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    return crc;
+}
+
+inline uint32_t crc32_compute(const uint8_t* data, size_t len) {
+    return ~crc32_update(0xFFFFFFFFu, data, len);
+}
+
+// One table, one byte per step; the reference the slice-by-4 loop is measured against.
+inline uint32_t crc32_compute_bytewise(const uint8_t* data, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--) crc = (crc >> 8) ^ crc32_tables[0][(crc ^ *data++) & 0xFF];
+    return ~crc;
+}
+
+// CRC of new_data given crc = CRC of old_data; both len bytes (len <= CRC32_MAX_SHIFT).
+inline uint32_t __not_in_flash_func(crc32_patch)(uint32_t crc, const uint8_t* old_data, const uint8_t* new_data,
+                                                 size_t len) {
+    const auto& t = crc32_tables;
+    size_t i = 0;
+    while (i < len) {
+        if (old_data[i] == new_data[i]) {
+            i++;
+            continue;
+        }
+        uint32_t delta = 0;
+        while (i < len && old_data[i] != new_data[i]) {
+            delta = (delta >> 8) ^ t[0][(delta ^ old_data[i] ^ new_data[i]) & 0xFF];
+            i++;
+        }
+        crc ^= crc32_multiply(crc32_shifts[len - i], delta);
+    }
+    return crc;
+}
+
+// State after the HID header byte, so a report CRC does not need the header in the same buffer
+constexpr uint32_t ds_bt_seed_state(uint8_t hid_header) {
+    uint32_t crc = 0xFFFFFFFFu ^ hid_header;
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (CRC32_POLY & (0u - (crc & 1)));
+    return crc;
+}
+
+// report: starts at the report id, len includes the trailing CRC
+inline uint32_t ds_bt_crc(uint8_t hid_header, const uint8_t* report, size_t len) {
+    return ~crc32_update(ds_bt_seed_state(hid_header), report, len - DS_BT_CRC_SIZE);
+}
+
+inline uint32_t ds_bt_stored_crc(const uint8_t* report, size_t len) {
+    const uint8_t* c = &report[len - DS_BT_CRC_SIZE];
+    return c[0] | (c[1] << 8) | (c[2] << 16) | (static_cast<uint32_t>(c[3]) << 24);
+}
+
+inline void ds_bt_store_crc(uint8_t* report, size_t len, uint32_t crc) {
+    uint8_t* c = &report[len - DS_BT_CRC_SIZE];
+    c[0] = static_cast<uint8_t>(crc);
+    c[1] = static_cast<uint8_t>(crc >> 8);
+    c[2] = static_cast<uint8_t>(crc >> 16);
+    c[3] = static_cast<uint8_t>(crc >> 24);
+}
+
+inline bool ds_bt_input_crc_ok(const uint8_t* report, size_t len) {
+    return ds_bt_crc(DS_BT_HID_INPUT, report, len) == ds_bt_stored_crc(report, len);
+}
@@ -0,0 +1,64 @@
+#pragma once
+// Dual-core mode (build with -DDUALSENSE_DUAL_CORE=ON).
+// Core1 owns the CYW43 driver and the BTstack run loop: its async context IRQs run every BTstack callback and
+// the L2CAP sends. Core0 runs Gamepad-Core (UpdateInput/UpdateOutput) and the application. Input frames reach
+// core0 through the input pipeline triple buffer (latest wins); output reports reach core1 through an SPSC ring
+// of full report snapshots, drained by the output worker in pico_w_btstack.h on core1 into the output scheduler.
+#if PICO_W_DUAL_CORE
+#include <cstdint>
+#include <cstring>
+#include "pico/async_context.h"
+#include "pico/cyw43_arch.h"
+#include "btstack_config.h"
+#include "pico_w_connections.h"
+#include "pico_w_log.h"
+#include "pico_w_spsc_ring.h"
+
+#define OUTPUT_RING_CAPACITY 8
+#define OUTPUT_PUSH_TIMEOUT_US 200
+
+struct output_command {
+    uint8_t slot;
+    uint8_t report[OUTPUT_REPORT_SIZE];
+    latency_stamp stamp;
+};
+
+static spsc_ring<output_command, OUTPUT_RING_CAPACITY> output_ring; // core0 -> core1
+static uint32_t output_ring_dropped = 0;  // core0 only
+static async_when_pending_worker_t output_worker;
+
+// core0: called from pico_w_platform_policy::Write with the freshly packed output report of slot.
+inline bool dual_core_submit_output(uint8_t slot, const uint8_t* report, const latency_stamp& stamp) {
+    output_command command;
+    command.slot = slot;
+    command.stamp = stamp;
+    memcpy(command.report, report, OUTPUT_REPORT_SIZE);
+
+    // core1 drains the ring within one worker pass; only wait briefly if it fell behind
+    const uint64_t deadline = time_us_64() + OUTPUT_PUSH_TIMEOUT_US;
+    while (!output_ring.push(command)) {
+        if (time_us_64() > deadline) {
+            output_ring_dropped++;
+            LOG_WARN(LOG_OUTPUT_RING_FULL, slot);
+            return false;
+        }
+        tight_loop_contents();
+    }
+    async_context_set_work_pending(cyw43_arch_async_context(), &output_worker);
+    return true;
+}
+
+// core1: stages everything queued by core0 in the output scheduler. Several reports queued for one slot in the
+// same pass collapse into the newest one. Returns a mask of the slots that received a report.
+inline uint8_t dual_core_drain_outputs() {
+    uint8_t drained = 0;
+    while (const output_command* command = output_ring.front()) {
+        if (command->slot < MAX_NR_GAMEPADS) {
+            output_stage(command->slot, command->report, command->stamp);
+            drained |= static_cast<uint8_t>(1u << command->slot);
+        }
+        output_ring.pop();
+    }
+    return drained;
+}
+#endif
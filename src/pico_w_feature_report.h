@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include "btstack_config.h"
+#include "bluetooth.h"
+#include "btstack_run_loop.h"
+#include "l2cap.h"
+#include "pico_w_connections.h"
+
+// Feature reports over the HID control channel.
+// feature_report_get() sends a HID GET_REPORT (feature) for one report id and returns at once. The controller's
+// DATA reply, or a HANDSHAKE error, goes to the handler passed with the request. A request without an answer
+// within its timeout is sent again, up to FEATURE_REPORT_ATTEMPTS times, then the handler gets
+// FEATURE_REPORT_TIMEOUT. HID allows one control transaction at a time, so a slot holds at most one request; a
+// disconnect drops it without calling the handler. BTstack context only.
+
+#define FEATURE_REPORT_ATTEMPTS 3
+
+#define HID_TRANS_HANDSHAKE   0x00
+#define HID_TRANS_GET_REPORT  0x40
+#define HID_TRANS_DATA        0xA0
+#define HID_PARAM_FEATURE     0x03    // report type parameter; HID_REPORT_TYPE_FEATURE is BTstack's enum value
+
+enum feature_report_status : uint8_t {
+    FEATURE_REPORT_OK = 0,
+    FEATURE_REPORT_REJECTED,    // HANDSHAKE with an error code
+    FEATURE_REPORT_TIMEOUT,
+};
+
+// report starts at the report id; size includes it
+typedef void (*feature_report_handler_t)(uint8_t slot, feature_report_status status, const uint8_t* report,
+                                         uint16_t size);
+
+struct feature_request {
+    btstack_timer_source_t timer;
+    feature_report_handler_t handler;   // nullptr: no request outstanding
+    uint8_t report_id;
+    uint8_t attempts;
+    uint16_t timeout_ms;
+};
+
+static feature_request feature_requests[MAX_NR_GAMEPADS];
+
+inline void feature_report_send(uint8_t slot);
+
+inline void feature_report_timeout(btstack_timer_source_t* timer) {
+    const uint8_t slot = static_cast<uint8_t>(reinterpret_cast<feature_request*>(timer) - feature_requests);
+    feature_request& request = feature_requests[slot];
+    if (!request.handler) return;
+    if (request.attempts < FEATURE_REPORT_ATTEMPTS) {
+        feature_report_send(slot);
+        return;
+    }
+    const feature_report_handler_t handler = request.handler;
+    request.handler = nullptr;
+    handler(slot, FEATURE_REPORT_TIMEOUT, nullptr, 0);
+}
+
+// One GET_REPORT; a send refused for lack of ACL buffers counts as an attempt that timed out.
+inline void feature_report_send(uint8_t slot) {
+    feature_request& request = feature_requests[slot];
+    request.attempts++;
+    const uint8_t get_report[2] = {HID_TRANS_GET_REPORT | HID_PARAM_FEATURE, request.report_id};
+    l2cap_send(connections[slot].cid_control, get_report, sizeof(get_report));
+    btstack_run_loop_set_timer_handler(&request.timer, &feature_report_timeout);
+    btstack_run_loop_set_timer(&request.timer, request.timeout_ms);
+    btstack_run_loop_add_timer(&request.timer);
+}
+
+// Returns false if slot has no control channel or a request is still outstanding.
+inline bool feature_report_get(uint8_t slot, uint8_t report_id, feature_report_handler_t handler,
+                               uint16_t timeout_ms) {
+    feature_request& request = feature_requests[slot];
+    if (request.handler || connections[slot].cid_control == 0) return false;
+    request.handler = handler;
+    request.report_id = report_id;
+    request.attempts = 0;
+    request.timeout_ms = timeout_ms;
+    feature_report_send(slot);
+    return true;
+}
+
+inline void feature_report_cancel(uint8_t slot) {
+    feature_request& request = feature_requests[slot];
+    if (!request.handler) return;
+    btstack_run_loop_remove_timer(&request.timer);
+    request.handler = nullptr;
+}
+
+// l2cap_packet_handler: a packet on the HID control channel of slot.
+inline void feature_report_control_packet(uint8_t slot, const uint8_t* packet, uint16_t size) {
+    feature_request& request = feature_requests[slot];
+    if (!request.handler || size == 0) return;
+    feature_report_status status;
+    if ((packet[0] & 0xF0) == HID_TRANS_HANDSHAKE && (packet[0] & 0x0F) != 0) {
+        status = FEATURE_REPORT_REJECTED;
+    } else if (packet[0] == (HID_TRANS_DATA | HID_PARAM_FEATURE) && size > 1 &&
+               packet[1] == request.report_id) {
+        status = FEATURE_REPORT_OK;
+    } else {
+        return;
+    }
+    btstack_run_loop_remove_timer(&request.timer);
+    const feature_report_handler_t handler = request.handler;
+    request.handler = nullptr;
+    handler(slot, status, status == FEATURE_REPORT_OK ? &packet[1] : nullptr,
+            status == FEATURE_REPORT_OK ? static_cast<uint16_t>(size - 1) : 0);
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "pico_w_report_view.h"
+
+// Fixed-point input state (build with -DDUALSENSE_FIXED_INPUT=ON).
+// The RP2040 has no FPU, so turning every 0x31 report into float sticks, triggers and touch coordinates and then
+// comparing them with abs() is soft-float work on every frame. fixed_input_decode() reads the same report snapshot
+// that UpdateInput decodes, in place through a ds_input_view, and fills a parallel Q15 state: sticks and triggers
+// go through 256-entry lookup tables with the deadzone and response curve already applied, touch coordinates are
+// scaled with a multiply and a shift.
+// Floats only appear when a caller asks for one with q15_to_float().
+
+typedef int16_t q15_t;
+
+#define Q15_ONE 32767
+#define FIXED_TOUCH_MAX_X 1919
+#define FIXED_TOUCH_MAX_Y 1079
+
+#ifndef FIXED_STICK_DEADZONE_Q15
+#define FIXED_STICK_DEADZONE_Q15 2621   // 0.08
+#endif
+
+#ifndef FIXED_TRIGGER_DEADZONE_Q15
+#define FIXED_TRIGGER_DEADZONE_Q15 0
+#endif
+
+enum fixed_curve : uint8_t {
+    FIXED_CURVE_LINEAR = 0,
+    FIXED_CURVE_QUADRATIC,
+    FIXED_CURVE_CUBIC,
+};
+
+#ifndef FIXED_STICK_CURVE
+#define FIXED_STICK_CURVE FIXED_CURVE_LINEAR
+#endif
+
+// Button bits: d-pad, face buttons at their report positions, then report bytes 8 and 9
+enum fixed_button : uint32_t {
+    FIXED_BUTTON_DPAD_UP    = 1u << 0,
+    FIXED_BUTTON_DPAD_RIGHT = 1u << 1,
+    FIXED_BUTTON_DPAD_DOWN  = 1u << 2,
+    FIXED_BUTTON_DPAD_LEFT  = 1u << 3,
+    FIXED_BUTTON_SQUARE     = 1u << 4,
+    FIXED_BUTTON_CROSS      = 1u << 5,
+    FIXED_BUTTON_CIRCLE     = 1u << 6,
+    FIXED_BUTTON_TRIANGLE   = 1u << 7,
+    FIXED_BUTTON_L1         = 1u << 8,
+    FIXED_BUTTON_R1         = 1u << 9,
+    FIXED_BUTTON_L2         = 1u << 10,
+    FIXED_BUTTON_R2         = 1u << 11,
+    FIXED_BUTTON_CREATE     = 1u << 12,
+    FIXED_BUTTON_OPTIONS    = 1u << 13,
+    FIXED_BUTTON_L3         = 1u << 14,
+    FIXED_BUTTON_R3         = 1u << 15,
+    FIXED_BUTTON_PS         = 1u << 16,
+    FIXED_BUTTON_TOUCHPAD   = 1u << 17,
+    FIXED_BUTTON_MUTE       = 1u << 18,
+};
+
+struct fixed_stick {
+    q15_t x;
+    q15_t y;
+};
+
+struct fixed_input_state {
+    fixed_stick left;
+    fixed_stick right;
+    q15_t l2;
+    q15_t r2;
+    uint32_t buttons;       // fixed_button bits
+    uint8_t touch_count;
+    q15_t touch_x;          // first active finger, 0..Q15_ONE across the pad
+    q15_t touch_y;
+};
+
+inline float q15_to_float(q15_t value) {
+    return static_cast<float>(value) * (1.0f / Q15_ONE);
+}
+
+constexpr q15_t q15_abs(q15_t value) {
+    return value < 0 ? static_cast<q15_t>(-value) : value;
+}
+
+// Deadzone, rescale and curve for a magnitude in 0..Q15_ONE; integer only, shared by the table builders.
+constexpr int32_t fixed_shape(int32_t magnitude, int32_t deadzone, fixed_curve curve) {
+    if (magnitude <= deadzone) return 0;
+    int32_t shaped = (magnitude - deadzone) * Q15_ONE / (Q15_ONE - deadzone);
+    if (curve == FIXED_CURVE_QUADRATIC) shaped = shaped * shaped >> 15;
+    if (curve == FIXED_CURVE_CUBIC) shaped = (shaped * shaped >> 15) * shaped >> 15;
+    return shaped;
+}
+
+// Raw stick byte (0x80 centred) -> Q15 in -Q15_ONE..Q15_ONE
+constexpr std::array<q15_t, 256> fixed_make_stick_lut(int32_t deadzone, fixed_curve curve) {
+    std::array<q15_t, 256> lut{};
+    for (int32_t raw = 0; raw < 256; raw++) {
+        int32_t centred = raw - 128;
+        if (centred < -127) centred = -127;
+        const int32_t magnitude = (centred < 0 ? -centred : centred) * Q15_ONE / 127;
+        const int32_t shaped = fixed_shape(magnitude, deadzone, curve);
+        lut[raw] = static_cast<q15_t>(centred < 0 ? -shaped : shaped);
+    }
+    return lut;
+}
+
+// Raw trigger byte -> Q15 in 0..Q15_ONE
+constexpr std::array<q15_t, 256> fixed_make_trigger_lut(int32_t deadzone) {
+    std::array<q15_t, 256> lut{};
+    for (int32_t raw = 0; raw < 256; raw++) {
+        lut[raw] = static_cast<q15_t>(fixed_shape(raw * Q15_ONE / 255, deadzone, FIXED_CURVE_LINEAR));
+    }
+    return lut;
+}
+
+// D-pad hat (0 = up, clockwise, 8 = released) -> FIXED_BUTTON_DPAD_* bits
+constexpr uint8_t fixed_dpad_bits[16] = {
+    0x1, 0x3, 0x2, 0x6, 0x4, 0xC, 0x8, 0x9, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+// Q16 reciprocals: pixel * scale >> 16 maps the touch range onto 0..Q15_ONE without a division per frame
+constexpr uint32_t fixed_touch_scale_x = (static_cast<uint32_t>(Q15_ONE) << 16) / FIXED_TOUCH_MAX_X;
+constexpr uint32_t fixed_touch_scale_y = (static_cast<uint32_t>(Q15_ONE) << 16) / FIXED_TOUCH_MAX_Y;
+
+static std::array<q15_t, 256> fixed_stick_lut =
+        fixed_make_stick_lut(FIXED_STICK_DEADZONE_Q15, static_cast<fixed_curve>(FIXED_STICK_CURVE));
+static std::array<q15_t, 256> fixed_trigger_lut = fixed_make_trigger_lut(FIXED_TRIGGER_DEADZONE_Q15);
+
+// Application: rebuilds the tables, e.g. from a settings menu. Not for the per-frame path.
+inline void fixed_input_configure(q15_t stick_deadzone, fixed_curve stick_curve, q15_t trigger_deadzone) {
+    fixed_stick_lut = fixed_make_stick_lut(stick_deadzone, stick_curve);
+    fixed_trigger_lut = fixed_make_trigger_lut(trigger_deadzone);
+}
+
+// Reads the report in place through the view; nothing but the Q15 state is written.
+inline void fixed_input_decode(ds_input_view report, fixed_input_state& state) {
+    state.left.x = fixed_stick_lut[report.left_x()];
+    state.left.y = fixed_stick_lut[report.left_y()];
+    state.right.x = fixed_stick_lut[report.right_x()];
+    state.right.y = fixed_stick_lut[report.right_y()];
+    state.l2 = fixed_trigger_lut[report.l2()];
+    state.r2 = fixed_trigger_lut[report.r2()];
+    const uint8_t face = report.buttons(0);
+    state.buttons = fixed_dpad_bits[face & 0x0F] | (face & 0xF0u) | (static_cast<uint32_t>(report.buttons(1)) << 8) |
+                    (static_cast<uint32_t>(report.buttons(2) & 0x07) << 16);
+
+    const ds_touch_point finger0 = report.touch(0);
+    const ds_touch_point finger1 = report.touch(1);
+    state.touch_count = static_cast<uint8_t>(finger0.active + finger1.active);
+    const ds_touch_point& touch = finger0.active ? finger0 : finger1;
+    if (state.touch_count) {
+        state.touch_x = static_cast<q15_t>(touch.x >= FIXED_TOUCH_MAX_X ? Q15_ONE : (touch.x * fixed_touch_scale_x) >> 16);
+        state.touch_y = static_cast<q15_t>(touch.y >= FIXED_TOUCH_MAX_Y ? Q15_ONE : (touch.y * fixed_touch_scale_y) >> 16);
+    } else {
+        state.touch_x = 0;
+        state.touch_y = 0;
+    }
+}
+
+// Thousandths for printing without %f
+constexpr int q15_to_milli(q15_t value) {
+    return static_cast<int32_t>(value) * 1000 / Q15_ONE;
+}
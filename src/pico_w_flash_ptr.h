@@ -5,74 +5,373 @@
 #ifndef DUALSENSE_TEST_FLASH_OPERATOR_H
 #define DUALSENSE_TEST_FLASH_OPERATOR_H
 
+#include <cstddef>
 #include <cstdio>
 #include <cstring>
 
 #include "btstack_util.h"
+#include "pico_w_crc32.h"
 #include "hardware/flash.h"
 #include "hardware/sync.h"
+#if PICO_W_DUAL_CORE
+#include "pico/multicore.h"
+#endif
+
+// Bond journal: append-only log of MAC/link-key records spread over BOND_SECTOR_COUNT sectors. A record also
+// carries the controller's calibration feature report once it has been read, so a reconnect has it at once.
+// Every record carries a generation (global append counter) and a CRC; the newest valid record of a MAC wins and
+// a DELETED record is a tombstone. Records are appended by programming the page that holds them (0xFF bytes
+// leave the other records untouched), so adding a key never erases anything.
+// The sector after the one being written is always kept erased. When the write position enters a new sector,
+// the live records of the following (oldest) sector are copied forward and only then is that sector erased.
+// flash_bonds_init() scans the journal once at boot into bond_index; lookups never touch flash afterwards.
+// Journals of 32-byte records without calibration (magic 0xB0) are rewritten in the current layout at boot.
 
 // offset 1.5MB
 #define FLASH_TARGET_OFFSET (1536 * 1024)
 #define CONFIG_VALID_MARKER 0xDEADBEEF
-#define CONFIG_INVALID      0xFF
 
+#define BOND_SECTOR_COUNT 4
+#define BOND_RECORD_SIZE 128
+#define BOND_RECORDS_PER_SECTOR (FLASH_SECTOR_SIZE / BOND_RECORD_SIZE)
+#define BOND_RECORD_COUNT (BOND_SECTOR_COUNT * BOND_RECORDS_PER_SECTOR)
+#define BOND_MAX_DEVICES 8
+
+#define BOND_RECORD_MAGIC   0xB1
+#define BOND_RECORD_V1_MAGIC 0xB0
+#define BOND_RECORD_V1_SIZE 32
+#define BOND_RECORD_KEY     0x01
+#define BOND_RECORD_DELETED 0x02
+
+#define BOND_CALIBRATION_SIZE 41    // DualSense feature report 0x05 with report id and CRC
+
+// Single-record layout written by earlier firmware at FLASH_TARGET_OFFSET, imported once by flash_bonds_init()
 typedef struct {
     uint8_t mac[6];
     link_key_t link_key;
     uint32_t exists;
 } device_config_t;
 
-inline void flash_save_config(const uint8_t *addr, const uint8_t *link_key) {
-    uint8_t buffer[FLASH_PAGE_SIZE] = {};
-    device_config_t config;
-    memcpy(config.mac, addr, 6);
-    if (link_key) {
-        memcpy(config.link_key, link_key, LINK_KEY_LEN);
-        config.exists = CONFIG_VALID_MARKER;
+struct bond_record {
+    uint8_t magic;
+    uint8_t type;
+    uint8_t mac[6];
+    uint32_t generation;
+    link_key_t link_key;
+    uint8_t calibration[BOND_CALIBRATION_SIZE];  // all 0xFF: not read yet
+    uint8_t reserved[55];
+    uint32_t crc;           // over every byte before it
+};
+
+struct bond_record_v1 {
+    uint8_t magic;
+    uint8_t type;
+    uint8_t mac[6];
+    uint32_t generation;
+    link_key_t link_key;
+    uint32_t crc;
+};
+
+struct bond_entry {
+    bool in_use;
+    bool deleted;           // newest record is a tombstone, kept until its sector is compacted
+    bool has_calibration;
+    bd_addr_t mac;
+    link_key_t link_key;
+    uint8_t calibration[BOND_CALIBRATION_SIZE];
+    uint32_t generation;
+    uint16_t record;        // journal slot of the newest record
+};
+
+static_assert(sizeof(bond_record) == BOND_RECORD_SIZE, "bond_record must tile a flash page");
+static_assert(sizeof(bond_record_v1) == BOND_RECORD_V1_SIZE, "bond_record_v1 is the 32-byte layout");
+static_assert(BOND_MAX_DEVICES < BOND_RECORDS_PER_SECTOR, "compaction copies live records into one sector");
+
+static bond_entry bond_index[BOND_MAX_DEVICES];
+static uint16_t bond_write_slot = 0;
+static uint32_t bond_generation = 0;
+
+inline const bond_record *bond_record_at(uint16_t slot) {
+    return reinterpret_cast<const bond_record *>(XIP_BASE + FLASH_TARGET_OFFSET) + slot;
+}
+
+inline bool bond_record_valid(const bond_record *record) {
+    return record->magic == BOND_RECORD_MAGIC &&
+           (record->type == BOND_RECORD_KEY || record->type == BOND_RECORD_DELETED) &&
+           record->crc == crc32_compute(reinterpret_cast<const uint8_t *>(record), offsetof(bond_record, crc));
+}
+
+inline bool bond_range_blank(uint32_t offset, uint32_t len) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(XIP_BASE + FLASH_TARGET_OFFSET + offset);
+    for (uint32_t i = 0; i < len; i++) {
+        if (bytes[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+inline uint16_t bond_sector_of(uint16_t slot) {
+    return static_cast<uint16_t>(slot / BOND_RECORDS_PER_SECTOR);
+}
+
+// Flash writes stall XIP: with BTstack on core1, core0 is parked in RAM for the duration
+inline uint32_t bond_flash_begin() {
+#if PICO_W_DUAL_CORE
+    if (multicore_lockout_victim_is_initialized(0)) multicore_lockout_start_blocking();
+#endif
+    return save_and_disable_interrupts();
+}
+
+inline void bond_flash_end(uint32_t ints) {
+    restore_interrupts(ints);
+#if PICO_W_DUAL_CORE
+    if (multicore_lockout_victim_is_initialized(0)) multicore_lockout_end_blocking();
+#endif
+}
+
+inline void bond_erase_sector(uint16_t sector) {
+    printf("[FLASH] Compacting bond sector %u\n", sector);
+    const uint32_t ints = bond_flash_begin();
+    flash_range_erase(FLASH_TARGET_OFFSET + sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+    bond_flash_end(ints);
+}
+
+// Programs one record; only its page is written and interrupts are off for a single page program.
+inline void bond_program_record(uint16_t slot, const bond_record &record) {
+    uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    const uint32_t offset = static_cast<uint32_t>(slot) * BOND_RECORD_SIZE;
+    memcpy(&page[offset % FLASH_PAGE_SIZE], &record, sizeof(record));
+
+    const uint32_t ints = bond_flash_begin();
+    flash_range_program(FLASH_TARGET_OFFSET + offset - offset % FLASH_PAGE_SIZE, page, FLASH_PAGE_SIZE);
+    bond_flash_end(ints);
+}
+
+inline bond_entry *bond_find_entry(const uint8_t *mac) {
+    for (auto &entry: bond_index) {
+        if (entry.in_use && bd_addr_cmp(entry.mac, mac) == 0) return &entry;
+    }
+    return nullptr;
+}
+
+// Index slot for mac: its own entry, a free one, or the one with the oldest generation if that is older than
+// generation. Returns nullptr when every entry is newer (the record falls out of the index).
+inline bond_entry *bond_claim_entry(const uint8_t *mac, uint32_t generation) {
+    if (bond_entry *entry = bond_find_entry(mac)) return entry->generation < generation ? entry : nullptr;
+
+    bond_entry *victim = nullptr;
+    for (auto &entry: bond_index) {
+        if (!entry.in_use) return &entry;
+        if (!victim || entry.generation < victim->generation) victim = &entry;
     }
+    return victim->generation < generation ? victim : nullptr;
+}
+
+inline void bond_index_apply(const bond_record *record, uint16_t slot) {
+    bond_entry *entry = bond_claim_entry(record->mac, record->generation);
+    if (!entry) return;
+    entry->in_use = true;
+    entry->deleted = record->type == BOND_RECORD_DELETED;
+    memcpy(entry->mac, record->mac, 6);
+    memcpy(entry->link_key, record->link_key, LINK_KEY_LEN);
+    entry->has_calibration = record->calibration[0] != 0xFF;
+    memcpy(entry->calibration, record->calibration, BOND_CALIBRATION_SIZE);
+    entry->generation = record->generation;
+    entry->record = slot;
+}
 
-    memcpy(buffer, &config, sizeof(device_config_t));
+inline void bond_append(uint8_t type, const uint8_t *mac, const uint8_t *link_key, const uint8_t *calibration);
 
-    printf("[FLASH] Config saved: MAC=%s, Key: ", bd_addr_to_str(addr));
-    if (link_key) {
-        for (int i = 0; i < LINK_KEY_LEN; i++) {
-            printf("%02X", link_key[i]);
+// Copies the live records of sector into the journal head, forgets tombstones stored there and erases it.
+// Everything in the oldest sector predates the rest of the journal, so a tombstone there shadows nothing else.
+inline void bond_compact_sector(uint16_t sector) {
+    if (bond_range_blank(sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE)) return;
+
+    for (auto &entry: bond_index) {
+        if (!entry.in_use || bond_sector_of(entry.record) != sector) continue;
+        if (entry.deleted) {
+            entry = {};
+        } else {
+            bond_append(BOND_RECORD_KEY, entry.mac, entry.link_key,
+                        entry.has_calibration ? entry.calibration : nullptr);
         }
     }
-    printf("\n");
+    bond_erase_sector(sector);
+}
 
-    const uint32_t ints = save_and_disable_interrupts();
-    flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);
-    flash_range_program(FLASH_TARGET_OFFSET, buffer, FLASH_PAGE_SIZE);
-    restore_interrupts(ints);
+// Steps the write position; entering a sector compacts the one after it, keeping it blank.
+inline void bond_advance_write_slot() {
+    bond_write_slot = static_cast<uint16_t>((bond_write_slot + 1) % BOND_RECORD_COUNT);
+    if (bond_write_slot % BOND_RECORDS_PER_SECTOR != 0) return;
+
+    const uint16_t sector = bond_sector_of(bond_write_slot);
+    if (!bond_range_blank(sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE)) bond_erase_sector(sector);
+    bond_compact_sector(static_cast<uint16_t>((sector + 1) % BOND_SECTOR_COUNT));
 }
 
-inline bool flash_load_config(uint8_t *addr, uint8_t *link_key) {
-    const auto flash_target_contents = reinterpret_cast<const device_config_t *>((XIP_BASE + FLASH_TARGET_OFFSET));
+inline void bond_append(uint8_t type, const uint8_t *mac, const uint8_t *link_key, const uint8_t *calibration) {
+    // skip slots left half-programmed by a reset
+    while (!bond_range_blank(static_cast<uint32_t>(bond_write_slot) * BOND_RECORD_SIZE, BOND_RECORD_SIZE)) {
+        bond_advance_write_slot();
+    }
+
+    bond_record record;
+    memset(&record, 0xFF, sizeof(record));
+    record.magic = BOND_RECORD_MAGIC;
+    record.type = type;
+    memcpy(record.mac, mac, 6);
+    record.generation = ++bond_generation;
+    if (link_key) memcpy(record.link_key, link_key, LINK_KEY_LEN);
+    if (calibration) memcpy(record.calibration, calibration, BOND_CALIBRATION_SIZE);
+    record.crc = crc32_compute(reinterpret_cast<const uint8_t *>(&record), offsetof(bond_record, crc));
 
-    if (flash_target_contents->exists == CONFIG_VALID_MARKER) {
-        memcpy(addr, flash_target_contents->mac, 6);
-        memcpy(link_key, flash_target_contents->link_key, LINK_KEY_LEN);
-        printf("[FLASH] Config carregada: MAC=%s\n", bd_addr_to_str(addr));
-        printf("[FLASH] Config saved: MAC=%s, Key: ", bd_addr_to_str(addr));
-        if (link_key) {
-            for (int i = 0; i < 16; i++) {
-                printf("%02X", link_key[i]);
-            }
+    bond_program_record(bond_write_slot, record);
+    bond_index_apply(&record, bond_write_slot);
+    bond_advance_write_slot();
+}
+
+// Rebuilds a 32-byte-record journal in the current layout. Returns false if there is none.
+inline bool bond_import_v1() {
+    constexpr uint16_t v1_records = BOND_SECTOR_COUNT * FLASH_SECTOR_SIZE / BOND_RECORD_V1_SIZE;
+    const auto *records = reinterpret_cast<const bond_record_v1 *>(XIP_BASE + FLASH_TARGET_OFFSET);
+    bool found = false;
+    for (uint16_t slot = 0; slot < v1_records; slot++) {
+        const bond_record_v1 &old = records[slot];
+        if (old.magic != BOND_RECORD_V1_MAGIC ||
+            (old.type != BOND_RECORD_KEY && old.type != BOND_RECORD_DELETED) ||
+            old.crc != crc32_compute(reinterpret_cast<const uint8_t *>(&old), offsetof(bond_record_v1, crc))) {
+            continue;
         }
-        printf("\n");
-        return true;
+        bond_record record;
+        memset(&record, 0xFF, sizeof(record));
+        record.type = old.type;
+        memcpy(record.mac, old.mac, 6);
+        record.generation = old.generation;
+        memcpy(record.link_key, old.link_key, LINK_KEY_LEN);
+        bond_index_apply(&record, 0);
+        found = true;
     }
+    if (!found) return false;
 
-    return false;
+    printf("[FLASH] Rewriting bond journal with calibration records\n");
+    bond_entry live[BOND_MAX_DEVICES];
+    memcpy(live, bond_index, sizeof(live));
+    memset(bond_index, 0, sizeof(bond_index));
+    for (uint16_t sector = 0; sector < BOND_SECTOR_COUNT; sector++) bond_erase_sector(sector);
+    // oldest first, so the most recent device stays the most recent
+    while (true) {
+        bond_entry *oldest = nullptr;
+        for (auto &entry: live) {
+            if (entry.in_use && !entry.deleted && (!oldest || entry.generation < oldest->generation)) oldest = &entry;
+        }
+        if (!oldest) break;
+        bond_append(BOND_RECORD_KEY, oldest->mac, oldest->link_key, nullptr);
+        oldest->in_use = false;
+    }
+    return true;
 }
 
-inline void flash_clear_config() {
-    uint32_t ints = save_and_disable_interrupts();
-    flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);
-    restore_interrupts(ints);
-    printf("[FLASH] clean keys!\n");
+// Boot: builds bond_index from the journal and restores the write position after the newest record.
+inline void flash_bonds_init() {
+    memset(bond_index, 0, sizeof(bond_index));
+    bond_generation = 0;
+    bond_write_slot = 0;
+
+    uint16_t newest_slot = 0;
+    for (uint16_t slot = 0; slot < BOND_RECORD_COUNT; slot++) {
+        const bond_record *record = bond_record_at(slot);
+        if (!bond_record_valid(record)) continue;
+        bond_index_apply(record, slot);
+        if (record->generation > bond_generation) {
+            bond_generation = record->generation;
+            newest_slot = slot;
+        }
+    }
+
+    if (bond_generation == 0 && !bond_import_v1()) {
+        const auto legacy = reinterpret_cast<const device_config_t *>(XIP_BASE + FLASH_TARGET_OFFSET);
+        if (legacy->exists == CONFIG_VALID_MARKER) {
+            device_config_t config = *legacy;
+            printf("[FLASH] Importing single-device config: MAC=%s\n", bd_addr_to_str(config.mac));
+            bond_erase_sector(0);
+            bond_append(BOND_RECORD_KEY, config.mac, config.link_key, nullptr);
+        }
+    } else {
+        bond_write_slot = static_cast<uint16_t>((newest_slot + 1) % BOND_RECORD_COUNT);
+    }
+
+    // Finish a compaction cut short by a reset: the sector after the head must be blank
+    const uint16_t head_sector = bond_sector_of(bond_write_slot);
+    bond_compact_sector(static_cast<uint16_t>((head_sector + 1) % BOND_SECTOR_COUNT));
+
+    uint8_t count = 0;
+    for (auto &entry: bond_index) count += entry.in_use && !entry.deleted ? 1 : 0;
+    printf("[FLASH] %u bonded device(s), journal generation %u, next slot %u\n",
+           count, (unsigned int) bond_generation, bond_write_slot);
+}
+
+// Link key for mac from the RAM index.
+inline bool flash_bond_find(const uint8_t *mac, uint8_t *link_key) {
+    const bond_entry *entry = bond_find_entry(mac);
+    if (!entry || entry->deleted) return false;
+    memcpy(link_key, entry->link_key, LINK_KEY_LEN);
+    return true;
+}
+
+// Most recently bonded device, the one to wait for after boot.
+inline bool flash_bond_latest(uint8_t *mac) {
+    const bond_entry *latest = nullptr;
+    for (auto &entry: bond_index) {
+        if (entry.in_use && !entry.deleted && (!latest || entry.generation > latest->generation)) latest = &entry;
+    }
+    if (!latest) return false;
+    memcpy(mac, latest->mac, 6);
+    return true;
+}
+
+// Calibration feature report of mac, if it was read before.
+inline bool flash_bond_calibration(const uint8_t *mac, uint8_t *report) {
+    const bond_entry *entry = bond_find_entry(mac);
+    if (!entry || entry->deleted || !entry->has_calibration) return false;
+    memcpy(report, entry->calibration, BOND_CALIBRATION_SIZE);
+    return true;
+}
+
+// Stores the calibration report next to the bond of mac; a controller without a bond is not cached.
+inline bool flash_bond_save_calibration(const uint8_t *mac, const uint8_t *report) {
+    const bond_entry *entry = bond_find_entry(mac);
+    if (!entry || entry->deleted) return false;
+    if (entry->has_calibration && memcmp(entry->calibration, report, BOND_CALIBRATION_SIZE) == 0) return true;
+
+    link_key_t link_key;
+    memcpy(link_key, entry->link_key, LINK_KEY_LEN);
+    bond_append(BOND_RECORD_KEY, mac, link_key, report);
+    printf("[FLASH] Calibration saved: MAC=%s\n", bd_addr_to_str(mac));
+    return true;
+}
+
+inline void flash_bond_save(const uint8_t *mac, const uint8_t *link_key) {
+    const bond_entry *entry = bond_find_entry(mac);
+    if (entry && !entry->deleted && memcmp(entry->link_key, link_key, LINK_KEY_LEN) == 0) return;
+
+    // re-pairing does not change the controller's factory calibration
+    uint8_t calibration[BOND_CALIBRATION_SIZE];
+    const bool has_calibration = entry && entry->has_calibration;
+    if (has_calibration) memcpy(calibration, entry->calibration, BOND_CALIBRATION_SIZE);
+    bond_append(BOND_RECORD_KEY, mac, link_key, has_calibration ? calibration : nullptr);
+    printf("[FLASH] Bond saved: MAC=%s, Key: ", bd_addr_to_str(mac));
+    for (int i = 0; i < LINK_KEY_LEN; i++) {
+        printf("%02X", link_key[i]);
+    }
+    printf("\n");
+}
+
+inline void flash_bond_remove(const uint8_t *mac) {
+    const bond_entry *entry = bond_find_entry(mac);
+    if (!entry || entry->deleted) return;
+
+    bond_append(BOND_RECORD_DELETED, mac, nullptr, nullptr);
+    printf("[FLASH] Bond removed: MAC=%s\n", bd_addr_to_str(mac));
 }
 
 #endif //DUALSENSE_TEST_FLASH_OPERATOR_H
@@ -0,0 +1,350 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "btstack_config.h"
+#include "btstack_run_loop.h"
+#include "l2cap.h"
+#include "pico/time.h"
+#include "pico_w_capture.h"
+#include "pico_w_connections.h"
+#include "pico_w_crc32.h"
+#include "pico_w_link_health.h"
+#include "pico_w_log.h"
+#include "pico_w_spsc_ring.h"
+
+// Haptic audio (build with -DDUALSENSE_HAPTIC_AUDIO=ON).
+// Over Bluetooth the DualSense takes its voice-coil haptics as report 0x32: a sequence tag, a settings packet
+// and HAPTIC_AUDIO_PACKET_FRAMES stereo frames of signed 8-bit samples at HAPTIC_AUDIO_SAMPLE_RATE_HZ, so one
+// report every 10.67 ms. The application writes samples with haptic_audio_write() (or _pcm16) and they are cut
+// into whole packets in a per-slot spsc_ring; the producer side needs no lock, from core0 in the dual-core build
+// too. On the BTstack side a run-loop timer keeps each stream's schedule: packet n is due at start + n periods,
+// computed from the sample clock so the rate does not drift with timer rounding. A due packet sets the slot in
+// output_haptic_mask and waits for a CAN_SEND_NOW on l2cap_cid_interrupt like the 0x31 output reports, which it
+// goes ahead of but does not replace. A stream starts once HAPTIC_AUDIO_PREFILL_PACKETS are queued; while no
+// other stream is open, the timer only looks every HAPTIC_AUDIO_IDLE_POLL_MS. When the ring runs dry it sends
+// silence to keep the controller's buffer fed, and after HAPTIC_AUDIO_UNDERRUN_PACKETS silent packets in a row it
+// stops and waits for the prefill again. A stream that fell more than two periods behind (ACL buffers busy, a
+// long stall) restarts its schedule instead of bursting to catch up.
+
+#ifndef PICO_W_HAPTIC_AUDIO
+#define PICO_W_HAPTIC_AUDIO 0
+#endif
+
+#define HAPTIC_AUDIO_SAMPLE_RATE_HZ 3000
+#define HAPTIC_AUDIO_PACKET_FRAMES 32                   // stereo frames per report
+#define HAPTIC_AUDIO_PACKET_BYTES (2 * HAPTIC_AUDIO_PACKET_FRAMES)
+#define HAPTIC_AUDIO_REPORT_ID 0x32
+#define HAPTIC_AUDIO_REPORT_SIZE 141                    // report id .. CRC32, after the 0xA2 HID header
+#define HAPTIC_AUDIO_SAMPLES_OFFSET 13
+
+#ifndef HAPTIC_AUDIO_RING_PACKETS
+#define HAPTIC_AUDIO_RING_PACKETS 16                    // ~171 ms per slot
+#endif
+#define HAPTIC_AUDIO_PREFILL_PACKETS 2
+#define HAPTIC_AUDIO_UNDERRUN_PACKETS 3
+#define HAPTIC_AUDIO_IDLE_POLL_MS 100                   // no stream open anywhere
+
+// Time of packet n of a stream, from the sample clock.
+constexpr uint32_t haptic_audio_packet_offset_us(uint32_t n) {
+    return static_cast<uint32_t>(static_cast<uint64_t>(n) * HAPTIC_AUDIO_PACKET_FRAMES * 1000000u /
+                                 HAPTIC_AUDIO_SAMPLE_RATE_HZ);
+}
+
+#define HAPTIC_AUDIO_PERIOD_US haptic_audio_packet_offset_us(1)
+#define HAPTIC_AUDIO_MAX_LATE_US (2 * HAPTIC_AUDIO_PERIOD_US)
+
+static_assert(HAPTIC_AUDIO_SAMPLES_OFFSET + HAPTIC_AUDIO_PACKET_BYTES <= HAPTIC_AUDIO_REPORT_SIZE - DS_BT_CRC_SIZE,
+              "samples must fit ahead of the CRC");
+
+// Report 0x32 up to the samples: sequence tag (high nibble), packet 0x11 (settings, 7 bytes), packet 0x12
+// (samples, 64 bytes); bit 7 of a packet id says a length byte follows. The rest is zero up to the CRC.
+static constexpr uint8_t haptic_audio_report_header[HAPTIC_AUDIO_SAMPLES_OFFSET] = {
+    HAPTIC_AUDIO_REPORT_ID, 0x00,
+    0x80 | 0x11, 7, 0xFE, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00,
+    0x80 | 0x12, HAPTIC_AUDIO_PACKET_BYTES,
+};
+
+struct haptic_audio_packet {
+    int8_t samples[HAPTIC_AUDIO_PACKET_BYTES];          // left, right, left, ...
+};
+
+enum haptic_audio_state : uint8_t {
+    HAPTIC_AUDIO_IDLE = 0,                              // waiting for the prefill
+    HAPTIC_AUDIO_STREAMING,
+};
+
+struct haptic_audio_stats {
+    uint32_t packets;           // reports sent, silent ones included
+    uint32_t silent;            // underrun: silence sent in place of a packet
+    uint32_t stalls;            // streams stopped after HAPTIC_AUDIO_UNDERRUN_PACKETS silent packets
+    uint32_t resyncs;           // schedules restarted after falling behind
+    uint32_t acl_full;          // sends retried after BTSTACK_ACL_BUFFERS_FULL
+    uint32_t failed;            // sends refused for another reason; that packet is lost
+    uint32_t discarded;         // packets dropped while the slot had no controller
+};
+
+struct haptic_audio_slot {
+    spsc_ring<haptic_audio_packet, HAPTIC_AUDIO_RING_PACKETS> ring;
+    // producer: the application
+    std::atomic<bool> open{false};
+    haptic_audio_packet partial;
+    uint8_t partial_frames;
+    uint32_t refused_frames;    // written while the ring was full; haptic_audio_write() returned short
+    // consumer: BTstack context
+    haptic_audio_state state;
+    uint8_t sequence;
+    uint8_t silent_run;
+    bool sending_silence;       // the report in flight carries no ring packet
+    uint32_t start_us;
+    uint32_t sent_packets;      // since start_us
+    uint32_t due_us;
+    haptic_audio_stats stats;
+};
+
+static haptic_audio_slot haptic_audio_slots[MAX_NR_GAMEPADS];
+static btstack_timer_source_t haptic_audio_timer;
+static bool haptic_audio_timer_armed = false;
+
+// --- producer ---
+
+// InitializeAudioDevice: slot starts a new stream from whatever is written next.
+inline void haptic_audio_open(uint8_t slot) {
+    haptic_audio_slot& h = haptic_audio_slots[slot];
+    h.partial_frames = 0;
+    h.open.store(true, std::memory_order_release);
+}
+
+// Queued packets still play out; nothing more is accepted.
+inline void haptic_audio_close(uint8_t slot) {
+    haptic_audio_slots[slot].open.store(false, std::memory_order_release);
+}
+
+// Frames haptic_audio_write() takes right now.
+inline uint32_t haptic_audio_space(uint8_t slot) {
+    const haptic_audio_slot& h = haptic_audio_slots[slot];
+    return (HAPTIC_AUDIO_RING_PACKETS - h.ring.size()) * HAPTIC_AUDIO_PACKET_FRAMES - h.partial_frames;
+}
+
+template<typename Sample, typename Convert>
+inline uint32_t haptic_audio_write_frames(uint8_t slot, const Sample* frames, uint32_t count, Convert convert) {
+    haptic_audio_slot& h = haptic_audio_slots[slot];
+    if (!h.open.load(std::memory_order_relaxed)) return 0;
+    uint32_t taken = 0;
+    while (taken < count) {
+        const uint32_t n = std::min<uint32_t>(count - taken, HAPTIC_AUDIO_PACKET_FRAMES - h.partial_frames);
+        int8_t* out = &h.partial.samples[2 * h.partial_frames];
+        const Sample* in = &frames[2 * taken];
+        for (uint32_t i = 0; i < 2 * n; i++) out[i] = convert(in[i]);
+        if (h.partial_frames + n == HAPTIC_AUDIO_PACKET_FRAMES) {
+            if (!h.ring.push(h.partial)) break;         // ring full: these frames stay unwritten
+            h.partial_frames = 0;
+        } else {
+            h.partial_frames = static_cast<uint8_t>(h.partial_frames + n);
+        }
+        taken += n;
+    }
+    h.refused_frames += count - taken;
+    return taken;
+}
+
+// Interleaved stereo int8 frames at HAPTIC_AUDIO_SAMPLE_RATE_HZ; returns how many were taken, the rest did not fit.
+inline uint32_t haptic_audio_write(uint8_t slot, const int8_t* frames, uint32_t count) {
+    return haptic_audio_write_frames(slot, frames, count, [](int8_t s) { return s; });
+}
+
+// Interleaved stereo 16-bit PCM at HAPTIC_AUDIO_SAMPLE_RATE_HZ, reduced to its high byte.
+inline uint32_t haptic_audio_write_pcm16(uint8_t slot, const int16_t* frames, uint32_t count) {
+    return haptic_audio_write_frames(slot, frames, count, [](int16_t s) { return static_cast<int8_t>(s >> 8); });
+}
+
+// ProcessAudioHaptic: the end of a buffer or clip; a partly filled packet goes out padded with silence.
+inline bool haptic_audio_flush(uint8_t slot) {
+    haptic_audio_slot& h = haptic_audio_slots[slot];
+    if (!h.partial_frames) return true;
+    memset(&h.partial.samples[2 * h.partial_frames], 0, 2 * (HAPTIC_AUDIO_PACKET_FRAMES - h.partial_frames));
+    if (!h.ring.push(h.partial)) return false;
+    h.partial_frames = 0;
+    return true;
+}
+
+// --- consumer: BTstack context ---
+
+inline void haptic_audio_stop(haptic_audio_slot& h, uint8_t slot) {
+    h.state = HAPTIC_AUDIO_IDLE;
+    h.silent_run = 0;
+    output_haptic_mask &= static_cast<uint8_t>(~(1u << slot));
+}
+
+// Marks the slots whose packet is due and returns how long until the next one is; the timer handler and every
+// send call it.
+inline uint32_t haptic_audio_poll(uint32_t now_us) {
+    uint32_t wait_us = UINT32_MAX;
+    bool any_open = false;
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        haptic_audio_slot& h = haptic_audio_slots[slot];
+        const uint8_t bit = static_cast<uint8_t>(1u << slot);
+        const gamepad_connection& conn = connections[slot];
+        if (!conn.in_use || conn.cid_interrupt == 0) {
+            if (h.state != HAPTIC_AUDIO_IDLE) haptic_audio_stop(h, slot);
+            for (; h.ring.front(); h.ring.pop()) h.stats.discarded++;
+            continue;
+        }
+        any_open |= h.open.load(std::memory_order_relaxed);
+        if (h.state == HAPTIC_AUDIO_IDLE) {
+            if (h.ring.size() < HAPTIC_AUDIO_PREFILL_PACKETS) continue;
+            h.state = HAPTIC_AUDIO_STREAMING;
+            h.start_us = now_us;
+            h.sent_packets = 0;
+            h.due_us = now_us;
+        }
+        if (output_haptic_mask & bit) {
+            wait_us = std::min(wait_us, HAPTIC_AUDIO_PERIOD_US);   // still waiting for CAN_SEND_NOW
+            continue;
+        }
+        const int32_t until_due = static_cast<int32_t>(h.due_us - now_us);
+        if (until_due > 0) {
+            wait_us = std::min(wait_us, static_cast<uint32_t>(until_due));
+            continue;
+        }
+        if (static_cast<uint32_t>(-until_due) > HAPTIC_AUDIO_MAX_LATE_US) {
+            h.stats.resyncs++;
+            h.start_us = now_us;
+            h.sent_packets = 0;
+            h.due_us = now_us;
+        }
+        output_haptic_mask |= bit;
+        wait_us = std::min(wait_us, HAPTIC_AUDIO_PERIOD_US);
+    }
+    if (output_haptic_mask) output_kick();
+    if (wait_us == UINT32_MAX && any_open) wait_us = HAPTIC_AUDIO_PERIOD_US;
+    return wait_us;
+}
+
+inline void haptic_audio_timer_handler(btstack_timer_source_t* timer);
+
+inline void haptic_audio_arm(uint32_t wait_us) {
+    if (haptic_audio_timer_armed) btstack_run_loop_remove_timer(&haptic_audio_timer);
+    const uint32_t wait_ms = wait_us == UINT32_MAX ? HAPTIC_AUDIO_IDLE_POLL_MS
+                                                   : std::max<uint32_t>(1, (wait_us + 999) / 1000);
+    btstack_run_loop_set_timer_handler(&haptic_audio_timer, &haptic_audio_timer_handler);
+    btstack_run_loop_set_timer(&haptic_audio_timer, wait_ms);
+    btstack_run_loop_add_timer(&haptic_audio_timer);
+    haptic_audio_timer_armed = true;
+}
+
+inline void haptic_audio_timer_handler(btstack_timer_source_t*) {
+    haptic_audio_timer_armed = false;
+    haptic_audio_arm(haptic_audio_poll(time_us_32()));
+}
+
+inline void haptic_audio_init() {
+    for (auto& h : haptic_audio_slots) {
+        for (; h.ring.front(); h.ring.pop()) {}
+        h.state = HAPTIC_AUDIO_IDLE;
+        h.silent_run = 0;
+        h.stats = {};
+    }
+    output_haptic_mask = 0;
+    haptic_audio_arm(UINT32_MAX);
+}
+
+// CAN_SEND_NOW: slot's next haptic report is due and goes ahead of its output report.
+inline bool haptic_audio_due(uint8_t slot) {
+    return output_haptic_mask & (1u << slot);
+}
+
+// The report (HAPTIC_AUDIO_REPORT_SIZE bytes from the report id, CRC included) for the packet due on slot: the
+// oldest one queued, or silence when the ring ran dry. The packet stays queued until haptic_audio_sent().
+inline void haptic_audio_build(uint8_t slot, uint8_t* report) {
+    haptic_audio_slot& h = haptic_audio_slots[slot];
+    const haptic_audio_packet* packet = h.ring.front();
+    h.sending_silence = !packet;
+    memcpy(report, haptic_audio_report_header, HAPTIC_AUDIO_SAMPLES_OFFSET);
+    report[1] = static_cast<uint8_t>(h.sequence << 4);
+    uint8_t* samples = &report[HAPTIC_AUDIO_SAMPLES_OFFSET];
+    if (packet) {
+        memcpy(samples, packet->samples, HAPTIC_AUDIO_PACKET_BYTES);
+    } else {
+        memset(samples, 0, HAPTIC_AUDIO_PACKET_BYTES);
+    }
+    memset(samples + HAPTIC_AUDIO_PACKET_BYTES, 0,
+           HAPTIC_AUDIO_REPORT_SIZE - DS_BT_CRC_SIZE - HAPTIC_AUDIO_SAMPLES_OFFSET - HAPTIC_AUDIO_PACKET_BYTES);
+    ds_bt_store_crc(report, HAPTIC_AUDIO_REPORT_SIZE, ds_bt_crc(DS_BT_HID_OUTPUT, report, HAPTIC_AUDIO_REPORT_SIZE));
+}
+
+// Outcome of sending the report haptic_audio_build() made: on success the schedule moves to the next packet. A
+// full ACL buffer keeps the packet due for the next CAN_SEND_NOW; any other failure skips it.
+inline void haptic_audio_sent(uint8_t slot, uint8_t status) {
+    haptic_audio_slot& h = haptic_audio_slots[slot];
+    if (status == BTSTACK_ACL_BUFFERS_FULL) {
+        h.stats.acl_full++;
+        return;
+    }
+    if (status == ERROR_CODE_SUCCESS) {
+        h.stats.packets++;
+        h.sequence = static_cast<uint8_t>((h.sequence + 1) & 0x0F);
+    } else {
+        h.stats.failed++;
+    }
+    if (h.sending_silence) {
+        h.stats.silent++;
+        h.silent_run++;
+    } else {
+        h.ring.pop();
+        h.silent_run = 0;
+    }
+    output_haptic_mask &= static_cast<uint8_t>(~(1u << slot));
+    h.sent_packets++;
+    h.due_us = h.start_us + haptic_audio_packet_offset_us(h.sent_packets);
+    if (h.silent_run >= HAPTIC_AUDIO_UNDERRUN_PACKETS) {
+        h.stats.stalls++;
+        haptic_audio_stop(h, slot);
+    }
+}
+
+// CAN_SEND_NOW on cid with haptic_audio_due(slot): builds the report in BTstack's outgoing buffer and sends it.
+inline void haptic_audio_send(uint8_t slot, uint16_t cid) {
+    uint8_t status = BTSTACK_ACL_BUFFERS_FULL;
+    if (l2cap_reserve_packet_buffer()) {
+        uint8_t* buff = l2cap_get_outgoing_buffer();
+        buff[0] = DS_BT_HID_OUTPUT;
+        haptic_audio_build(slot, &buff[1]);
+        status = l2cap_send_prepared(cid, 1 + HAPTIC_AUDIO_REPORT_SIZE);
+        if (status != ERROR_CODE_SUCCESS) l2cap_release_packet_buffer();
+        switch (status) {
+            case ERROR_CODE_SUCCESS:
+                LOG_DEBUG(LOG_L2CAP_SENT, cid);
+                CAPTURE_FRAME(CAPTURE_OUT, cid, buff, 1 + HAPTIC_AUDIO_REPORT_SIZE);
+                break;
+            case L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU:
+                LOG_WARN(LOG_L2CAP_MTU_EXCEEDED, cid);
+                break;
+            case BTSTACK_ACL_BUFFERS_FULL:
+                LOG_WARN(LOG_L2CAP_ACL_FULL, cid);
+                break;
+            default:
+                LOG_ERROR(LOG_L2CAP_SEND_FAILED, cid, status);
+        }
+    }
+    link_health_output(slot, status);
+    haptic_audio_sent(slot, status);
+    // the CAN_SEND_NOW may have been requested for the output report: it stays pending until it goes out
+    if (output_staged_report(slot) && !output_unchanged(slot)) {
+        output_pending_mask |= static_cast<uint8_t>(1u << slot);
+    }
+    output_release(slot);
+    haptic_audio_arm(haptic_audio_poll(time_us_32()));
+}
+
+inline void haptic_audio_print() {
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        const haptic_audio_stats& s = haptic_audio_slots[slot].stats;
+        printf("[HAP] Device %u: %u packets (%u silent), %u stalls, %u resyncs, %u ACL full, %u failed, "
+               "%u discarded, %u frames refused\n", slot, (unsigned int)s.packets, (unsigned int)s.silent,
+               (unsigned int)s.stalls, (unsigned int)s.resyncs, (unsigned int)s.acl_full, (unsigned int)s.failed,
+               (unsigned int)s.discarded, (unsigned int)haptic_audio_slots[slot].refused_frames);
+    }
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "pico_w_imu_fusion.h"
+#include "pico_w_input_bench.h"
+
+// Cost and accuracy of imu_fusion_step() against the same filter in float (build with -DDUALSENSE_INPUT_BENCH=ON to
+// run it at boot; the host driver runs it too). The recording is synthesised from a known motion: a tilted start,
+// then rotation about all three axes at up to ~4 rad/s, sampled at 250 Hz with gyro bias and sensor noise and
+// encoded as 0x31 reports with the controller's raw units. That gives ground truth for the tilt as well as the
+// float reference to compare the fixed-point estimate with. Cycles are counted as in pico_w_input_bench.h.
+
+#define IMU_BENCH_INTERVAL_US 4000
+#define IMU_BENCH_SETTLE_UPDATES 250    // tilt error is measured after the first second
+
+struct float_imu_state {
+    float q[4];
+    float integral[3];
+    bool seeded;
+};
+
+// imu_fusion_step() in float, on the same calibrated samples and gains.
+inline void float_imu_step(float_imu_state& state, const imu_calibration& calibration, ds_input_view report,
+                           float dt) {
+    float rate[3];
+    float accel[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        rate[i] = static_cast<float>(report.gyro(i) - calibration.gyro_bias[i]) * calibration.gyro_scale[i] *
+                  (1.0f / (1 << 24));
+        accel[i] = static_cast<float>(report.accel(i) - calibration.accel_bias[i]) * calibration.accel_scale[i] *
+                   (1.0f / (4096.0f * IMU_ACCEL_ONE_G));
+    }
+    const float magnitude = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+    const bool gravity_valid = magnitude >= 0.5f && magnitude <= 1.5f;
+    float* q = state.q;
+    if (!state.seeded) {
+        if (!gravity_valid) return;
+        const float u[3] = {accel[0] / magnitude, accel[1] / magnitude, accel[2] / magnitude};
+        const float n = sqrtf(2.0f * (1.0f + u[2]));
+        q[0] = n * 0.5f;
+        q[1] = u[1] / n;
+        q[2] = -u[0] / n;
+        q[3] = 0.0f;
+        state.seeded = true;
+        return;
+    }
+    if (gravity_valid) {
+        const float u[3] = {accel[0] / magnitude, accel[1] / magnitude, accel[2] / magnitude};
+        const float up[3] = {2.0f * (q[1] * q[3] - q[0] * q[2]), 2.0f * (q[0] * q[1] + q[2] * q[3]),
+                             q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]};
+        const float error[3] = {u[1] * up[2] - u[2] * up[1], u[2] * up[0] - u[0] * up[2], u[0] * up[1] - u[1] * up[0]};
+        for (uint8_t i = 0; i < 3; i++) {
+            state.integral[i] += IMU_FUSION_KI_Q16 / 65536.0f * error[i] * dt;
+            rate[i] += state.integral[i] + IMU_FUSION_KP_Q16 / 65536.0f * error[i];
+        }
+    }
+    const float hx = rate[0] * 0.5f * dt, hy = rate[1] * 0.5f * dt, hz = rate[2] * 0.5f * dt;
+    const float w = q[0] - q[1] * hx - q[2] * hy - q[3] * hz;
+    const float x = q[1] + q[0] * hx + q[2] * hz - q[3] * hy;
+    const float y = q[2] + q[0] * hy - q[1] * hz + q[3] * hx;
+    const float z = q[3] + q[0] * hz + q[1] * hy - q[2] * hx;
+    const float inverse = 1.0f / sqrtf(w * w + x * x + y * y + z * z);
+    q[0] = w * inverse;
+    q[1] = x * inverse;
+    q[2] = y * inverse;
+    q[3] = z * inverse;
+}
+
+// Calibration report 0x05 of a typical pad: small gyro biases, +-540 deg/s references, 8192 counts per g.
+inline void imu_bench_make_calibration(uint8_t* report) {
+    static const int16_t values[17] = {
+        12, -7, 3,                              // gyro pitch/yaw/roll bias
+        8862, -8838, 8870, -8850, 8855, -8849,  // gyro plus/minus per axis
+        540, 540,                               // gyro speed plus/minus, deg/s
+        8230, -8170, 8190, -8210, 8260, -8100,  // accelerometer plus/minus per axis
+    };
+    memset(report, 0, 41);
+    report[0] = 0x05;
+    for (int i = 0; i < 17; i++) {
+        report[1 + i * 2] = static_cast<uint8_t>(values[i]);
+        report[2 + i * 2] = static_cast<uint8_t>(values[i] >> 8);
+    }
+}
+
+inline float imu_bench_noise(uint32_t* seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return static_cast<float>(static_cast<int32_t>(*seed) >> 16) * (1.0f / 32768.0f);
+}
+
+// Motion sample index of the recording: true attitude advanced to the sample, then encoded as a 0x31 report.
+inline void imu_bench_make_report(uint8_t* report, uint32_t index, const imu_calibration& calibration, float truth[4],
+                                  uint32_t* seed) {
+    const float t = index * (IMU_BENCH_INTERVAL_US * 1e-6f);
+    const float rate[3] = {3.0f * sinf(2.1f * t), 2.0f * sinf(1.3f * t + 0.5f), 4.0f * cosf(0.7f * t)};
+    if (index == 0) {
+        // 40 degrees about x, then 25 about y
+        const float a = 0.3490659f, b = 0.2181662f;
+        truth[0] = cosf(a) * cosf(b);
+        truth[1] = sinf(a) * cosf(b);
+        truth[2] = cosf(a) * sinf(b);
+        truth[3] = -sinf(a) * sinf(b);
+    } else {
+        const float dt = IMU_BENCH_INTERVAL_US * 1e-6f;
+        const float hx = rate[0] * 0.5f * dt, hy = rate[1] * 0.5f * dt, hz = rate[2] * 0.5f * dt;
+        const float w = truth[0] - truth[1] * hx - truth[2] * hy - truth[3] * hz;
+        const float x = truth[1] + truth[0] * hx + truth[2] * hz - truth[3] * hy;
+        const float y = truth[2] + truth[0] * hy - truth[1] * hz + truth[3] * hx;
+        const float z = truth[3] + truth[0] * hz + truth[1] * hy - truth[2] * hx;
+        const float inverse = 1.0f / sqrtf(w * w + x * x + y * y + z * z);
+        truth[0] = w * inverse;
+        truth[1] = x * inverse;
+        truth[2] = y * inverse;
+        truth[3] = z * inverse;
+    }
+    const float up[3] = {2.0f * (truth[1] * truth[3] - truth[0] * truth[2]),
+                         2.0f * (truth[0] * truth[1] + truth[2] * truth[3]),
+                         truth[0] * truth[0] - truth[1] * truth[1] - truth[2] * truth[2] + truth[3] * truth[3]};
+
+    memset(report, 0, ds_input_view::size);
+    report[0] = 0x31;
+    uint8_t* b = &report[ds_input_view::data];
+    for (uint8_t i = 0; i < 3; i++) {
+        // +-0.03 rad/s of gyro noise and 0.02 g of accelerometer noise on top of the calibration offsets
+        const float gyro = rate[i] * (1 << 24) / calibration.gyro_scale[i] + calibration.gyro_bias[i] +
+                           imu_bench_noise(seed) * 0.03f * (1 << 24) / calibration.gyro_scale[i];
+        const float accel = (up[i] + imu_bench_noise(seed) * 0.02f) * (4096.0f * IMU_ACCEL_ONE_G) /
+                            calibration.accel_scale[i] + calibration.accel_bias[i];
+        const int16_t g = static_cast<int16_t>(lrintf(gyro));
+        const int16_t a = static_cast<int16_t>(lrintf(accel));
+        b[15 + i * 2] = static_cast<uint8_t>(g);
+        b[16 + i * 2] = static_cast<uint8_t>(g >> 8);
+        b[21 + i * 2] = static_cast<uint8_t>(a);
+        b[22 + i * 2] = static_cast<uint8_t>(a >> 8);
+    }
+    const uint32_t timestamp = index * IMU_BENCH_INTERVAL_US * IMU_SENSOR_TICKS_PER_US;
+    memcpy(&b[27], &timestamp, 4);
+}
+
+// Angle between two gravity directions, degrees.
+inline float imu_bench_angle(const float a[3], const float b[3]) {
+    const float na = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    const float nb = sqrtf(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+    const float c = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (na * nb);
+    return acosf(c > 1.0f ? 1.0f : c < -1.0f ? -1.0f : c) * 57.29578f;
+}
+
+struct imu_bench_result {
+    uint32_t updates;
+    uint64_t float_cycles;
+    uint64_t fixed_cycles;
+    float max_divergence_deg;   // fixed against float tilt, whole recording
+    float fixed_tilt_rms_deg;   // estimated against true gravity after settling
+    float float_tilt_rms_deg;
+    float fixed_tilt_max_deg;
+};
+
+inline imu_bench_result imu_bench_run(uint32_t updates) {
+    uint8_t calibration_report[41];
+    imu_bench_make_calibration(calibration_report);
+    const imu_calibration calibration = imu_calibration_parse(calibration_report);
+
+    imu_bench_result result = {updates, 0, 0, 0.0f, 0.0f, 0.0f, 0.0f};
+    input_bench_cycles_init();
+    imu_fusion_state fixed;
+    imu_fusion_reset(fixed);
+    float_imu_state reference = {};
+    float truth[4];
+    uint32_t seed = 0x1A2B;
+    uint8_t report[ds_input_view::size];
+    double fixed_square = 0.0, float_square = 0.0;
+    for (uint32_t i = 0; i < updates; i++) {
+        imu_bench_make_report(report, i, calibration, truth, &seed);
+
+        uint32_t start = input_bench_cycles();
+        float_imu_step(reference, calibration, {report}, IMU_BENCH_INTERVAL_US * 1e-6f);
+        result.float_cycles += input_bench_elapsed(start, input_bench_cycles());
+
+        start = input_bench_cycles();
+        imu_fusion_step(fixed, calibration, {report});
+        result.fixed_cycles += input_bench_elapsed(start, input_bench_cycles());
+
+        const float* q = reference.q;
+        const float float_up[3] = {2.0f * (q[1] * q[3] - q[0] * q[2]), 2.0f * (q[0] * q[1] + q[2] * q[3]),
+                                   q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]};
+        const float true_up[3] = {2.0f * (truth[1] * truth[3] - truth[0] * truth[2]),
+                                  2.0f * (truth[0] * truth[1] + truth[2] * truth[3]),
+                                  truth[0] * truth[0] - truth[1] * truth[1] - truth[2] * truth[2] +
+                                  truth[3] * truth[3]};
+        const float fixed_up[3] = {fixed.gravity[0] / 32767.0f, fixed.gravity[1] / 32767.0f,
+                                   fixed.gravity[2] / 32767.0f};
+
+        // heading is not observable without a magnetometer: the two filters' yaw random-walks apart with the
+        // length of the recording, so only the tilt is compared
+        const float divergence = imu_bench_angle(fixed_up, float_up);
+        if (divergence > result.max_divergence_deg) result.max_divergence_deg = divergence;
+
+        if (i >= IMU_BENCH_SETTLE_UPDATES) {
+            const float fixed_tilt = imu_bench_angle(fixed_up, true_up);
+            const float float_tilt = imu_bench_angle(float_up, true_up);
+            fixed_square += fixed_tilt * fixed_tilt;
+            float_square += float_tilt * float_tilt;
+            if (fixed_tilt > result.fixed_tilt_max_deg) result.fixed_tilt_max_deg = fixed_tilt;
+        }
+    }
+    const uint32_t settled = updates > IMU_BENCH_SETTLE_UPDATES ? updates - IMU_BENCH_SETTLE_UPDATES : 1;
+    result.fixed_tilt_rms_deg = static_cast<float>(sqrt(fixed_square / settled));
+    result.float_tilt_rms_deg = static_cast<float>(sqrt(float_square / settled));
+    return result;
+}
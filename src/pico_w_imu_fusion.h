@@ -0,0 +1,272 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "btstack_config.h"
+#include "pico_w_report_view.h"
+
+// Orientation from the 0x31 gyro/accelerometer fields, in fixed point (build with -DDUALSENSE_IMU_FUSION=ON to run
+// it in the application loop; the host driver benchmarks it against a float reference).
+// A Mahony complementary filter: the gyro rate is integrated into a quaternion and the angle between the measured
+// and the estimated gravity steers it back with a proportional and an integral gain. Everything is int32 with 64-bit
+// products, so an update costs a few dozen multiplies and one integer square root on the M0+ instead of soft-float.
+// Samples are calibrated with integer factors taken from feature report 0x05 (the same report calibration_apply()
+// hands to Gamepad-Core); dt comes from the controller's sensor timestamp, so frames the application skipped are
+// integrated over the whole gap. Formats: quaternion Q30, rates Q24 rad/s, accelerometer 1/8192 g, gravity Q15.
+
+typedef int32_t q30_t;
+
+#define Q30_ONE (1 << 30)
+
+#define IMU_ACCEL_ONE_G 8192                // calibrated accelerometer counts per g
+#define IMU_GYRO_DEFAULT_SCALE 17872        // Q24 rad/s per count for +-2000 deg/s over int16
+#define IMU_GYRO_MAX_SCALE 32767            // (raw - bias) * scale stays inside int32
+#define IMU_RAD_PER_DEG_Q24 292818          // pi / 180 * 2^24
+#define IMU_SENSOR_TICKS_PER_US 3           // sensor timestamp counts 1/3 us
+#define IMU_MAX_DT_US 100000                // longer gaps are integrated as 100 ms
+
+#ifndef IMU_FUSION_KP_Q16
+#define IMU_FUSION_KP_Q16 32768             // 0.5
+#endif
+
+#ifndef IMU_FUSION_KI_Q16
+#define IMU_FUSION_KI_Q16 655               // 0.01
+#endif
+
+struct imu_calibration {
+    int16_t gyro_bias[3];
+    int32_t gyro_scale[3];      // Q24 rad/s per count
+    int16_t accel_bias[3];
+    int32_t accel_scale[3];     // Q12, raw count -> 1/8192 g
+};
+
+struct imu_fusion_state {
+    q30_t q[4];                 // w, x, y, z: rotates the sensor frame into the world frame, world up is +z
+    int16_t gravity[3];         // Q15, world up in the sensor frame: what the accelerometer reads at rest
+    int32_t integral[3];        // Q24 rad/s, gyro bias learned by the integral term
+    uint32_t last_sensor_timestamp;
+    bool seeded;                // q initialised from the accelerometer
+    uint32_t updates;
+};
+
+constexpr imu_calibration imu_calibration_default = {
+    {0, 0, 0}, {IMU_GYRO_DEFAULT_SCALE, IMU_GYRO_DEFAULT_SCALE, IMU_GYRO_DEFAULT_SCALE},
+    {0, 0, 0}, {4096, 4096, 4096},
+};
+
+// Written from the BTstack context when a calibration is applied, read by the application loop.
+static imu_calibration imu_calibrations[MAX_NR_GAMEPADS];
+static imu_fusion_state imu_fusion[MAX_NR_GAMEPADS];
+
+inline int16_t imu_read_i16(const uint8_t* at) {
+    return static_cast<int16_t>(at[0] | (at[1] << 8));
+}
+
+// Feature report 0x05 from its report id: gyro pitch/yaw/roll bias, plus/minus per axis, speed plus/minus, then
+// accelerometer plus/minus per axis, all int16. Axes with a degenerate or out of range entry keep the defaults.
+inline imu_calibration imu_calibration_parse(const uint8_t* report) {
+    imu_calibration calibration = imu_calibration_default;
+    const int32_t speed_2x = imu_read_i16(&report[19]) + imu_read_i16(&report[21]);
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        const int32_t bias = imu_read_i16(&report[1 + axis * 2]);
+        const int32_t plus = imu_read_i16(&report[7 + axis * 4]);
+        const int32_t minus = imu_read_i16(&report[9 + axis * 4]);
+        const int32_t denom = (plus > bias ? plus - bias : bias - plus) + (minus > bias ? minus - bias : bias - minus);
+        if (denom > 0) {
+            const int64_t scale = static_cast<int64_t>(speed_2x) * IMU_RAD_PER_DEG_Q24 / denom;
+            if (scale >= IMU_GYRO_DEFAULT_SCALE / 2 && scale <= IMU_GYRO_MAX_SCALE) {
+                calibration.gyro_bias[axis] = static_cast<int16_t>(bias);
+                calibration.gyro_scale[axis] = static_cast<int32_t>(scale);
+            }
+        }
+
+        const int32_t accel_plus = imu_read_i16(&report[23 + axis * 4]);
+        const int32_t accel_minus = imu_read_i16(&report[25 + axis * 4]);
+        const int32_t range_2g = accel_plus - accel_minus;
+        if (range_2g > 0) {
+            const int32_t scale = (2 * IMU_ACCEL_ONE_G << 12) / range_2g;
+            if (scale >= 2048 && scale <= 8192) {
+                calibration.accel_bias[axis] = static_cast<int16_t>(accel_plus - range_2g / 2);
+                calibration.accel_scale[axis] = scale;
+            }
+        }
+    }
+    return calibration;
+}
+
+// BTstack context: report is a CRC-checked 0x05 report, or nullptr to fall back to the nominal sensor ranges.
+inline void imu_fusion_calibrate(uint8_t slot, const uint8_t* report) {
+    imu_calibrations[slot] = report ? imu_calibration_parse(report) : imu_calibration_default;
+}
+
+inline q30_t q30_mul(q30_t a, q30_t b) {
+    return static_cast<q30_t>(static_cast<int64_t>(a) * b >> 30);
+}
+
+inline uint32_t imu_isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > value) bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Accelerometer in 1/8192 g -> unit vector in Q15. Returns false outside 0.5..1.5 g, where the reading is mostly
+// linear acceleration and says little about gravity.
+inline bool imu_accel_direction(const int32_t accel[3], int32_t unit[3]) {
+    int32_t a[3] = {accel[0], accel[1], accel[2]};
+    uint32_t shift = 0;
+    uint32_t largest = static_cast<uint32_t>((a[0] < 0 ? -a[0] : a[0]) | (a[1] < 0 ? -a[1] : a[1]) |
+                                             (a[2] < 0 ? -a[2] : a[2]));
+    while (largest >= 1u << 15) {
+        largest >>= 1;
+        shift++;
+    }
+    for (int32_t& v : a) v >>= shift;
+    const uint32_t norm = imu_isqrt(static_cast<uint32_t>(a[0] * a[0]) + static_cast<uint32_t>(a[1] * a[1]) +
+                                    static_cast<uint32_t>(a[2] * a[2]));
+    const uint32_t magnitude = norm << shift;
+    if (norm == 0 || magnitude < IMU_ACCEL_ONE_G / 2 || magnitude > IMU_ACCEL_ONE_G * 3 / 2) return false;
+    for (uint8_t i = 0; i < 3; i++) unit[i] = (a[i] << 15) / static_cast<int32_t>(norm);
+    return true;
+}
+
+// World up in the sensor frame, third row of the rotation matrix.
+inline void imu_quaternion_up(const q30_t q[4], q30_t up[3]) {
+    up[0] = 2 * (q30_mul(q[1], q[3]) - q30_mul(q[0], q[2]));
+    up[1] = 2 * (q30_mul(q[0], q[1]) + q30_mul(q[2], q[3]));
+    up[2] = q30_mul(q[0], q[0]) - q30_mul(q[1], q[1]) - q30_mul(q[2], q[2]) + q30_mul(q[3], q[3]);
+}
+
+inline int16_t imu_q30_to_q15(q30_t value) {
+    const int32_t q15 = value >> 15;
+    return static_cast<int16_t>(q15 > 32767 ? 32767 : q15 < -32767 ? -32767 : q15);
+}
+
+// Shortest rotation taking world up onto the measured direction: (1 + uz, uy, -ux, 0), normalised.
+inline void imu_fusion_seed(imu_fusion_state& state, const int32_t unit[3]) {
+    state.integral[0] = state.integral[1] = state.integral[2] = 0;
+    if (unit[2] < -32767 + 64) {
+        // upside down: half a turn about x
+        state.q[0] = 0;
+        state.q[1] = Q30_ONE;
+        state.q[2] = state.q[3] = 0;
+    } else {
+        const int32_t w = (32767 + unit[2]) >> 1;   // Q14 from here on so the squares fit
+        const int32_t x = unit[1] >> 1;
+        const int32_t y = -unit[0] >> 1;
+        const int32_t norm = static_cast<int32_t>(imu_isqrt(static_cast<uint32_t>(w * w + x * x + y * y)));
+        state.q[0] = static_cast<q30_t>((static_cast<int64_t>(w) << 30) / norm);
+        state.q[1] = static_cast<q30_t>((static_cast<int64_t>(x) << 30) / norm);
+        state.q[2] = static_cast<q30_t>((static_cast<int64_t>(y) << 30) / norm);
+        state.q[3] = 0;
+    }
+    state.seeded = true;
+}
+
+inline void imu_fusion_reset(imu_fusion_state& state) {
+    state = {};
+    state.q[0] = Q30_ONE;
+    state.gravity[2] = 32767;
+}
+
+// One report: correct the gyro rate with the gravity error, integrate it over the time since the previous sample,
+// renormalise. The first report after a reset only seeds the attitude from the accelerometer.
+inline void imu_fusion_step(imu_fusion_state& state, const imu_calibration& calibration, ds_input_view report) {
+    int32_t rate[3];
+    int32_t accel[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        rate[i] = (report.gyro(i) - calibration.gyro_bias[i]) * calibration.gyro_scale[i];
+        accel[i] = (report.accel(i) - calibration.accel_bias[i]) * calibration.accel_scale[i] >> 12;
+    }
+    int32_t unit[3];
+    const bool gravity_valid = imu_accel_direction(accel, unit);
+    const uint32_t timestamp = report.sensor_timestamp();
+    const uint32_t elapsed_us = (timestamp - state.last_sensor_timestamp) / IMU_SENSOR_TICKS_PER_US;
+    const bool first = !state.seeded;
+    state.last_sensor_timestamp = timestamp;
+
+    if (first) {
+        if (!gravity_valid) return;
+        imu_fusion_seed(state, unit);
+    } else if (elapsed_us > 0) {
+        // seconds in Q32
+        const int64_t dt = static_cast<int64_t>(elapsed_us > IMU_MAX_DT_US ? IMU_MAX_DT_US : elapsed_us) * 4295;
+        q30_t* q = state.q;
+        if (gravity_valid) {
+            q30_t up[3];
+            imu_quaternion_up(q, up);
+            // measured x estimated: the rotation that would bring the estimate onto the measurement, Q30
+            const int64_t ux = unit[0], uy = unit[1], uz = unit[2];
+            const q30_t error[3] = {
+                static_cast<q30_t>((uy * up[2] - uz * up[1]) >> 15),
+                static_cast<q30_t>((uz * up[0] - ux * up[2]) >> 15),
+                static_cast<q30_t>((ux * up[1] - uy * up[0]) >> 15),
+            };
+            for (uint8_t i = 0; i < 3; i++) {
+                if (IMU_FUSION_KI_Q16) {
+                    const int64_t integral_rate = static_cast<int64_t>(IMU_FUSION_KI_Q16) * error[i] >> 22;
+                    state.integral[i] += static_cast<int32_t>(integral_rate * dt >> 32);
+                    rate[i] += state.integral[i];
+                }
+                rate[i] += static_cast<int32_t>(static_cast<int64_t>(IMU_FUSION_KP_Q16) * error[i] >> 22);
+            }
+        }
+
+        // half the rotation angle over dt, Q24 * Q32 -> Q30 with the half folded into the shift
+        const q30_t hx = static_cast<q30_t>(rate[0] * dt >> 27);
+        const q30_t hy = static_cast<q30_t>(rate[1] * dt >> 27);
+        const q30_t hz = static_cast<q30_t>(rate[2] * dt >> 27);
+        const q30_t w = q[0] - q30_mul(q[1], hx) - q30_mul(q[2], hy) - q30_mul(q[3], hz);
+        const q30_t x = q[1] + q30_mul(q[0], hx) + q30_mul(q[2], hz) - q30_mul(q[3], hy);
+        const q30_t y = q[2] + q30_mul(q[0], hy) - q30_mul(q[1], hz) + q30_mul(q[3], hx);
+        const q30_t z = q[3] + q30_mul(q[0], hz) + q30_mul(q[1], hy) - q30_mul(q[2], hx);
+
+        // one Newton step towards unit length, (3 - |q|^2) / 2; the norm only drifts by the step squared
+        const int64_t norm = (static_cast<int64_t>(w) * w + static_cast<int64_t>(x) * x + static_cast<int64_t>(y) * y +
+                              static_cast<int64_t>(z) * z) >> 30;
+        const int64_t factor = (3ll << 30) - norm;
+        q[0] = static_cast<q30_t>(w * factor >> 31);
+        q[1] = static_cast<q30_t>(x * factor >> 31);
+        q[2] = static_cast<q30_t>(y * factor >> 31);
+        q[3] = static_cast<q30_t>(z * factor >> 31);
+    } else {
+        return;
+    }
+
+    q30_t up[3];
+    imu_quaternion_up(state.q, up);
+    for (uint8_t i = 0; i < 3; i++) state.gravity[i] = imu_q30_to_q15(up[i]);
+    state.updates++;
+}
+
+// Application loop, once per consumed 0x31 frame of slot.
+inline const imu_fusion_state& imu_fusion_update(uint8_t slot, ds_input_view report, bool first_after_connect) {
+    imu_fusion_state& state = imu_fusion[slot];
+    if (first_after_connect) imu_fusion_reset(state);
+    imu_fusion_step(state, imu_calibrations[slot], report);
+    return state;
+}
+
+inline float q30_to_float(q30_t value) {
+    return static_cast<float>(value) * (1.0f / Q30_ONE);
+}
+
+inline void imu_fusion_dump() {
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        const imu_fusion_state& state = imu_fusion[slot];
+        if (!state.updates) continue;
+        printf("[IMU] Device %u: q (%d, %d, %d, %d) gravity (%d, %d, %d) x1000, %u updates\n", slot,
+               (int)(state.q[0] / (Q30_ONE / 1000)), (int)(state.q[1] / (Q30_ONE / 1000)),
+               (int)(state.q[2] / (Q30_ONE / 1000)), (int)(state.q[3] / (Q30_ONE / 1000)),
+               state.gravity[0] * 1000 / 32767, state.gravity[1] * 1000 / 32767, state.gravity[2] * 1000 / 32767,
+               (unsigned int)state.updates);
+    }
+}
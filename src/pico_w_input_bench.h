@@ -0,0 +1,140 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include "pico_w_fixed_input.h"
+
+// Per-report cost of the float input path against fixed_input_decode() (build with -DDUALSENSE_INPUT_BENCH=ON to
+// run it at boot; the host driver runs it too). The float reference does what a float consumer does per frame:
+// normalise sticks, triggers and touch, apply the same deadzone and curve, then test the sticks with fabsf().
+// On the RP2040 cycles come from SysTick at the core clock, on x86 hosts from the TSC.
+
+#if defined(__arm__)
+#include "hardware/structs/systick.h"
+
+inline void input_bench_cycles_init() {
+    systick_hw->csr = 0;
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;  // enable, processor clock
+}
+
+inline uint32_t input_bench_cycles() { return systick_hw->cvr; }
+
+// SysTick counts down and wraps at 24 bits; one report takes far fewer cycles than a wrap
+inline uint32_t input_bench_elapsed(uint32_t start, uint32_t end) { return (start - end) & 0x00FFFFFF; }
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+inline void input_bench_cycles_init() {}
+inline uint32_t input_bench_cycles() { return static_cast<uint32_t>(__rdtsc()); }
+inline uint32_t input_bench_elapsed(uint32_t start, uint32_t end) { return end - start; }
+#else
+#include "pico/time.h"
+
+// no cycle counter: microseconds
+inline void input_bench_cycles_init() {}
+inline uint32_t input_bench_cycles() { return time_us_32(); }
+inline uint32_t input_bench_elapsed(uint32_t start, uint32_t end) { return end - start; }
+#endif
+
+#define INPUT_BENCH_STICK_ACTIVE 0.1f
+#define INPUT_BENCH_STICK_ACTIVE_Q15 3276  // 0.1 * Q15_ONE, rounded down for '>'
+
+struct float_input_state {
+    float lx, ly, rx, ry;
+    float l2, r2;
+    uint32_t buttons;
+    uint8_t touch_count;
+    float touch_x, touch_y;
+};
+
+inline float float_shape(float magnitude, float deadzone, fixed_curve curve) {
+    if (magnitude <= deadzone) return 0.0f;
+    float shaped = (magnitude - deadzone) / (1.0f - deadzone);
+    if (curve == FIXED_CURVE_QUADRATIC) shaped = shaped * shaped;
+    if (curve == FIXED_CURVE_CUBIC) shaped = shaped * shaped * shaped;
+    return shaped;
+}
+
+inline float float_stick(uint8_t raw, float deadzone, fixed_curve curve) {
+    float value = (static_cast<float>(raw) - 128.0f) / 127.0f;
+    if (value < -1.0f) value = -1.0f;
+    const float shaped = float_shape(fabsf(value), deadzone, curve);
+    return value < 0.0f ? -shaped : shaped;
+}
+
+inline void float_input_decode(const uint8_t* report, float_input_state& state, float stick_deadzone,
+                               fixed_curve stick_curve, float trigger_deadzone) {
+    const uint8_t* b = &report[ds_input_view::data];
+    state.lx = float_stick(b[0], stick_deadzone, stick_curve);
+    state.ly = float_stick(b[1], stick_deadzone, stick_curve);
+    state.rx = float_stick(b[2], stick_deadzone, stick_curve);
+    state.ry = float_stick(b[3], stick_deadzone, stick_curve);
+    state.l2 = float_shape(static_cast<float>(b[4]) / 255.0f, trigger_deadzone, FIXED_CURVE_LINEAR);
+    state.r2 = float_shape(static_cast<float>(b[5]) / 255.0f, trigger_deadzone, FIXED_CURVE_LINEAR);
+    state.buttons = fixed_dpad_bits[b[7] & 0x0F] | (b[7] & 0xF0u) | (static_cast<uint32_t>(b[8]) << 8) |
+                    (static_cast<uint32_t>(b[9] & 0x07) << 16);
+
+    const bool finger0 = !(b[32] & 0x80);
+    const bool finger1 = !(b[36] & 0x80);
+    state.touch_count = static_cast<uint8_t>(finger0 + finger1);
+    const uint8_t* touch = finger0 ? &b[32] : &b[36];
+    const uint32_t x = touch[1] | ((touch[2] & 0x0Fu) << 8);
+    const uint32_t y = (touch[2] >> 4) | (static_cast<uint32_t>(touch[3]) << 4);
+    state.touch_x = state.touch_count ? fminf(static_cast<float>(x) / FIXED_TOUCH_MAX_X, 1.0f) : 0.0f;
+    state.touch_y = state.touch_count ? fminf(static_cast<float>(y) / FIXED_TOUCH_MAX_Y, 1.0f) : 0.0f;
+}
+
+struct input_bench_result {
+    uint32_t reports;
+    uint64_t float_cycles;
+    uint64_t fixed_cycles;
+    uint32_t mismatches;    // reports where the two paths disagree on stick activity
+};
+
+// Fills report with pseudo-random sticks, triggers, buttons and touch from *seed.
+inline void input_bench_make_report(uint8_t* report, uint32_t* seed) {
+    for (int i = 0; i < 78; i++) {
+        *seed = *seed * 1664525u + 1013904223u;
+        report[i] = static_cast<uint8_t>(*seed >> 24);
+    }
+    report[0] = 0x31;
+    report[ds_input_view::data + 7] = static_cast<uint8_t>((report[ds_input_view::data + 7] & 0xF0) | (report[9] % 9));
+}
+
+// Runs both paths over the same reports with the compiled-in deadzones and curve.
+inline input_bench_result input_bench_run(uint32_t reports) {
+    constexpr float stick_deadzone = FIXED_STICK_DEADZONE_Q15 / 32767.0f;
+    constexpr float trigger_deadzone = FIXED_TRIGGER_DEADZONE_Q15 / 32767.0f;
+    constexpr auto stick_curve = static_cast<fixed_curve>(FIXED_STICK_CURVE);
+
+    input_bench_result result = {reports, 0, 0, 0};
+    input_bench_cycles_init();
+    uint8_t report[78];
+    uint32_t seed = 0x5EED;
+    volatile uint32_t sink = 0;
+    for (uint32_t i = 0; i < reports; i++) {
+        input_bench_make_report(report, &seed);
+
+        uint32_t start = input_bench_cycles();
+        float_input_state f;
+        float_input_decode(report, f, stick_deadzone, stick_curve, trigger_deadzone);
+        const bool float_active = fabsf(f.lx) > INPUT_BENCH_STICK_ACTIVE || fabsf(f.ly) > INPUT_BENCH_STICK_ACTIVE ||
+                                  fabsf(f.rx) > INPUT_BENCH_STICK_ACTIVE || fabsf(f.ry) > INPUT_BENCH_STICK_ACTIVE;
+        sink = sink + float_active + static_cast<uint32_t>(f.l2 * 255.0f) + static_cast<uint32_t>(f.touch_x * 1000.0f);
+        result.float_cycles += input_bench_elapsed(start, input_bench_cycles());
+
+        start = input_bench_cycles();
+        fixed_input_state q;
+        fixed_input_decode({report}, q);
+        const bool fixed_active = q15_abs(q.left.x) > INPUT_BENCH_STICK_ACTIVE_Q15 ||
+                                  q15_abs(q.left.y) > INPUT_BENCH_STICK_ACTIVE_Q15 ||
+                                  q15_abs(q.right.x) > INPUT_BENCH_STICK_ACTIVE_Q15 ||
+                                  q15_abs(q.right.y) > INPUT_BENCH_STICK_ACTIVE_Q15;
+        sink = sink + fixed_active + static_cast<uint32_t>(q.l2 >> 7) + static_cast<uint32_t>(q15_to_milli(q.touch_x));
+        result.fixed_cycles += input_bench_elapsed(start, input_bench_cycles());
+
+        if (float_active != fixed_active) result.mismatches++;
+    }
+    return result;
+}
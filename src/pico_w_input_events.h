@@ -0,0 +1,193 @@
+#pragma once
+#include <cstdint>
+#include "btstack_config.h"
+#include "pico_w_fixed_input.h"
+#include "pico_w_report_view.h"
+#include "pico_w_spsc_ring.h"
+
+// Input change detection.
+// input_events_update() packs the fields an application subscribed to out of each 0x31 frame into a few 32-bit
+// words (sticks, triggers, button bits, touch points, IMU, battery) and compares them with the previous frame of
+// the slot. The result is a dirty bitmask, so an unchanged frame costs a handful of byte loads and word compares
+// and the application can skip everything that depends on the fields. Button changes become press/release
+// events, and stick/trigger moves of at least INPUT_AXIS_EVENT_THRESHOLD become axis events, together with
+// touch and battery changes. All of them carry the frame's arrival time and go into a fixed-capacity queue
+// drained with input_events_pop(). The IMU changes on every frame and only ever sets its dirty bit.
+// Runs on the application loop only: producer and consumer of the queue are the same context.
+
+#define INPUT_EVENT_QUEUE_CAPACITY 64
+
+#ifndef INPUT_AXIS_EVENT_THRESHOLD
+#define INPUT_AXIS_EVENT_THRESHOLD 4   // raw units (0..255); smaller moves only mark the stick dirty
+#endif
+
+enum input_dirty : uint16_t {
+    INPUT_DIRTY_BUTTONS     = 1u << 0,
+    INPUT_DIRTY_LEFT_STICK  = 1u << 1,
+    INPUT_DIRTY_RIGHT_STICK = 1u << 2,
+    INPUT_DIRTY_TRIGGERS    = 1u << 3,
+    INPUT_DIRTY_TOUCH       = 1u << 4,
+    INPUT_DIRTY_IMU         = 1u << 5,
+    INPUT_DIRTY_BATTERY     = 1u << 6,
+    INPUT_DIRTY_ALL         = 0x7F,
+};
+
+enum input_event_type : uint8_t {
+    INPUT_EVENT_PRESS = 0,  // code: fixed_button bit index
+    INPUT_EVENT_RELEASE,    // code: fixed_button bit index
+    INPUT_EVENT_AXIS,       // code: input_axis, value: raw position
+    INPUT_EVENT_TOUCH,      // code: active finger count
+    INPUT_EVENT_BATTERY,    // value: raw battery byte
+    INPUT_EVENT_ACTION,     // code: event code of an action_event() binding (pico_w_action_map.h)
+};
+
+enum input_axis : uint8_t {
+    INPUT_AXIS_LEFT_X = 0,
+    INPUT_AXIS_LEFT_Y,
+    INPUT_AXIS_RIGHT_X,
+    INPUT_AXIS_RIGHT_Y,
+    INPUT_AXIS_L2,
+    INPUT_AXIS_R2,
+    INPUT_AXIS_COUNT
+};
+
+struct input_event {
+    uint32_t timestamp_us;
+    uint8_t slot;
+    uint8_t type;
+    uint8_t code;
+    uint8_t value;
+};
+
+static_assert(sizeof(input_event) == 8, "input_event should stay two words");
+
+struct input_digest {
+    uint32_t sticks;        // LX LY RX RY
+    uint32_t triggers;      // L2 R2
+    uint32_t buttons;       // fixed_button bits
+    uint32_t touch[2];
+    uint32_t imu[3];        // gyro + accel
+    uint32_t battery;
+};
+
+struct input_change_slot {
+    input_digest last;
+    uint8_t axis_reported[INPUT_AXIS_COUNT];
+    bool valid;
+};
+
+static input_change_slot input_change_slots[MAX_NR_GAMEPADS];
+static spsc_ring<input_event, INPUT_EVENT_QUEUE_CAPACITY> input_event_queue;
+static uint32_t input_events_dropped = 0;
+static uint16_t input_events_mask = INPUT_DIRTY_ALL;
+
+// Fields to compare and report; everything else is neither read nor marked dirty.
+inline void input_events_subscribe(uint16_t dirty_mask) {
+    input_events_mask = dirty_mask;
+    for (auto& slot : input_change_slots) slot.valid = false;
+}
+
+// Next frame of slot is compared against nothing: every subscribed field comes out dirty.
+inline void input_events_reset(uint8_t slot) {
+    input_change_slots[slot].valid = false;
+}
+
+inline bool input_events_pop(input_event& event) {
+    const input_event* front = input_event_queue.front();
+    if (!front) return false;
+    event = *front;
+    input_event_queue.pop();
+    return true;
+}
+
+inline void input_events_emit(uint32_t timestamp_us, uint8_t slot, uint8_t type, uint8_t code, uint8_t value) {
+    if (!input_event_queue.push({timestamp_us, slot, type, code, value})) input_events_dropped++;
+}
+
+inline uint32_t input_pack4(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+inline void input_events_axes(input_change_slot& state, uint8_t slot, uint32_t timestamp_us, uint32_t word,
+                              uint8_t first_axis, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        const uint8_t value = static_cast<uint8_t>(word >> (8 * i));
+        uint8_t& reported = state.axis_reported[first_axis + i];
+        const int move = value > reported ? value - reported : reported - value;
+        if (move < INPUT_AXIS_EVENT_THRESHOLD && state.valid) continue;
+        reported = value;
+        input_events_emit(timestamp_us, slot, INPUT_EVENT_AXIS, static_cast<uint8_t>(first_axis + i), value);
+    }
+}
+
+// Application loop: compares the subscribed fields of report with the previous frame of slot, queues the events
+// and returns the input_dirty bits of what changed.
+inline uint16_t input_events_update(uint8_t slot, ds_input_view report, uint32_t timestamp_us) {
+    input_change_slot& state = input_change_slots[slot];
+    const uint16_t mask = input_events_mask;
+    const uint8_t* b = &report.bytes[ds_input_view::data];
+    input_digest next = state.last;
+    uint16_t dirty = 0;
+
+    if (mask & (INPUT_DIRTY_LEFT_STICK | INPUT_DIRTY_RIGHT_STICK)) {
+        next.sticks = input_pack4(&b[0]);
+        const uint32_t changed = state.valid ? next.sticks ^ state.last.sticks : 0xFFFFFFFFu;
+        if ((mask & INPUT_DIRTY_LEFT_STICK) && (changed & 0x0000FFFFu)) {
+            dirty |= INPUT_DIRTY_LEFT_STICK;
+            input_events_axes(state, slot, timestamp_us, next.sticks, INPUT_AXIS_LEFT_X, 2);
+        }
+        if ((mask & INPUT_DIRTY_RIGHT_STICK) && (changed & 0xFFFF0000u)) {
+            dirty |= INPUT_DIRTY_RIGHT_STICK;
+            input_events_axes(state, slot, timestamp_us, next.sticks >> 16, INPUT_AXIS_RIGHT_X, 2);
+        }
+    }
+    if (mask & INPUT_DIRTY_TRIGGERS) {
+        next.triggers = b[4] | (b[5] << 8);
+        if (!state.valid || next.triggers != state.last.triggers) {
+            dirty |= INPUT_DIRTY_TRIGGERS;
+            input_events_axes(state, slot, timestamp_us, next.triggers, INPUT_AXIS_L2, 2);
+        }
+    }
+    if (mask & INPUT_DIRTY_BUTTONS) {
+        next.buttons = fixed_dpad_bits[b[7] & 0x0F] | (b[7] & 0xF0u) | (static_cast<uint32_t>(b[8]) << 8) |
+                       (static_cast<uint32_t>(b[9] & 0x07) << 16);
+        const uint32_t previous = state.valid ? state.last.buttons : 0;
+        uint32_t changed = next.buttons ^ previous;
+        if (changed || !state.valid) dirty |= INPUT_DIRTY_BUTTONS;
+        while (changed) {
+            const uint8_t bit = static_cast<uint8_t>(__builtin_ctz(changed));
+            changed &= changed - 1;
+            input_events_emit(timestamp_us, slot, (next.buttons >> bit) & 1 ? INPUT_EVENT_PRESS : INPUT_EVENT_RELEASE,
+                              bit, 0);
+        }
+    }
+    if (mask & INPUT_DIRTY_TOUCH) {
+        next.touch[0] = input_pack4(&b[32]);
+        next.touch[1] = input_pack4(&b[36]);
+        if (!state.valid || next.touch[0] != state.last.touch[0] || next.touch[1] != state.last.touch[1]) {
+            dirty |= INPUT_DIRTY_TOUCH;
+            input_events_emit(timestamp_us, slot, INPUT_EVENT_TOUCH,
+                              static_cast<uint8_t>(!(b[32] & 0x80) + !(b[36] & 0x80)), 0);
+        }
+    }
+    if (mask & INPUT_DIRTY_IMU) {
+        next.imu[0] = input_pack4(&b[15]);
+        next.imu[1] = input_pack4(&b[19]);
+        next.imu[2] = input_pack4(&b[23]);
+        if (!state.valid || next.imu[0] != state.last.imu[0] || next.imu[1] != state.last.imu[1] ||
+            next.imu[2] != state.last.imu[2]) {
+            dirty |= INPUT_DIRTY_IMU;
+        }
+    }
+    if (mask & INPUT_DIRTY_BATTERY) {
+        next.battery = b[52];
+        if (!state.valid || next.battery != state.last.battery) {
+            dirty |= INPUT_DIRTY_BATTERY;
+            input_events_emit(timestamp_us, slot, INPUT_EVENT_BATTERY, 0, static_cast<uint8_t>(next.battery));
+        }
+    }
+
+    state.last = next;
+    state.valid = true;
+    return dirty;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "btstack_config.h"
+#include "pico/sem.h"
+#include "pico/time.h"
+#include "pico_w_triple_buffer.h"
+
+// Report-driven input handoff.
+// l2cap_packet_handler publishes every complete 0x31 frame into the triple buffer of its controller slot
+// together with its arrival time, and wakes the application loop. The loop blocks in input_pipeline_wait() and
+// then claims the newest consistent frame of each slot with input_pipeline_acquire() and reads it in place; only
+// FDeviceContext::Buffer gets a copy for UpdateInput, which never sees a half-written report.
+// Frames replaced before the loop consumed them are counted per slot as overwritten.
+
+#define INPUT_REPORT_SIZE 78
+
+struct input_frame {
+    uint64_t arrival_us;
+    bool first_after_connect;
+    uint8_t report[INPUT_REPORT_SIZE];
+};
+
+struct input_frame_info {
+    uint32_t sequence;          // frames published on this slot since boot
+    uint64_t timestamp_us;      // arrival time of this frame
+    float delta_time;           // seconds between this frame and the previous consumed one
+    uint32_t frames_since_last; // frames published since the previous take (1 = none missed)
+    bool first_after_connect;   // first frame published after the slot (re)connected
+};
+
+struct input_slot {
+    spsc_triple_buffer<input_frame> frames;
+    bool next_first_after_connect;  // producer only
+    uint32_t consumed_sequence;     // consumer only
+    uint64_t consumed_timestamp_us; // consumer only
+    uint32_t overwritten;           // consumer only
+    uint32_t crc_rejected;          // producer only
+    uint32_t malformed;             // producer only
+};
+
+static semaphore_t input_frame_sem;
+static input_slot input_slots[MAX_NR_GAMEPADS];
+
+inline void input_pipeline_init() {
+    sem_init(&input_frame_sem, 0, 1);
+    for (auto& slot : input_slots) {
+        slot.frames.reset();
+        slot.next_first_after_connect = true;
+        slot.consumed_sequence = 0;
+        slot.consumed_timestamp_us = 0;
+        slot.overwritten = 0;
+        slot.crc_rejected = 0;
+        slot.malformed = 0;
+    }
+}
+
+// Producer side: marks the next frame so the disconnect gap is not reported as delta time.
+inline void input_pipeline_reset_timing(uint8_t slot) {
+    input_slots[slot].next_first_after_connect = true;
+}
+
+// Producer side: BTstack context, with the report as received (starting at the 0x31 report id).
+inline void input_pipeline_publish(uint8_t slot, const uint8_t* report, uint64_t arrival_us) {
+    input_slot& s = input_slots[slot];
+    input_frame& frame = s.frames.write_slot();
+    memcpy(frame.report, report, INPUT_REPORT_SIZE);
+    frame.arrival_us = arrival_us;
+    frame.first_after_connect = s.next_first_after_connect;
+    s.next_first_after_connect = false;
+    s.frames.publish();
+    sem_release(&input_frame_sem);
+}
+
+// Producer side: a frame of slot failed its CRC and was dropped before publishing.
+inline void input_pipeline_reject(uint8_t slot) {
+    input_slots[slot].crc_rejected++;
+}
+
+// Producer side: a frame of slot that is not a full-length 0x31 report was dropped before publishing.
+inline void input_pipeline_reject_malformed(uint8_t slot) {
+    input_slots[slot].malformed++;
+}
+
+// Consumer side: sleeps (WFE) until any slot published a frame or timeout_ms elapses. Returns false on timeout.
+inline bool input_pipeline_wait(uint32_t timeout_ms) {
+    return sem_acquire_timeout_ms(&input_frame_sem, timeout_ms);
+}
+
+// Consumer side: claims the newest unconsumed frame of slot and returns its report (INPUT_REPORT_SIZE bytes) in
+// place. The producer never writes a claimed frame, so the pointer stays valid until the next acquire or take on
+// the same slot. Returns nullptr if the slot has nothing new.
+inline const uint8_t* input_pipeline_acquire(uint8_t slot, input_frame_info& info) {
+    input_slot& s = input_slots[slot];
+    uint32_t sequence = 0;
+    const input_frame* frame = s.frames.acquire(sequence);
+    if (!frame) return nullptr;
+
+    info.sequence = sequence;
+    info.timestamp_us = frame->arrival_us;
+    info.frames_since_last = sequence - s.consumed_sequence;
+    info.first_after_connect = frame->first_after_connect;
+    info.delta_time = frame->first_after_connect || s.consumed_timestamp_us == 0
+                              ? 0.0f
+                              : static_cast<float>(frame->arrival_us - s.consumed_timestamp_us) * 1e-6f;
+
+    s.overwritten += info.frames_since_last - 1;
+    s.consumed_sequence = sequence;
+    s.consumed_timestamp_us = frame->arrival_us;
+    return frame->report;
+}
+
+// Consumer side: like input_pipeline_acquire(), copying the report into report_out (INPUT_REPORT_SIZE bytes).
+inline bool input_pipeline_take(uint8_t slot, input_frame_info& info, uint8_t* report_out) {
+    const uint8_t* report = input_pipeline_acquire(slot, info);
+    if (!report) return false;
+    memcpy(report_out, report, INPUT_REPORT_SIZE);
+    return true;
+}
+
+// Frames of slot that were replaced by a newer one before the application consumed them.
+inline uint32_t input_pipeline_overwritten(uint8_t slot) {
+    return input_slots[slot].overwritten;
+}
+
+// Frames of slot dropped because their CRC did not match.
+inline uint32_t input_pipeline_crc_rejected(uint8_t slot) {
+    return input_slots[slot].crc_rejected;
+}
+
+// Frames of slot dropped because they were not a full-length 0x31 report.
+inline uint32_t input_pipeline_malformed(uint8_t slot) {
+    return input_slots[slot].malformed;
+}
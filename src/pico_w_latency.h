@@ -0,0 +1,144 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "btstack_config.h"
+#include "pico/time.h"
+
+// End-to-end latency probes.
+// Every 0x31 frame carries its arrival time from l2cap_packet_handler. The application loop records when
+// UpdateInput finished with it, pico_w_platform_policy::Write stamps the output report with the arrival time of
+// the frame that triggered it, and L2CAP_EVENT_CAN_SEND_NOW records the moment l2cap_send accepted the report.
+// Each stage goes into a log-linear histogram (4 buckets per power of two, 12.5% resolution) so p50/p99 survive
+// hours of traffic in a fixed 2 KB. latency_dump() prints them; the main loop calls it when 'l' arrives on
+// USB CDC and clears them on 'r'. With the USB HID bridge a fifth stage ends when the host has polled the frame's
+// gamepad report. Build with PICO_W_LATENCY=0 to compile the probes out.
+// Histograms have one writer each (the decode and write stages run on the application loop, the send stages in
+// the BTstack context); a dump taken while reports flow may be off by the samples recorded during it.
+
+#ifndef PICO_W_LATENCY
+#define PICO_W_LATENCY 1
+#endif
+
+#ifndef PICO_W_BUILD_ID
+#define PICO_W_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+#define LATENCY_BUCKETS 128
+
+enum latency_stage : uint8_t {
+    LATENCY_DECODED = 0,    // radio arrival -> UpdateInput done
+    LATENCY_WRITTEN,        // radio arrival -> UpdateOutput/Write
+    LATENCY_QUEUED,         // Write -> l2cap_send accepted the report
+    LATENCY_END_TO_END,     // radio arrival -> l2cap_send accepted the report
+    LATENCY_USB_DELIVERED,  // radio arrival -> USB HID input report polled by the host
+    LATENCY_STAGE_COUNT
+};
+
+// Carried with a staged output report. origin_us = 0: the report was not triggered by an input frame.
+struct latency_stamp {
+    uint32_t origin_us;
+    uint32_t write_us;
+};
+
+struct latency_histogram {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+};
+
+#if PICO_W_LATENCY
+static latency_histogram latency_histograms[LATENCY_STAGE_COUNT];
+static uint32_t latency_origin_us[MAX_NR_GAMEPADS];  // application loop only
+
+// 0..7 exact, then 4 buckets per power of two
+constexpr uint32_t latency_bucket(uint32_t us) {
+    if (us < 8) return us;
+    uint32_t msb = 31;
+    while (!(us & (1u << msb))) msb--;
+    return 8 + (msb - 3) * 4 + ((us >> (msb - 2)) & 3);
+}
+
+// Largest value that lands in bucket
+constexpr uint32_t latency_bucket_limit(uint32_t bucket) {
+    if (bucket < 8) return bucket;
+    const uint32_t msb = 3 + (bucket - 8) / 4;
+    const uint64_t base = (1ull << msb) + (static_cast<uint64_t>((bucket - 8) % 4) << (msb - 2));
+    return static_cast<uint32_t>(base + (1ull << (msb - 2)) - 1);
+}
+
+static_assert(latency_bucket(UINT32_MAX) < LATENCY_BUCKETS, "latency histogram too small for 32-bit samples");
+
+inline void latency_record(latency_stage stage, uint32_t us) {
+    latency_histogram& h = latency_histograms[stage];
+    h.buckets[latency_bucket(us)]++;
+    h.count++;
+    h.total_us += us;
+    if (us > h.max_us) h.max_us = us;
+}
+
+// Application loop: UpdateInput of slot finished with the frame that arrived at arrival_us.
+inline void latency_input_decoded(uint8_t slot, uint64_t arrival_us) {
+    const uint32_t origin_us = static_cast<uint32_t>(arrival_us);
+    latency_record(LATENCY_DECODED, time_us_32() - origin_us);
+    latency_origin_us[slot] = origin_us ? origin_us : 1;
+}
+
+// Application loop (Write): stamp for the report being written. The first report after a decoded frame carries
+// that frame's arrival time; later ones in the same frame do not.
+inline latency_stamp latency_output_stamp(uint8_t slot) {
+    const latency_stamp stamp = {latency_origin_us[slot], time_us_32()};
+    if (stamp.origin_us) latency_record(LATENCY_WRITTEN, stamp.write_us - stamp.origin_us);
+    latency_origin_us[slot] = 0;
+    return stamp;
+}
+
+// BTstack context: l2cap_send accepted the report stamped with stamp.
+inline void latency_output_sent(const latency_stamp& stamp) {
+    const uint32_t now_us = time_us_32();
+    latency_record(LATENCY_QUEUED, now_us - stamp.write_us);
+    if (stamp.origin_us) latency_record(LATENCY_END_TO_END, now_us - stamp.origin_us);
+}
+
+// Application loop (TinyUSB callback): the host polled the bridge report of the frame that arrived at origin_us.
+inline void latency_usb_delivered(uint32_t origin_us) {
+    latency_record(LATENCY_USB_DELIVERED, time_us_32() - origin_us);
+}
+
+// Upper bound of the bucket holding the given percentile (1..100)
+inline uint32_t latency_percentile(const latency_histogram& h, uint32_t percentile) {
+    if (h.count == 0) return 0;
+    const uint64_t rank = (static_cast<uint64_t>(h.count) * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h.buckets[i];
+        if (seen >= rank) return latency_bucket_limit(i) < h.max_us ? latency_bucket_limit(i) : h.max_us;
+    }
+    return h.max_us;
+}
+
+inline void latency_reset() {
+    for (auto& h : latency_histograms) h = {};
+}
+
+inline void latency_dump() {
+    static const char* const names[LATENCY_STAGE_COUNT] = {
+        "arrival->decoded", "arrival->write", "write->send", "arrival->send", "arrival->usb",
+    };
+    printf("[LAT] build %s\n", PICO_W_BUILD_ID);
+    printf("[LAT] %-18s %8s %8s %8s %8s %8s (us)\n", "stage", "count", "mean", "p50", "p99", "max");
+    for (uint8_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        const latency_histogram& h = latency_histograms[stage];
+        printf("[LAT] %-18s %8u %8u %8u %8u %8u\n", names[stage], (unsigned int)h.count,
+               (unsigned int)(h.count ? h.total_us / h.count : 0), (unsigned int)latency_percentile(h, 50),
+               (unsigned int)latency_percentile(h, 99), (unsigned int)h.max_us);
+    }
+}
+#else
+inline void latency_input_decoded(uint8_t, uint64_t) {}
+inline latency_stamp latency_output_stamp(uint8_t) { return {}; }
+inline void latency_output_sent(const latency_stamp&) {}
+inline void latency_usb_delivered(uint32_t) {}
+inline void latency_reset() {}
+inline void latency_dump() { printf("[LAT] built with PICO_W_LATENCY=0\n"); }
+#endif
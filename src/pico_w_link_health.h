@@ -0,0 +1,239 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "btstack_config.h"
+#include "btstack_event.h"
+#include "btstack_run_loop.h"
+#include "hci.h"
+#include "pico_w_connections.h"
+#include "pico_w_report_view.h"
+
+// Link health.
+// Per-connection counters, cleared when the ACL link comes up: 0x31 frames and their rate, inter-arrival jitter,
+// frames missing by the report counter, CRC failures, output sends, ACL-full retries and failed sends, and the RSSI
+// and link quality the radio measures for the link. Jitter is the RFC 3550 estimate: how far the arrival interval
+// of consecutive frames strays from the interval of their sensor timestamps, smoothed by 1/16, so the controller's
+// own timing does not count, only what the air and the stack add to it.
+// Every LINK_HEALTH_WINDOW_MS a run-loop timer closes the window of each link. It computes the frame rate, queues
+// HCI Read RSSI and Read Link Quality, and grades the window: ACL-full retries, failed sends, more than
+// LINK_HEALTH_GAP_PERMILLE frames lost or a weak signal make it degraded. A degraded window doubles the link's
+// output interval (output_slot::backoff, up to LINK_HEALTH_MAX_BACKOFF steps); LINK_HEALTH_RECOVER_WINDOWS clean
+// ones in a row take one step back. All of it runs in the BTstack context; link_health_snapshot() copies the
+// counters of one link for the application loop, which holds the BTstack lock around it.
+
+#ifndef LINK_HEALTH_WINDOW_MS
+#define LINK_HEALTH_WINDOW_MS 1000
+#endif
+#define LINK_HEALTH_JITTER_MAX_US 100000    // a longer stall is an outage, not jitter
+#define LINK_HEALTH_GAP_PERMILLE 20         // 2% of the window's frames missing
+#define LINK_HEALTH_WEAK_RSSI (-10)         // dB below the golden receive power range (BR/EDR Read RSSI)
+#define LINK_HEALTH_WEAK_QUALITY 192        // Read Link Quality, 255 = best
+#define LINK_HEALTH_MAX_BACKOFF 3           // 250 Hz cap down to ~31 Hz
+#define LINK_HEALTH_RECOVER_WINDOWS 3
+
+#define LINK_HEALTH_READ_RSSI    (1u << 0)
+#define LINK_HEALTH_READ_QUALITY (1u << 1)
+
+struct link_health_stats {
+    uint32_t connected_us;
+    uint32_t frames;                // 0x31 frames accepted
+    uint16_t frames_per_sec;        // over the last closed window
+    uint32_t jitter_us;
+    uint32_t sequence_gaps;         // frames missing by the report counter
+    uint32_t crc_failures;
+    uint32_t malformed;             // frames that were not a full-length 0x31 report
+    uint32_t output_sends;
+    uint32_t output_acl_full;       // sends retried after BTSTACK_ACL_BUFFERS_FULL
+    uint32_t output_failed;         // sends refused for another reason; that report is lost
+    uint8_t signal_read;            // LINK_HEALTH_READ_* results received
+    int8_t rssi;
+    uint8_t link_quality;
+    uint8_t backoff;                // output interval doubled this many times
+    uint32_t degraded_windows;
+};
+
+struct link_health_slot {
+    link_health_stats stats;
+    uint32_t last_arrival_us;
+    uint32_t last_sensor_time;
+    uint8_t last_counter;
+    uint32_t jitter_q4;             // jitter_us << 4, the running estimate
+    uint32_t window_start_us;
+    uint32_t window_frames;
+    uint32_t window_gaps;
+    uint32_t window_errors;         // ACL-full retries and failed sends
+    uint8_t clean_windows;
+    uint8_t pending_reads;          // LINK_HEALTH_READ_* not issued yet
+};
+
+static link_health_slot link_health_slots[MAX_NR_GAMEPADS];
+static btstack_timer_source_t link_health_timer;
+
+// HCI_EVENT_CONNECTION_COMPLETE: counters start over with the new link; the output rate starts undegraded.
+inline void link_health_connected(uint8_t slot) {
+    link_health_slots[slot] = {};
+    link_health_slots[slot].stats.connected_us = time_us_32();
+    link_health_slots[slot].window_start_us = link_health_slots[slot].stats.connected_us;
+}
+
+// l2cap_packet_handler: a 0x31 frame of slot passed the CRC check.
+inline void link_health_frame(uint8_t slot, uint32_t arrival_us, ds_input_view report) {
+    link_health_slot& h = link_health_slots[slot];
+    const uint8_t counter = report.counter();
+    const uint32_t sensor_time = report.sensor_timestamp();
+    if (h.stats.frames > 0) {
+        // a counter that went backwards is a repeated frame, not 255 lost ones
+        const uint8_t missing = static_cast<uint8_t>(counter - h.last_counter - 1);
+        if (missing < 0x80) {
+            h.stats.sequence_gaps += missing;
+            h.window_gaps += missing;
+        }
+        const uint32_t sent_us = (sensor_time - h.last_sensor_time) / ds_input_view::sensor_ticks_per_us;
+        const int32_t transit = static_cast<int32_t>((arrival_us - h.last_arrival_us) - sent_us);
+        const uint32_t deviation = static_cast<uint32_t>(transit < 0 ? -transit : transit);
+        if (deviation <= LINK_HEALTH_JITTER_MAX_US) {
+            h.jitter_q4 += deviation - ((h.jitter_q4 + 8) >> 4);
+            h.stats.jitter_us = h.jitter_q4 >> 4;
+        }
+    }
+    h.last_counter = counter;
+    h.last_sensor_time = sensor_time;
+    h.last_arrival_us = arrival_us;
+    h.stats.frames++;
+    h.window_frames++;
+}
+
+inline void link_health_crc_failure(uint8_t slot) {
+    link_health_slots[slot].stats.crc_failures++;
+}
+
+inline void link_health_malformed(uint8_t slot) {
+    link_health_slots[slot].stats.malformed++;
+}
+
+// L2CAP_EVENT_CAN_SEND_NOW: outcome of an output report send on slot.
+inline void link_health_output(uint8_t slot, uint8_t status) {
+    link_health_slot& h = link_health_slots[slot];
+    if (status == ERROR_CODE_SUCCESS) {
+        h.stats.output_sends++;
+        return;
+    }
+    if (status == BTSTACK_ACL_BUFFERS_FULL) {
+        h.stats.output_acl_full++;
+    } else {
+        h.stats.output_failed++;
+    }
+    h.window_errors++;
+}
+
+// Issues the queued signal reads while the controller takes commands.
+inline void link_health_pump() {
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        link_health_slot& h = link_health_slots[slot];
+        const gamepad_connection& conn = connections[slot];
+        if (!conn.in_use) {
+            h.pending_reads = 0;
+            continue;
+        }
+        while (h.pending_reads) {
+            if (!hci_can_send_command_packet_now()) return;
+            if (h.pending_reads & LINK_HEALTH_READ_RSSI) {
+                h.pending_reads &= ~LINK_HEALTH_READ_RSSI;
+                hci_send_cmd(&hci_read_rssi, conn.handle);
+            } else {
+                h.pending_reads &= ~LINK_HEALTH_READ_QUALITY;
+                hci_send_cmd(&hci_read_link_quality, conn.handle);
+            }
+        }
+    }
+}
+
+// HCI_EVENT_COMMAND_COMPLETE: results of the signal reads.
+inline void link_health_command_complete(const uint8_t* packet) {
+    const uint16_t opcode = hci_event_command_complete_get_command_opcode(packet);
+    if (opcode != HCI_OPCODE_HCI_READ_RSSI && opcode != HCI_OPCODE_HCI_READ_LINK_QUALITY) return;
+    // status, connection handle, value
+    const uint8_t* result = hci_event_command_complete_get_return_parameters(packet);
+    const gamepad_connection* conn = connection_for_handle(little_endian_read_16(result, 1));
+    if (result[0] != ERROR_CODE_SUCCESS || !conn) return;
+    link_health_stats& stats = link_health_slots[connection_slot(conn)].stats;
+    if (opcode == HCI_OPCODE_HCI_READ_RSSI) {
+        stats.rssi = static_cast<int8_t>(result[3]);
+        stats.signal_read |= LINK_HEALTH_READ_RSSI;
+    } else {
+        stats.link_quality = result[3];
+        stats.signal_read |= LINK_HEALTH_READ_QUALITY;
+    }
+}
+
+// Grades the window just closed and moves the output backoff of slot.
+inline void link_health_close_window(uint8_t slot, uint32_t now_us) {
+    link_health_slot& h = link_health_slots[slot];
+    link_health_stats& stats = h.stats;
+    const uint32_t elapsed_us = now_us - h.window_start_us;
+    stats.frames_per_sec = elapsed_us ? static_cast<uint16_t>((h.window_frames * 1000000ull + elapsed_us / 2) /
+                                                              elapsed_us) : 0;
+    const uint32_t expected = h.window_frames + h.window_gaps;
+    const bool lossy = h.window_gaps && h.window_gaps * 1000u > expected * LINK_HEALTH_GAP_PERMILLE;
+    const bool weak = ((stats.signal_read & LINK_HEALTH_READ_RSSI) && stats.rssi <= LINK_HEALTH_WEAK_RSSI) ||
+                      ((stats.signal_read & LINK_HEALTH_READ_QUALITY) && stats.link_quality < LINK_HEALTH_WEAK_QUALITY);
+    const bool degraded = h.window_errors || lossy || weak;
+    h.window_start_us = now_us;
+    h.window_frames = 0;
+    h.window_gaps = 0;
+    h.window_errors = 0;
+
+    uint8_t backoff = stats.backoff;
+    if (degraded) {
+        stats.degraded_windows++;
+        h.clean_windows = 0;
+        if (backoff < LINK_HEALTH_MAX_BACKOFF) backoff++;
+    } else if (backoff && ++h.clean_windows >= LINK_HEALTH_RECOVER_WINDOWS) {
+        h.clean_windows = 0;
+        backoff--;
+    }
+    if (backoff != stats.backoff) {
+        stats.backoff = backoff;
+        output_slots[slot].backoff = backoff;
+        printf("[LINK] Device %u: output interval %u us (%s)\n", slot,
+               (unsigned int)output_interval_us(output_slots[slot]), degraded ? "link degraded" : "recovered");
+    }
+}
+
+inline void link_health_timer_handler(btstack_timer_source_t* timer) {
+    const uint32_t now_us = time_us_32();
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        if (!connections[slot].in_use) continue;
+        link_health_close_window(slot, now_us);
+        link_health_slots[slot].pending_reads = LINK_HEALTH_READ_RSSI | LINK_HEALTH_READ_QUALITY;
+    }
+    btstack_run_loop_set_timer(timer, LINK_HEALTH_WINDOW_MS);
+    btstack_run_loop_add_timer(timer);
+    link_health_pump();
+}
+
+inline void link_health_init() {
+    for (auto& h : link_health_slots) h = {};
+    btstack_run_loop_set_timer_handler(&link_health_timer, &link_health_timer_handler);
+    btstack_run_loop_set_timer(&link_health_timer, LINK_HEALTH_WINDOW_MS);
+    btstack_run_loop_add_timer(&link_health_timer);
+}
+
+// BTstack context or under the BTstack lock: counters of the live link of slot; false when it has none.
+inline bool link_health_snapshot(uint8_t slot, link_health_stats& stats) {
+    if (slot >= MAX_NR_GAMEPADS || !connections[slot].in_use) return false;
+    stats = link_health_slots[slot].stats;
+    return true;
+}
+
+inline void link_health_print(uint8_t slot, const link_health_stats& s) {
+    printf("[LINK] Device %u: %u frames, %u/s, jitter %u us, %u lost, %u CRC failures, %u malformed\n", slot,
+           (unsigned int)s.frames, s.frames_per_sec, (unsigned int)s.jitter_us, (unsigned int)s.sequence_gaps,
+           (unsigned int)s.crc_failures, (unsigned int)s.malformed);
+    printf("[LINK]   output %u sent, %u ACL full, %u failed, backoff %u (%u degraded windows)",
+           (unsigned int)s.output_sends, (unsigned int)s.output_acl_full, (unsigned int)s.output_failed, s.backoff,
+           (unsigned int)s.degraded_windows);
+    if (s.signal_read & LINK_HEALTH_READ_RSSI) printf(", RSSI %d", s.rssi);
+    if (s.signal_read & LINK_HEALTH_READ_QUALITY) printf(", link quality %u", s.link_quality);
+    printf("\n");
+}
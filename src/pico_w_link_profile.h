@@ -0,0 +1,199 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "btstack_config.h"
+#include "bluetooth.h"
+#include "gap.h"
+#include "hci.h"
+#include "pico_w_connections.h"
+
+// Link profiles.
+// Every ACL link gets a profile when it comes up, and link_profile_select() switches a live one. COMPETITIVE makes
+// the Pico central and writes a link policy without role switch or sniff, so the controller can neither take the
+// role back nor drop into sniff and add its interval to every report. It also asks for guaranteed QoS and sets a
+// 10 ms automatic flush timeout: an output report that has not left by then is already superseded by a newer one.
+// BATTERY allows role switch and sniff, requests sniff at 10..15 ms and restores best effort QoS and no flush.
+// The settings are issued one HCI command at a time from link_profile_pump(), which the HCI event handler calls
+// after every event; a role switch is waited for before the link policy is written. All of it runs in the BTstack
+// context. Each link also keeps the measured interval between its 0x31 frames; link_profile_dump() prints profile,
+// role, mode and interval from the application loop.
+
+#ifndef PICO_W_LINK_PROFILE
+#define PICO_W_LINK_PROFILE LINK_PROFILE_COMPETITIVE
+#endif
+
+#define LINK_MODE_ACTIVE 0
+#define LINK_MODE_SNIFF  2
+
+enum link_profile : uint8_t {
+    LINK_PROFILE_COMPETITIVE = 0,
+    LINK_PROFILE_BATTERY,
+    LINK_PROFILE_COUNT
+};
+
+struct link_profile_params {
+    const char* name;
+    uint16_t link_policy;           // LM_LINK_POLICY_* bits
+    uint16_t sniff_min_slots;       // 0.625 ms slots; sniff_max_slots 0: stay active
+    uint16_t sniff_max_slots;
+    uint16_t sniff_attempt;
+    uint16_t sniff_timeout;
+    hci_service_type_t qos_service;
+    uint32_t qos_token_rate;        // bytes/s
+    uint32_t qos_latency_us;
+    uint32_t qos_delay_variation_us;
+    uint16_t flush_timeout_slots;   // 0: never flush
+};
+
+static constexpr link_profile_params LINK_PROFILES[LINK_PROFILE_COUNT] = {
+    // 78-byte output reports at the 250 Hz scheduler cap: ~20 KB/s, latency of two slots
+    {"competitive", LM_LINK_POLICY_DISABLE_ALL_LM_MODES, 0, 0, 0, 0,
+     HCI_SERVICE_TYPE_GUARANTEED, 20000, 1250, 1250, 0x0010},
+    {"battery", LM_LINK_POLICY_ENABLE_ROLE_SWITCH | LM_LINK_POLICY_ENABLE_SNIFF_MODE, 0x0010, 0x0018, 2, 1,
+     HCI_SERVICE_TYPE_BEST_EFFORT, 0, 25000, 0xFFFFFFFFu, 0},
+};
+
+enum link_step : uint8_t {
+    LINK_STEP_ROLE   = 1u << 0,
+    LINK_STEP_POLICY = 1u << 1,
+    LINK_STEP_SNIFF  = 1u << 2,
+    LINK_STEP_QOS    = 1u << 3,
+    LINK_STEP_FLUSH  = 1u << 4,
+    LINK_STEP_ALL    = 0x1F,
+};
+
+struct link_slot {
+    link_profile profile;
+    uint8_t pending;                // link_step bits not issued yet
+    bool awaiting_role;             // role switch requested, HCI_EVENT_ROLE_CHANGE outstanding
+    hci_role_t role;
+    uint8_t mode;                   // LINK_MODE_*, from HCI_EVENT_MODE_CHANGE
+    uint16_t sniff_interval_slots;
+    uint32_t last_arrival_us;
+    uint32_t interval_avg_us;       // moving average over ~8 frames
+    uint32_t interval_max_us;
+    uint32_t frames;
+};
+
+static link_slot link_slots[MAX_NR_GAMEPADS];
+static link_profile link_profile_default = static_cast<link_profile>(PICO_W_LINK_PROFILE);
+
+inline const char* link_role_name(hci_role_t role) {
+    return role == HCI_ROLE_MASTER ? "central" : "peripheral";
+}
+
+// Issues the pending steps of every link while the controller takes commands.
+inline void link_profile_pump() {
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        link_slot& s = link_slots[slot];
+        const gamepad_connection& conn = connections[slot];
+        if (!conn.in_use) continue;
+        const link_profile_params& p = LINK_PROFILES[s.profile];
+        while (s.pending && !s.awaiting_role) {
+            const uint8_t step = static_cast<uint8_t>(s.pending & -s.pending);
+            if ((step & (LINK_STEP_POLICY | LINK_STEP_FLUSH)) && !hci_can_send_command_packet_now()) return;
+            s.pending &= ~step;
+            switch (step) {
+                case LINK_STEP_ROLE:
+                    if (s.profile == LINK_PROFILE_COMPETITIVE && s.role != HCI_ROLE_MASTER) {
+                        s.awaiting_role = gap_request_role(conn.addr, HCI_ROLE_MASTER) == ERROR_CODE_SUCCESS;
+                    }
+                    break;
+                case LINK_STEP_POLICY:
+                    hci_send_cmd(&hci_write_link_policy_settings, conn.handle, p.link_policy);
+                    break;
+                case LINK_STEP_SNIFF:
+                    if (p.sniff_max_slots) {
+                        gap_sniff_mode_enter(conn.handle, p.sniff_min_slots, p.sniff_max_slots, p.sniff_attempt,
+                                             p.sniff_timeout);
+                    } else if (s.mode == LINK_MODE_SNIFF) {
+                        gap_sniff_mode_exit(conn.handle);
+                    }
+                    break;
+                case LINK_STEP_QOS:
+                    gap_qos_set(conn.handle, p.qos_service, p.qos_token_rate, 0, p.qos_latency_us,
+                                p.qos_delay_variation_us);
+                    break;
+                case LINK_STEP_FLUSH:
+                    hci_send_cmd(&hci_write_automatic_flush_timeout, conn.handle, p.flush_timeout_slots);
+                    break;
+            }
+        }
+    }
+}
+
+// Applies profile to the live link of slot.
+inline void link_profile_select(uint8_t slot, link_profile profile) {
+    link_slot& s = link_slots[slot];
+    s.profile = profile;
+    s.pending = LINK_STEP_ALL;
+    s.interval_avg_us = 0;
+    s.interval_max_us = 0;
+    s.frames = 0;
+    printf("[LINK] Device %u: %s profile\n", slot, LINK_PROFILES[profile].name);
+    link_profile_pump();
+}
+
+// New default for later links, applied to every live one as well.
+inline void link_profile_select_all(link_profile profile) {
+    link_profile_default = profile;
+    gap_set_allow_role_switch(profile == LINK_PROFILE_COMPETITIVE);
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        if (connections[slot].in_use) link_profile_select(slot, profile);
+    }
+}
+
+// HCI_EVENT_CONNECTION_COMPLETE: a new link starts active, on the default profile.
+inline void link_profile_connected(uint8_t slot) {
+    link_slots[slot] = {};
+    link_slots[slot].role = gap_get_role(connections[slot].handle);
+    link_profile_select(slot, link_profile_default);
+}
+
+inline void link_profile_role_change(const uint8_t* addr, uint8_t status, hci_role_t role) {
+    const gamepad_connection* conn = connection_for_addr(addr);
+    if (!conn) return;
+    const uint8_t slot = connection_slot(conn);
+    link_slots[slot].awaiting_role = false;
+    if (status != ERROR_CODE_SUCCESS) {
+        printf("[LINK] Device %u: role switch failed: 0x%02x\n", slot, status);
+        return;
+    }
+    link_slots[slot].role = role;
+    printf("[LINK] Device %u: %s\n", slot, link_role_name(role));
+}
+
+inline void link_profile_mode_change(hci_con_handle_t handle, uint8_t status, uint8_t mode, uint16_t interval) {
+    const gamepad_connection* conn = connection_for_handle(handle);
+    if (!conn || status != ERROR_CODE_SUCCESS) return;
+    link_slot& s = link_slots[connection_slot(conn)];
+    s.mode = mode;
+    s.sniff_interval_slots = mode == LINK_MODE_SNIFF ? interval : 0;
+}
+
+// l2cap_packet_handler: a 0x31 frame of slot arrived at arrival_us.
+inline void link_profile_frame(uint8_t slot, uint32_t arrival_us) {
+    link_slot& s = link_slots[slot];
+    if (s.frames++ > 0) {
+        const uint32_t interval = arrival_us - s.last_arrival_us;
+        const int32_t error = static_cast<int32_t>(interval - s.interval_avg_us);
+        s.interval_avg_us = s.frames == 2 ? interval : s.interval_avg_us + (error >> 3);
+        if (interval > s.interval_max_us) s.interval_max_us = interval;
+    }
+    s.last_arrival_us = arrival_us;
+}
+
+inline void link_profile_dump() {
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        if (!connections[slot].in_use) continue;
+        const link_slot& s = link_slots[slot];
+        printf("[LINK] Device %u: %s, %s, ", slot, LINK_PROFILES[s.profile].name, link_role_name(s.role));
+        if (s.mode == LINK_MODE_SNIFF) {
+            printf("sniff %u us", (unsigned int)(s.sniff_interval_slots * 625u));
+        } else {
+            printf("active");
+        }
+        printf(", report interval %u us (max %u us, %u frames)\n", (unsigned int)s.interval_avg_us,
+               (unsigned int)s.interval_max_us, (unsigned int)s.frames);
+    }
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include "pico/platform.h"
+#include "pico/stdlib.h"
+#include "pico_w_spsc_ring.h"
+
+// Deferred binary logging.
+// LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG store a fixed-size record (timestamp, message id, up to LOG_MAX_ARGS
+// 32-bit arguments) instead of formatting, so BTstack callbacks never block on stdio. Each execution context
+// has its own SPSC ring: the BTstack context (its async context IRQ, or core1 in dual-core mode) and the
+// application loop, so producers never share a ring. log_drain() runs from the application loop when it is
+// idle, merges both rings by timestamp and prints them, or with PICO_W_LOG_BINARY=1 writes the raw records for
+// host/log_decode.cpp to format on the PC.
+// Levels above PICO_W_LOG_LEVEL compile to nothing.
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef PICO_W_LOG_LEVEL
+#define PICO_W_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef PICO_W_LOG_BINARY
+#define PICO_W_LOG_BINARY 0
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_RING_CAPACITY 64
+#define LOG_DRAIN_BUSY 2
+#define LOG_DRAIN_ALL (LOG_RING_CAPACITY * 2)
+#define LOG_SYNC_0 0xB1
+#define LOG_SYNC_1 0x0C
+
+// X(id, format). Formats take only 32-bit integer conversions (%u %d %x %c) and no trailing newline.
+// Append new messages at the end: the ids are part of the binary format read by host/log_decode.cpp.
+#define PICO_W_LOG_MESSAGES(X) \
+    X(LOG_L2CAP_SENT,          "[L2CAP] Output report sent on CID 0x%04x") \
+    X(LOG_L2CAP_SEND_FAILED,   "[L2CAP] l2cap_send on CID 0x%04x failed: 0x%02x") \
+    X(LOG_L2CAP_MTU_EXCEEDED,  "[L2CAP] CID 0x%04x: L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU") \
+    X(LOG_L2CAP_ACL_FULL,      "[L2CAP] CID 0x%04x: BTSTACK_ACL_BUFFERS_FULL") \
+    X(LOG_OUTPUT_SCHEDULED,    "[OUT] l2cap_request_can_send_now_event to device %u") \
+    X(LOG_OUTPUT_RING_FULL,    "[OUT] Core1 output ring full, report for device %u dropped") \
+    X(LOG_OUTPUT_UNCHANGED,    "[OUT] Device %u output unchanged, send skipped") \
+    X(LOG_OUTPUT_RETRY,        "[OUT] Device %u output pending again after BTSTACK_ACL_BUFFERS_FULL") \
+    X(LOG_INPUT_CRC_REJECTED,  "[L2CAP] Device %u input frame CRC mismatch, dropped (%u total)") \
+    X(LOG_INPUT_MALFORMED,     "[L2CAP] Device %u input frame 0x%02x of %u bytes is not a full 0x31 report, dropped") \
+    X(LOG_FIRST_INPUT,         "[BT] Device %u first input %u ms after origin %u (0 boot, 1 wake, 2 link loss), %u pages")
+
+enum log_id : uint16_t {
+#define LOG_MESSAGE_ID(id, format) id,
+    PICO_W_LOG_MESSAGES(LOG_MESSAGE_ID)
+#undef LOG_MESSAGE_ID
+    LOG_MESSAGE_COUNT
+};
+
+static const char* const log_formats[LOG_MESSAGE_COUNT] = {
+#define LOG_MESSAGE_FORMAT(id, format) format,
+    PICO_W_LOG_MESSAGES(LOG_MESSAGE_FORMAT)
+#undef LOG_MESSAGE_FORMAT
+};
+
+struct log_record {
+    uint32_t timestamp_us;
+    uint16_t id;
+    uint8_t level;
+    uint8_t argc;
+    uint32_t args[LOG_MAX_ARGS];
+};
+
+static_assert(sizeof(log_record) == 24, "log_record is part of the binary log format");
+
+struct log_ring {
+    spsc_ring<log_record, LOG_RING_CAPACITY> records;
+    std::atomic<uint32_t> dropped{0};   // written by the producer only
+    uint32_t dropped_reported = 0;      // consumer only
+};
+
+enum log_context : uint8_t {
+    LOG_CONTEXT_APP = 0,
+    LOG_CONTEXT_BTSTACK = 1,
+    LOG_CONTEXT_COUNT
+};
+
+static log_ring log_rings[LOG_CONTEXT_COUNT];
+
+inline log_context log_current_context() {
+    return get_core_num() != 0 || __get_current_exception() != 0 ? LOG_CONTEXT_BTSTACK : LOG_CONTEXT_APP;
+}
+
+template<typename... Args>
+inline void log_write(uint8_t level, log_id id, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many deferred log arguments");
+    static_assert(((std::is_integral_v<Args> || std::is_enum_v<Args>) && ...), "deferred log arguments must be integers");
+
+    const log_record record = {time_us_32(), id, level, static_cast<uint8_t>(sizeof...(Args)),
+                               {static_cast<uint32_t>(args)...}};
+    log_ring& ring = log_rings[log_current_context()];
+    if (!ring.records.push(record)) {
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+#if PICO_W_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(id, ...) log_write(LOG_LEVEL_ERROR, id __VA_OPT__(,) __VA_ARGS__)
+#else
+#define LOG_ERROR(id, ...) ((void)0)
+#endif
+
+#if PICO_W_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(id, ...) log_write(LOG_LEVEL_WARN, id __VA_OPT__(,) __VA_ARGS__)
+#else
+#define LOG_WARN(id, ...) ((void)0)
+#endif
+
+#if PICO_W_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(id, ...) log_write(LOG_LEVEL_INFO, id __VA_OPT__(,) __VA_ARGS__)
+#else
+#define LOG_INFO(id, ...) ((void)0)
+#endif
+
+#if PICO_W_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(id, ...) log_write(LOG_LEVEL_DEBUG, id __VA_OPT__(,) __VA_ARGS__)
+#else
+#define LOG_DEBUG(id, ...) ((void)0)
+#endif
+
+// Formats record as "<ms>.<us> <message>". Used by the text drain and by the host decoder.
+inline int log_format(const log_record& record, char* out, size_t len) {
+    static const char level_tags[] = {' ', 'E', 'W', 'I', 'D'};
+    const int prefix = snprintf(out, len, "%7u.%03u %c ", (unsigned int)(record.timestamp_us / 1000),
+                                (unsigned int)(record.timestamp_us % 1000),
+                                record.level < sizeof(level_tags) ? level_tags[record.level] : '?');
+    if (prefix < 0 || static_cast<size_t>(prefix) >= len) return prefix;
+    if (record.id >= LOG_MESSAGE_COUNT) {
+        return prefix + snprintf(out + prefix, len - prefix, "[LOG] unknown message %u", record.id);
+    }
+    return prefix + snprintf(out + prefix, len - prefix, log_formats[record.id], (unsigned int)record.args[0],
+                             (unsigned int)record.args[1], (unsigned int)record.args[2], (unsigned int)record.args[3]);
+}
+
+inline void log_emit(const log_record& record) {
+#if PICO_W_LOG_BINARY
+    putchar_raw(LOG_SYNC_0);
+    putchar_raw(LOG_SYNC_1);
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&record);
+    for (size_t i = 0; i < sizeof(record); i++) putchar_raw(bytes[i]);
+#else
+    char line[128];
+    log_format(record, line, sizeof(line));
+    puts(line);
+#endif
+}
+
+// Application loop: formats up to max_records pending records, oldest first across both rings.
+// Returns the number of records written.
+inline uint32_t log_drain(uint32_t max_records) {
+    uint32_t written = 0;
+    while (written < max_records) {
+        const log_record* app = log_rings[LOG_CONTEXT_APP].records.front();
+        const log_record* bt = log_rings[LOG_CONTEXT_BTSTACK].records.front();
+        if (!app && !bt) break;
+
+        const bool take_bt = !app || (bt && static_cast<int32_t>(bt->timestamp_us - app->timestamp_us) < 0);
+        log_ring& ring = log_rings[take_bt ? LOG_CONTEXT_BTSTACK : LOG_CONTEXT_APP];
+        log_emit(*ring.records.front());
+        ring.records.pop();
+        written++;
+    }
+
+    for (auto& ring : log_rings) {
+        const uint32_t dropped = ring.dropped.load(std::memory_order_relaxed);
+        if (dropped != ring.dropped_reported) {
+            printf("[LOG] %u records dropped (ring full)\n", (unsigned int)(dropped - ring.dropped_reported));
+            ring.dropped_reported = dropped;
+        }
+    }
+    return written;
+}
@@ -0,0 +1,206 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include "btstack_config.h"
+#include "pico/platform.h"
+#include "GCore/Interfaces/ISonyGamepad.h"
+#include "pico_w_action_map.h"
+#include "pico_w_capture.h"
+#include "pico_w_connections.h"
+#include "pico_w_crc32.h"
+#include "pico_w_feature_report.h"
+#include "pico_w_flash_ptr.h"
+#include "pico_w_haptic_audio.h"
+#include "pico_w_imu_fusion.h"
+#include "pico_w_input_events.h"
+#include "pico_w_input_pipeline.h"
+#include "pico_w_latency.h"
+#include "pico_w_link_health.h"
+#include "pico_w_link_profile.h"
+#include "pico_w_log.h"
+#include "pico_w_output_sequencer.h"
+#include "pico_w_platform.h"
+#include "pico_w_reconnect.h"
+#include "pico_w_trigger_effects.h"
+#include "pico_w_usb_bridge.h"
+#if PICO_W_DUAL_CORE
+#include "pico_w_dual_core.h"
+#endif
+#if PICO_W_FIXED_INPUT
+#include "pico_w_fixed_input.h"
+#endif
+
+// Heap arena and static RAM budget.
+// Gamepad-Core owns its devices and the platform instance through std::unique_ptr and an unordered_map, and
+// SetCustomTrigger takes a std::vector, so the firmware cannot avoid operator new outright. With
+// -DDUALSENSE_ZERO_HEAP=ON the global operator new/delete are replaced by a bump allocator over one static arena
+// sized from MAX_NR_GAMEPADS: every allocation is charged to the subsystem named by heap_charge(), frees during
+// init are not reused, and once heap_seal() runs any new or delete panics. Nothing here is thread-safe: allocate
+// from core0 before core1 starts doing the same. memory_budget_dump() prints the static RAM of each subsystem and,
+// on the RP2040, how much of the 264 KB the whole image takes. main.cpp is the only translation unit including this.
+
+enum heap_subsystem : uint8_t {
+    HEAP_REGISTRY = 0,      // Gamepad-Core devices with their FDeviceContext, and the registry's table
+    HEAP_PLATFORM,
+    HEAP_EFFECTS,           // trigger effect scratch buffer
+    HEAP_OTHER,
+    HEAP_SUBSYSTEM_COUNT
+};
+
+struct heap_arena {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    size_t charged[HEAP_SUBSYSTEM_COUNT];
+    heap_subsystem current;
+    bool sealed;
+    uint32_t refused;       // requests that did not fit or came after the seal
+};
+
+#define HEAP_ARENA_ALIGN 8
+// unordered_map node plus alignment rounding per device
+#define HEAP_DEVICE_OVERHEAD 32
+#ifndef HEAP_ARENA_SLACK
+#define HEAP_ARENA_SLACK 256    // the registry's bucket arrays as it grows to MAX_NR_GAMEPADS
+#endif
+
+constexpr size_t heap_round(size_t bytes) {
+    return (bytes + HEAP_ARENA_ALIGN - 1) & ~static_cast<size_t>(HEAP_ARENA_ALIGN - 1);
+}
+
+constexpr size_t heap_arena_size =
+        MAX_NR_GAMEPADS * heap_round(sizeof(ISonyGamepad) + HEAP_DEVICE_OVERHEAD) +
+        heap_round(sizeof(GamepadCore::TGenericHardwareInfo<pico_w_platform_policy>)) +
+        heap_round(TRIGGER_EFFECT_SIZE) + HEAP_ARENA_SLACK;
+
+// nullptr when sealed or full
+inline void* heap_arena_alloc(heap_arena& arena, size_t bytes) {
+    const size_t rounded = heap_round(bytes ? bytes : 1);
+    if (arena.sealed || rounded > arena.size - arena.used) {
+        arena.refused++;
+        return nullptr;
+    }
+    void* block = arena.base + arena.used;
+    arena.used += rounded;
+    arena.charged[arena.current] += rounded;
+    return block;
+}
+
+#if PICO_W_ZERO_HEAP
+alignas(HEAP_ARENA_ALIGN) static uint8_t heap_arena_storage[heap_arena_size];
+static heap_arena heap_static_arena = {heap_arena_storage, sizeof(heap_arena_storage), 0, {}, HEAP_OTHER, false, 0};
+
+void* operator new(size_t bytes) {
+    void* block = heap_arena_alloc(heap_static_arena, bytes);
+    if (!block) {
+        panic("[HEAP] %u-byte allocation %s", (unsigned int)bytes,
+              heap_static_arena.sealed ? "after init" : "does not fit the arena");
+    }
+    return block;
+}
+
+void* operator new[](size_t bytes) { return operator new(bytes); }
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept { return heap_arena_alloc(heap_static_arena, bytes); }
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept {
+    return heap_arena_alloc(heap_static_arena, bytes);
+}
+
+void operator delete(void* block) noexcept {
+    if (block && heap_static_arena.sealed) panic("[HEAP] free after init");
+}
+
+void operator delete[](void* block) noexcept { operator delete(block); }
+void operator delete(void* block, size_t) noexcept { operator delete(block); }
+void operator delete[](void* block, size_t) noexcept { operator delete(block); }
+#endif
+
+// Allocations from here on are charged to subsystem. No-op without the arena.
+inline void heap_charge(heap_subsystem subsystem) {
+#if PICO_W_ZERO_HEAP
+    heap_static_arena.current = subsystem;
+#else
+    (void)subsystem;
+#endif
+}
+
+// End of init: from here on the heap traps.
+inline void heap_seal() {
+#if PICO_W_ZERO_HEAP
+    heap_static_arena.current = HEAP_OTHER;
+    heap_static_arena.sealed = true;
+#endif
+}
+
+#if defined(__arm__)
+extern "C" char __data_start__[], __bss_end__[], __end__[], __StackLimit[];
+#endif
+
+struct memory_budget_entry {
+    const char* name;
+    size_t bytes;
+};
+
+inline void memory_budget_dump() {
+    const memory_budget_entry entries[] = {
+        {"connections", sizeof(connections) + sizeof(cid_table) + sizeof(output_slots)},
+        {"input pipeline", sizeof(input_slots) + sizeof(input_frame_sem)},
+        {"input events", sizeof(input_change_slots) + sizeof(input_event_queue)},
+        {"output sequencer", sizeof(output_sequencer_slots)},
+        {"action map", sizeof(action_slots)},
+#if PICO_W_DUAL_CORE
+        {"output ring", sizeof(output_ring)},
+#endif
+#if PICO_W_FIXED_INPUT
+        {"fixed input", sizeof(fixed_stick_lut) + sizeof(fixed_trigger_lut)},
+#endif
+        {"imu fusion", sizeof(imu_calibrations) + sizeof(imu_fusion)},
+        {"crc32 tables", sizeof(crc32_tables) + sizeof(crc32_shifts)},
+        {"bonds", sizeof(bond_index)},
+        {"feature reports", sizeof(feature_requests)},
+        {"link profiles", sizeof(link_slots)},
+        {"link health", sizeof(link_health_slots)},
+        {"reconnect", sizeof(reconnect_targets) + sizeof(reconnect_timings) + sizeof(reconnect_timer)},
+#if PICO_W_LATENCY
+        {"latency", sizeof(latency_histograms) + sizeof(latency_origin_us)},
+#endif
+        {"deferred log", sizeof(log_rings)},
+#if PICO_W_CAPTURE
+        {"l2cap capture", sizeof(capture_buffer)},
+#endif
+#if PICO_W_HAPTIC_AUDIO
+        {"haptic audio", sizeof(haptic_audio_slots)},
+#endif
+#if PICO_W_USB_BRIDGE
+        {"usb bridge", sizeof(usb_bridge_slots)},
+#endif
+#if PICO_W_ZERO_HEAP
+        {"heap arena", sizeof(heap_arena_storage)},
+#endif
+    };
+    static const char* const subsystems[HEAP_SUBSYSTEM_COUNT] = {"registry", "platform", "effects", "other"};
+
+    size_t listed = 0;
+    printf("[MEM] Static RAM by subsystem (%u controllers):\n", MAX_NR_GAMEPADS);
+    for (const memory_budget_entry& entry : entries) {
+        printf("[MEM]   %-18s %6u\n", entry.name, (unsigned int)entry.bytes);
+        listed += entry.bytes;
+    }
+    printf("[MEM]   %-18s %6u\n", "listed total", (unsigned int)listed);
+#if PICO_W_ZERO_HEAP
+    printf("[MEM] Heap arena: %u of %u bytes used (", (unsigned int)heap_static_arena.used,
+           (unsigned int)heap_static_arena.size);
+    for (uint8_t i = 0; i < HEAP_SUBSYSTEM_COUNT; i++) {
+        printf("%s%s %u", i ? ", " : "", subsystems[i], (unsigned int)heap_static_arena.charged[i]);
+    }
+    printf(")%s\n", heap_static_arena.sealed ? ", sealed" : "");
+#else
+    (void)subsystems;
+#endif
+#if defined(__arm__)
+    const size_t image = static_cast<size_t>(__bss_end__ - __data_start__);
+    printf("[MEM] .data + .bss %u bytes: %u outside the list (BTstack, CYW43, SDK); %u left for heap of 264 KB\n",
+           (unsigned int)image, (unsigned int)(image - listed), (unsigned int)(__StackLimit - __end__));
+#endif
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "btstack_config.h"
+#include "pico_w_trigger_effects.h"
+#include "GCore/Interfaces/ISonyGamepad.h"
+
+// Output timelines.
+// A timeline is a constant array of keyframes, each setting some output fields at a time offset. Lightbar and
+// rumble are continuous: between two keyframes that both set them the sequencer fades linearly, emitting one
+// UpdateOutput per OUTPUT_SEQUENCER_DEFAULT_RATE_HZ frame; after the last keyframe that sets them they hold.
+// A keyframe with OUTPUT_FIELD_STEP jumps to its lightbar/rumble instead. Feature flags, player LED and trigger
+// effects are always steps applied when their keyframe is reached.
+// output_sequencer_poll() runs on the application loop, where the Gamepad-Core device state lives, and returns how
+// long the loop may sleep before the next frame is due, so a timeline never blocks input processing. The output
+// scheduler still coalesces and rate-limits whatever the frames produce.
+
+#define OUTPUT_SEQUENCER_DEFAULT_RATE_HZ 50
+#define OUTPUT_SEQUENCER_IDLE UINT32_MAX
+
+enum output_field : uint8_t {
+    OUTPUT_FIELD_LIGHTBAR      = 1u << 0,
+    OUTPUT_FIELD_RUMBLE        = 1u << 1,
+    OUTPUT_FIELD_PLAYER_LED    = 1u << 2,
+    OUTPUT_FIELD_TRIGGER_LEFT  = 1u << 3,
+    OUTPUT_FIELD_TRIGGER_RIGHT = 1u << 4,
+    OUTPUT_FIELD_FEATURE       = 1u << 5,
+    OUTPUT_FIELD_STEP          = 1u << 6,  // no fade into this keyframe
+};
+
+struct output_keyframe {
+    uint32_t at_ms;                 // from the start of the timeline, non-decreasing
+    uint8_t fields;                 // output_field bits this keyframe sets
+    uint8_t lightbar[3];
+    uint8_t rumble[2];              // SetVibration(rumble[0], rumble[1])
+    EDSPlayer player;
+    uint8_t player_brightness;
+    const trigger_effect* trigger;  // applied to the hand(s) in fields
+    uint8_t feature[4];             // Output.Feature
+};
+
+struct output_sequencer_slot {
+    const output_keyframe* keys;    // nullptr: idle
+    uint8_t count;
+    uint8_t next_step;              // first keyframe whose step fields are not applied yet
+    uint32_t start_ms;
+    uint32_t next_ms;               // next frame due
+    uint8_t applied;                // continuous output_field bits handed to Gamepad-Core at least once
+    uint8_t lightbar[3];            // last values handed to Gamepad-Core
+    uint8_t rumble[2];
+};
+
+static output_sequencer_slot output_sequencer_slots[MAX_NR_GAMEPADS];
+static uint32_t output_sequencer_interval_ms = 1000 / OUTPUT_SEQUENCER_DEFAULT_RATE_HZ;
+static uint32_t output_sequencer_frames = 0;
+
+inline void output_sequencer_set_rate(uint32_t hz) {
+    output_sequencer_interval_ms = hz ? (1000 + hz - 1) / hz : 1;
+}
+
+// Replaces whatever timeline slot was playing; keys must outlive it (constexpr arrays do).
+inline void output_sequencer_start(uint8_t slot, const output_keyframe* keys, uint8_t count, uint32_t now_ms) {
+    output_sequencer_slot& s = output_sequencer_slots[slot];
+    s = {};
+    s.keys = count ? keys : nullptr;
+    s.count = count;
+    s.start_ms = now_ms;
+    s.next_ms = now_ms;
+}
+
+template<uint8_t Count>
+inline void output_sequencer_start(uint8_t slot, const output_keyframe (&keys)[Count], uint32_t now_ms) {
+    output_sequencer_start(slot, keys, Count, now_ms);
+}
+
+inline void output_sequencer_stop(uint8_t slot) {
+    output_sequencer_slots[slot].keys = nullptr;
+}
+
+inline bool output_sequencer_active(uint8_t slot) {
+    return output_sequencer_slots[slot].keys != nullptr;
+}
+
+// Value of a continuous field at t: the last keyframe setting it, faded towards the next one. Returns false if no
+// keyframe up to t sets it; *fading tells whether a later keyframe still changes it.
+template<uint8_t Field, uint8_t Channels>
+inline bool output_sequencer_sample(const output_sequencer_slot& s, uint32_t t, uint8_t* out, bool* fading) {
+    const output_keyframe* from = nullptr;
+    const output_keyframe* to = nullptr;
+    for (uint8_t i = 0; i < s.count; i++) {
+        const output_keyframe& key = s.keys[i];
+        if (!(key.fields & Field)) continue;
+        if (key.at_ms <= t) {
+            from = &key;
+        } else {
+            to = &key;
+            break;
+        }
+    }
+    if (!from) return false;
+    const uint8_t* a = Field == OUTPUT_FIELD_LIGHTBAR ? from->lightbar : from->rumble;
+    if (!to || (to->fields & OUTPUT_FIELD_STEP)) {
+        for (uint8_t c = 0; c < Channels; c++) out[c] = a[c];
+        return true;
+    }
+    const uint8_t* b = Field == OUTPUT_FIELD_LIGHTBAR ? to->lightbar : to->rumble;
+    const uint32_t span = to->at_ms - from->at_ms;
+    const uint32_t done = t - from->at_ms;
+    for (uint8_t c = 0; c < Channels; c++) {
+        out[c] = static_cast<uint8_t>(a[c] + (static_cast<int32_t>(b[c]) - a[c]) * static_cast<int32_t>(done) /
+                                                     static_cast<int32_t>(span));
+    }
+    *fading = true;
+    return true;
+}
+
+// Application loop: applies the frame of slot's timeline due at now_ms (if any) and returns the milliseconds until
+// the next one, or OUTPUT_SEQUENCER_IDLE when nothing is playing.
+inline uint32_t output_sequencer_poll(uint8_t slot, ISonyGamepad* gamepad, uint32_t now_ms) {
+    output_sequencer_slot& s = output_sequencer_slots[slot];
+    if (!s.keys) return OUTPUT_SEQUENCER_IDLE;
+    if (static_cast<int32_t>(s.next_ms - now_ms) > 0) return s.next_ms - now_ms;
+
+    const uint32_t t = now_ms - s.start_ms;
+    bool changed = false;
+    for (; s.next_step < s.count && s.keys[s.next_step].at_ms <= t; s.next_step++) {
+        const output_keyframe& key = s.keys[s.next_step];
+        if (key.fields & OUTPUT_FIELD_FEATURE) {
+            gamepad->GetMutableDeviceContext()->Output.Feature = {key.feature[0], key.feature[1], key.feature[2],
+                                                                  key.feature[3]};
+        }
+        if (key.fields & OUTPUT_FIELD_PLAYER_LED) gamepad->SetPlayerLed(key.player, key.player_brightness);
+        if ((key.fields & OUTPUT_FIELD_TRIGGER_LEFT) && key.trigger) {
+            trigger_apply(gamepad, EDSGamepadHand::Left, *key.trigger);
+        }
+        if ((key.fields & OUTPUT_FIELD_TRIGGER_RIGHT) && key.trigger) {
+            trigger_apply(gamepad, EDSGamepadHand::Right, *key.trigger);
+        }
+        changed |= (key.fields & (OUTPUT_FIELD_FEATURE | OUTPUT_FIELD_PLAYER_LED | OUTPUT_FIELD_TRIGGER_LEFT |
+                                  OUTPUT_FIELD_TRIGGER_RIGHT)) != 0;
+    }
+
+    bool fading = false;
+    uint8_t lightbar[3];
+    uint8_t rumble[2];
+    const bool has_lightbar = output_sequencer_sample<OUTPUT_FIELD_LIGHTBAR, 3>(s, t, lightbar, &fading);
+    const bool has_rumble = output_sequencer_sample<OUTPUT_FIELD_RUMBLE, 2>(s, t, rumble, &fading);
+    if (has_lightbar && (!(s.applied & OUTPUT_FIELD_LIGHTBAR) || memcmp(lightbar, s.lightbar, 3) != 0)) {
+        s.applied |= OUTPUT_FIELD_LIGHTBAR;
+        memcpy(s.lightbar, lightbar, 3);
+        gamepad->SetLightbar({lightbar[0], lightbar[1], lightbar[2], 0});
+        changed = true;
+    }
+    if (has_rumble && (!(s.applied & OUTPUT_FIELD_RUMBLE) || memcmp(rumble, s.rumble, 2) != 0)) {
+        s.applied |= OUTPUT_FIELD_RUMBLE;
+        memcpy(s.rumble, rumble, 2);
+        gamepad->SetVibration(rumble[0], rumble[1]);
+        changed = true;
+    }
+    if (changed) {
+        gamepad->UpdateOutput();
+        output_sequencer_frames++;
+    }
+
+    if (s.next_step >= s.count && !fading) {
+        s.keys = nullptr;
+        return OUTPUT_SEQUENCER_IDLE;
+    }
+    s.next_ms = now_ms + output_sequencer_interval_ms;
+    if (s.next_step < s.count) {
+        const uint32_t step_ms = s.start_ms + s.keys[s.next_step].at_ms;
+        if (!fading || static_cast<int32_t>(step_ms - s.next_ms) < 0) s.next_ms = step_ms;
+    }
+    return s.next_ms - now_ms;
+}
@@ -1,14 +1,31 @@
 #pragma once
 #include "GCore/Templates/TGenericHardwareInfo.h"
 #include "GImplementations/Utils/GamepadSensors.h"
+#include "pico/cyw43_arch.h"
+#include "pico_w_haptic_audio.h"
+#include "pico_w_latency.h"
+#include "pico_w_log.h"
 
 
 struct pico_w_platform_policy {
 
     static void Write(FDeviceContext* Context) {
         if (!Context) return;
-        printf("l2cap_request_can_send_now_event to device \n");
-        l2cap_request_can_send_now_event(l2cap_cid_interrupt);
+        const uint8_t slot = connection_slot_for_context(Context);
+        if (slot == NO_SLOT) return;
+        const latency_stamp stamp = latency_output_stamp(slot);
+#if PICO_W_DUAL_CORE
+        // runs on core0: hand the packed report to the BTstack core
+        dual_core_submit_output(slot, Context->GetRawOutputBuffer(), stamp);
+#else
+        // called from the application loop: BTstack state may only be touched under the async context lock
+        LOG_DEBUG(LOG_OUTPUT_SCHEDULED, slot);
+        async_context_t* bt_context = cyw43_arch_async_context();
+        async_context_acquire_lock_blocking(bt_context);
+        output_stage(slot, Context->GetRawOutputBuffer(), stamp);
+        output_schedule(slot);
+        async_context_release_lock(bt_context);
+#endif
     }
 
     static bool CreateHandle(FDeviceContext* Context) {
@@ -19,7 +36,20 @@ struct pico_w_platform_policy {
     static void Read(FDeviceContext* Context) {}
     static void Detect(std::vector<FDeviceContext>& Devices) {}
     static void InvalidateHandle(FDeviceContext* Context) {}
-    static void ProcessAudioHaptic(FDeviceContext* Context) {}
-    static void InitializeAudioDevice(FDeviceContext* Context) {}
+
+    // Samples reach the slot's ring through haptic_audio_write(); this closes the buffer written so far
+    static void ProcessAudioHaptic(FDeviceContext* Context) {
+#if PICO_W_HAPTIC_AUDIO
+        const uint8_t slot = connection_slot_for_context(Context);
+        if (slot != NO_SLOT) haptic_audio_flush(slot);
+#endif
+    }
+
+    static void InitializeAudioDevice(FDeviceContext* Context) {
+#if PICO_W_HAPTIC_AUDIO
+        const uint8_t slot = connection_slot_for_context(Context);
+        if (slot != NO_SLOT) haptic_audio_open(slot);
+#endif
+    }
 };
 
@@ -0,0 +1,245 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "btstack_config.h"
+#include "bluetooth.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "pico/time.h"
+#include "pico_w_flash_ptr.h"
+#include "pico_w_log.h"
+
+// Reconnect state machine.
+// With a bond in the RAM index (flash_bond_find/flash_bond_latest never touch flash), the host pages the bonded
+// controller straight away instead of waiting for it or running an inquiry: on boot it pages the most recent bond,
+// and after a link loss it pages the controller that dropped. Every controller to page is a target with its own
+// schedule: failed pages are retried after RECONNECT_BACKOFF_MS, and a target whose schedule is exhausted is dropped;
+// when the last one goes the host falls back to the pairing inquiry. Only one page is outstanding at a time, and
+// targets that are due take turns, so a pad that never answers cannot starve one in range. The host stays
+// connectable throughout, with interlaced page scan, so a controller waking up and paging us wins over the schedule.
+// The time from boot, controller wake (connection request) or link loss to the first 0x31 frame of that
+// controller is recorded per origin; reconnect_dump() prints it from the application loop. Everything else runs in
+// the BTstack context.
+
+#define RECONNECT_PAGE_TIMEOUT_SLOTS 0x0C80     // 2 s in 0.625 ms slots (BTstack default: 0x6000, 15.36 s)
+#define RECONNECT_PAGE_SCAN_INTERVAL 0x0400     // 640 ms
+#define RECONNECT_PAGE_SCAN_WINDOW   0x0024     // 22.5 ms, interlaced: a wake-up page lands within one interval
+#define RECONNECT_BUSY_RETRY_MS 10              // no HCI command credit for the page; not a failed attempt
+
+// Delay before each page; a page that fails moves to the next entry, the end of the table to the inquiry. A page
+// the controller has no command credit for (link health and link profile send HCI commands too) is not sent, so
+// no CONNECTION_COMPLETE would ever answer it; it is tried again after RECONNECT_BUSY_RETRY_MS instead.
+static constexpr uint16_t RECONNECT_BACKOFF_MS[] = {0, 500, 1000, 2000, 4000, 8000};
+#define RECONNECT_ATTEMPTS (sizeof(RECONNECT_BACKOFF_MS) / sizeof(RECONNECT_BACKOFF_MS[0]))
+
+#define RECONNECT_NONE 0xFF
+
+enum reconnect_origin : uint8_t {
+    RECONNECT_ORIGIN_BOOT = 0,  // HCI working, bond in flash
+    RECONNECT_ORIGIN_WAKE,      // bonded controller paged us
+    RECONNECT_ORIGIN_LINK_LOSS, // bonded controller disconnected, we page it
+    RECONNECT_ORIGIN_COUNT
+};
+
+// A bonded controller to page; at most one per controller slot.
+struct reconnect_target {
+    bd_addr_t addr;
+    bool active;
+    uint8_t attempt;
+    uint32_t due_ms;        // run loop time of its next page
+};
+
+struct reconnect_timing {
+    uint32_t count;
+    uint32_t last_ms;
+    uint32_t best_ms;
+    uint32_t worst_ms;
+};
+
+static reconnect_target reconnect_targets[MAX_NR_GAMEPADS];
+static uint8_t reconnect_paging = RECONNECT_NONE;   // target with an hci_create_connection outstanding
+static uint8_t reconnect_next = 0;                  // first target to consider for the next page
+static uint32_t reconnect_pages = 0;
+static uint32_t reconnect_busy_retries = 0;    // pages put off for want of an HCI command credit
+static btstack_timer_source_t reconnect_timer;
+
+// Time-to-first-input measurement in flight
+static bool reconnect_measuring = false;
+static reconnect_origin reconnect_measure_origin;
+static bd_addr_t reconnect_measure_addr;
+static uint64_t reconnect_measure_start_us;
+static uint8_t reconnect_measure_pages;
+static reconnect_timing reconnect_timings[RECONNECT_ORIGIN_COUNT];
+
+inline void start_pairing_inquiry();
+
+inline void reconnect_configure_radio() {
+    gap_set_page_timeout(RECONNECT_PAGE_TIMEOUT_SLOTS);
+    gap_set_page_scan_activity(RECONNECT_PAGE_SCAN_INTERVAL, RECONNECT_PAGE_SCAN_WINDOW);
+    gap_set_page_scan_type(PAGE_SCAN_MODE_INTERLACED);
+}
+
+// Starts timing from now to the first input of addr; a newer origin replaces one still in flight.
+inline void reconnect_measure(reconnect_origin origin, const uint8_t* addr) {
+    reconnect_measuring = true;
+    reconnect_measure_origin = origin;
+    bd_addr_copy(reconnect_measure_addr, addr);
+    reconnect_measure_start_us = time_us_64();
+    reconnect_measure_pages = 0;
+}
+
+inline void reconnect_timer_handler(btstack_timer_source_t*);
+
+inline void reconnect_arm_ms(uint32_t delay_ms) {
+    btstack_run_loop_remove_timer(&reconnect_timer);
+    btstack_run_loop_set_timer_handler(&reconnect_timer, &reconnect_timer_handler);
+    btstack_run_loop_set_timer(&reconnect_timer, delay_ms);
+    btstack_run_loop_add_timer(&reconnect_timer);
+}
+
+// Arms the timer for the target due first, unless a page is outstanding; its answer reschedules.
+inline void reconnect_schedule() {
+    if (reconnect_paging != RECONNECT_NONE) return;
+    const uint32_t now = btstack_run_loop_get_time_ms();
+    bool any = false;
+    uint32_t wait_ms = 0;
+    for (const reconnect_target& t : reconnect_targets) {
+        if (!t.active) continue;
+        const int32_t left = static_cast<int32_t>(t.due_ms - now);
+        const uint32_t ms = left > 0 ? static_cast<uint32_t>(left) : 0;
+        wait_ms = !any || ms < wait_ms ? ms : wait_ms;
+        any = true;
+    }
+    if (any) {
+        reconnect_arm_ms(wait_ms);
+    } else {
+        btstack_run_loop_remove_timer(&reconnect_timer);
+    }
+}
+
+inline void reconnect_timer_handler(btstack_timer_source_t*) {
+    if (reconnect_paging != RECONNECT_NONE) return;
+    const uint32_t now = btstack_run_loop_get_time_ms();
+    uint8_t index = RECONNECT_NONE;
+    for (uint8_t i = 0; i < MAX_NR_GAMEPADS && index == RECONNECT_NONE; i++) {
+        const uint8_t candidate = static_cast<uint8_t>((reconnect_next + i) % MAX_NR_GAMEPADS);
+        const reconnect_target& t = reconnect_targets[candidate];
+        if (t.active && static_cast<int32_t>(t.due_ms - now) <= 0) index = candidate;
+    }
+    if (index == RECONNECT_NONE) {
+        reconnect_schedule();
+        return;
+    }
+    reconnect_target& t = reconnect_targets[index];
+    if (!hci_can_send_command_packet_now() ||
+        hci_send_cmd(&hci_create_connection, t.addr, hci_usable_acl_packet_types(), 1, 0, 0, 1) !=
+            ERROR_CODE_SUCCESS) {
+        reconnect_busy_retries++;
+        reconnect_arm_ms(RECONNECT_BUSY_RETRY_MS);
+        return;
+    }
+    reconnect_paging = index;
+    reconnect_next = static_cast<uint8_t>((index + 1) % MAX_NR_GAMEPADS);
+    reconnect_pages++;
+    if (reconnect_measuring) reconnect_measure_pages++;
+    printf("[BT] Paging %s (attempt %u/%u)\n", bd_addr_to_str(t.addr), t.attempt + 1,
+           (unsigned int)RECONNECT_ATTEMPTS);
+}
+
+inline uint8_t reconnect_find(const uint8_t* addr) {
+    for (uint8_t i = 0; i < MAX_NR_GAMEPADS; i++) {
+        if (reconnect_targets[i].active && bd_addr_cmp(addr, reconnect_targets[i].addr) == 0) return i;
+    }
+    return RECONNECT_NONE;
+}
+
+// Page the bonded controller at addr on the backoff schedule, from its first entry; other targets keep theirs.
+inline void reconnect_start(const uint8_t* addr) {
+    uint8_t index = reconnect_find(addr);
+    for (uint8_t i = 0; i < MAX_NR_GAMEPADS && index == RECONNECT_NONE; i++) {
+        if (!reconnect_targets[i].active) index = i;
+    }
+    if (index == RECONNECT_NONE) {
+        printf("[BT] Already paging %d controllers, not paging %s\n", MAX_NR_GAMEPADS, bd_addr_to_str(addr));
+        return;
+    }
+    reconnect_target& t = reconnect_targets[index];
+    bd_addr_copy(t.addr, addr);
+    t.active = true;
+    t.attempt = 0;
+    t.due_ms = btstack_run_loop_get_time_ms() + RECONNECT_BACKOFF_MS[0];
+    reconnect_schedule();
+}
+
+inline void reconnect_cancel() {
+    btstack_run_loop_remove_timer(&reconnect_timer);
+    for (reconnect_target& t : reconnect_targets) t.active = false;
+    reconnect_paging = RECONNECT_NONE;
+}
+
+inline bool reconnect_active() {
+    if (reconnect_paging != RECONNECT_NONE) return true;
+    for (const reconnect_target& t : reconnect_targets) {
+        if (t.active) return true;
+    }
+    return false;
+}
+
+// HCI_EVENT_CONNECTION_COMPLETE. Returns true if the event answered our page.
+inline bool reconnect_connection_complete(const uint8_t* addr, uint8_t status) {
+    const bool ours = reconnect_paging != RECONNECT_NONE &&
+                      bd_addr_cmp(addr, reconnect_targets[reconnect_paging].addr) == 0;
+    if (status == ERROR_CODE_SUCCESS) {
+        // our page or the controller's own: either way that target is back
+        const uint8_t index = reconnect_find(addr);
+        if (index != RECONNECT_NONE) reconnect_targets[index].active = false;
+        if (ours) reconnect_paging = RECONNECT_NONE;
+        reconnect_schedule();
+        return ours;
+    }
+    if (!ours) return false;
+
+    reconnect_target& t = reconnect_targets[reconnect_paging];
+    reconnect_paging = RECONNECT_NONE;
+    if (++t.attempt < RECONNECT_ATTEMPTS) {
+        printf("[BT] Page failed: 0x%02x, retrying in %u ms\n", status, RECONNECT_BACKOFF_MS[t.attempt]);
+        t.due_ms = btstack_run_loop_get_time_ms() + RECONNECT_BACKOFF_MS[t.attempt];
+    } else {
+        printf("[BT] %s did not answer %u pages, giving up on it\n", bd_addr_to_str(t.addr),
+               (unsigned int)RECONNECT_ATTEMPTS);
+        t.active = false;
+        if (!reconnect_active()) {
+            printf("[BT] No controller left to page, falling back to inquiry\n");
+            start_pairing_inquiry();
+            return true;
+        }
+    }
+    reconnect_schedule();
+    return true;
+}
+
+// First 0x31 frame from addr on slot.
+inline void reconnect_first_input(const uint8_t* addr, uint8_t slot) {
+    if (!reconnect_measuring || bd_addr_cmp(addr, reconnect_measure_addr) != 0) return;
+    reconnect_measuring = false;
+    const uint32_t ms = static_cast<uint32_t>((time_us_64() - reconnect_measure_start_us) / 1000);
+    reconnect_timing& t = reconnect_timings[reconnect_measure_origin];
+    t.best_ms = t.count == 0 || ms < t.best_ms ? ms : t.best_ms;
+    t.worst_ms = ms > t.worst_ms ? ms : t.worst_ms;
+    t.last_ms = ms;
+    t.count++;
+    LOG_INFO(LOG_FIRST_INPUT, slot, ms, reconnect_measure_origin, reconnect_measure_pages);
+}
+
+inline void reconnect_dump() {
+    static const char* const names[RECONNECT_ORIGIN_COUNT] = {"boot", "wake", "link loss"};
+    printf("[BT] Time to first input (ms), %u pages sent, %u put off for a command credit\n",
+           (unsigned int)reconnect_pages, (unsigned int)reconnect_busy_retries);
+    printf("[BT] %-10s %6s %8s %8s %8s\n", "origin", "count", "last", "best", "worst");
+    for (uint8_t origin = 0; origin < RECONNECT_ORIGIN_COUNT; origin++) {
+        const reconnect_timing& t = reconnect_timings[origin];
+        printf("[BT] %-10s %6u %8u %8u %8u\n", names[origin], (unsigned int)t.count, (unsigned int)t.last_ms,
+               (unsigned int)t.best_ms, (unsigned int)t.worst_ms);
+    }
+}
@@ -14,8 +14,10 @@ namespace policy_device {
             size_t operator()(const int32_t& v) const { return std::hash<int32_t>{}(v); }
         };
 
+        // Engine ids are handed out in creation order and double as controller slot numbers
         static EngineIdType AllocEngineDevice() {
-            return 0;
+            static EngineIdType next_id = 0;
+            return next_id++;
         }
 
         static void DisconnectDevice(EngineIdType id) {
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Read-only view of a DualSense Bluetooth 0x31 input report, wherever it lives: the BTstack receive buffer during
+// l2cap_packet_handler, or the triple-buffer slot handed out by input_pipeline_acquire(). Nothing is copied or
+// decoded up front; each accessor reads just the bytes of its field, so a consumer only pays for what it uses.
+// Offsets follow the report as stored in FDeviceContext::Buffer: [0] report id, [1] sequence tag, data from [2].
+
+struct ds_touch_point {
+    bool active;
+    uint8_t id;
+    uint16_t x;     // 0..1919
+    uint16_t y;     // 0..1079
+};
+
+struct ds_input_view {
+    static constexpr size_t size = 78;
+    static constexpr size_t data = 2;
+    static constexpr uint32_t sensor_ticks_per_us = 3;
+
+    const uint8_t* bytes;
+
+    uint8_t report_id() const { return bytes[0]; }
+    uint8_t sequence() const { return bytes[1] >> 4; }
+
+    uint8_t left_x() const { return bytes[data + 0]; }
+    uint8_t left_y() const { return bytes[data + 1]; }
+    uint8_t right_x() const { return bytes[data + 2]; }
+    uint8_t right_y() const { return bytes[data + 3]; }
+    uint8_t l2() const { return bytes[data + 4]; }
+    uint8_t r2() const { return bytes[data + 5]; }
+    uint8_t counter() const { return bytes[data + 6]; }    // +1 per report sent
+
+    // [7] d-pad hat (low nibble) + face buttons, [8] shoulders/sticks/create/options, [9] PS/touchpad/mute
+    uint8_t buttons(uint8_t index) const { return bytes[data + 7 + index]; }
+    uint8_t dpad() const { return bytes[data + 7] & 0x0F; }
+
+    int16_t gyro(uint8_t axis) const { return read_i16(data + 15 + axis * 2); }
+    int16_t accel(uint8_t axis) const { return read_i16(data + 21 + axis * 2); }
+    uint32_t sensor_timestamp() const { return read_u32(data + 27); }
+
+    // touch point 0 or 1: [id | inactive bit 7][x low][x high | y low][y high]
+    ds_touch_point touch(uint8_t index) const {
+        const uint8_t* t = &bytes[data + 32 + index * 4];
+        return {!(t[0] & 0x80), static_cast<uint8_t>(t[0] & 0x7F), static_cast<uint16_t>(t[1] | ((t[2] & 0x0F) << 8)),
+                static_cast<uint16_t>((t[2] >> 4) | (t[3] << 4))};
+    }
+
+    uint8_t battery() const { return bytes[data + 52]; }
+    uint32_t crc() const { return read_u32(size - 4); }
+
+private:
+    int16_t read_i16(size_t at) const { return static_cast<int16_t>(bytes[at] | (bytes[at + 1] << 8)); }
+    uint32_t read_u32(size_t at) const {
+        return bytes[at] | (bytes[at + 1] << 8) | (bytes[at + 2] << 16) | (static_cast<uint32_t>(bytes[at + 3]) << 24);
+    }
+};
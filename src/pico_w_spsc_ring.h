@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Bounded single-producer / single-consumer ring. Head is written only by the consumer and tail only by the
+// producer, so plain atomic loads/stores are enough (lock-free on the M0+ and across the two RP2040 cores).
+// Capacity must be a power of two.
+template<typename T, uint32_t Capacity>
+struct spsc_ring {
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "spsc_ring capacity must be a power of two");
+
+    // --- producer ---
+    bool push(const T& item) {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // --- consumer ---
+    // Oldest item, or nullptr when empty. Valid until pop().
+    const T* front() const {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &items[h & (Capacity - 1)];
+    }
+
+    void pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint32_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    T items[Capacity] = {};
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+};
@@ -0,0 +1,187 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "GCore/Interfaces/ISonyGamepad.h"
+
+// Adaptive trigger effects as constexpr data.
+// Each DualSense trigger mode has a builder struct holding its parameters; pack() checks the ranges and produces
+// the 10-byte block (mode + parameters) that SetCustomTrigger expects. Declared constexpr at namespace scope, an
+// effect is packed by the compiler and lands in flash as a plain std::array. A parameter out of range in a
+// constant expression reaches trigger_effect_invalid(), which is not constexpr, so the build fails; evaluated at
+// run time the same builder returns TRIGGER_EFFECT_OFF instead.
+// Zones are the 10 positions of the trigger travel, 0 (released) to 9 (fully pressed); strengths are 1..8.
+
+#define TRIGGER_EFFECT_SIZE 10
+#define TRIGGER_ZONES 10
+
+enum trigger_mode : uint8_t {
+    TRIGGER_MODE_OFF        = 0x05,
+    TRIGGER_MODE_FEEDBACK   = 0x21,
+    TRIGGER_MODE_BOW        = 0x22,
+    TRIGGER_MODE_GALLOP     = 0x23,
+    TRIGGER_MODE_WEAPON     = 0x25,
+    TRIGGER_MODE_VIBRATION  = 0x26,
+    TRIGGER_MODE_MACHINE    = 0x27,
+};
+
+using trigger_effect = std::array<uint8_t, TRIGGER_EFFECT_SIZE>;
+
+inline constexpr trigger_effect TRIGGER_EFFECT_OFF = {TRIGGER_MODE_OFF};
+
+inline trigger_effect trigger_effect_invalid() { return TRIGGER_EFFECT_OFF; }
+
+constexpr bool trigger_strength_ok(uint8_t strength) { return strength >= 1 && strength <= 8; }
+
+constexpr void trigger_put16(trigger_effect& effect, uint8_t at, uint32_t value) {
+    effect[at] = static_cast<uint8_t>(value);
+    effect[at + 1] = static_cast<uint8_t>(value >> 8);
+}
+
+constexpr void trigger_put32(trigger_effect& effect, uint8_t at, uint32_t value) {
+    trigger_put16(effect, at, value);
+    trigger_put16(effect, at + 2, value >> 16);
+}
+
+constexpr uint32_t trigger_zone_pair(uint8_t start, uint8_t end) { return (1u << start) | (1u << end); }
+
+// Resistance of `strength` from zone `start` to the end of the travel
+struct trigger_feedback {
+    uint8_t start;
+    uint8_t strength;
+
+    constexpr trigger_effect pack() const {
+        if (start >= TRIGGER_ZONES || !trigger_strength_ok(strength)) return trigger_effect_invalid();
+        uint32_t zones = 0;
+        uint32_t forces = 0;
+        for (uint8_t zone = start; zone < TRIGGER_ZONES; zone++) {
+            zones |= 1u << zone;
+            forces |= static_cast<uint32_t>(strength - 1) << (3 * zone);
+        }
+        trigger_effect effect{TRIGGER_MODE_FEEDBACK};
+        trigger_put16(effect, 1, zones);
+        trigger_put32(effect, 3, forces);
+        return effect;
+    }
+};
+
+// Tension that builds from start to end, then snaps back with snap_force
+struct trigger_bow {
+    uint8_t start;
+    uint8_t end;
+    uint8_t strength;
+    uint8_t snap_force;
+
+    constexpr trigger_effect pack() const {
+        if (start >= end || end > 8 || !trigger_strength_ok(strength) || !trigger_strength_ok(snap_force)) {
+            return trigger_effect_invalid();
+        }
+        trigger_effect effect{TRIGGER_MODE_BOW};
+        trigger_put16(effect, 1, trigger_zone_pair(start, end));
+        trigger_put16(effect, 3, (strength - 1) | ((snap_force - 1) << 3));
+        return effect;
+    }
+};
+
+// Two-beat pulse between start and end; the feet are positions 0..7 in the cycle, frequency in Hz
+struct trigger_gallop {
+    uint8_t start;
+    uint8_t end;
+    uint8_t first_foot;
+    uint8_t second_foot;
+    uint8_t frequency;
+
+    constexpr trigger_effect pack() const {
+        if (start >= end || end > 9 || first_foot >= second_foot || second_foot > 7 || frequency == 0) {
+            return trigger_effect_invalid();
+        }
+        trigger_effect effect{TRIGGER_MODE_GALLOP};
+        trigger_put16(effect, 1, trigger_zone_pair(start, end));
+        effect[3] = static_cast<uint8_t>(second_foot | (first_foot << 3));
+        effect[4] = frequency;
+        return effect;
+    }
+};
+
+// Resistance between start and end that gives way past end, like a trigger break
+struct trigger_weapon {
+    uint8_t start;
+    uint8_t end;
+    uint8_t strength;
+
+    constexpr trigger_effect pack() const {
+        if (start < 2 || start > 7 || end <= start || end > 8 || !trigger_strength_ok(strength)) {
+            return trigger_effect_invalid();
+        }
+        trigger_effect effect{TRIGGER_MODE_WEAPON};
+        trigger_put16(effect, 1, trigger_zone_pair(start, end));
+        effect[3] = static_cast<uint8_t>(strength - 1);
+        return effect;
+    }
+};
+
+// Vibration of amplitude 1..8 from zone start to the end of the travel, frequency in Hz
+struct trigger_vibration {
+    uint8_t start;
+    uint8_t amplitude;
+    uint8_t frequency;
+
+    constexpr trigger_effect pack() const {
+        if (start >= TRIGGER_ZONES || !trigger_strength_ok(amplitude) || frequency == 0) {
+            return trigger_effect_invalid();
+        }
+        uint32_t zones = 0;
+        uint32_t amplitudes = 0;
+        for (uint8_t zone = start; zone < TRIGGER_ZONES; zone++) {
+            zones |= 1u << zone;
+            amplitudes |= static_cast<uint32_t>(amplitude - 1) << (3 * zone);
+        }
+        trigger_effect effect{TRIGGER_MODE_VIBRATION};
+        trigger_put16(effect, 1, zones);
+        trigger_put32(effect, 3, amplitudes);
+        effect[9] = frequency;
+        return effect;
+    }
+};
+
+// Alternates between strength_a and strength_b between start and end; period in tenths of a second
+struct trigger_machine {
+    uint8_t start;
+    uint8_t end;
+    uint8_t strength_a;
+    uint8_t strength_b;
+    uint8_t frequency;
+    uint8_t period;
+
+    constexpr trigger_effect pack() const {
+        if (start >= end || end > 9 || !trigger_strength_ok(strength_a) || !trigger_strength_ok(strength_b) ||
+            frequency == 0) {
+            return trigger_effect_invalid();
+        }
+        trigger_effect effect{TRIGGER_MODE_MACHINE};
+        trigger_put16(effect, 1, trigger_zone_pair(start, end));
+        effect[3] = static_cast<uint8_t>((strength_a - 1) | ((strength_b - 1) << 3));
+        effect[4] = frequency;
+        effect[5] = period;
+        return effect;
+    }
+};
+
+// Packed by the compiler, whatever the argument: trigger_effect_v<trigger_weapon{3, 8, 8}>
+template<auto Builder>
+inline constexpr trigger_effect trigger_effect_v = Builder.pack();
+
+// SetCustomTrigger takes a std::vector; this one is sized once by trigger_effects_init() and overwritten in place,
+// so applying an effect is a fixed 10-byte copy with no allocation. Application loop only.
+static std::vector<uint8_t> trigger_effect_scratch;
+
+// Startup, before the first trigger_apply(): the scratch buffer's one allocation.
+inline void trigger_effects_init() {
+    trigger_effect_scratch.assign(TRIGGER_EFFECT_SIZE, 0);
+}
+
+inline void trigger_apply(ISonyGamepad* gamepad, EDSGamepadHand hand, const trigger_effect& effect) {
+    std::copy(effect.begin(), effect.end(), trigger_effect_scratch.begin());
+    gamepad->GetIGamepadTrigger()->SetCustomTrigger(hand, trigger_effect_scratch);
+}
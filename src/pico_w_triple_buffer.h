@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Single-producer / single-consumer triple buffer.
+// The producer always has a free slot to write (never the published one, never the one being read), the
+// consumer always gets the newest complete slot. Only atomic loads and stores are used, so it stays
+// lock-free on the Cortex-M0+ (no LDREX/STREX) and never masks interrupts.
+template<typename T>
+struct spsc_triple_buffer {
+    static constexpr uint8_t none = 0xFF;
+
+    // Not thread-safe; call before producer and consumer start.
+    void reset() {
+        latest.store(none);
+        reading.store(none);
+        writing = 0;
+        published_count = 0;
+        acquired_sequence = 0;
+    }
+
+    // --- producer ---
+    T& write_slot() {
+        const uint8_t published = latest.load(std::memory_order_acquire);
+        const uint8_t in_use = reading.load(std::memory_order_seq_cst);
+        uint8_t slot = 0;
+        while (slot == published || slot == in_use) slot++;
+        writing = slot;
+        return slots[slot];
+    }
+
+    void publish() {
+        sequences[writing] = ++published_count;
+        latest.store(writing, std::memory_order_seq_cst);
+    }
+
+    // --- consumer ---
+    // Claims the newest published slot. Returns nullptr when nothing newer than the last call was published.
+    // The returned slot stays valid until the next acquire().
+    const T* acquire(uint32_t& sequence) {
+        uint8_t slot;
+        do {
+            slot = latest.load(std::memory_order_acquire);
+            if (slot == none) return nullptr;
+            reading.store(slot, std::memory_order_seq_cst);
+        } while (latest.load(std::memory_order_seq_cst) != slot);
+
+        sequence = sequences[slot];
+        if (sequence == acquired_sequence) return nullptr;
+        acquired_sequence = sequence;
+        return &slots[slot];
+    }
+
+    T slots[3] = {};
+    uint32_t sequences[3] = {};
+    std::atomic<uint8_t> latest{none};
+    std::atomic<uint8_t> reading{none};
+    uint8_t writing = 0;           // producer only
+    uint32_t published_count = 0;  // producer only
+    uint32_t acquired_sequence = 0; // consumer only
+};
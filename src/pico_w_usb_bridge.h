@@ -0,0 +1,200 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "btstack_config.h"
+#include "GCore/Interfaces/ISonyGamepad.h"
+#include "pico_w_latency.h"
+#include "pico_w_report_view.h"
+#include "pico_w_trigger_effects.h"
+#include "pico_w_usb_device.h"
+
+// USB HID bridge (build with -DDUALSENSE_USB_BRIDGE=ON).
+// Each controller slot shows up on the Pico's USB port as one HID gamepad interface the host polls every 1 ms.
+// This header is the translation layer and knows nothing of TinyUSB, so host/main.cpp can test and time it;
+// pico_w_usb_device.cpp holds the descriptors and callbacks that move its buffers. usb_bridge_stage_input() turns a
+// 0x31 frame into the input report below as soon as the application loop acquires it, before Gamepad-Core decodes
+// it: the fields are byte copies of the frame, no float on the way. A frame that comes in while the previous
+// report still waits for the endpoint replaces it, the host only wants the newest state. The host's output report
+// is copied by usb_bridge_stage_output() and applied with SetLightbar, SetVibration and trigger_apply() by
+// usb_bridge_apply_pending(). Both directions use the fixed buffers of usb_bridge_slots; application loop only.
+//
+// Input report: [0..5] LX LY RX RY L2 R2 (0..255), [6] d-pad hat in the low nibble (0 up, clockwise, 8 released),
+// [7..8] buttons 1..15 little-endian: square cross circle triangle L1 R1 L2 R2 create options L3 R3 PS touchpad
+// mute, [9] the DualSense report counter, so the host can tell a skipped frame from a repeated one.
+// Output report: [0] USB_BRIDGE_OUT_* flags, [1..3] lightbar RGB, [4..5] rumble left/right, [6..15] left and
+// [16..25] right trigger effect as the 10-byte block of pico_w_trigger_effects.h, mode byte first.
+
+#ifndef PICO_W_USB_BRIDGE
+#define PICO_W_USB_BRIDGE 0
+#endif
+
+static_assert(USB_BRIDGE_OUTPUT_SIZE == 6 + 2 * TRIGGER_EFFECT_SIZE, "output report: flags, RGB, rumble, triggers");
+
+#define USB_BRIDGE_OUT_LIGHTBAR      (1u << 0)
+#define USB_BRIDGE_OUT_RUMBLE        (1u << 1)
+#define USB_BRIDGE_OUT_LEFT_TRIGGER  (1u << 2)
+#define USB_BRIDGE_OUT_RIGHT_TRIGGER (1u << 3)
+
+struct usb_bridge_slot {
+    uint8_t input[USB_BRIDGE_INPUT_SIZE];   // newest report not yet handed to the endpoint
+    uint32_t input_origin_us;               // radio arrival of the frame it came from
+    bool input_pending;
+    uint32_t in_flight_origin_us;           // report the endpoint holds until the host polls it; 0 = none
+    bool live;                              // last report came from a connected controller
+    uint8_t output[USB_BRIDGE_OUTPUT_SIZE];
+    bool output_pending;
+    uint32_t forwarded;                     // input reports the host took
+    uint32_t replaced;                      // input reports overwritten before the endpoint was free
+    uint32_t outputs;                       // output reports applied
+    uint32_t rejected;                      // output reports of the wrong size, or for a slot with no controller
+};
+
+static usb_bridge_slot usb_bridge_slots[MAX_NR_GAMEPADS];
+
+inline void usb_bridge_translate_input(ds_input_view report, uint8_t* out) {
+    memcpy(out, &report.bytes[ds_input_view::data], 6);
+    out[6] = report.dpad();
+    const uint16_t buttons = static_cast<uint16_t>((report.buttons(0) >> 4) | (report.buttons(1) << 4) |
+                                                   ((report.buttons(2) & 0x07) << 12));
+    out[7] = static_cast<uint8_t>(buttons);
+    out[8] = static_cast<uint8_t>(buttons >> 8);
+    out[9] = report.counter();
+}
+
+// Sticks centred, nothing pressed: what the host sees of a slot whose controller went away.
+inline void usb_bridge_neutral_input(uint8_t* out) {
+    memset(out, 0, USB_BRIDGE_INPUT_SIZE);
+    memset(out, 0x80, 4);
+    out[6] = 8;
+}
+
+inline bool usb_bridge_trigger_mode_known(uint8_t mode) {
+    switch (mode) {
+        case TRIGGER_MODE_OFF:
+        case TRIGGER_MODE_FEEDBACK:
+        case TRIGGER_MODE_BOW:
+        case TRIGGER_MODE_GALLOP:
+        case TRIGGER_MODE_WEAPON:
+        case TRIGGER_MODE_VIBRATION:
+        case TRIGGER_MODE_MACHINE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The flagged fields of one output report onto gamepad, then one UpdateOutput; false when nothing was flagged.
+// A trigger block with an unknown mode byte turns that trigger's effect off.
+inline bool usb_bridge_apply_output(ISonyGamepad* gamepad, const uint8_t* report) {
+    const uint8_t flags = report[0];
+    if (flags & USB_BRIDGE_OUT_LIGHTBAR) gamepad->SetLightbar({report[1], report[2], report[3]});
+    if (flags & USB_BRIDGE_OUT_RUMBLE) gamepad->SetVibration(report[4], report[5]);
+    for (uint8_t i = 0; i < 2; i++) {
+        if (!(flags & (USB_BRIDGE_OUT_LEFT_TRIGGER << i))) continue;
+        const uint8_t* block = &report[6 + i * TRIGGER_EFFECT_SIZE];
+        trigger_effect effect = TRIGGER_EFFECT_OFF;
+        if (usb_bridge_trigger_mode_known(block[0])) memcpy(effect.data(), block, TRIGGER_EFFECT_SIZE);
+        trigger_apply(gamepad, i ? EDSGamepadHand::Right : EDSGamepadHand::Left, effect);
+    }
+    if (!(flags & (USB_BRIDGE_OUT_LIGHTBAR | USB_BRIDGE_OUT_RUMBLE | USB_BRIDGE_OUT_LEFT_TRIGGER |
+                   USB_BRIDGE_OUT_RIGHT_TRIGGER))) {
+        return false;
+    }
+    gamepad->UpdateOutput();
+    return true;
+}
+
+// A 0x31 frame of slot that arrived at origin_us; replaces a report the endpoint has not taken yet.
+inline void usb_bridge_stage_input(uint8_t slot, ds_input_view report, uint32_t origin_us) {
+    usb_bridge_slot& b = usb_bridge_slots[slot];
+    if (b.input_pending) b.replaced++;
+    usb_bridge_translate_input(report, b.input);
+    b.input_origin_us = origin_us ? origin_us : 1;
+    b.input_pending = true;
+    b.live = true;
+}
+
+// The controller of slot disconnected: one neutral report so no button stays held on the host.
+inline void usb_bridge_release(uint8_t slot) {
+    usb_bridge_slot& b = usb_bridge_slots[slot];
+    if (!b.live) return;
+    usb_bridge_neutral_input(b.input);
+    b.input_origin_us = 0;
+    b.input_pending = true;
+    b.live = false;
+}
+
+// The endpoint of slot is free: the report to hand it, or nullptr when none is pending.
+inline const uint8_t* usb_bridge_take_input(uint8_t slot) {
+    usb_bridge_slot& b = usb_bridge_slots[slot];
+    if (!b.input_pending) return nullptr;
+    b.input_pending = false;
+    b.in_flight_origin_us = b.input_origin_us;
+    return b.input;
+}
+
+// The host polled the report taken last: radio arrival to USB transfer complete is the latency the bridge adds.
+inline void usb_bridge_input_delivered(uint8_t slot) {
+    usb_bridge_slot& b = usb_bridge_slots[slot];
+    if (b.in_flight_origin_us) latency_usb_delivered(b.in_flight_origin_us);
+    b.in_flight_origin_us = 0;
+    b.forwarded++;
+}
+
+// An output report the host sent to the interface of slot; applied by the next usb_bridge_apply_pending().
+inline bool usb_bridge_stage_output(uint8_t slot, const uint8_t* report, uint16_t size) {
+    usb_bridge_slot& b = usb_bridge_slots[slot];
+    if (size != USB_BRIDGE_OUTPUT_SIZE) {
+        b.rejected++;
+        return false;
+    }
+    memcpy(b.output, report, USB_BRIDGE_OUTPUT_SIZE);
+    b.output_pending = true;
+    return true;
+}
+
+inline void usb_bridge_apply_pending(uint8_t slot, ISonyGamepad* gamepad) {
+    usb_bridge_slot& b = usb_bridge_slots[slot];
+    if (!b.output_pending) return;
+    b.output_pending = false;
+    if (!gamepad || !gamepad->IsConnected()) {
+        b.rejected++;
+        return;
+    }
+    if (usb_bridge_apply_output(gamepad, b.output)) b.outputs++;
+}
+
+inline void usb_bridge_print() {
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) {
+        const usb_bridge_slot& b = usb_bridge_slots[slot];
+        printf("[USB] Device %u: %u reports forwarded, %u replaced, %u outputs applied, %u rejected\n", slot,
+               (unsigned int)b.forwarded, (unsigned int)b.replaced, (unsigned int)b.outputs,
+               (unsigned int)b.rejected);
+    }
+}
+
+#if PICO_W_USB_BRIDGE
+// Hands slot's pending report to its IN endpoint if the endpoint is free; otherwise usb_device_input_delivered()
+// sends it the moment the host has polled the one before.
+inline void usb_bridge_send(uint8_t slot) {
+    if (!usb_device_ready(slot)) return;
+    const uint8_t* report = usb_bridge_take_input(slot);
+    if (report) usb_device_report(slot, report, USB_BRIDGE_INPUT_SIZE);
+}
+
+inline void usb_bridge_task() {
+    usb_device_task();
+    for (uint8_t slot = 0; slot < MAX_NR_GAMEPADS; slot++) usb_bridge_send(slot);
+}
+
+// Called back from pico_w_usb_device.cpp; main.cpp is the only translation unit including this header.
+void usb_device_output_received(uint8_t slot, const uint8_t* report, uint16_t size) {
+    usb_bridge_stage_output(slot, report, size);
+}
+
+void usb_device_input_delivered(uint8_t slot) {
+    usb_bridge_input_delivered(slot);
+    usb_bridge_send(slot);
+}
+#endif
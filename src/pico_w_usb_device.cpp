@@ -0,0 +1,211 @@
+// TinyUSB descriptors and callbacks of the USB HID bridge (DUALSENSE_USB_BRIDGE=ON); see pico_w_usb_device.h.
+#include <cstring>
+#include "tusb.h"
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+#include "btstack_config.h"
+#include "pico_w_usb_device.h"
+
+#ifndef USB_BRIDGE_VID
+#define USB_BRIDGE_VID 0xCAFE       // TinyUSB's example vendor id; set your own for anything but a bench
+#endif
+#ifndef USB_BRIDGE_PID
+#define USB_BRIDGE_PID 0x4031
+#endif
+
+static_assert(CFG_TUD_HID == MAX_NR_GAMEPADS && MAX_NR_GAMEPADS <= 4, "one HID interface per controller slot");
+static_assert(USB_BRIDGE_OUTPUT_SIZE <= CFG_TUD_HID_EP_BUFSIZE, "output report larger than the HID endpoint");
+
+enum {
+    USB_ITF_CDC = 0,
+    USB_ITF_CDC_DATA,
+    USB_ITF_HID,                    // slot i on USB_ITF_HID + i
+    USB_ITF_COUNT = USB_ITF_HID + CFG_TUD_HID
+};
+
+enum {
+    USB_STR_LANGID = 0,
+    USB_STR_MANUFACTURER,
+    USB_STR_PRODUCT,
+    USB_STR_SERIAL,
+    USB_STR_CDC,
+    USB_STR_HID,
+    USB_STR_COUNT
+};
+
+#define USB_EP_CDC_NOTIF 0x81
+#define USB_EP_CDC_OUT 0x02
+#define USB_EP_CDC_IN 0x82
+#define USB_EP_HID_OUT(slot) (0x03 + (slot))
+#define USB_EP_HID_IN(slot) (0x83 + (slot))
+
+// Byte layout of both reports in pico_w_usb_bridge.h.
+static const uint8_t usb_bridge_report_descriptor[] = {
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_GAMEPAD),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        // [0..5] sticks and triggers
+        HID_USAGE(HID_USAGE_DESKTOP_X), HID_USAGE(HID_USAGE_DESKTOP_Y),
+        HID_USAGE(HID_USAGE_DESKTOP_Z), HID_USAGE(HID_USAGE_DESKTOP_RZ),
+        HID_USAGE(HID_USAGE_DESKTOP_RX), HID_USAGE(HID_USAGE_DESKTOP_RY),
+        HID_LOGICAL_MIN(0), HID_LOGICAL_MAX_N(255, 2),
+        HID_REPORT_COUNT(6), HID_REPORT_SIZE(8),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+        // [6] hat 0..7 in 45 degree steps, 8 released, then 4 bits of padding
+        HID_USAGE(HID_USAGE_DESKTOP_HAT_SWITCH),
+        HID_LOGICAL_MIN(0), HID_LOGICAL_MAX(7),
+        HID_PHYSICAL_MIN(0), HID_PHYSICAL_MAX_N(315, 2),
+        HID_REPORT_COUNT(1), HID_REPORT_SIZE(4),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_NULL_STATE),
+        HID_INPUT(HID_CONSTANT),
+        // [7..8] 15 buttons and a padding bit
+        HID_USAGE_PAGE(HID_USAGE_PAGE_BUTTON),
+        HID_USAGE_MIN(1), HID_USAGE_MAX(15),
+        HID_LOGICAL_MIN(0), HID_LOGICAL_MAX(1),
+        HID_REPORT_COUNT(15), HID_REPORT_SIZE(1),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+        HID_REPORT_COUNT(1),
+        HID_INPUT(HID_CONSTANT),
+        // [9] report counter, then the output report
+        HID_USAGE_PAGE_N(HID_USAGE_PAGE_VENDOR, 2),
+        HID_USAGE(0x01),
+        HID_LOGICAL_MIN(0), HID_LOGICAL_MAX_N(255, 2),
+        HID_REPORT_COUNT(1), HID_REPORT_SIZE(8),
+        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+        HID_USAGE(0x02),
+        HID_REPORT_COUNT(USB_BRIDGE_OUTPUT_SIZE),
+        HID_OUTPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    HID_COLLECTION_END,
+};
+
+static const tusb_desc_device_t usb_bridge_device_descriptor = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    // interface association for the CDC pair
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USB_BRIDGE_VID,
+    .idProduct = USB_BRIDGE_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = USB_STR_MANUFACTURER,
+    .iProduct = USB_STR_PRODUCT,
+    .iSerialNumber = USB_STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+#define USB_BRIDGE_HID_DESCRIPTOR(slot)                                                                           \
+    TUD_HID_INOUT_DESCRIPTOR(USB_ITF_HID + (slot), USB_STR_HID, HID_ITF_PROTOCOL_NONE,                            \
+                             sizeof(usb_bridge_report_descriptor), USB_EP_HID_OUT(slot), USB_EP_HID_IN(slot),     \
+                             CFG_TUD_HID_EP_BUFSIZE, USB_BRIDGE_POLL_MS)
+
+#define USB_BRIDGE_CONFIG_SIZE (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + CFG_TUD_HID * TUD_HID_INOUT_DESC_LEN)
+
+static const uint8_t usb_bridge_configuration_descriptor[] = {
+    TUD_CONFIG_DESCRIPTOR(1, USB_ITF_COUNT, 0, USB_BRIDGE_CONFIG_SIZE, 0, 250),
+    TUD_CDC_DESCRIPTOR(USB_ITF_CDC, USB_STR_CDC, USB_EP_CDC_NOTIF, 8, USB_EP_CDC_OUT, USB_EP_CDC_IN, 64),
+    USB_BRIDGE_HID_DESCRIPTOR(0),
+#if CFG_TUD_HID > 1
+    USB_BRIDGE_HID_DESCRIPTOR(1),
+#endif
+#if CFG_TUD_HID > 2
+    USB_BRIDGE_HID_DESCRIPTOR(2),
+#endif
+#if CFG_TUD_HID > 3
+    USB_BRIDGE_HID_DESCRIPTOR(3),
+#endif
+};
+
+static_assert(sizeof(usb_bridge_configuration_descriptor) == USB_BRIDGE_CONFIG_SIZE, "configuration descriptor");
+
+void usb_device_init() {
+    tusb_init();
+}
+
+void usb_device_task() {
+    tud_task();
+}
+
+void usb_device_wait_ms(uint32_t ms) {
+    const uint64_t until_us = time_us_64() + ms * 1000ull;
+    while (time_us_64() < until_us) tud_task();
+}
+
+bool usb_device_ready(uint8_t slot) {
+    return tud_hid_n_ready(slot);
+}
+
+bool usb_device_report(uint8_t slot, const uint8_t* report, uint16_t size) {
+    return tud_hid_n_report(slot, 0, report, size);
+}
+
+extern "C" {
+
+uint8_t const* tud_descriptor_device_cb(void) {
+    return reinterpret_cast<const uint8_t*>(&usb_bridge_device_descriptor);
+}
+
+uint8_t const* tud_descriptor_configuration_cb(uint8_t index) {
+    (void)index;
+    return usb_bridge_configuration_descriptor;
+}
+
+uint8_t const* tud_hid_descriptor_report_cb(uint8_t instance) {
+    (void)instance;
+    return usb_bridge_report_descriptor;
+}
+
+uint16_t const* tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    (void)langid;
+    static uint16_t utf16[32];
+    static const char* const strings[USB_STR_COUNT] = {
+        nullptr, "Raspberry Pi", "Pico W DualSense bridge", nullptr, "Console", "DualSense",
+    };
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    size_t length;
+    if (index == USB_STR_LANGID) {
+        utf16[1] = 0x0409;
+        length = 1;
+    } else if (index < USB_STR_COUNT) {
+        const char* text = strings[index];
+        if (index == USB_STR_SERIAL) {
+            pico_get_unique_board_id_string(serial, sizeof(serial));
+            text = serial;
+        }
+        length = strlen(text);
+        if (length > sizeof(utf16) / sizeof(utf16[0]) - 1) length = sizeof(utf16) / sizeof(utf16[0]) - 1;
+        for (size_t i = 0; i < length; i++) utf16[1 + i] = static_cast<uint8_t>(text[i]);
+    } else {
+        return nullptr;
+    }
+    utf16[0] = static_cast<uint16_t>((TUSB_DESC_STRING << 8) | (2 * length + 2));
+    return utf16;
+}
+
+// No feature reports, and GET_REPORT(input) is answered by the next poll.
+uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer,
+                               uint16_t reqlen) {
+    (void)instance;
+    (void)report_id;
+    (void)report_type;
+    (void)buffer;
+    (void)reqlen;
+    return 0;
+}
+
+void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type,
+                           uint8_t const* buffer, uint16_t bufsize) {
+    (void)report_id;
+    if (instance >= MAX_NR_GAMEPADS || report_type == HID_REPORT_TYPE_FEATURE) return;
+    usb_device_output_received(instance, buffer, bufsize);
+}
+
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint16_t len) {
+    (void)report;
+    (void)len;
+    if (instance < MAX_NR_GAMEPADS) usb_device_input_delivered(instance);
+}
+
+}
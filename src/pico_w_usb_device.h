@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+// USB device side of the HID bridge, as seen from main.cpp.
+// The descriptors and TinyUSB callbacks live in pico_w_usb_device.cpp, the one translation unit besides main.cpp:
+// TinyUSB and BTstack both declare a hid_report_type_t, so tusb.h and the BTstack headers cannot meet in one file.
+// Linking tinyusb_device hands TinyUSB to the application: the configuration carries the CDC interface stdio uses
+// next to one HID interface per controller slot (IN and OUT interrupt endpoints, bInterval USB_BRIDGE_POLL_MS), and
+// nothing runs tud_task() in the background, usb_device_task() does once per pass of the application loop.
+// usb_device_report() copies the report into TinyUSB's endpoint buffer, so the caller's buffer is free on return.
+// Application loop only.
+
+#define USB_BRIDGE_POLL_MS 1
+#define USB_BRIDGE_INPUT_SIZE 10
+#define USB_BRIDGE_OUTPUT_SIZE 26
+
+// Before stdio_init_all(): stdio's CDC interface rides on this configuration.
+void usb_device_init();
+// Runs TinyUSB's callbacks, and with them the two below.
+void usb_device_task();
+// sleep_ms() that keeps the device enumerating.
+void usb_device_wait_ms(uint32_t ms);
+// The IN endpoint of slot is free.
+bool usb_device_ready(uint8_t slot);
+bool usb_device_report(uint8_t slot, const uint8_t* report, uint16_t size);
+
+// Defined by the application: an output report for slot from the OUT endpoint or SET_REPORT, and the host having
+// polled the input report of slot handed over last.
+void usb_device_output_received(uint8_t slot, const uint8_t* report, uint16_t size);
+void usb_device_input_delivered(uint8_t slot);
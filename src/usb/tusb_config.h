@@ -0,0 +1,32 @@
+// TinyUSB configuration for the USB HID bridge (DUALSENSE_USB_BRIDGE=ON): the CDC interface stdio prints to, and
+// one HID interface per controller slot. Only on the include path of bridge builds: without the bridge
+// pico_stdio_usb owns TinyUSB and uses its own configuration.
+#pragma once
+
+#include "btstack_config.h"
+
+#ifndef CFG_TUSB_RHPORT0_MODE
+#define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
+#endif
+
+#ifndef CFG_TUSB_MEM_SECTION
+#define CFG_TUSB_MEM_SECTION
+#endif
+
+#ifndef CFG_TUSB_MEM_ALIGN
+#define CFG_TUSB_MEM_ALIGN __attribute__((aligned(4)))
+#endif
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+#define CFG_TUD_CDC 1
+#define CFG_TUD_MSC 0
+#define CFG_TUD_HID MAX_NR_GAMEPADS
+#define CFG_TUD_MIDI 0
+#define CFG_TUD_VENDOR 0
+
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+
+// full-speed interrupt endpoints; both bridge reports fit
+#define CFG_TUD_HID_EP_BUFSIZE 32